@@ -16,6 +16,7 @@
 
 #include "network/network.h"
 #include "vfs.h"
+#include "cdrstats.h"
 //#include "debug.h"
 //#define printf
 #define hdprintf(x...)
@@ -756,6 +757,28 @@ static int response_sceenshot_process_request(struct http_state *http, const cha
     return 1;
 }
 
+/* ---------- cd read statistics */
+
+static char cdstats_buffer[4096];
+
+static int response_cdstats_process_request(struct http_state *http, const char *method, const char *url) {
+    if (strcmp(method, "GET"))
+        return 0;
+
+    if (!strcmp(url, "/CDSTATS/reset"))
+        CdrStatsReset(NULL);
+    else if (!strcmp(url, "/CDSTATS/dump"))
+        CdrStatsDump(CDRSTATS_FILE);
+    else if (strcmp(url, "/CDSTATS"))
+        return 0;
+
+    CdrStatsFormat(cdstats_buffer, sizeof (cdstats_buffer));
+
+    http->code = 200;
+    response_static_process_request(http, cdstats_buffer);
+    return 1;
+}
+
 /* ---------- err400 handler */
 
 static int response_err400_process_request(struct http_state *http, const char *method, const char *url) {
@@ -783,6 +806,7 @@ struct httpd_handler http_handler[] ={
     {response_ftp_process_request, 0, 0, 0, response_static_do_data, 0, response_static_finish},
     {response_sceenshot_process_request, 0, 0, 0, response_static_do_data, 0, response_static_finish},
     {response_fuses_process_request, 0, 0, 0, response_static_do_data, 0, response_static_finish},
+    {response_cdstats_process_request, 0, 0, 0, response_static_do_data, 0, response_static_finish},
     {response_vfs_process_request, 0, 0, response_vfs_do_header, response_vfs_do_data, 0, response_vfs_finish},
     {response_err400_process_request, 0, 0, 0, response_static_do_data, 0, response_static_finish},
     {response_err404_process_request, 0, 0, 0, response_static_do_data, 0, response_static_finish}
@@ -22,22 +22,26 @@
 #include "plugins.h"
 #include "cdrom.h"
 #include "cdriso.h"
+#include "cdrstats.h"
+#include "misc.h"
 
 #ifdef _WIN32
-#include <process.h>
 #include <windows.h>
 #elif defined(LIBXENON)
 #include <xenon_soc/xenon_power.h>
 #include <sys/time.h>
 #include <unistd.h>
 #else
-#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <unistd.h>
 #endif
 
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
 static FILE *cdHandle = NULL;
-static FILE *cddaHandle = NULL;
 static FILE *subHandle = NULL;
 
 static boolean subChanMixed = FALSE;
@@ -46,28 +50,16 @@ static boolean subChanRaw = FALSE;
 static unsigned char cdbuffer[CD_FRAMESIZE_RAW];
 static unsigned char subbuffer[SUB_FRAMESIZE];
 
-static unsigned char sndbuffer[CD_FRAMESIZE_RAW * 10];
-
-#define CDDA_FRAMETIME			(1000 * (sizeof(sndbuffer) / CD_FRAMESIZE_RAW) / 75)
-
+static unsigned int cdbufferSect = (unsigned int)-1; // sector in cdbuffer
 
 #define MODE1_DATA_SIZE			2048
 
 static boolean isMode1ISO = FALSE;
 
 
-#ifdef _WIN32
-static HANDLE threadid;
-#elif defined(LIBXENON)
-static unsigned int threadid = 3;
-static unsigned char thread_stack[0x10000];
-#else
-static pthread_t threadid;
-#endif
-static unsigned int initial_offset = 0;
-static volatile boolean playing = FALSE;
+static boolean playing = FALSE;
 static boolean cddaBigEndian = FALSE;
-static volatile unsigned int cddaCurOffset = 0;
+static unsigned int cddaCurOffset = 0;
 
 char* CALLBACK CDR__getDriveLetter(void);
 long CALLBACK CDR__configure(void);
@@ -89,6 +81,16 @@ struct trackinfo {
 static int numtracks = 0;
 static struct trackinfo ti[MAXTRACKS];
 
+// what the cue/ccd/mds/toc of an image says, the parsers don't touch the
+// open image so the file browser can use them from other threads
+typedef struct {
+	int numtracks;
+	struct trackinfo ti[MAXTRACKS];
+	boolean subChanMixed;
+	boolean subChanRaw;
+	boolean cddaBigEndian;
+} isotoc_t;
+
 // get a sector from a msf-array
 unsigned int msf2sec(char *msf) {
 	return ((msf[0] * 60 + msf[1]) * 75) + msf[2];
@@ -131,213 +133,49 @@ static void tok2msf(char *time, char *msf) {
 	}
 }
 
-static long GetTickCount(void) {
-	return mftb();
-}
-
-
 u16 *iso_play_cdbuf;
 u16 iso_play_bufptr;
 
-
-// this thread plays audio data
-#ifdef _WIN32
-static void playthread(void *param)
-#else
-static void *playthread(void *param)
-#endif
-{
-	long			d, t, i, s;
-	unsigned char	tmp;
-	int sec;
-
-	t = GetTickCount();
-
-	iso_play_cdbuf = 0;
-	iso_play_bufptr = 0;
-
-	while (playing) {
-		d = t - (long)GetTickCount();
-		if (d <= 0) {
-			d = 1;
-		}
-		else if (d > CDDA_FRAMETIME) {
-			d = CDDA_FRAMETIME;
-		}
-#ifdef _WIN32
-		Sleep(d);
-#else
-		usleep(d * 1000);
-#endif
-
-		t = GetTickCount() + CDDA_FRAMETIME;
-
-		if (subChanMixed) {
-			s = 0;
-
-			for (i = 0; i < sizeof(sndbuffer) / CD_FRAMESIZE_RAW; i++) {
-				// read one sector
-				d = fread(sndbuffer + CD_FRAMESIZE_RAW * i, 1, CD_FRAMESIZE_RAW, cddaHandle);
-				if (d < CD_FRAMESIZE_RAW) {
-					break;
-				}
-
-				s += d;
-
-				fread( subbuffer, 1, SUB_FRAMESIZE, cddaHandle );
-			}
-		}
-		else {
-			s = fread(sndbuffer, 1, sizeof(sndbuffer), cddaHandle);
-
-			sec = cddaCurOffset / CD_FRAMESIZE_RAW;
-
-			if (subHandle != NULL) {
-				fseek(subHandle, sec * SUB_FRAMESIZE, SEEK_SET);
-				fread(subbuffer, 1, SUB_FRAMESIZE, subHandle);
-			}
-		}
-
-		if (s == 0) {
-			playing = FALSE;
-			fclose(cddaHandle);
-			cddaHandle = NULL;
-			initial_offset = 0;
-			break;
-		}
-
-		if (!cdr.Muted && playing) {
-			if (cddaBigEndian) {
-				for (i = 0; i < s / 2; i++) {
-					tmp = sndbuffer[i * 2];
-					sndbuffer[i * 2] = sndbuffer[i * 2 + 1];
-					sndbuffer[i * 2 + 1] = tmp;
-				}
-			}
-
-			// wipe data track
-			if( subHandle || subChanMixed ) {
-				if( ti[ ((struct SubQ *) subbuffer)->TrackNumber ].type == DATA )
-					memset( sndbuffer, 0, s );
-			}
-
-			SPU_playCDDAchannel((short *)sndbuffer, s);
-		}
-
-
-		cddaCurOffset += s;
-
-	
-		// BIOS CD Player: Fast forward / reverse seek
-		if( cdr.FastForward ) {
-			// ~+0.25 sec
-			cddaCurOffset += CD_FRAMESIZE_RAW * 75 * 3;
-
-#if 0
-			// Bad idea: too much static
-			if( subChanInterleaved )
-				fseek( cddaHandle, s * (CD_FRAMESIZE_RAW + SUB_FRAMESIZE), SEEK_SET );
-			else
-				fseek( cddaHandle, s * CD_FRAMESIZE_RAW, SEEK_SET );
-#endif
+/*
+CDDA: cdrPlayInterrupt pulls one sector each emulated sector time through
+ISOreadCDDA, so the audio reaches the spu at the rate the emu plays it and
+no thread has to keep time. The sectors take the same way as data (preload,
+read-ahead ring), which keeps the disk off the emu thread while a track
+streams.
+*/
+
+// 16 bit samples of a big endian image -> little endian, in place
+static void SwapCDDA(unsigned char *buf, int bytes) {
+	unsigned char tmp;
+
+#ifdef __ALTIVEC__
+	if (!((unsigned long)buf & 1)) {
+		const vector unsigned char swap = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+
+		// up to an aligned buf
+		for (; bytes >= 2 && ((unsigned long)buf & 15); bytes -= 2, buf += 2) {
+			tmp = buf[0];
+			buf[0] = buf[1];
+			buf[1] = tmp;
 		}
-		else if( cdr.FastBackward ) {
-			// ~-0.25 sec
-			cddaCurOffset -= CD_FRAMESIZE_RAW * 75 * 3;
-			if( cddaCurOffset & 0x80000000 ) {
-				cddaCurOffset = 0;
-				cdr.FastBackward = 0;
-
-				playing = 0;
-				fclose(cddaHandle);
-				cddaHandle = NULL;
-				initial_offset = 0;
-				break;
-			}
 
-#if 0
-			// Bad idea: too much static
-			if( subChanInterleaved )
-				fseek( cddaHandle, s * (CD_FRAMESIZE_RAW + SUB_FRAMESIZE), SEEK_SET );
-			else
-				fseek( cddaHandle, s * CD_FRAMESIZE_RAW, SEEK_SET );
-#endif
+		for (; bytes >= 16; bytes -= 16, buf += 16) {
+			vector unsigned char v = vec_ld(0, buf);
+			vec_st(vec_perm(v, v, swap), 0, buf);
 		}
-
-	
-		// Vib Ribbon: decoded buffer IRQ
-		iso_play_cdbuf = (u16 *)sndbuffer;
-		iso_play_bufptr = 0;
 	}
-
-#ifdef _WIN32
-	_endthread();
-#else
-#ifndef XENON
-	pthread_exit(0);
-#endif
-	return NULL;
-#endif
-}
-
-// stop the CDDA playback
-static void stopCDDA() {
-	if (!playing) {
-		return;
-	}
-
-	playing = FALSE;
-#ifdef _WIN32
-	WaitForSingleObject(threadid, INFINITE);
-#else
-#ifdef LIBXENON
-	while(xenon_is_thread_task_running(threadid));
-#else
-	pthread_join(threadid, NULL);
-#endif
 #endif
 
-	if (cddaHandle != NULL) {
-		fclose(cddaHandle);
-		cddaHandle = NULL;
+	for (; bytes >= 2; bytes -= 2, buf += 2) {
+		tmp = buf[0];
+		buf[0] = buf[1];
+		buf[1] = tmp;
 	}
-
-	initial_offset = 0;
-}
-
-// start the CDDA playback
-static void startCDDA(unsigned int offset) {
-	if (playing) {
-		if (initial_offset == offset) {
-			return;
-		}
-		stopCDDA();
-	}
-
-	cddaHandle = fopen(GetIsoFile(), "rb");
-	if (cddaHandle == NULL) {
-		return;
-	}
-
-	initial_offset = offset;
-	cddaCurOffset = initial_offset;
-	fseek(cddaHandle, initial_offset, SEEK_SET);
-
-	playing = TRUE;
-
-#ifdef _WIN32
-	threadid = (HANDLE)_beginthread(playthread, 0, NULL);
-#ifdef LIBXENON
-	xenon_run_thread_task(threadid,thread_stack,playthread);
-#else
-	pthread_create(&threadid, NULL, playthread, NULL);
-#endif
-#endif
 }
 
 // this function tries to get the .toc file of the given .bin
 // the necessary data is put into the ti (trackinformation)-array
-static int parsetoc(const char *isofile) {
+static int parsetoc(const char *isofile, isotoc_t *toc) {
 	char			tocname[MAXPATHLEN];
 	FILE			*fi;
 	char			linebuf[256], dummy[256], name[256];
@@ -345,7 +183,7 @@ static int parsetoc(const char *isofile) {
 	char			time[20], time2[20];
 	unsigned int	t;
 
-	numtracks = 0;
+	toc->numtracks = 0;
 
 	// copy name of the iso and change extension from .bin to .toc
 	strncpy(tocname, isofile, sizeof(tocname));
@@ -376,8 +214,8 @@ static int parsetoc(const char *isofile) {
 		}
 	}
 
-	memset(&ti, 0, sizeof(ti));
-	cddaBigEndian = TRUE; // cdrdao uses big-endian for CD Audio
+	memset(toc->ti, 0, sizeof(toc->ti));
+	toc->cddaBigEndian = TRUE; // cdrdao uses big-endian for CD Audio
 
 	// parse the .toc file
 	while (fgets(linebuf, sizeof(linebuf), fi) != NULL) {
@@ -390,43 +228,44 @@ static int parsetoc(const char *isofile) {
 		if (!strcmp(token, "TRACK")) {
 			// get type of track
 			token = strtok(NULL, " ");
-			numtracks++;
+			if (token == NULL || toc->numtracks == MAXTRACKS - 1) break;
+			toc->numtracks++;
 
 			if (!strncmp(token, "MODE2_RAW", 9)) {
-				ti[numtracks].type = DATA;
-				sec2msf(2 * 75, ti[numtracks].start); // assume data track on 0:2:0
+				toc->ti[toc->numtracks].type = DATA;
+				sec2msf(2 * 75, toc->ti[toc->numtracks].start); // assume data track on 0:2:0
 
 				// check if this image contains mixed subchannel data
 				token = strtok(NULL, " ");
 				if (token != NULL && !strncmp(token, "RW_RAW", 6)) {
-					subChanMixed = TRUE;
-					subChanRaw = TRUE;
+					toc->subChanMixed = TRUE;
+					toc->subChanRaw = TRUE;
 				}
 			}
 			else if (!strncmp(token, "AUDIO", 5)) {
-				ti[numtracks].type = CDDA;
+				toc->ti[toc->numtracks].type = CDDA;
 			}
 		}
 		else if (!strcmp(token, "DATAFILE")) {
-			if (ti[numtracks].type == CDDA) {
+			if (toc->ti[toc->numtracks].type == CDDA) {
 				sscanf(linebuf, "DATAFILE \"%[^\"]\" #%d %8s", name, &t, time2);
-				t /= CD_FRAMESIZE_RAW + (subChanMixed ? SUB_FRAMESIZE : 0);
+				t /= CD_FRAMESIZE_RAW + (toc->subChanMixed ? SUB_FRAMESIZE : 0);
 				t += 2 * 75;
-				sec2msf(t, (char *)&ti[numtracks].start);
-				tok2msf((char *)&time2, (char *)&ti[numtracks].length);
+				sec2msf(t, (char *)&toc->ti[toc->numtracks].start);
+				tok2msf((char *)&time2, (char *)&toc->ti[toc->numtracks].length);
 			}
 			else {
 				sscanf(linebuf, "DATAFILE \"%[^\"]\" %8s", name, time);
-				tok2msf((char *)&time, (char *)&ti[numtracks].length);
+				tok2msf((char *)&time, (char *)&toc->ti[toc->numtracks].length);
 			}
 		}
 		else if (!strcmp(token, "FILE")) {
 			sscanf(linebuf, "FILE \"%[^\"]\" #%d %8s %8s", name, &t, time, time2);
-			tok2msf((char *)&time, (char *)&ti[numtracks].start);
-			t /= CD_FRAMESIZE_RAW + (subChanMixed ? SUB_FRAMESIZE : 0);
-			t += msf2sec(ti[numtracks].start) + 2 * 75;
-			sec2msf(t, (char *)&ti[numtracks].start);
-			tok2msf((char *)&time2, (char *)&ti[numtracks].length);
+			tok2msf((char *)&time, (char *)&toc->ti[toc->numtracks].start);
+			t /= CD_FRAMESIZE_RAW + (toc->subChanMixed ? SUB_FRAMESIZE : 0);
+			t += msf2sec(toc->ti[toc->numtracks].start) + 2 * 75;
+			sec2msf(t, (char *)&toc->ti[toc->numtracks].start);
+			tok2msf((char *)&time2, (char *)&toc->ti[toc->numtracks].length);
 		}
 	}
 
@@ -437,7 +276,7 @@ static int parsetoc(const char *isofile) {
 
 // this function tries to get the .cue file of the given .bin
 // the necessary data is put into the ti (trackinformation)-array
-static int parsecue(const char *isofile) {
+static int parsecue(const char *isofile, FILE *image, isotoc_t *toc) {
 	char			cuename[MAXPATHLEN];
 	FILE			*fi;
 	char			*token;
@@ -446,7 +285,7 @@ static int parsecue(const char *isofile) {
 	char			linebuf[256], dummy[256];
 	unsigned int	t;
 
-	numtracks = 0;
+	toc->numtracks = 0;
 
 	// copy name of the iso and change extension from .bin to .cue
 	strncpy(cuename, isofile, sizeof(cuename));
@@ -470,12 +309,12 @@ static int parsecue(const char *isofile) {
 			// Don't proceed further, as this is actually a .toc file rather
 			// than a .cue file.
 			fclose(fi);
-			return parsetoc(isofile);
+			return parsetoc(isofile, toc);
 		}
 		fseek(fi, 0, SEEK_SET);
 	}
 
-	memset(&ti, 0, sizeof(ti));
+	memset(toc->ti, 0, sizeof(toc->ti));
 
 	while (fgets(linebuf, sizeof(linebuf), fi) != NULL) {
 		strncpy(dummy, linebuf, sizeof(linebuf));
@@ -486,13 +325,14 @@ static int parsecue(const char *isofile) {
 		}
 
 		if (!strcmp(token, "TRACK")){
-			numtracks++;
+			if (toc->numtracks == MAXTRACKS - 1) break;
+			toc->numtracks++;
 
 			if (strstr(linebuf, "AUDIO") != NULL) {
-				ti[numtracks].type = CDDA;
+				toc->ti[toc->numtracks].type = CDDA;
 			}
 			else if (strstr(linebuf, "MODE1/2352") != NULL || strstr(linebuf, "MODE2/2352") != NULL) {
-				ti[numtracks].type = DATA;
+				toc->ti[toc->numtracks].type = DATA;
 			}
 		}
 		else if (!strcmp(token, "INDEX")) {
@@ -503,15 +343,15 @@ static int parsecue(const char *isofile) {
 				if (*tmp != '\n') sscanf(tmp, "%8s", time);
 			}
 
-			tok2msf((char *)&time, (char *)&ti[numtracks].start);
+			tok2msf((char *)&time, (char *)&toc->ti[toc->numtracks].start);
 
-			t = msf2sec(ti[numtracks].start) + 2 * 75;
-			sec2msf(t, ti[numtracks].start);
+			t = msf2sec(toc->ti[toc->numtracks].start) + 2 * 75;
+			sec2msf(t, toc->ti[toc->numtracks].start);
 
 			// If we've already seen another track, this is its end
-			if (numtracks > 1) {
-				t = msf2sec(ti[numtracks].start) - msf2sec(ti[numtracks - 1].start);
-				sec2msf(t, ti[numtracks - 1].length);
+			if (toc->numtracks > 1) {
+				t = msf2sec(toc->ti[toc->numtracks].start) - msf2sec(toc->ti[toc->numtracks - 1].start);
+				sec2msf(t, toc->ti[toc->numtracks - 1].length);
 			}
 		}
 	}
@@ -519,10 +359,10 @@ static int parsecue(const char *isofile) {
 	fclose(fi);
 
 	// Fill out the last track's end based on size
-	if (numtracks >= 1) {
-		fseek(cdHandle, 0, SEEK_END);
-		t = ftell(cdHandle) / 2352 - msf2sec(ti[numtracks].start) + 2 * 75;
-		sec2msf(t, ti[numtracks].length);
+	if (toc->numtracks >= 1) {
+		fseek(image, 0, SEEK_END);
+		t = ftell(image) / 2352 - msf2sec(toc->ti[toc->numtracks].start) + 2 * 75;
+		sec2msf(t, toc->ti[toc->numtracks].length);
 	}
 
 	return 0;
@@ -530,13 +370,13 @@ static int parsecue(const char *isofile) {
 
 // this function tries to get the .ccd file of the given .img
 // the necessary data is put into the ti (trackinformation)-array
-static int parseccd(const char *isofile) {
+static int parseccd(const char *isofile, FILE *image, isotoc_t *toc) {
 	char			ccdname[MAXPATHLEN];
 	FILE			*fi;
 	char			linebuf[256];
 	unsigned int	t;
 
-	numtracks = 0;
+	toc->numtracks = 0;
 
 	// copy name of the iso and change extension from .img to .ccd
 	strncpy(ccdname, isofile, sizeof(ccdname));
@@ -552,24 +392,25 @@ static int parseccd(const char *isofile) {
 		return -1;
 	}
 
-	memset(&ti, 0, sizeof(ti));
+	memset(toc->ti, 0, sizeof(toc->ti));
 
 	while (fgets(linebuf, sizeof(linebuf), fi) != NULL) {
 		if (!strncmp(linebuf, "[TRACK", 6)){
-			numtracks++;
+			if (toc->numtracks == MAXTRACKS - 1) break;
+			toc->numtracks++;
 		}
 		else if (!strncmp(linebuf, "MODE=", 5)) {
 			sscanf(linebuf, "MODE=%d", &t);
-			ti[numtracks].type = ((t == 0) ? CDDA : DATA);
+			toc->ti[toc->numtracks].type = ((t == 0) ? CDDA : DATA);
 		}
 		else if (!strncmp(linebuf, "INDEX 1=", 8)) {
 			sscanf(linebuf, "INDEX 1=%d", &t);
-			sec2msf(t + 2 * 75, ti[numtracks].start);
+			sec2msf(t + 2 * 75, toc->ti[toc->numtracks].start);
 
 			// If we've already seen another track, this is its end
-			if (numtracks > 1) {
-				t = msf2sec(ti[numtracks].start) - msf2sec(ti[numtracks - 1].start);
-				sec2msf(t, ti[numtracks - 1].length);
+			if (toc->numtracks > 1) {
+				t = msf2sec(toc->ti[toc->numtracks].start) - msf2sec(toc->ti[toc->numtracks - 1].start);
+				sec2msf(t, toc->ti[toc->numtracks - 1].length);
 			}
 		}
 	}
@@ -577,10 +418,10 @@ static int parseccd(const char *isofile) {
 	fclose(fi);
 
 	// Fill out the last track's end based on size
-	if (numtracks >= 1) {
-		fseek(cdHandle, 0, SEEK_END);
-		t = ftell(cdHandle) / 2352 - msf2sec(ti[numtracks].start) + 2 * 75;
-		sec2msf(t, ti[numtracks].length);
+	if (toc->numtracks >= 1) {
+		fseek(image, 0, SEEK_END);
+		t = ftell(image) / 2352 - msf2sec(toc->ti[toc->numtracks].start) + 2 * 75;
+		sec2msf(t, toc->ti[toc->numtracks].length);
 	}
 
 	return 0;
@@ -588,13 +429,13 @@ static int parseccd(const char *isofile) {
 
 // this function tries to get the .mds file of the given .mdf
 // the necessary data is put into the ti (trackinformation)-array
-static int parsemds(const char *isofile) {
+static int parsemds(const char *isofile, isotoc_t *toc) {
 	char			mdsname[MAXPATHLEN];
 	FILE			*fi;
 	unsigned int	offset, extra_offset, l, i;
 	unsigned short	s;
 
-	numtracks = 0;
+	toc->numtracks = 0;
 
 	// copy name of the iso and change extension from .mdf to .mds
 	strncpy(mdsname, isofile, sizeof(mdsname));
@@ -610,7 +451,7 @@ static int parsemds(const char *isofile) {
 		return -1;
 	}
 
-	memset(&ti, 0, sizeof(ti));
+	memset(toc->ti, 0, sizeof(toc->ti));
 
 	// check if it's a valid mds file
 	fread(&i, 1, sizeof(unsigned int), fi);
@@ -631,7 +472,7 @@ static int parsemds(const char *isofile) {
 	fseek(fi, offset, SEEK_SET);
 	fread(&s, 1, sizeof(unsigned short), fi);
 	s = SWAP16(s);
-	numtracks = s;
+	toc->numtracks = (s < MAXTRACKS ? s : MAXTRACKS - 1);
 
 	// get offset to track blocks
 	fseek(fi, 4, SEEK_CUR);
@@ -649,24 +490,24 @@ static int parsemds(const char *isofile) {
 
 	// check if the image contains mixed subchannel data
 	fseek(fi, offset + 1, SEEK_SET);
-	subChanMixed = (fgetc(fi) ? TRUE : FALSE);
+	toc->subChanMixed = (fgetc(fi) ? TRUE : FALSE);
 
 	// read track data
-	for (i = 1; i <= numtracks; i++) {
+	for (i = 1; i <= toc->numtracks; i++) {
 		fseek(fi, offset, SEEK_SET);
 
 		// get the track type
-		ti[i].type = ((fgetc(fi) == 0xA9) ? CDDA : DATA);
+		toc->ti[i].type = ((fgetc(fi) == 0xA9) ? CDDA : DATA);
 		fseek(fi, 8, SEEK_CUR);
 
 		// get the track starting point
-		ti[i].start[0] = fgetc(fi);
-		ti[i].start[1] = fgetc(fi);
-		ti[i].start[2] = fgetc(fi);
+		toc->ti[i].start[0] = fgetc(fi);
+		toc->ti[i].start[1] = fgetc(fi);
+		toc->ti[i].start[2] = fgetc(fi);
 
 		if (i > 1) {
-			l = msf2sec(ti[i].start);
-			sec2msf(l - 2 * 75, ti[i].start); // ???
+			l = msf2sec(toc->ti[i].start);
+			sec2msf(l - 2 * 75, toc->ti[i].start); // ???
 		}
 
 		// get the track length
@@ -676,7 +517,7 @@ static int parsemds(const char *isofile) {
 		fseek(fi, extra_offset + 4, SEEK_SET);
 		fread(&l, 1, sizeof(unsigned int), fi);
 		l = SWAP32(l);
-		sec2msf(l, ti[i].length);
+		sec2msf(l, toc->ti[i].length);
 
 		offset += 0x50;
 	}
@@ -685,8 +526,46 @@ static int parsemds(const char *isofile) {
 	return 0;
 }
 
+// toc of isofile from whichever of its cue/ccd/mds/toc is there,
+// returns the tag to print (NULL: none found)
+static const char *readtoc(const char *isofile, FILE *image, isotoc_t *toc) {
+	memset(toc, 0, sizeof(*toc));
+
+	if (parseccd(isofile, image, toc) == 0) {
+		return "[+ccd]";
+	}
+	else if (parsemds(isofile, toc) == 0) {
+		return "[+mds]";
+	}
+	else if (parsecue(isofile, image, toc) == 0) {
+		return "[+cue]";
+	}
+	else if (parsetoc(isofile, toc) == 0) {
+		return "[+toc]";
+	}
+
+	toc->numtracks = 0;
+	return NULL;
+}
+
+//guess whether it is mode1/2048
+static boolean ismode1iso(FILE *image) {
+	u32 modeTest = 0;
+	boolean mode1 = FALSE;
+
+	fseek(image, 0, SEEK_END);
+	if(ftell(image) % 2048 == 0) {
+		fseek(image, 0, SEEK_SET);
+		fread(&modeTest, 4, 1, image);
+		if(SWAP32(modeTest)!=0xffffff00) mode1 = TRUE;
+	}
+	fseek(image, 0, SEEK_SET);
+
+	return mode1;
+}
+
 // this function tries to get the .sub file of the given .img
-static int opensubfile(const char *isoname) {
+static FILE *opensubfile(const char *isoname) {
 	char		subname[MAXPATHLEN];
 
 	// copy name of the iso and change extension from .img to .sub
@@ -696,17 +575,658 @@ static int opensubfile(const char *isoname) {
 		strcpy(subname + strlen(subname) - 4, ".sub");
 	}
 	else {
+		return NULL;
+	}
+
+	return fopen(subname, "rb");
+}
+
+// read one sector (and its subchannel data) from the image
+static int readSector(FILE *f, FILE *sf, unsigned int sect, unsigned char *buf, unsigned char *sub) {
+	if (subChanMixed) {
+		fseek(f, sect * (CD_FRAMESIZE_RAW + SUB_FRAMESIZE), SEEK_SET);
+		if (fread(buf, 1, CD_FRAMESIZE_RAW, f) != CD_FRAMESIZE_RAW) return -1;
+		fread(sub, 1, SUB_FRAMESIZE, f);
+		return 0;
+	}
+
+	if (isMode1ISO) {
+		fseek(f, sect * MODE1_DATA_SIZE, SEEK_SET);
+		if (fread(buf + 12, 1, MODE1_DATA_SIZE, f) != MODE1_DATA_SIZE) return -1;
+	} else {
+		fseek(f, sect * CD_FRAMESIZE_RAW, SEEK_SET);
+		if (fread(buf, 1, CD_FRAMESIZE_RAW, f) != CD_FRAMESIZE_RAW) return -1;
+	}
+
+	if (sf != NULL) {
+		fseek(sf, sect * SUB_FRAMESIZE, SEEK_SET);
+		fread(sub, 1, SUB_FRAMESIZE, sf);
+	}
+
+	return 0;
+}
+
+#ifdef LIBXENON
+#define lwsync() __asm__ __volatile__("lwsync" : : : "memory")
+#else
+#define lwsync()
+#endif
+
+/*
+Subchannel Q index: with a .sub file or mixed subchannel data, the Q of
+all sectors is gathered once into a list of the ones that differ from the
+Q the toc gives (pregaps, LibCrypt, bad rips), so a read needs neither the
+.sub file nor the raw bit decoding. Sectors below sqBuilt come from the
+index, the rest still from the image.
+
+On the xenon the read-ahead worker builds it when it has nothing else to
+do, the other builds do it when the image is opened. Once done it is kept
+next to the image (.sqi) for the next time, and the .sub file is closed.
+*/
+
+#define SQ_CHUNK			64					// sectors indexed at once
+#define SQ_MAGIC			"SQI1"
+
+typedef struct {
+	u32 sect;
+	unsigned char q[12];
+} sq_entry_t;
+
+static sq_entry_t *sqList = NULL;	// the differing ones, by sector
+static u32 sqMax = 0;
+static volatile u32 sqCount = 0;
+static volatile u32 sqSectors = 0;	// to index, set last
+static volatile u32 sqBuilt = 0;	// ... and indexed so far
+static volatile int sqStop = 0;		// don't go on (closing, too many)
+static int sqDone = 0;				// sidecar written, .sub closed
+static int sqLoaded = 0;			// ... or read
+static unsigned char sqChunk[SQ_CHUNK * (CD_FRAMESIZE_RAW + SUB_FRAMESIZE)];
+
+// deinterleave Q of 'raw' subchannel data ripped by cdrdao
+static void SubQDecode(const unsigned char *sub, unsigned char *q) {
+	int i;
+
+	memset(q, 0, 12);
+
+	for (i = 0; i < 8 * 12; i++) {
+		if (sub[i] & (1 << 6)) { // only subchannel Q is needed
+			q[i >> 3] |= (1 << (7 - (i & 7)));
+		}
+	}
+}
+
+// Q of sect as the toc has it
+static void SubQSynth(u32 sect, unsigned char *q) {
+	unsigned char msf[3];
+	u32 start = 0;
+	u16 crc;
+	int t = 1, i;
+
+	for (i = numtracks; i > 1; i--) {
+		if (sect + 150 >= msf2sec((char *)ti[i].start)) break;
+	}
+	if (numtracks > 0) {
+		t = i;
+		start = msf2sec((char *)ti[t].start) - 150;
+	}
+
+	q[0] = (numtracks > 0 && ti[t].type == CDDA) ? 0x01 : 0x41;
+	q[1] = itob(t);
+	q[2] = 0x01;
+	sec2msf(sect - start, (char *)msf);
+	q[3] = itob(msf[0]);
+	q[4] = itob(msf[1]);
+	q[5] = itob(msf[2]);
+	q[6] = 0;
+	sec2msf(sect + 150, (char *)msf);
+	q[7] = itob(msf[0]);
+	q[8] = itob(msf[1]);
+	q[9] = itob(msf[2]);
+
+	crc = calcCrc(q, 10);
+	q[10] = crc >> 8;
+	q[11] = crc & 0xff;
+}
+
+// index the next chunk, f: the .sub file or the mixed image
+static void SQBuildChunk(FILE *f) {
+	u32 stride = subChanMixed ? CD_FRAMESIZE_RAW + SUB_FRAMESIZE : SUB_FRAMESIZE;
+	u32 skip = subChanMixed ? CD_FRAMESIZE_RAW : 0;
+	u32 pos = sqBuilt, n = sqSectors - pos, count = sqCount, i;
+	unsigned char q[12], synth[12];
+
+	if (n > SQ_CHUNK) n = SQ_CHUNK;
+
+	fseek(f, pos * stride, SEEK_SET);
+	if (fread(sqChunk, stride, n, f) != n) {
+		sqStop = 1; // short file: the rest stays on disk
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		const unsigned char *sub = sqChunk + i * stride + skip;
+
+		if (subChanRaw)
+			SubQDecode(sub, q);
+		else
+			memcpy(q, sub + 12, 12);
+
+		SubQSynth(pos + i, synth);
+		if (memcmp(q, synth, 12) == 0) continue;
+
+		if (count == sqMax) {
+			sqStop = 1; // hardly matches the toc, not worth it
+			return;
+		}
+
+		sqList[count].sect = pos + i;
+		memcpy(sqList[count].q, q, 12);
+		count++;
+	}
+
+	lwsync(); // entries before the count
+	sqCount = count;
+	lwsync(); // count before the sectors
+	sqBuilt = pos + n;
+}
+
+// Q of sect from the index, 0 if it isn't indexed (yet)
+static int SQGetQ(u32 sect, unsigned char *q) {
+	u32 lo = 0, hi, mid;
+
+	if (sect >= sqBuilt) return 0;
+
+	lwsync(); // entries after sqBuilt
+	hi = sqCount;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (sqList[mid].sect < sect) lo = mid + 1;
+		else hi = mid;
+	}
+
+	if (lo < sqCount && sqList[lo].sect == sect)
+		memcpy(q, sqList[lo].q, 12);
+	else
+		SubQSynth(sect, q);
+
+	return 1;
+}
+
+// image.img -> image.sqi
+static int SQFileName(char *name) {
+	strncpy(name, GetIsoFile(), MAXPATHLEN);
+	name[MAXPATHLEN - 1] = '\0';
+	if (strlen(name) < 4) return -1;
+
+	strcpy(name + strlen(name) - 4, ".sqi");
+	return 0;
+}
+
+// tells if the sidecar still fits the toc
+static u32 SQTocHash(void) {
+	u32 h = numtracks | (subChanRaw << 8) | (subChanMixed << 9);
+	int i;
+
+	for (i = 1; i <= numtracks; i++)
+		h = h * 31 + (ti[i].type << 24 | ti[i].start[0] << 16 | ti[i].start[1] << 8 | ti[i].start[2]);
+
+	return h;
+}
+
+static int SQLoad(u32 sectors) {
+	char name[MAXPATHLEN], magic[4];
+	u32 head[3], i;
+	FILE *f;
+
+	if (SQFileName(name) != 0 || (f = fopen(name, "rb")) == NULL) return -1;
+
+	if (fread(magic, 1, 4, f) != 4 || memcmp(magic, SQ_MAGIC, 4) != 0 ||
+		fread(head, 4, 3, f) != 3 || SWAP32(head[0]) != sectors ||
+		SWAP32(head[1]) != SQTocHash()) {
+		fclose(f);
+		return -1;
+	}
+
+	sqMax = SWAP32(head[2]);
+	sqList = malloc(sqMax * sizeof(sq_entry_t) + 1);
+	if (sqList == NULL) {
+		fclose(f);
 		return -1;
 	}
 
-	subHandle = fopen(subname, "rb");
-	if (subHandle == NULL) {
+	for (i = 0; i < sqMax; i++) {
+		if (fread(&sqList[i].sect, 4, 1, f) != 1 || fread(sqList[i].q, 1, 12, f) != 12) break;
+		sqList[i].sect = SWAP32(sqList[i].sect);
+	}
+
+	fclose(f);
+
+	if (i != sqMax) {
+		free(sqList);
+		sqList = NULL;
 		return -1;
 	}
 
+	sqCount = sqMax;
+	sqSectors = sqBuilt = sectors;
+	sqLoaded = 1;
+	return 0;
+}
+
+static void SQSave(void) {
+	char name[MAXPATHLEN];
+	u32 head[3], i, sect;
+	FILE *f;
+
+	if (SQFileName(name) != 0 || (f = fopen(name, "wb")) == NULL) return;
+
+	head[0] = SWAP32(sqSectors);
+	head[1] = SWAP32(SQTocHash());
+	head[2] = SWAP32(sqCount);
+	fwrite(SQ_MAGIC, 1, 4, f);
+	fwrite(head, 4, 3, f);
+
+	for (i = 0; i < sqCount; i++) {
+		sect = SWAP32(sqList[i].sect);
+		fwrite(&sect, 4, 1, f);
+		fwrite(sqList[i].q, 1, 12, f);
+	}
+
+	fclose(f);
+}
+
+// (emu) the index is complete: keep it, the .sub file isn't needed anymore
+static void SQFinish(void) {
+	sqDone = 1;
+
+	if (!sqLoaded) SQSave();
+
+	if (subHandle != NULL) {
+		fclose(subHandle);
+		subHandle = NULL;
+	}
+}
+
+/*
+Preload: the data track (CDR_PRELOAD_DATA) or the whole image
+(CDR_PRELOAD_ALL), up to PL_MAX of it, gets copied to RAM when the image
+is opened, so the reads don't have to go through libfat anymore. On the xenon the read-ahead
+worker loads it from the start whenever it has nothing to read ahead; the
+sectors below plLoaded are served from RAM, the rest from the image like
+before. The other builds mmap the image instead.
+
+Subchannel data of a .sub file comes from the file (or the Q index).
+*/
+
+#define PL_CHUNK			0x40000				// loaded at once
+#define PL_MAX				(64 * 1024 * 1024)	// most RAM we take
+
+static int plMode = CDR_PRELOAD_OFF;
+static unsigned char *plData = NULL;
+static volatile u32 plSize = 0;		// bytes to load from the start of the image
+static volatile u32 plLoaded = 0;	// ... and loaded so far
+#if !defined(_WIN32) && !defined(LIBXENON)
+static size_t plMapSize = 0;
+#endif
+
+static u32 plSectorSize(void) {
+	if (subChanMixed) return CD_FRAMESIZE_RAW + SUB_FRAMESIZE;
+	return isMode1ISO ? MODE1_DATA_SIZE : CD_FRAMESIZE_RAW;
+}
+
+// sector from RAM, 0 if it isn't loaded (yet)
+static int PLGetSector(unsigned int sect, unsigned char *buf, unsigned char *sub) {
+	u32 size = plSectorSize(), offset = sect * size;
+
+	if (plData == NULL || offset + size > plLoaded) return 0;
+
+	lwsync(); // sector data after plLoaded
+
+	if (subChanMixed) {
+		memcpy(buf, plData + offset, CD_FRAMESIZE_RAW);
+		memcpy(sub, plData + offset + CD_FRAMESIZE_RAW, SUB_FRAMESIZE);
+		return 1;
+	}
+
+	if (isMode1ISO)
+		memcpy(buf + 12, plData + offset, MODE1_DATA_SIZE);
+	else
+		memcpy(buf, plData + offset, CD_FRAMESIZE_RAW);
+
+	if (subHandle != NULL && sect >= sqBuilt) {
+		fseek(subHandle, sect * SUB_FRAMESIZE, SEEK_SET);
+		fread(sub, 1, SUB_FRAMESIZE, subHandle);
+	}
+
+	return 1;
+}
+
+/*
+Read-ahead: once the emu reads sectors one after the other (CdlReadN,
+CdlReadS streaming), a worker on another hw thread reads the next ones
+into a ring, with their own file handles. ISOreadTrack takes them from
+there and only reads the image itself on a miss, so a slow usb/hdd access
+doesn't stall the emu thread. A seek drops the ring, the next sequential
+read starts it again behind the new position. The worker runs from the
+open of the image to its close, so the spu mix threads see its hw thread
+taken; it is free again after the close.
+
+Not on the xenon, or with the hw thread taken, every read is done right
+away like before.
+*/
+
+#define RA_SECTORS			64					// ring size
+#define RA_THREAD			5
+
+typedef struct {
+	unsigned char data[CD_FRAMESIZE_RAW];
+	unsigned char sub[SUB_FRAMESIZE];
+} ra_sector_t;
+
+#ifdef LIBXENON
+static unsigned int raLast = (unsigned int)-2;	// last sector the emu read
+
+static ra_sector_t raRing[RA_SECTORS];
+
+// the emu sets raWant and bumps raGen, the worker then restarts the ring at
+// raWant (-1: idle) and acks with raGenDone
+static volatile int raWant = -1;
+static volatile u32 raGen = 0, raGenDone = 0;
+
+// ring of the current gen: sectors raBase + raTail ... raBase + raHead - 1
+static volatile int raBase = -1;
+static volatile u32 raHead = 0, raTail = 0;
+static volatile int raEof = 0;
+
+static FILE *raHandle = NULL;
+static FILE *raSubHandle = NULL;
+static int raOpen = 0; // 0: not tried, 1: open and running, -1: failed
+
+static volatile int raEnd = 0;		// (emu) worker, stop
+static volatile int raEnded = 1;	// (worker) stopped
+static unsigned char ra_thread_stack[0x10000];
+
+// (worker) next chunk of the preload
+static void PLLoadChunk(void) {
+	u32 pos = plLoaded, n = plSize - pos;
+
+	if (n > PL_CHUNK) n = PL_CHUNK;
+
+	fseek(raHandle, pos, SEEK_SET);
+	if (fread(plData + pos, 1, n, raHandle) != n) {
+		plSize = pos; // short image: the rest stays on disk
+		return;
+	}
+
+	lwsync(); // data before plLoaded
+	plLoaded = pos + n;
+}
+
+static void RAThread(void) {
+	while (!raEnd) {
+		u32 gen = raGen;
+		ra_sector_t *s;
+
+		if (gen != raGenDone) {
+			lwsync(); // raWant after the gen
+			raBase = raWant;
+			raHead = 0;
+			raTail = 0;
+			raEof = 0;
+			lwsync(); // ring reset before the ack
+			raGenDone = gen;
+			continue;
+		}
+
+		if (raBase < 0 || raEof || raHead - raTail >= RA_SECTORS) {
+			if (sqBuilt < sqSectors && !sqStop)
+				SQBuildChunk(subChanMixed ? raHandle : raSubHandle);
+			else if (plLoaded < plSize)
+				PLLoadChunk();
+			else
+				usleep(500);
+			continue;
+		}
+
+		s = &raRing[raHead % RA_SECTORS];
+		if (readSector(raHandle, raBase + raHead < sqBuilt ? NULL : raSubHandle,
+				raBase + raHead, s->data, s->sub) != 0) {
+			raEof = 1; // end of the image
+			continue;
+		}
+
+		lwsync(); // sector data before the index
+		if (raGen == gen) raHead++;
+	}
+
+	raEnded = 1;
+}
+
+// restart the ring at sect, wait until the worker took it
+static void RARequest(int sect) {
+	raWant = sect;
+	lwsync();
+	raGen++;
+
+	while (raGenDone != raGen)
+		usleep(100);
+}
+
+// open the worker's handles, then start it: raOpen tells how it went
+static void RAStart(void) {
+	if (raOpen != 0) return;
+
+	raOpen = -1;
+
+	// hw thread taken (spu mix threads, disc info scan)?
+	if (!raEnded || xenon_is_thread_task_running(RA_THREAD)) return;
+
+	raHandle = fopen(GetIsoFile(), "rb");
+	if (raHandle == NULL) return;
+
+	setvbuf(raHandle, NULL, _IOFBF, 0x10000);
+
+	if (subHandle != NULL) {
+		raSubHandle = opensubfile(GetIsoFile());
+		if (raSubHandle == NULL) {
+			fclose(raHandle);
+			raHandle = NULL;
+			return;
+		}
+	}
+
+	// nothing left of the last image
+	raWant = -1;
+	raGenDone = raGen;
+	raBase = -1;
+	raHead = raTail = 0;
+	raEof = 0;
+
+	raEnd = 0;
+	raEnded = 0;
+	raOpen = 1;
+	lwsync(); // all of it before the worker runs
+	xenon_run_thread_task(RA_THREAD, &ra_thread_stack[sizeof(ra_thread_stack) - 0x100], RAThread);
+}
+#endif
+
+// end the worker, close its handles
+static void RAStop(void) {
+#ifdef LIBXENON
+	raLast = (unsigned int)-2;
+	plSize = 0; // no more preload chunks
+	sqStop = 1; // ... or index chunks
+
+	if (raOpen == 1) {
+		raEnd = 1;
+		while (!raEnded)
+			usleep(100);
+	}
+
+	if (raHandle != NULL) {
+		fclose(raHandle);
+		raHandle = NULL;
+	}
+	if (raSubHandle != NULL) {
+		fclose(raSubHandle);
+		raSubHandle = NULL;
+	}
+
+	raOpen = 0;
+#endif
+}
+
+// sector from the read-ahead ring, 0 if the emu has to read it itself
+static int RAGetSector(unsigned int sect, unsigned char *buf, unsigned char *sub) {
+#ifdef LIBXENON
+	int seq = (sect == raLast + 1);
+
+	raLast = sect;
+
+	if (raOpen == 0 && seq) RAStart();
+	if (raOpen != 1) return 0;
+
+	if (raBase >= 0) {
+		u32 idx = sect - raBase;
+
+		// not read yet, but the worker is at it
+		while (idx - raTail < RA_SECTORS && idx >= raHead && !raEof)
+			usleep(100);
+
+		if (idx - raTail < raHead - raTail) {
+			ra_sector_t *s = &raRing[idx % RA_SECTORS];
+
+			lwsync(); // sector data after the index
+			memcpy(buf, s->data, CD_FRAMESIZE_RAW);
+			memcpy(sub, s->sub, SUB_FRAMESIZE);
+
+			lwsync(); // done with the slot before handing it back
+			raTail = idx + 1;
+			return 1;
+		}
+	}
+
+	// seek: stream on from here
+	if (seq) RARequest(sect + 1);
+#endif
+
 	return 0;
 }
 
+// index the subchannel Q of the image that just got opened
+static void SQStart(void) {
+	FILE *f = subChanMixed ? cdHandle : subHandle;
+	u32 sectors;
+
+	if (f == NULL) return;
+
+	fseek(f, 0, SEEK_END);
+	sectors = ftell(f) / (subChanMixed ? CD_FRAMESIZE_RAW + SUB_FRAMESIZE : SUB_FRAMESIZE);
+	fseek(f, 0, SEEK_SET);
+
+	if (sectors == 0) return;
+
+	if (SQLoad(sectors) == 0) {
+		SQFinish();
+		SysPrintf("[+sqi]");
+		return;
+	}
+
+	sqMax = sectors / 16 + 4096;
+	sqList = malloc(sqMax * sizeof(sq_entry_t));
+	if (sqList == NULL) return;
+
+#ifdef LIBXENON
+	RAStart();
+	if (raOpen != 1) {
+		free(sqList);
+		sqList = NULL;
+		return;
+	}
+
+	lwsync();
+	sqSectors = sectors; // the worker takes it from here
+#else
+	sqSectors = sectors;
+	while (sqBuilt < sqSectors && !sqStop)
+		SQBuildChunk(f);
+#endif
+}
+
+// after RAStop: the worker is done with sqList
+static void SQStop(void) {
+	free(sqList);
+	sqList = NULL;
+	sqMax = sqCount = 0;
+	sqSectors = sqBuilt = 0;
+	sqStop = 0;
+	sqDone = sqLoaded = 0;
+}
+
+// start the preload of the image that just got opened
+static void PLStart(void) {
+	long fileSize;
+	u32 size;
+
+	if (plMode == CDR_PRELOAD_OFF) return;
+
+	fseek(cdHandle, 0, SEEK_END);
+	fileSize = ftell(cdHandle);
+	fseek(cdHandle, 0, SEEK_SET);
+
+	size = fileSize;
+
+	// data track: up to the second one
+	if (plMode == CDR_PRELOAD_DATA && numtracks > 1 && ti[2].type == CDDA)
+		size = (msf2sec((char *)ti[2].start) - 2 * 75) * plSectorSize();
+
+	if (size > fileSize) size = fileSize;
+	if (size == 0) return;
+
+#ifdef LIBXENON
+	if (size > PL_MAX) size = PL_MAX;
+
+	plData = malloc(size);
+	if (plData == NULL) return;
+
+	RAStart();
+	if (raOpen != 1) {
+		free(plData);
+		plData = NULL;
+		return;
+	}
+
+	plLoaded = 0;
+	lwsync();
+	plSize = size; // the worker takes it from here
+#elif !defined(_WIN32)
+	plData = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(cdHandle), 0);
+	if (plData == MAP_FAILED) {
+		plData = NULL;
+		return;
+	}
+
+	plMapSize = size;
+	plSize = plLoaded = size;
+#else
+	return;
+#endif
+
+	SysPrintf("[+ram]");
+}
+
+// after RAStop: the worker is done with plData
+static void PLStop(void) {
+#ifdef LIBXENON
+	free(plData);
+#elif !defined(_WIN32)
+	if (plData != NULL) munmap(plData, plMapSize);
+#endif
+	plData = NULL;
+	plSize = plLoaded = 0;
+}
+
 long CALLBACK ISOinit(void) {
 	assert(cdHandle == NULL);
 	assert(subHandle == NULL);
@@ -715,6 +1235,9 @@ long CALLBACK ISOinit(void) {
 }
 
 static long CALLBACK ISOshutdown(void) {
+	RAStop();
+	PLStop();
+	SQStop();
 	if (cdHandle != NULL) {
 		fclose(cdHandle);
 		cdHandle = NULL;
@@ -723,7 +1246,8 @@ static long CALLBACK ISOshutdown(void) {
 		fclose(subHandle);
 		subHandle = NULL;
 	}
-	stopCDDA();
+	cdbufferSect = (unsigned int)-1;
+	playing = FALSE;
 	return 0;
 }
 
@@ -741,7 +1265,8 @@ static void PrintTracks(void) {
 // This function is invoked by the front-end when opening an ISO
 // file for playback
 static long CALLBACK ISOopen(void) {
-	u32 modeTest = 0;
+	isotoc_t toc;
+	const char *tag;
 
 	if (cdHandle != NULL) {
 		return 0; // it's already open
@@ -753,38 +1278,33 @@ static long CALLBACK ISOopen(void) {
 	}
 
 	SysPrintf(_("Loaded CD Image: %s"), GetIsoFile());
+	CdrStatsReset(GetIsoFile());
+
+	tag = readtoc(GetIsoFile(), cdHandle, &toc);
 
-	cddaBigEndian = FALSE;
-	subChanMixed = FALSE;
-	subChanRaw = FALSE;
+	numtracks = toc.numtracks;
+	memcpy(ti, toc.ti, sizeof(ti));
+	cddaBigEndian = toc.cddaBigEndian;
+	subChanMixed = toc.subChanMixed;
+	subChanRaw = toc.subChanRaw;
 	isMode1ISO = FALSE;
 
-	if (parseccd(GetIsoFile()) == 0) {
-		SysPrintf("[+ccd]");
-	}
-	else if (parsemds(GetIsoFile()) == 0) {
-		SysPrintf("[+mds]");
-	}
-	else if (parsecue(GetIsoFile()) == 0) {
-		SysPrintf("[+cue]");
-	}
-	else if (parsetoc(GetIsoFile()) == 0) {
-		SysPrintf("[+toc]");
+	if (tag != NULL) {
+		SysPrintf(tag);
 	} else {
-		//guess whether it is mode1/2048
-		fseek(cdHandle, 0, SEEK_END);
-		if(ftell(cdHandle) % 2048 == 0) {
-			fseek(cdHandle, 0, SEEK_SET);
-			fread(&modeTest, 4, 1, cdHandle);
-			if(SWAP32(modeTest)!=0xffffff00) isMode1ISO = TRUE;
-		}
-		fseek(cdHandle, 0, SEEK_SET);
+		isMode1ISO = ismode1iso(cdHandle);
 	}
 
-	if (!subChanMixed && opensubfile(GetIsoFile()) == 0) {
+	if (!subChanMixed && (subHandle = opensubfile(GetIsoFile())) != NULL) {
 		SysPrintf("[+sub]");
 	}
 
+	SQStart();
+	PLStart();
+#ifdef LIBXENON
+	RAStart();
+#endif
+
 	SysPrintf(".\n");
 
 	PrintTracks();
@@ -793,6 +1313,9 @@ static long CALLBACK ISOopen(void) {
 }
 
 static long CALLBACK ISOclose(void) {
+	RAStop();
+	PLStop();
+	SQStop();
 	if (cdHandle != NULL) {
 		fclose(cdHandle);
 		cdHandle = NULL;
@@ -801,7 +1324,8 @@ static long CALLBACK ISOclose(void) {
 		fclose(subHandle);
 		subHandle = NULL;
 	}
-	stopCDDA();
+	cdbufferSect = (unsigned int)-1;
+	playing = FALSE;
 	return 0;
 }
 
@@ -864,16 +1388,8 @@ static long CALLBACK ISOgetTD(unsigned char track, unsigned char *buffer) {
 // decode 'raw' subchannel data ripped by cdrdao
 static void DecodeRawSubData(void) {
 	unsigned char subQData[12];
-	int i;
-
-	memset(subQData, 0, sizeof(subQData));
-
-	for (i = 0; i < 8 * 12; i++) {
-		if (subbuffer[i] & (1 << 6)) { // only subchannel Q is needed
-			subQData[i >> 3] |= (1 << (7 - (i & 7)));
-		}
-	}
 
+	SubQDecode(subbuffer, subQData);
 	memcpy(&subbuffer[12], subQData, 12);
 }
 
@@ -881,39 +1397,50 @@ static void DecodeRawSubData(void) {
 // time: byte 0 - minute; byte 1 - second; byte 2 - frame
 // uses bcd format
 static long CALLBACK ISOreadTrack(unsigned char *time) {
+	unsigned int sect;
+
 	if (cdHandle == NULL) {
 		return -1;
 	}
 
-	if (subChanMixed) {
-		fseek(cdHandle, MSF2SECT(btoi(time[0]), btoi(time[1]), btoi(time[2])) * (CD_FRAMESIZE_RAW + SUB_FRAMESIZE), SEEK_SET);
-		fread(cdbuffer, 1, CD_FRAMESIZE_RAW, cdHandle);
-		fread(subbuffer, 1, SUB_FRAMESIZE, cdHandle);
+	sect = MSF2SECT(btoi(time[0]), btoi(time[1]), btoi(time[2]));
+
+	// cdrPlayInterrupt reads the subq of a sector right before its audio
+	if (sect == cdbufferSect) {
+		cdrStats.repeatHits++;
+		return 0;
+	}
+	cdbufferSect = sect;
 
-		if (subChanRaw) DecodeRawSubData();
+	if (sqSectors != 0 && !sqDone && sqBuilt == sqSectors) SQFinish();
+
+	if (PLGetSector(sect, cdbuffer, subbuffer)) {
+		cdrStats.ramHits++;
+	}
+	else if (RAGetSector(sect, cdbuffer, subbuffer)) {
+		cdrStats.aheadHits++;
 	}
 	else {
-		if(isMode1ISO) {
-			fseek(cdHandle, MSF2SECT(btoi(time[0]), btoi(time[1]), btoi(time[2])) * MODE1_DATA_SIZE, SEEK_SET);
-			fread(cdbuffer + 12, 1, MODE1_DATA_SIZE, cdHandle);
-			memset(cdbuffer, 0, 12); //not really necessary, fake mode 2 header
-			cdbuffer[0] = (time[0]);
-			cdbuffer[1] = (time[1]);
-			cdbuffer[2] = (time[2]);
-			cdbuffer[3] = 1; //mode 1
-		} else {
-			fseek(cdHandle, MSF2SECT(btoi(time[0]), btoi(time[1]), btoi(time[2])) * CD_FRAMESIZE_RAW, SEEK_SET);
-			fread(cdbuffer, 1, CD_FRAMESIZE_RAW, cdHandle);
-		}
+		u32 t = CdrStatsTime();
 
-		if (subHandle != NULL) {
-			fseek(subHandle, MSF2SECT(btoi(time[0]), btoi(time[1]), btoi(time[2])) * SUB_FRAMESIZE, SEEK_SET);
-			fread(subbuffer, 1, SUB_FRAMESIZE, subHandle);
+		readSector(cdHandle, sect < sqBuilt ? NULL : subHandle, sect, cdbuffer, subbuffer);
 
-			if (subChanRaw) DecodeRawSubData();
-		}
+		cdrStats.diskReads++;
+		cdrStats.diskTime += CdrStatsTime() - t;
+	}
+
+	if (isMode1ISO) {
+		memset(cdbuffer, 0, 12); //not really necessary, fake mode 2 header
+		cdbuffer[0] = (time[0]);
+		cdbuffer[1] = (time[1]);
+		cdbuffer[2] = (time[2]);
+		cdbuffer[3] = 1; //mode 1
 	}
 
+	if (SQGetQ(sect, subbuffer + 12)) return 0;
+
+	if ((subChanMixed || subHandle != NULL) && subChanRaw) DecodeRawSubData();
+
 	return 0;
 }
 
@@ -925,27 +1452,22 @@ static unsigned char * CALLBACK ISOgetBuffer(void) {
 // plays cdda audio
 // sector: byte 0 - minute; byte 1 - second; byte 2 - frame
 // does NOT uses bcd format
+// the audio goes through ISOreadCDDA, only the state is kept here
 static long CALLBACK ISOplay(unsigned char *time) {
-	if (SPU_playCDDAchannel != NULL) {
-		if (subChanMixed) {
-			startCDDA(MSF2SECT(time[0], time[1], time[2]) * (CD_FRAMESIZE_RAW + SUB_FRAMESIZE));
-		}
-		else {
-			startCDDA(MSF2SECT(time[0], time[1], time[2]) * CD_FRAMESIZE_RAW);
-		}
-	}
+	cddaCurOffset = MSF2SECT(time[0], time[1], time[2]) * CD_FRAMESIZE_RAW;
+	playing = TRUE;
 	return 0;
 }
 
 // stops cdda audio
 static long CALLBACK ISOstop(void) {
-	stopCDDA();
+	playing = FALSE;
 	return 0;
 }
 
 // gets subchannel data
 static unsigned char* CALLBACK ISOgetBufferSub(void) {
-	if (subHandle != NULL || subChanMixed) {
+	if (subHandle != NULL || subChanMixed || sqSectors != 0) {
 		return subbuffer;
 	}
 
@@ -988,16 +1510,11 @@ long CALLBACK ISOreadCDDA(unsigned char m, unsigned char s, unsigned char f, uns
 	memcpy(buffer, p - 12, CD_FRAMESIZE_RAW); // copy from the beginning of the sector
 
 	if (cddaBigEndian) {
-		int i;
-		unsigned char tmp;
-
-		for (i = 0; i < CD_FRAMESIZE_RAW / 2; i++) {
-			tmp = buffer[i * 2];
-			buffer[i * 2] = buffer[i * 2 + 1];
-			buffer[i * 2 + 1] = tmp;
-		}
+		SwapCDDA(buffer, CD_FRAMESIZE_RAW);
 	}
 
+	cddaCurOffset = MSF2SECT(m, s, f) * CD_FRAMESIZE_RAW;
+
 	return 0;
 }
 
@@ -1025,6 +1542,44 @@ void cdrIsoInit(void) {
 	numtracks = 0;
 }
 
+void cdrIsoSetPreload(int mode) {
+	plMode = mode;
+}
+
+int cdrIsoReadLayout(const char *isofile, CdrIsoLayout *layout) {
+	isotoc_t toc;
+	FILE *image;
+	int i;
+
+	image = fopen(isofile, "rb");
+	if (image == NULL) return -1;
+
+	memset(layout, 0, sizeof(*layout));
+
+	if (readtoc(isofile, image, &toc) != NULL) {
+		layout->sectorSize = CD_FRAMESIZE_RAW + (toc.subChanMixed ? SUB_FRAMESIZE : 0);
+	} else {
+		layout->sectorSize = ismode1iso(image) ? MODE1_DATA_SIZE : CD_FRAMESIZE_RAW;
+	}
+
+	fclose(image);
+
+	// no toc: a single data track, like ISOgetTN says
+	if (toc.numtracks == 0) {
+		toc.numtracks = 1;
+		toc.ti[1].type = DATA;
+		sec2msf(2 * 75, toc.ti[1].start);
+	}
+
+	layout->numTracks = toc.numtracks;
+	for (i = 1; i <= toc.numtracks; i++) {
+		layout->trackType[i] = toc.ti[i].type;
+		memcpy(layout->trackStart[i], toc.ti[i].start, 3);
+	}
+
+	return 0;
+}
+
 int cdrIsoActive(void) {
 	return (cdHandle != NULL);
 }
@@ -25,8 +25,28 @@
 extern "C" {
 #endif
 
+#define CDR_PRELOAD_OFF		0
+#define CDR_PRELOAD_DATA	1	// first track
+#define CDR_PRELOAD_ALL		2
+
+#define CDR_ISO_MAXTRACKS	99
+
+#define CDR_ISO_DATA		1
+#define CDR_ISO_CDDA		2
+
+// tracks of an image as cdriso would open it
+typedef struct {
+	int numTracks;
+	unsigned char trackType[CDR_ISO_MAXTRACKS + 1];		// CDR_ISO_*, by track number
+	unsigned char trackStart[CDR_ISO_MAXTRACKS + 1][3];	// msf, not bcd
+	unsigned int sectorSize;							// in the file: 2048, 2352, 2448
+} CdrIsoLayout;
+
 void cdrIsoInit(void);
+void cdrIsoSetPreload(int mode);
 int cdrIsoActive(void);
+// doesn't touch the open image, can be called from other threads
+int cdrIsoReadLayout(const char *isofile, CdrIsoLayout *layout);
 
 #ifdef __cplusplus
 }
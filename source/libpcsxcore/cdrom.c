@@ -24,6 +24,12 @@
 #include "cdrom.h"
 #include "ppf.h"
 #include "psxdma.h"
+#include "cdrstats.h"
+
+#ifdef LIBXENON
+#include <xenon_soc/xenon_power.h>
+#include <unistd.h>
+#endif
 
 cdrStruct cdr;
 
@@ -121,6 +127,17 @@ unsigned char Test23[] = { 0x43, 0x58, 0x44, 0x32, 0x39 ,0x34, 0x30, 0x51 };
 // so (PSXCLK / 75) = cdr read time (linuzappz)
 #define cdReadTime (PSXCLK / 75)
 
+// fast seek (Config.CdSpeed): seeks and data sectors take 1/2, 1/4 or 1/8
+// of the drive time, or next to nothing. Never less than CDR_FAST_MIN, the
+// acks of the commands still come first. Streamed sectors (XA, STR) and
+// cdda keep the drive speed.
+#define CDR_FAST_MIN 0x2000
+
+// submode: real-time, audio, video
+#define SUBMODE_STREAM (0x40 | 0x04 | 0x02)
+
+static u8 cdrSpeed;
+
 static struct CdrStat stat;
 static struct SubQ *subq;
 
@@ -218,6 +235,81 @@ extern SPUregisterCallback SPU_registerCallback;
 	cdr.ResultReady = 1; \
 }
 
+static const char *cdrSpeedName[] = { "1x", "2x", "4x", "8x", "instant" };
+
+// Config.CdSpeed, unless the game is in cdspeed.txt of the patches dir:
+// "SLUS_005.94 1x" (1x, 2x, 4x, 8x or instant), # comments.
+// For the games which break with fast seek.
+void cdrLoadSpeed() {
+	FILE *f;
+	char file[MAXPATHLEN], line[256], id[16], speed[16], game[10];
+	int i, j;
+
+	cdrSpeed = Config.CdSpeed;
+	if (cdrSpeed > CDR_SPEED_INSTANT) cdrSpeed = CDR_SPEED_INSTANT;
+
+	if (CdromId[0] == '\0') return;
+
+	for (i = 0; i < 9 && CdromId[i] != '\0'; i++) game[i] = toupper(CdromId[i]);
+	game[i] = '\0';
+
+	sprintf(file, "%scdspeed.txt", Config.PatchesDir);
+
+	f = fopen(file, "r");
+	if (f == NULL) return;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%15s %15s", id, speed) != 2 || id[0] == '#') continue;
+
+		// like CdromId: letters and digits
+		for (i = j = 0; id[i] != '\0'; i++) {
+			if (isalnum(id[i])) id[j++] = toupper(id[i]);
+		}
+		id[j] = '\0';
+
+		if (strcmp(id, game) != 0) continue;
+
+		for (i = 0; speed[i] != '\0'; i++) speed[i] = tolower(speed[i]);
+
+		for (i = 0; i <= CDR_SPEED_INSTANT; i++) {
+			if (strcmp(speed, cdrSpeedName[i]) == 0) {
+				cdrSpeed = i;
+				break;
+			}
+		}
+		break;
+	}
+
+	fclose(f);
+
+	SysPrintf(_("Cd speed: %s\n"), cdrSpeedName[cdrSpeed]);
+}
+
+// drive time -> fast seek time
+static u32 cdrFastTime(u32 time) {
+	u32 fast;
+
+	if (cdrSpeed == CDR_SPEED_NORMAL) return time;
+
+	fast = cdrSpeed == CDR_SPEED_INSTANT ? 0 : time >> cdrSpeed;
+	if (fast < CDR_FAST_MIN) fast = CDR_FAST_MIN;
+
+	return fast < time ? fast : time;
+}
+
+// time until the next sector, cdr.Transfer has the header of the last one
+static u32 cdrSectorTime() {
+	u32 time = (cdr.Mode & MODE_SPEED) ? (cdReadTime / 2) : cdReadTime;
+
+	// XA / movies: the game takes them at the speed of the drive. Only
+	// mode 2 sectors have a submode, mode 1 has user data there
+	if ((cdr.Mode & MODE_STRSND) ||
+		(cdr.Transfer[3] == 2 && (cdr.Transfer[4 + 2] & SUBMODE_STREAM)))
+		return time;
+
+	return cdrFastTime(time);
+}
+
 void adjustTransferIndex()
 {
 	unsigned int bufSize = 0;
@@ -504,6 +596,8 @@ void Find_CurTrack() {
 }
 
 static void ReadTrack( u8 *time ) {
+	u32 t;
+
 	cdr.Prev[0] = itob( time[0] );
 	cdr.Prev[1] = itob( time[1] );
 	cdr.Prev[2] = itob( time[2] );
@@ -511,7 +605,9 @@ static void ReadTrack( u8 *time ) {
 #ifdef CDR_LOG
 	CDR_LOG("ReadTrack() Log: KEY *** %x:%x:%x\n", cdr.Prev[0], cdr.Prev[1], cdr.Prev[2]);
 #endif
+	t = CdrStatsTime();
 	cdr.RErr = CDR_readTrack(cdr.Prev);
+	CdrStatsRead(time, CdrStatsTime() - t);
 }
 
 
@@ -917,13 +1013,16 @@ void cdrPlayInterrupt()
 
 	{
 		u8 temp[3];
+		u32 t;
 
 		temp[0] = itob(cdr.SetSectorPlay[0]);
 		temp[1] = itob(cdr.SetSectorPlay[1]);
 		temp[2] = itob(cdr.SetSectorPlay[2]);
 
 		// get subq
+		t = CdrStatsTime();
 		CDR_readTrack( temp );
+		CdrStatsRead(cdr.SetSectorPlay, CdrStatsTime() - t);
 	}
 
 	if( CDR_readCDDA ) {
@@ -1371,7 +1470,7 @@ void cdrInterrupt() {
 			Rockman X5 = 0.5-4x
 			- fix capcom logo
 			*/
-			AddIrqQueue(CdlSeekL + 0x20, cdReadTime * 4);
+			AddIrqQueue(CdlSeekL + 0x20, cdrFastTime(cdReadTime * 4));
 			break;
 
     	case CdlSeekL + 0x20:
@@ -1393,7 +1492,7 @@ void cdrInterrupt() {
         	cdr.Result[0] = cdr.StatP;
 			cdr.StatP |= STATUS_SEEK;
         	cdr.Stat = Acknowledge;
-			AddIrqQueue(CdlSeekP + 0x20, cdReadTime * 1);
+			AddIrqQueue(CdlSeekP + 0x20, cdrFastTime(cdReadTime * 1));
 			break;
 
     	case CdlSeekP + 0x20:
@@ -1554,12 +1653,12 @@ void cdrInterrupt() {
 				// - fix cutscene speech (startup)
 
 				// ??? - use more accurate seek time later
-				CDREAD_INT((cdr.Mode & 0x80) ? (cdReadTime / 2) : cdReadTime * 1);
+				CDREAD_INT(cdrSectorTime());
 			} else {
 				cdr.StatP |= STATUS_READ;
 				cdr.StatP &= ~STATUS_SEEK;
 
-				CDREAD_INT((cdr.Mode & 0x80) ? (cdReadTime / 2) : cdReadTime * 1);
+				CDREAD_INT(cdrSectorTime());
 			}
 
 			SetResultSize(1);
@@ -1586,6 +1685,150 @@ void cdrInterrupt() {
 #endif
 }
 
+/*
+XA decode worker: the read interrupt only checks the header of an xa
+sector and queues it. Decoding it (and the resampling the spu plugin does
+when it gets the pcm) runs on another hw thread, in queue order.
+The worker holds its hw thread from the cdrom open to the close
+(cdrXAStart/cdrXAStop), so the spu mix threads and the disc info scan
+see it taken. Without the thread (not on the xenon, xa off at the open,
+or its hw thread taken) the sector gets decoded right away.
+*/
+
+#define XA_QUEUE_SIZE		32					// sectors, power of 2
+#define XA_SECTOR_SIZE		(8 + 18 * 128)		// subheader + sound groups
+#define XA_THREAD			1
+
+typedef struct {
+	int first;
+	u8 data[XA_SECTOR_SIZE];
+} xa_sector_t;
+
+static void XADecodeSector(u8 *sector, int first) {
+	xa_decode_sector(&cdr.Xa, sector, first);
+
+#if 0
+	int xa_type;
+
+	// save - set only for FirstSector
+	xa_type = cdr.Xa.stereo;
+
+
+	// Duke Nukem - Time to Kill - speech, music volume control
+	// Tekken 3 - post-match fade out
+	if( cdr.Xa.stereo == 0 )
+		CDXA_Attenuation( cdr.Xa.pcm, cdr.Xa.nsamples * 2, cdr.Xa.stereo, XA_ATTENUATE );
+	else
+		CDXA_Attenuation( cdr.Xa.pcm, cdr.Xa.nsamples * 4, cdr.Xa.stereo, XA_ATTENUATE );
+
+
+	// fix mono xa attenuation
+	if( cdr.Xa.stereo == 0 ) cdr.Xa.stereo = 1;
+#endif
+
+	SPU_playADPCMchannel(&cdr.Xa);
+
+#if 0
+	cdr.Xa.stereo = xa_type;
+#endif
+}
+
+#ifdef LIBXENON
+#define lwsync() __asm__ __volatile__("lwsync" : : : "memory")
+
+static xa_sector_t xaQueue[XA_QUEUE_SIZE];
+static volatile u32 xaQueueWrite = 0, xaQueueRead = 0;
+
+static int xaOpen = 0; // 1: worker running
+static volatile int xaEnd = 0; // (emu) worker, stop
+static volatile int xaEnded = 1; // (worker) stopped
+static unsigned char xa_thread_stack[0x10000];
+
+static void XAThread(void) {
+	while (!xaEnd) {
+		xa_sector_t *s;
+
+		if (xaQueueRead == xaQueueWrite) {
+			usleep(500);
+			continue;
+		}
+
+		lwsync(); // sector data after the index
+
+		s = &xaQueue[xaQueueRead & (XA_QUEUE_SIZE - 1)];
+		XADecodeSector(s->data, s->first);
+
+		lwsync(); // done with the slot before handing it back
+		xaQueueRead++;
+	}
+
+	xaEnded = 1;
+}
+#endif
+
+static void XAQueueSector(u8 *sector, int first) {
+#ifdef LIBXENON
+	if (xaOpen) {
+		xa_sector_t *s;
+
+		// full: wait for the worker
+		while (xaQueueWrite - xaQueueRead >= XA_QUEUE_SIZE)
+			usleep(100);
+
+		s = &xaQueue[xaQueueWrite & (XA_QUEUE_SIZE - 1)];
+		s->first = first;
+		memcpy(s->data, sector, XA_SECTOR_SIZE);
+
+		lwsync(); // sector data before the index
+		xaQueueWrite++;
+		return;
+	}
+#endif
+
+	XADecodeSector(sector, first);
+}
+
+// wait until all queued sectors are decoded (cdr.Xa is ours again and the
+// spu got all of them), before the cdrom or spu state is saved or replaced
+void cdrXAFlush() {
+#ifdef LIBXENON
+	while (xaQueueRead != xaQueueWrite)
+		usleep(100);
+#endif
+}
+
+// with the cdrom open: start the worker
+void cdrXAStart() {
+#ifdef LIBXENON
+	if (xaOpen || Config.Xa) return;
+
+	// hw thread taken (disc info scan)?
+	if (!xaEnded || xenon_is_thread_task_running(XA_THREAD)) return;
+
+	xaQueueWrite = xaQueueRead = 0;
+	xaEnd = 0;
+	xaEnded = 0;
+	xaOpen = 1;
+	lwsync(); // all of it before the worker runs
+	xenon_run_thread_task(XA_THREAD, &xa_thread_stack[sizeof(xa_thread_stack) - 0x100], XAThread);
+#endif
+}
+
+// before the cdrom gets closed: decode what's queued, end the worker
+void cdrXAStop() {
+#ifdef LIBXENON
+	if (!xaOpen) return;
+
+	cdrXAFlush();
+
+	xaEnd = 1;
+	while (!xaEnded)
+		usleep(100);
+
+	xaOpen = 0;
+#endif
+}
+
 void cdrReadInterrupt() {
 	u8 *buf;
 
@@ -1642,37 +1885,13 @@ void cdrReadInterrupt() {
 		if((cdr.Transfer[4 + 2] & 0x4) &&
 			 (cdr.Transfer[4 + 1] == cdr.Channel) &&
 			 (cdr.Transfer[4 + 0] == cdr.File)) {
-			int ret = xa_decode_sector(&cdr.Xa, cdr.Transfer+4, cdr.FirstSector);
+			int ret = xa_check_sector(cdr.Transfer+4, cdr.FirstSector);
 
 			if (!ret) {
-#if 0
-				int xa_type;
-
-				// save - set only for FirstSector
-				xa_type = cdr.Xa.stereo;
-
-
-				// Duke Nukem - Time to Kill - speech, music volume control
-				// Tekken 3 - post-match fade out
-				if( cdr.Xa.stereo == 0 )
-					CDXA_Attenuation( cdr.Xa.pcm, cdr.Xa.nsamples * 2, cdr.Xa.stereo, XA_ATTENUATE );
-				else
-					CDXA_Attenuation( cdr.Xa.pcm, cdr.Xa.nsamples * 4, cdr.Xa.stereo, XA_ATTENUATE );
-
-
-				// fix mono xa attenuation
-				if( cdr.Xa.stereo == 0 ) cdr.Xa.stereo = 1;
-#endif
-
-				SPU_playADPCMchannel(&cdr.Xa);
+				XAQueueSector(cdr.Transfer+4, cdr.FirstSector);
 				cdr.FirstSector = 0;
 
 
-#if 0
-				cdr.Xa.stereo = xa_type;
-#endif
-
-
 #if 0
 				// Crash Team Racing: music, speech
 				// - done using cdda decoded buffer (spu irq)
@@ -1708,7 +1927,7 @@ void cdrReadInterrupt() {
 		AddIrqQueue(CdlPause, 0x2000);
 	}
 	else {
-		CDREAD_INT((cdr.Mode & MODE_SPEED) ? (cdReadTime / 2) : cdReadTime);
+		CDREAD_INT(cdrSectorTime());
 	}
 
 	/*
@@ -2446,6 +2665,8 @@ void cdrDmaInterrupt()
 }
 
 void cdrReset() {
+	cdrXAFlush();
+
 	memset(&cdr, 0, sizeof(cdr));
 	cdr.CurTrack = 1;
 	cdr.File = 1;
@@ -2467,6 +2688,8 @@ int cdrFreeze(gzFile f, int Mode) {
 	if( Mode == 0 ) {
 		StopCdda();
 	}
+
+	cdrXAFlush();
 	
 	
 	gzfreeze(&cdr, sizeof(cdr));
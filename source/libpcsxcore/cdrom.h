@@ -114,6 +114,10 @@ void cdrWrite1(unsigned char rt);
 void cdrWrite2(unsigned char rt);
 void cdrWrite3(unsigned char rt);
 int cdrFreeze(gzFile f, int Mode);
+void cdrLoadSpeed();
+void cdrXAFlush();
+void cdrXAStart();
+void cdrXAStop();
 
 #ifdef __cplusplus
 }
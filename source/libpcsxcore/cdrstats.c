@@ -0,0 +1,180 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+/*
+* cd image read statistics, see cdrstats.h
+*/
+
+#include "psxcommon.h"
+#include "plugins.h"
+#include "cdrom.h"
+#include "cdrstats.h"
+
+#ifdef LIBXENON
+#include <ppc/timebase.h>
+#else
+#include <sys/time.h>
+#endif
+
+CdrStats cdrStats;
+
+static unsigned int lastSect = (unsigned int)-1;
+
+// track starts, read from the plugin on the first read (-1: not yet)
+static int numTracks = -1;
+static unsigned int trackStart[CDRSTATS_TRACKS + 1];
+
+void CdrStatsReset(const char *image) {
+	char name[sizeof(cdrStats.image)];
+
+	strcpy(name, image != NULL ? image : cdrStats.image);
+	name[sizeof(name) - 1] = '\0';
+
+	memset(&cdrStats, 0, sizeof(cdrStats));
+	strcpy(cdrStats.image, name);
+
+	lastSect = (unsigned int)-1;
+	numTracks = -1;
+}
+
+unsigned int CdrStatsTime(void) {
+#ifdef LIBXENON
+	return mftb() / (PPC_TIMEBASE_FREQ / 1000000);
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static int Log2Bucket(unsigned int v) {
+	int b = 0;
+
+	while (v > 1 && b < CDRSTATS_BUCKETS - 1) {
+		v >>= 1;
+		b++;
+	}
+
+	return b;
+}
+
+static void ReadTracks(void) {
+	unsigned char tn[2], td[3];
+	int i;
+
+	numTracks = 0;
+
+	if (CDR_getTN == NULL || CDR_getTD == NULL || CDR_getTN(tn) == -1) return;
+
+	for (i = tn[0]; i <= tn[1] && numTracks < CDRSTATS_TRACKS; i++) {
+		if (CDR_getTD((unsigned char)i, td) == -1) break;
+
+		// td: frame, second, minute
+		trackStart[numTracks++] = MSF2SECT(td[2], td[1], td[0]);
+	}
+}
+
+void CdrStatsRead(const unsigned char *msf, unsigned int us) {
+	unsigned int sect = MSF2SECT(msf[0], msf[1], msf[2]);
+	int t;
+
+	cdrStats.reads++;
+
+	if (sect == lastSect + 1) {
+		cdrStats.seqReads++;
+	} else if (sect != lastSect) {
+		cdrStats.seeks++;
+		cdrStats.seekHist[Log2Bucket(sect > lastSect ? sect - lastSect : lastSect - sect)]++;
+	}
+	lastSect = sect;
+
+	cdrStats.waitHist[Log2Bucket(us)]++;
+	cdrStats.waitTotal += us;
+	if (us > cdrStats.waitMax) cdrStats.waitMax = us;
+
+	if (numTracks < 0) ReadTracks();
+
+	if (numTracks > 0) {
+		for (t = numTracks - 1; t > 0 && sect < trackStart[t]; t--);
+		cdrStats.trackReads[t]++;
+	}
+}
+
+#define PRINT(...) \
+	do { \
+		if (len < size) len += snprintf(buf + len, size - len, __VA_ARGS__); \
+	} while (0)
+
+static int FormatHist(char *buf, int size, const char *title, const unsigned int *hist) {
+	int len = 0, i;
+
+	PRINT("%s\n", title);
+
+	for (i = 0; i < CDRSTATS_BUCKETS; i++) {
+		if (hist[i] == 0) continue;
+
+		if (i == CDRSTATS_BUCKETS - 1) PRINT("  >= %6u: %u\n", 1u << i, hist[i]);
+		else PRINT("  %6u ... %6u: %u\n", i ? 1u << i : 0, (2u << i) - 1, hist[i]);
+	}
+
+	return len;
+}
+
+int CdrStatsFormat(char *buf, int size) {
+	CdrStats s = cdrStats; // the workers go on counting
+	int len = 0, t;
+
+	if (size <= 0) return 0;
+	buf[0] = '\0';
+
+	PRINT("image: %s\n\n", s.image);
+
+	PRINT("reads: %u (%u sequential, %u seeks)\n", s.reads, s.seqReads, s.seeks);
+	PRINT("blocked: %llu us, %llu us per read, %u us max\n\n", s.waitTotal,
+		s.reads ? s.waitTotal / s.reads : 0, s.waitMax);
+
+	if (len < size) len += FormatHist(buf + len, size - len, "time blocked per read (us):", s.waitHist);
+	if (len < size) len += FormatHist(buf + len, size - len, "seek distance (sectors):", s.seekHist);
+
+	PRINT("\ncdriso: %u repeated, %u from ram, %u read ahead, %u from disk (%llu us)\n",
+		s.repeatHits, s.ramHits, s.aheadHits, s.diskReads, s.diskTime);
+	PRINT("cdrcimg: %u cache hits, %u misses, %llu bytes read, %llu inflated (%llu us)\n\n",
+		s.cacheHits, s.cacheMisses, s.bytesRead, s.bytesInflated, s.inflateTime);
+
+	PRINT("reads by track:\n");
+	for (t = 0; t < CDRSTATS_TRACKS; t++) {
+		if (s.trackReads[t]) PRINT("  %2d: %u\n", t + 1, s.trackReads[t]);
+	}
+
+	return len < size ? len : size - 1;
+}
+
+int CdrStatsDump(const char *file) {
+	char buf[4096];
+	FILE *f;
+	int len;
+
+	f = fopen(file, "w");
+	if (f == NULL) return -1;
+
+	len = CdrStatsFormat(buf, sizeof(buf));
+	fwrite(buf, 1, len, f);
+	fclose(f);
+
+	return 0;
+}
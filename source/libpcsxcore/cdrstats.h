@@ -0,0 +1,89 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifndef __CDRSTATS_H__
+#define __CDRSTATS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Read statistics of the cd image, to see why loads are slow: cdrom.c counts
+the reads it asks for and how long they block, the image plugins count
+where the sectors came from. Plain counters without locks, the workers of
+the plugins may add to them too.
+
+Served by the httpd as /CDSTATS (/CDSTATS/reset, /CDSTATS/dump).
+*/
+
+#define CDRSTATS_BUCKETS	16	// log2 histograms
+#define CDRSTATS_TRACKS		100
+
+#ifdef LIBXENON
+#define CDRSTATS_FILE		"uda:/cdrstats.txt"
+#else
+#define CDRSTATS_FILE		"cdrstats.txt"
+#endif
+
+typedef struct {
+	char image[256];
+
+	// cdrom.c
+	unsigned int reads;
+	unsigned int seqReads;						// the sector after the one before
+	unsigned int seeks;
+	unsigned int seekHist[CDRSTATS_BUCKETS];	// by distance in sectors
+	unsigned int waitHist[CDRSTATS_BUCKETS];	// by time blocked in us
+	unsigned long long waitTotal;				// us
+	unsigned int waitMax;
+	unsigned int trackReads[CDRSTATS_TRACKS];
+
+	// cdriso
+	unsigned int repeatHits;					// sector still in the buffer
+	unsigned int ramHits;						// preload
+	unsigned int aheadHits;						// read-ahead ring
+	unsigned int diskReads;						// on the emu thread
+	unsigned long long diskTime;				// us
+
+	// cdrcimg
+	unsigned int cacheHits;
+	unsigned int cacheMisses;					// inflated on the emu thread
+	unsigned long long bytesRead;				// compressed, from the image
+	unsigned long long bytesInflated;
+	unsigned long long inflateTime;				// us, emu thread and worker
+} CdrStats;
+
+extern CdrStats cdrStats;
+
+// image got opened: start over (NULL: same image)
+void CdrStatsReset(const char *image);
+
+// us timer
+unsigned int CdrStatsTime(void);
+
+// cdrom.c read of sector m:s:f (binary) that blocked for us
+void CdrStatsRead(const unsigned char *msf, unsigned int us);
+
+// text report, returns its length
+int CdrStatsFormat(char *buf, int size);
+int CdrStatsDump(const char *file);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
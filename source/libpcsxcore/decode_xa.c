@@ -348,6 +348,19 @@ s32 xa_decode_sector( xa_decode_t *xdp,
 	return 0;
 }
 
+//================================================================
+//=== same header check as xa_decode_sector, without decoding:
+//=== return -1 if xa_decode_sector would fail
+//================================================================
+s32 xa_check_sector( unsigned char *sectorp, int is_first_sector ) {
+	xa_subheader_t *subheadp = (xa_subheader_t *)sectorp;
+
+	if ( is_first_sector && AUDIO_CODING_GET_FREQ(subheadp->coding) > 1 )
+		return -1;
+
+	return 0;
+}
+
 /* EXAMPLE:
 "nsamples" is the number of 16 bit samples
 every sample is 2 bytes in mono and 4 bytes in stereo
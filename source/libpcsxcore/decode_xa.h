@@ -42,6 +42,8 @@ typedef struct {
 s32 xa_decode_sector( xa_decode_t *xdp,
 					   unsigned char *sectorp,
 					   int is_first_sector );
+s32 xa_check_sector( unsigned char *sectorp,
+					   int is_first_sector );
 
 #ifdef __cplusplus
 }
@@ -263,15 +263,45 @@ int LoadCdromFile(const char *filename, EXE_HEADER *head) {
 	return 0;
 }
 
+// SLUS_005.94;1 -> SLUS00594 (id has room for 10)
+void CdromIdFromExe(const char *exename, char *id) {
+	int i, c;
+
+	i = strlen(exename);
+	if (i >= 2) {
+		if (exename[i - 2] == ';') i-= 2;
+		c = 8; i--;
+		while (i >= 0 && c >= 0) {
+			if (isalnum(exename[i])) id[c--] = exename[i];
+			i--;
+		}
+	}
+}
+
+// PSX_TYPE_PAL or PSX_TYPE_NTSC
+u8 CdromIdRegion(const char *id) {
+	if((id[2] == 'e') || (id[2] == 'E') ||
+		!strncmp(id, "\0DTLS3035", 10) ||
+		!strncmp(id, "PBPX95001", 10) || // according to redump.org, these PAL
+		!strncmp(id, "PBPX95007", 10) || // discs have a non-standard ID;
+		!strncmp(id, "PBPX95008", 10))   // add more serials if they are discovered.
+		return PSX_TYPE_PAL; // pal
+
+	return PSX_TYPE_NTSC; // ntsc
+}
+
 int CheckCdrom() {
 	struct iso_directory_record *dir;
 	unsigned char time[4], *buf;
 	unsigned char mdir[4096];
 	char exename[256];
-	int i, c;
 
 	FreePPFCache();
 
+	// the speed of the last game must not stay, even if this isn't one
+	CdromId[0] = '\0';
+	cdrLoadSpeed();
+
 	time[0] = itob(0);
 	time[1] = itob(2);
 	time[2] = itob(0x10);
@@ -279,7 +309,6 @@ int CheckCdrom() {
 	READTRACK();
 
 	CdromLabel[0] = '\0';
-	CdromId[0] = '\0';
 
 	strncpy(CdromLabel, buf + 52, 32);
 
@@ -319,25 +348,11 @@ int CheckCdrom() {
 		return -1;		// SYSTEM.CNF and PSX.EXE not found
 
 	if (CdromId[0] == '\0') {
-		i = strlen(exename);
-		if (i >= 2) {
-			if (exename[i - 2] == ';') i-= 2;
-			c = 8; i--;
-			while (i >= 0 && c >= 0) {
-				if (isalnum(exename[i])) CdromId[c--] = exename[i];
-				i--;
-			}
-		}
+		CdromIdFromExe(exename, CdromId);
 	}
 
 	if (Config.PsxAuto) { // autodetect system (pal or ntsc)
-		if((CdromId[2] == 'e') || (CdromId[2] == 'E') ||
-			!strncmp(CdromId, "\0DTLS3035", 10) ||
-			!strncmp(CdromId, "PBPX95001", 10) || // according to redump.org, these PAL
-			!strncmp(CdromId, "PBPX95007", 10) || // discs have a non-standard ID;
-			!strncmp(CdromId, "PBPX95008", 10))   // add more serials if they are discovered.
-			Config.PsxType = PSX_TYPE_PAL; // pal
-		else Config.PsxType = PSX_TYPE_NTSC; // ntsc
+		Config.PsxType = CdromIdRegion(CdromId);
 	}
 
 	if (CdromLabel[0] == ' ') {
@@ -348,6 +363,7 @@ int CheckCdrom() {
 
 	BuildPPFCache();
 	LoadSBI();
+	cdrLoadSpeed();
 
 	return 0;
 }
@@ -536,7 +552,8 @@ int SaveState(const char *file) {
 	gzwrite(f, gpufP, sizeof(GPUFreeze_t));
 	free(gpufP);
 
-	// spu
+	// spu, no xa sector may be decoding into it meanwhile
+	cdrXAFlush();
 	spufP = (SPUFreeze_t *) malloc(16);
 	SPU_freeze(2, spufP);
 	Size = spufP->Size; gzwrite(f, &Size, 4);
@@ -595,7 +612,8 @@ int LoadState(const char *file) {
 	GPU_freeze(0, gpufP);
 	free(gpufP);
 
-	// spu
+	// spu, no xa sector may be decoding into it meanwhile
+	cdrXAFlush();
 	gzread(f, &Size, 4);
 	spufP = (SPUFreeze_t *)malloc(Size);
 	gzread(f, spufP, Size);
@@ -59,6 +59,8 @@ extern char CdromLabel[33];
 int LoadCdrom();
 int LoadCdromFile(const char *filename, EXE_HEADER *head);
 int CheckCdrom();
+void CdromIdFromExe(const char *exename, char *id);
+u8 CdromIdRegion(const char *id);
 int Load(const char *ExePath);
 
 int SaveState(const char *file);
@@ -23,6 +23,7 @@
 
 #include "plugins.h"
 #include "cdriso.h"
+#include "cdrom.h"
 
 static char IsoFile[MAXPATHLEN] = "";
 static s64 cdOpenCaseTime = 0;
@@ -791,6 +792,8 @@ void ReleasePlugins() {
 	}
 	NetOpened = FALSE;
 
+	cdrXAStop();
+
 	if (hCDRDriver != NULL || cdrIsoActive()) CDR_shutdown();
 	if (hGPUDriver != NULL) GPU_shutdown();
 	if (hSPUDriver != NULL) SPU_shutdown();
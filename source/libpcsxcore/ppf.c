@@ -24,158 +24,211 @@
 #include "ppf.h"
 #include "cdrom.h"
 
-typedef struct tagPPF_DATA {
-	s32					addr;
-	s32					pos;
+/*
+The patch records get compiled into one overlay per patched sector when
+the patch is loaded: the records of a sector are applied in file order,
+the bytes that end up patched are kept as a few spans of merged data. A
+hash from the sector number to its overlay makes the lookup on a read
+O(1), then each span is one memcpy.
+*/
+
+typedef struct {
+	s32					addr;		// sector
+	s32					pos;		// in the raw sector
 	s32					anz;
-	struct tagPPF_DATA	*pNext;
-} PPF_DATA;
+	s32					data;		// in ppfRecData, grows in file order
+} PPF_RECORD;
+
+typedef struct {
+	u16					pos;		// in the sector data (pB)
+	u16					len;
+	s32					data;		// in ppfData
+} PPF_SPAN;
 
-typedef struct tagPPF_CACHE {
+typedef struct {
 	s32					addr;
-	struct tagPPF_DATA	*pNext;
-} PPF_CACHE;
+	s32					span;		// first span in ppfSpan
+	s32					num;
+} PPF_SECTOR;
+
+// records while loading
+static PPF_RECORD		*ppfRec = NULL;
+static unsigned char	*ppfRecData = NULL;
+static int				iPPFRecNum = 0, iPPFRecMax = 0;
+static int				iPPFRecDataLen = 0, iPPFRecDataMax = 0;
+
+// overlays
+static PPF_SECTOR		*ppfSector = NULL;
+static PPF_SPAN			*ppfSpan = NULL;
+static unsigned char	*ppfData = NULL;
+static s32				*ppfHash = NULL;	// sector index + 1, 0: empty
+static u32				ppfHashMask = 0, ppfHashShift = 0;
+static int				iPPFNum = 0;		// patched sectors
+static s32				ppfMin = 0, ppfMax = -1;
+
+#define PPF_HASH(addr)	(((u32)(addr) * 2654435761u) >> ppfHashShift)
+
+static void FreePPFRecords() {
+	if (ppfRec != NULL) free(ppfRec);
+	if (ppfRecData != NULL) free(ppfRecData);
+	ppfRec = NULL;
+	ppfRecData = NULL;
+	iPPFRecNum = iPPFRecMax = 0;
+	iPPFRecDataLen = iPPFRecDataMax = 0;
+}
 
-static PPF_CACHE		*ppfCache = NULL;
-static PPF_DATA			*ppfHead = NULL, *ppfLast = NULL;
-static int				iPPFNum = 0;
+void FreePPFCache() {
+	FreePPFRecords();
+
+	if (ppfSector != NULL) free(ppfSector);
+	if (ppfSpan != NULL) free(ppfSpan);
+	if (ppfData != NULL) free(ppfData);
+	if (ppfHash != NULL) free(ppfHash);
+	ppfSector = NULL;
+	ppfSpan = NULL;
+	ppfData = NULL;
+	ppfHash = NULL;
+	iPPFNum = 0;
+	ppfMin = 0;
+	ppfMax = -1;
+}
 
-// using a linked data list, and address array
+// by sector, then file order
+static int ComparePPFRecord(const void *a, const void *b) {
+	const PPF_RECORD *ra = (const PPF_RECORD *)a, *rb = (const PPF_RECORD *)b;
+
+	if (ra->addr != rb->addr) return ra->addr < rb->addr ? -1 : 1;
+	return ra->data < rb->data ? -1 : (ra->data > rb->data);
+}
+
+// records -> overlays
 static void FillPPFCache() {
-	PPF_DATA		*p;
-	PPF_CACHE		*pc;
-	s32				lastaddr;
+	unsigned char	sector[CD_FRAMESIZE_RAW], patched[CD_FRAMESIZE_RAW];
+	PPF_SECTOR		*ps;
+	int				i, j, k, n, sectors, spans, bytes, bits;
+	const int		skip = CD_FRAMESIZE_RAW - DATA_SIZE; // sync, before pB
 
-	p = ppfHead;
-	lastaddr = -1;
-	iPPFNum = 0;
+	if (iPPFRecNum == 0) return;
 
-	while (p != NULL) {
-		if (p->addr != lastaddr) iPPFNum++;
-		lastaddr = p->addr;
-		p = p->pNext;
-	}
+	qsort(ppfRec, iPPFRecNum, sizeof(PPF_RECORD), ComparePPFRecord);
 
-	if (iPPFNum <= 0) return;
+	for (i = 1, sectors = 1; i < iPPFRecNum; i++) {
+		if (ppfRec[i].addr != ppfRec[i - 1].addr) sectors++;
+	}
 
-	pc = ppfCache = (PPF_CACHE *)malloc(iPPFNum * sizeof(PPF_CACHE));
+	for (bits = 1; (1 << bits) < sectors * 2; bits++);
 
-	iPPFNum--;
-	p = ppfHead;
-	lastaddr = -1;
+	// merged spans never outnumber the records, nor their bytes
+	ppfSector = (PPF_SECTOR *)malloc(sectors * sizeof(PPF_SECTOR));
+	ppfSpan = (PPF_SPAN *)malloc(iPPFRecNum * sizeof(PPF_SPAN));
+	ppfData = (unsigned char *)malloc(iPPFRecDataLen + 1);
+	ppfHash = (s32 *)calloc(1 << bits, sizeof(s32));
 
-	while (p != NULL) {
-		if (p->addr != lastaddr) {
-			pc->addr = p->addr;
-			pc->pNext = p;
-			pc++;
-		}
-		lastaddr = p->addr;
-		p = p->pNext;
+	if (ppfSector == NULL || ppfSpan == NULL || ppfData == NULL || ppfHash == NULL) {
+		FreePPFCache();
+		return;
 	}
-}
 
-void FreePPFCache() {
-	PPF_DATA *p = ppfHead;
-	void *pn;
+	ppfHashMask = (1 << bits) - 1;
+	ppfHashShift = 32 - bits;
 
-	while (p != NULL) {
-		pn = p->pNext;
-		free(p);
-		p = (PPF_DATA *)pn;
-	}
-	ppfHead = NULL;
-	ppfLast = NULL;
+	spans = bytes = 0;
 
-	if (ppfCache != NULL) free(ppfCache);
-	ppfCache = NULL;
-}
+	for (i = 0; i < iPPFRecNum; i = j) {
+		memset(patched, 0, sizeof(patched));
 
-void CheckPPFCache(unsigned char *pB, unsigned char m, unsigned char s, unsigned char f) {
-	PPF_CACHE *pcstart, *pcend, *pcpos;
-	int addr = MSF2SECT(btoi(m), btoi(s), btoi(f)), pos, anz, start;
+		for (j = i; j < iPPFRecNum && ppfRec[j].addr == ppfRec[i].addr; j++) {
+			memcpy(sector + ppfRec[j].pos, ppfRecData + ppfRec[j].data, ppfRec[j].anz);
+			memset(patched + ppfRec[j].pos, 1, ppfRec[j].anz);
+		}
 
-	if (ppfCache == NULL) return;
+		ps = &ppfSector[iPPFNum];
+		ps->addr = ppfRec[i].addr;
+		ps->span = spans;
+		ps->num = 0;
 
-	pcstart = ppfCache;
-	if (addr < pcstart->addr) return;
-	pcend = ppfCache + iPPFNum;
-	if (addr > pcend->addr) return;
+		for (k = skip; k < CD_FRAMESIZE_RAW; k = n) {
+			if (!patched[k]) {
+				n = k + 1;
+				continue;
+			}
 
-	while (1) {
-		if (addr == pcend->addr) { pcpos = pcend; break; }
+			for (n = k; n < CD_FRAMESIZE_RAW && patched[n]; n++);
 
-		pcpos = pcstart + (pcend - pcstart) / 2;
-		if (pcpos == pcstart) break;
-		if (addr < pcpos->addr) {
-			pcend = pcpos;
-			continue;
-		}
-		if (addr > pcpos->addr) {
-			pcstart = pcpos;
-			continue;
+			ppfSpan[spans].pos = k - skip;
+			ppfSpan[spans].len = n - k;
+			ppfSpan[spans].data = bytes;
+			memcpy(ppfData + bytes, sector + k, n - k);
+
+			bytes += n - k;
+			spans++;
+			ps->num++;
 		}
-		break;
+
+		if (ps->num == 0) continue; // only the sync got patched
+
+		for (k = PPF_HASH(ps->addr); ppfHash[k] != 0; k = (k + 1) & ppfHashMask);
+		ppfHash[k] = iPPFNum + 1;
+
+		iPPFNum++;
 	}
 
-	if (addr == pcpos->addr) {
-		PPF_DATA *p = pcpos->pNext;
-		while (p != NULL && p->addr == addr) {
-			pos = p->pos - (CD_FRAMESIZE_RAW - DATA_SIZE);
-			anz = p->anz;
-			if (pos < 0) { start = -pos; pos = 0; anz -= start; }
-			else start = 0;
-			memcpy(pB + pos, (unsigned char *)(p + 1) + start, anz);
-			p = p->pNext;
+	if (iPPFNum > 0) {
+		ppfMin = ppfSector[0].addr;
+		ppfMax = ppfSector[iPPFNum - 1].addr;
+	}
+
+	FreePPFRecords();
+}
+
+void CheckPPFCache(unsigned char *pB, unsigned char m, unsigned char s, unsigned char f) {
+	int addr = MSF2SECT(btoi(m), btoi(s), btoi(f)), i;
+	PPF_SECTOR *ps;
+	PPF_SPAN *sp;
+	u32 h;
+
+	if (addr < ppfMin || addr > ppfMax) return;
+
+	for (h = PPF_HASH(addr); ppfHash[h] != 0; h = (h + 1) & ppfHashMask) {
+		ps = &ppfSector[ppfHash[h] - 1];
+		if (ps->addr != addr) continue;
+
+		for (i = 0, sp = &ppfSpan[ps->span]; i < ps->num; i++, sp++) {
+			memcpy(pB + sp->pos, ppfData + sp->data, sp->len);
 		}
+		return;
 	}
 }
 
 static void AddToPPF(s32 ladr, s32 pos, s32 anz, unsigned char *ppfmem) {
-	if (ppfHead == NULL) {
-		ppfHead = (PPF_DATA *)malloc(sizeof(PPF_DATA) + anz);
-		ppfHead->addr = ladr;
-		ppfHead->pNext = NULL;
-		ppfHead->pos = pos;
-		ppfHead->anz = anz;
-		memcpy(ppfHead + 1, ppfmem, anz);
-		iPPFNum = 1;
-		ppfLast = ppfHead;
-	} else {
-		PPF_DATA *p = ppfHead;
-		PPF_DATA *plast = NULL;
-		PPF_DATA *padd;
-
-		if (ladr > ppfLast->addr || (ladr == ppfLast->addr && pos > ppfLast->pos)) {
-			p = NULL;
-			plast = ppfLast;
-		} else {
-			while (p != NULL) {
-				if (ladr < p->addr) break;
-				if (ladr == p->addr) {
-					while (p && ladr == p->addr && pos > p->pos) {
-						plast = p;
-						p = p->pNext;
-					}
-					break;
-				}
-				plast = p;
-				p = p->pNext;
-			}
-		}
+	if (anz <= 0) return;
 
-		padd = (PPF_DATA *)malloc(sizeof(PPF_DATA) + anz);
-		padd->addr = ladr;
-		padd->pNext = p;
-		padd->pos = pos;
-		padd->anz = anz;
-		memcpy(padd + 1, ppfmem, anz);
-		iPPFNum++;
-		if (plast == NULL) ppfHead = padd;
-		else plast->pNext = padd;
+	if (iPPFRecNum == iPPFRecMax) {
+		int max = iPPFRecMax ? iPPFRecMax * 2 : 256;
+		PPF_RECORD *rec = (PPF_RECORD *)realloc(ppfRec, max * sizeof(PPF_RECORD));
 
-		if (padd->pNext == NULL) ppfLast = padd;
+		if (rec == NULL) return;
+		ppfRec = rec;
+		iPPFRecMax = max;
 	}
+
+	if (iPPFRecDataLen + anz > iPPFRecDataMax) {
+		int max = iPPFRecDataMax ? iPPFRecDataMax * 2 : 0x10000;
+		unsigned char *data = (unsigned char *)realloc(ppfRecData, max);
+
+		if (data == NULL) return;
+		ppfRecData = data;
+		iPPFRecDataMax = max;
+	}
+
+	ppfRec[iPPFRecNum].addr = ladr;
+	ppfRec[iPPFRecNum].pos = pos;
+	ppfRec[iPPFRecNum].anz = anz;
+	ppfRec[iPPFRecNum].data = iPPFRecDataLen;
+	memcpy(ppfRecData + iPPFRecDataLen, ppfmem, anz);
+
+	iPPFRecNum++;
+	iPPFRecDataLen += anz;
 }
 
 void BuildPPFCache() {
@@ -329,7 +382,7 @@ void BuildPPFCache() {
 
 	fclose(ppffile);
 
-	FillPPFCache(); // build address array
+	FillPPFCache(); // build the sector overlays
 
 	SysPrintf(_("Loaded PPF %d.0 patch: %s.\n"), method + 1, szPPF);
 }
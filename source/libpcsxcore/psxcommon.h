@@ -155,6 +155,9 @@ typedef struct {
 	boolean VSyncWA;
 	boolean Widescreen;
 	u8 Cpu; // CPU_DYNAREC or CPU_INTERPRETER
+	u8 CdSpeed; // CDR_SPEED_*, seeks and data reads
+	u8 CdCache; // compressed images: inflated blocks kept, 4 MB << CdCache
+	u8 CdPreload; // CDR_PRELOAD_*, image copied to RAM (slow usb sticks)
 	u8 PsxType; // PSX_TYPE_NTSC or PSX_TYPE_PAL
 #ifdef _WIN32
 	char Lang[256];
@@ -185,6 +188,14 @@ enum {
 	CPU_INTERPRETER
 }; // CPU Types
 
+enum {
+	CDR_SPEED_NORMAL = 0,
+	CDR_SPEED_2X,
+	CDR_SPEED_4X,
+	CDR_SPEED_8X,
+	CDR_SPEED_INSTANT
+}; // Cd Speeds
+
 int EmuInit();
 void EmuReset();
 void EmuShutdown();
@@ -0,0 +1,635 @@
+/*
+ * disc ids for the file browser, see discinfo.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "psxcommon.h"
+#include "cdrom.h"
+#include "cdriso.h"
+#include "misc.h"
+#include "discinfo.h"
+#include "../plugins/cdrcimg/cdz.h"
+
+#ifdef LIBXENON
+#include <xenon_soc/xenon_power.h>
+#define lwsync() __asm__ __volatile__ ("lwsync" : : : "memory")
+#else
+#define lwsync()
+#endif
+
+extern void sec2msf(unsigned int s, char *msf);
+
+#define MAX_DIR_SECTORS 4 // of the root directory, psx discs need one
+
+/*
+ * image reader: user data of a sector by lba, enough to find SYSTEM.CNF
+ */
+
+typedef struct {
+    FILE *f;
+    unsigned int sectorSize; // 2048, 2352, 2448, 0: cdz
+
+    // cdz
+    unsigned int hunkSectors;
+    unsigned int sectors;
+    unsigned int indexOffset;
+    int hunk; // in buf, -1: none
+    unsigned char *buf;
+    unsigned char *in;
+} image_t;
+
+static unsigned int get_le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static void CloseImage(image_t *img) {
+    if (img->f != NULL) fclose(img->f);
+    free(img->buf);
+    free(img->in);
+    memset(img, 0, sizeof(*img));
+}
+
+// cdriso.c parses its tocs with strtok, one worker at a time
+static volatile int tocLock;
+
+static int OpenImage(const char *file, image_t *img, DiscInfo *info) {
+    unsigned char hdr[CDZ_HEADER_SIZE];
+    unsigned char track[CDZ_TRACK_SIZE];
+    CdrIsoLayout layout;
+    unsigned int tracks, i;
+    int ret;
+
+    memset(img, 0, sizeof(*img));
+    img->hunk = -1;
+
+    img->f = fopen(file, "rb");
+    if (img->f == NULL) return -1;
+
+    if (fread(hdr, 1, sizeof(hdr), img->f) != sizeof(hdr)) return -1;
+
+    // cdrcimg .Z: the index is in a separate .table, not worth it here
+    if (hdr[0] == 0x78 && hdr[1] == 0xda) return -1;
+
+    if (memcmp(hdr, CDZ_MAGIC, 4) == 0) {
+        img->hunkSectors = get_le32(hdr + 4);
+        img->sectors = get_le32(hdr + 8);
+        tracks = get_le32(hdr + 16);
+
+        if (img->hunkSectors < 1 || img->hunkSectors > CDZ_MAX_HUNK_SECTORS || tracks > CDR_ISO_MAXTRACKS)
+            return -1;
+
+        for (i = 1; i <= tracks; i++) {
+            if (fread(track, 1, sizeof(track), img->f) != sizeof(track)) return -1;
+
+            info->trackType[i] = track[0] == CDZ_TRACK_AUDIO ? CDR_ISO_CDDA : CDR_ISO_DATA;
+            sec2msf(get_le32(track + 4) + 2 * 75, (char *) info->trackStart[i]);
+        }
+        info->numTracks = tracks;
+
+        img->indexOffset = CDZ_HEADER_SIZE + tracks * CDZ_TRACK_SIZE;
+        img->buf = malloc(CDZ_MAX_HUNK_SECTORS * CDZ_SECTOR_SIZE);
+        img->in = malloc(CDZ_MAX_HUNK_SECTORS * (CDZ_SECTOR_SIZE + 1));
+
+        return img->buf != NULL && img->in != NULL ? 0 : -1;
+    }
+
+    while (__sync_lock_test_and_set(&tocLock, 1));
+    ret = cdrIsoReadLayout(file, &layout);
+    __sync_lock_release(&tocLock);
+
+    if (ret != 0) return -1;
+
+    img->sectorSize = layout.sectorSize;
+
+    info->numTracks = layout.numTracks;
+    memcpy(info->trackType, layout.trackType, sizeof(info->trackType));
+    memcpy(info->trackStart, layout.trackStart, sizeof(info->trackStart));
+
+    return 0;
+}
+
+static int ReadHunk(image_t *img, unsigned int hunk) {
+    unsigned char entry[CDZ_INDEX_SIZE];
+    unsigned int offset, size, sectors;
+
+    if ((int) hunk == img->hunk) return 0;
+    img->hunk = -1;
+
+    if (fseek(img->f, img->indexOffset + hunk * CDZ_INDEX_SIZE, SEEK_SET) != 0 ||
+            fread(entry, 1, sizeof(entry), img->f) != sizeof(entry))
+        return -1;
+
+    offset = get_le32(entry);
+    size = get_le32(entry + 4);
+
+    sectors = img->sectors - hunk * img->hunkSectors;
+    if (sectors > img->hunkSectors) sectors = img->hunkSectors;
+
+    if ((size & 0xffffff) > CDZ_MAX_HUNK_SECTORS * (CDZ_SECTOR_SIZE + 1)) return -1;
+
+    if (fseek(img->f, offset, SEEK_SET) != 0 ||
+            fread(img->in, 1, size & 0xffffff, img->f) != (size & 0xffffff))
+        return -1;
+
+    if (cdz_decode_hunk(img->in, size & 0xffffff, size >> 24, hunk * img->hunkSectors, sectors, img->buf) != 0)
+        return -1;
+
+    img->hunk = hunk;
+    return 0;
+}
+
+// 2048 bytes of user data of sector lba (form 1)
+static int ReadSector(image_t *img, unsigned int lba, unsigned char *data) {
+    unsigned char raw[CD_FRAMESIZE_RAW];
+    const unsigned char *sector = raw;
+
+    if (img->sectorSize == 0) {
+        if (lba >= img->sectors || ReadHunk(img, lba / img->hunkSectors) != 0) return -1;
+        sector = img->buf + (lba % img->hunkSectors) * CDZ_SECTOR_SIZE;
+    } else if (img->sectorSize == 2048) {
+        if (fseek(img->f, lba * 2048, SEEK_SET) != 0) return -1;
+        return fread(data, 1, 2048, img->f) == 2048 ? 0 : -1;
+    } else {
+        if (fseek(img->f, lba * img->sectorSize, SEEK_SET) != 0 ||
+                fread(raw, 1, sizeof(raw), img->f) != sizeof(raw))
+            return -1;
+    }
+
+    // mode 2 has the subheader in front of the data
+    memcpy(data, sector + (sector[15] == 2 ? 24 : 16), 2048);
+    return 0;
+}
+
+// name like "SYSTEM.CNF;1", no case
+static int NameIs(const unsigned char *rec, const char *name) {
+    int len = strlen(name), i;
+
+    if (rec[32] < len) return 0;
+
+    for (i = 0; i < len; i++) {
+        if (toupper(rec[33 + i]) != toupper((unsigned char) name[i])) return 0;
+    }
+
+    return 1;
+}
+
+// file in the directory at lba: its extent and size
+static int FindFile(image_t *img, unsigned int lba, unsigned int size, const char *name,
+        unsigned int *extent, unsigned int *fsize) {
+    unsigned char dir[2048];
+    const unsigned char *rec;
+    unsigned int n, i;
+
+    for (n = 0; n < (size + 2047) / 2048 && n < MAX_DIR_SECTORS; n++) {
+        if (ReadSector(img, lba + n, dir) != 0) return -1;
+
+        for (i = 0; i + 33 < sizeof(dir) && dir[i] != 0; i += rec[0]) {
+            rec = dir + i;
+            if (rec[0] < 34 || i + rec[0] > sizeof(dir)) break;
+
+            if (!(rec[25] & 2) && NameIs(rec, name)) {
+                *extent = get_le32(rec + 2);
+                *fsize = get_le32(rec + 10);
+                return 0;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// same as CheckCdrom, without the emu
+static int Identify(image_t *img, DiscInfo *info) {
+    unsigned char pvd[2048], cnf[2048 + 1];
+    char exename[256], *p;
+    unsigned int root, rootSize, extent, size;
+    int i;
+
+    if (ReadSector(img, 16, pvd) != 0 || memcmp(pvd + 1, "CD001", 5) != 0) return -1;
+
+    info->hash = crc32(0, pvd, sizeof(pvd));
+
+    root = get_le32(pvd + 156 + 2);
+    rootSize = get_le32(pvd + 156 + 10);
+
+    if (FindFile(img, root, rootSize, "SYSTEM.CNF;1", &extent, &size) == 0) {
+        if (ReadSector(img, extent, cnf) != 0) return -1;
+        if (size > 2048) size = 2048;
+        cnf[size] = '\0';
+
+        info->hash = crc32(info->hash, cnf, size);
+
+        p = strstr((char *) cnf, "cdrom:");
+        if (p == NULL) return -1;
+        for (p += 6; *p == '\\' || *p == '/'; p++);
+
+        for (i = 0; i < (int) sizeof(exename) - 1 && p[i] != '\0' && !isspace((unsigned char) p[i]); i++)
+            exename[i] = p[i];
+        exename[i] = '\0';
+
+        CdromIdFromExe(exename, info->id);
+    } else if (FindFile(img, root, rootSize, "PSX.EXE;1", &extent, &size) == 0) {
+        strcpy(info->id, "SLUS99999");
+    } else {
+        return -1;
+    }
+
+    if (info->id[0] == '\0') return -1;
+
+    info->region = CdromIdRegion(info->id);
+
+    memcpy(info->label, pvd + 40, 32);
+    info->label[32] = '\0';
+    for (i = 0; i < 32; i++) {
+        if ((unsigned char) info->label[i] < ' ' && info->label[i] != '\0') info->label[i] = ' ';
+    }
+    trim(info->label);
+    if (info->label[0] == '\0') strcpy(info->label, info->id);
+
+    return 0;
+}
+
+int DiscInfoRead(const char *file, DiscInfo *info) {
+    image_t img;
+    int ret;
+
+    memset(info, 0, sizeof(*info));
+
+    ret = OpenImage(file, &img, info);
+    if (ret == 0) ret = Identify(&img, info);
+    CloseImage(&img);
+
+    if (ret != 0) {
+        info->id[0] = '\0';
+        info->label[0] = '\0';
+    }
+
+    return ret;
+}
+
+/*
+ * cache, sorted by path
+ */
+
+typedef struct {
+    char *file;
+    unsigned long long size;
+    long mtime;
+    DiscInfo info;
+} entry_t;
+
+static entry_t *cache;
+static int cacheCount, cacheMax;
+static int cacheDirty;
+static char cacheFile[MAXPATHLEN];
+
+// index of file, or where it goes as ~index
+static int CacheFind(const char *file) {
+    int lo = 0, hi = cacheCount - 1, mid, c;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        c = strcmp(file, cache[mid].file);
+        if (c == 0) return mid;
+        if (c < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+
+    return ~lo;
+}
+
+static void CacheAdd(const char *file, unsigned long long size, long mtime, const DiscInfo *info) {
+    entry_t *e;
+    int i = CacheFind(file);
+
+    if (i < 0) {
+        if (cacheCount == cacheMax) {
+            int max = cacheMax ? cacheMax * 2 : 64;
+
+            e = realloc(cache, max * sizeof(entry_t));
+            if (e == NULL) return;
+            cache = e;
+            cacheMax = max;
+        }
+
+        i = ~i;
+        memmove(&cache[i + 1], &cache[i], (cacheCount - i) * sizeof(entry_t));
+        cacheCount++;
+
+        cache[i].file = strdup(file);
+    }
+
+    cache[i].size = size;
+    cache[i].mtime = mtime;
+    cache[i].info = *info;
+    cacheDirty = 1;
+}
+
+static int Stat(const char *file, unsigned long long *size, long *mtime) {
+    struct stat st;
+
+    if (stat(file, &st) != 0 || S_ISDIR(st.st_mode)) return -1;
+
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 0;
+}
+
+const DiscInfo *DiscInfoGet(const char *file) {
+    unsigned long long size;
+    long mtime;
+    int i = CacheFind(file);
+
+    if (i < 0 || Stat(file, &size, &mtime) != 0) return NULL;
+    if (cache[i].size != size || cache[i].mtime != mtime) return NULL;
+
+    return &cache[i].info;
+}
+
+// next tab separated field of the line
+static char *Field(char **line) {
+    char *f = *line, *tab;
+
+    if (f == NULL) return "";
+
+    tab = strchr(f, '\t');
+    if (tab != NULL) *tab++ = '\0';
+    *line = tab;
+
+    return f;
+}
+
+/*
+ * One image per line:
+ * size, mtime, id or "-", region, hash, tracks, label, path
+ * with the tracks as type (D/A) and start mmssff each, like D000200A283000
+ */
+void DiscInfoLoad(const char *file) {
+    char line[MAXPATHLEN + 1024], *l, *path, *label, *tracks, *id;
+    unsigned long long size;
+    long mtime;
+    unsigned int region, hash, m, s, f;
+    DiscInfo info;
+    FILE *fp;
+    int n;
+
+    strncpy(cacheFile, file, sizeof(cacheFile) - 1);
+
+    fp = fopen(file, "r");
+    if (fp == NULL) return;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        l = line;
+
+        size = strtoull(Field(&l), NULL, 10);
+        mtime = strtol(Field(&l), NULL, 10);
+        id = Field(&l);
+        region = strtoul(Field(&l), NULL, 10);
+        hash = strtoul(Field(&l), NULL, 16);
+        tracks = Field(&l);
+        label = Field(&l);
+        path = Field(&l);
+
+        if (path[0] == '\0') continue;
+
+        memset(&info, 0, sizeof(info));
+        if (strcmp(id, "-") != 0) strncpy(info.id, id, sizeof(info.id) - 1);
+        strncpy(info.label, label, sizeof(info.label) - 1);
+        info.region = region;
+        info.hash = hash;
+
+        for (n = 1; n <= CDR_ISO_MAXTRACKS && strlen(tracks) >= 7; n++, tracks += 7) {
+            if (sscanf(tracks + 1, "%2u%2u%2u", &m, &s, &f) != 3) break;
+
+            info.trackType[n] = tracks[0] == 'A' ? CDR_ISO_CDDA : CDR_ISO_DATA;
+            info.trackStart[n][0] = m;
+            info.trackStart[n][1] = s;
+            info.trackStart[n][2] = f;
+        }
+        info.numTracks = n - 1;
+
+        CacheAdd(path, size, mtime, &info);
+    }
+
+    fclose(fp);
+    cacheDirty = 0;
+}
+
+int DiscInfoSave(void) {
+    const DiscInfo *info;
+    FILE *fp;
+    int i, n;
+
+    if (!cacheDirty || cacheFile[0] == '\0') return 0;
+
+    fp = fopen(cacheFile, "w");
+    if (fp == NULL) return -1;
+
+    for (i = 0; i < cacheCount; i++) {
+        info = &cache[i].info;
+
+        fprintf(fp, "%llu\t%ld\t%s\t%u\t%08x\t", cache[i].size, cache[i].mtime,
+            info->id[0] ? info->id : "-", info->region, info->hash);
+
+        for (n = 1; n <= info->numTracks; n++) {
+            fprintf(fp, "%c%02u%02u%02u", info->trackType[n] == CDR_ISO_CDDA ? 'A' : 'D',
+                info->trackStart[n][0], info->trackStart[n][1], info->trackStart[n][2]);
+        }
+
+        fprintf(fp, "\t%s\t%s\n", info->label, cache[i].file);
+    }
+
+    fclose(fp);
+    cacheDirty = 0;
+
+    return 0;
+}
+
+/*
+ * background scan: the workers take the next job until none is left, the
+ * gui thread merges what they read into the cache
+ */
+
+enum {
+    JOB_WAITING,
+    JOB_DONE,
+    JOB_MERGED,
+};
+
+typedef struct {
+    char *file;
+    int index; // in the files of DiscInfoScan
+    unsigned long long size;
+    long mtime;
+    volatile int state;
+    DiscInfo info;
+} job_t;
+
+static job_t *jobs;
+static int numJobs, numMerged;
+static volatile int nextJob;
+static volatile int scanStop;
+static volatile int scanEnded;
+static int scanWorkers;
+
+#ifdef LIBXENON
+// image read ahead, xa decode, sound output: free until a game starts,
+// taken by its workers while it is paused in the menu, then skipped
+#define SCAN_THREADS 3
+static const int scanThread[SCAN_THREADS] = {5, 1, 3};
+static int scanUsed[SCAN_THREADS];
+static unsigned char scanStack[SCAN_THREADS][0x10000] __attribute__ ((aligned (128)));
+#endif
+
+static void ScanJobs(void) {
+    job_t *job;
+    int n;
+
+    while (!scanStop && (n = __sync_fetch_and_add(&nextJob, 1)) < numJobs) {
+        job = &jobs[n];
+
+        DiscInfoRead(job->file, &job->info);
+
+        lwsync();
+        job->state = JOB_DONE;
+    }
+}
+
+static void ScanThread(void) {
+    ScanJobs();
+
+    lwsync();
+    __sync_fetch_and_add(&scanEnded, 1);
+}
+
+static int ScanMerge(void (*done)(int index, const DiscInfo *info)) {
+    int i, n = 0;
+
+    for (i = 0; i < numJobs; i++) {
+        if (jobs[i].state != JOB_DONE) continue;
+
+        lwsync();
+        CacheAdd(jobs[i].file, jobs[i].size, jobs[i].mtime, &jobs[i].info);
+        if (done != NULL)
+            done(jobs[i].index, &jobs[i].info);
+        jobs[i].state = JOB_MERGED;
+        numMerged++;
+        n++;
+    }
+
+    return n;
+}
+
+static void ScanEnd(void) {
+    int i;
+
+    while (scanEnded < scanWorkers)
+        usleep(100);
+
+#ifdef LIBXENON
+    // the emu workers only start on a free hw thread: wait until the
+    // tasks are off them, not just done with the jobs
+    for (i = 0; i < SCAN_THREADS; i++) {
+        if (!scanUsed[i]) continue;
+
+        while (xenon_is_thread_task_running(scanThread[i]))
+            usleep(100);
+        scanUsed[i] = 0;
+    }
+#endif
+
+    ScanMerge(NULL);
+    DiscInfoSave();
+
+    for (i = 0; i < numJobs; i++)
+        free(jobs[i].file);
+    free(jobs);
+
+    jobs = NULL;
+    numJobs = numMerged = 0;
+    scanWorkers = 0;
+}
+
+void DiscInfoScan(char **files, int count) {
+    int i;
+
+    DiscInfoStop();
+
+    jobs = malloc(count * sizeof(job_t));
+    if (jobs == NULL) return;
+
+    for (i = 0; i < count; i++) {
+        job_t *job = &jobs[numJobs];
+
+        if (DiscInfoGet(files[i]) != NULL || Stat(files[i], &job->size, &job->mtime) != 0) continue;
+
+        job->file = strdup(files[i]);
+        if (job->file == NULL) continue;
+
+        job->index = i;
+        job->state = JOB_WAITING;
+        numJobs++;
+    }
+
+    if (numJobs == 0) {
+        free(jobs);
+        jobs = NULL;
+        return;
+    }
+
+    cdz_eccedc_init(); // before the workers decode cdz hunks
+
+    nextJob = 0;
+    scanStop = 0;
+    scanEnded = 0;
+    scanWorkers = 0;
+    lwsync();
+
+#ifdef LIBXENON
+    for (i = 0; i < SCAN_THREADS && scanWorkers < numJobs; i++) {
+        if (xenon_is_thread_task_running(scanThread[i])) continue;
+
+        scanWorkers++;
+        scanUsed[i] = 1;
+        xenon_run_thread_task(scanThread[i], &scanStack[i][sizeof(scanStack[i]) - 0x100], ScanThread);
+    }
+#endif
+}
+
+int DiscInfoPoll(void (*done)(int index, const DiscInfo *info)) {
+    job_t *job;
+    int n;
+
+    if (jobs == NULL) return 0;
+
+    // no spare thread: one image per frame
+    if (scanWorkers == 0 && nextJob < numJobs) {
+        job = &jobs[nextJob++];
+        DiscInfoRead(job->file, &job->info);
+        job->state = JOB_DONE;
+    }
+
+    n = ScanMerge(done);
+
+    if (numMerged == numJobs) ScanEnd();
+
+    return n;
+}
+
+void DiscInfoStop(void) {
+    if (jobs == NULL) return;
+
+    scanStop = 1;
+    lwsync();
+
+    ScanEnd();
+}
@@ -0,0 +1,48 @@
+#ifndef DISCINFO_H
+#define DISCINFO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cdriso.h"
+
+/*
+ * What the file browser shows of a disc image: game id, region, volume
+ * label and tracks. Read once from the image (like CheckCdrom does), then
+ * kept in a cache file by path, size and mtime. Images missing from the
+ * cache get read in the background by a few workers on spare hw threads.
+ */
+
+typedef struct {
+    char id[10]; // like CdromId, "" if it is no psx disc
+    char label[33]; // volume label
+    unsigned char region; // PSX_TYPE_*
+    unsigned char numTracks;
+    unsigned char trackType[CDR_ISO_MAXTRACKS + 1]; // CDR_ISO_*
+    unsigned char trackStart[CDR_ISO_MAXTRACKS + 1][3]; // msf
+    unsigned int hash; // crc32 of the volume descriptor and SYSTEM.CNF
+} DiscInfo;
+
+// read one image right away, 0 if it is a psx disc
+int DiscInfoRead(const char *file, DiscInfo *info);
+
+void DiscInfoLoad(const char *cacheFile);
+int DiscInfoSave(void);
+
+// cached info of file, NULL if not read yet or changed since
+const DiscInfo *DiscInfoGet(const char *file);
+
+// read the files which aren't cached in the background
+void DiscInfoScan(char **files, int count);
+// (gui thread) take what the workers read, done gets each image with its
+// index in the files of DiscInfoScan. Returns how many
+int DiscInfoPoll(void (*done)(int index, const DiscInfo *info));
+// wait for the workers, the emu needs the hw threads
+void DiscInfoStop(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -57,6 +57,8 @@ extern "C" {
 	long CDRCIMGopen(void);
 
 	void cdrcimg_set_fname(const char *fname);
+	void cdrcimg_set_cache_size(unsigned int kb);
+	void cdrcimg_set_preload(int mode);
 
 	/* PAD */
 	//typedef long (* PADopen)(unsigned long *);
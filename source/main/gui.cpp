@@ -55,6 +55,8 @@
 #include "debug.h"
 #include "sio.h"
 #include "misc.h"
+#include "cdriso.h"
+#include "discinfo.h"
 #include "gamecube_plugins.h"
 
 #include "gui.h"
@@ -431,6 +433,10 @@ static void ProgressUpdateCallback(void * e) {
 void SetIso(const char * fname) {
     SetIsoFile(NULL);
 
+    cdrIsoSetPreload(Config.CdPreload);
+    cdrcimg_set_preload(Config.CdPreload);
+    cdrcimg_set_cache_size(4096 << Config.CdCache);
+
     FILE *fd = fopen(fname, "rb");
     if (fd == NULL) {
         printf("Error loading %s\r\n", fname);
@@ -440,7 +446,7 @@ void SetIso(const char * fname) {
     int n = fread(header, 0x10, 1, fd);
 
     if(n){
-        if (header[0] == 0x78 && header[1] == 0xDA) {
+        if ((header[0] == 0x78 && header[1] == 0xDA) || memcmp(header, "CDZ1", 4) == 0) {
             printf("Use CDRCIMG for  %s\r\n", fname);
             strcpy(Config.Cdr, "CDRCIMG");
             cdrcimg_set_fname(fname);
@@ -461,6 +467,9 @@ void CleanupPath(char * path);
 static int pcsxr_run(void) {
     char cdfile[2048];
 
+    // the emu needs the hw threads of the scan
+    DiscInfoStop();
+
     sprintf(foldername, "%s/", browser.dir);
     makeRomName(browserList[browser.selIndex].filename, ROMFilename);
     sprintf(cdfile, "%s/%s/%s", rootdir, browser.dir, browserList[browser.selIndex].filename);
@@ -516,6 +525,71 @@ static int pcsxr_run(void) {
     return -1;
 }
 
+/****************************************************************************
+ * BrowserDiscInfo
+ *
+ * Shows the game id next to the images of browserList which are in the
+ * disc info cache, the others get read in the background. BrowserScanDone
+ * shows them as DiscInfoPoll hands them over.
+ ***************************************************************************/
+static int *scanEntry = NULL; // browserList index of the files of the scan
+
+static void BrowserShowId(int i, const DiscInfo *info) {
+    if (info->id[0] != '\0')
+        snprintf(browserList[i].displayname, MAXDISPLAY + 1, "%s [%s]", browserList[i].filename, info->id);
+}
+
+static void BrowserScanDone(int n, const DiscInfo *info) {
+    BrowserShowId(scanEntry[n], info);
+}
+
+static void BrowserDiscInfo() {
+    static bool loaded = false;
+    char path[2048];
+    char **files;
+    int count = 0, i;
+    const DiscInfo *info;
+
+    if (!loaded) {
+        createFilePath(path, "pcsxr/discinfo.txt");
+        DiscInfoLoad(path);
+        loaded = true;
+    }
+
+    // the last scan ends here, nothing of it gets to BrowserScanDone
+    DiscInfoStop();
+
+    free(scanEntry);
+    scanEntry = (int *) malloc(browser.numEntries * sizeof (int));
+    files = (char **) malloc(browser.numEntries * sizeof (char *));
+    if (scanEntry == NULL || files == NULL) {
+        free(files);
+        return;
+    }
+
+    for (i = 0; i < browser.numEntries; i++) {
+        if (browserList[i].isdir)
+            continue;
+
+        sprintf(path, "%s/%s/%s", rootdir, browser.dir, browserList[i].filename);
+        CleanupPath(path);
+
+        info = DiscInfoGet(path);
+        if (info != NULL)
+            BrowserShowId(i, info);
+        else {
+            files[count] = strdup(path);
+            if (files[count] != NULL)
+                scanEntry[count++] = i;
+        }
+    }
+
+    DiscInfoScan(files, count);
+    for (i = 0; i < count; i++)
+        free(files[i]);
+    free(files);
+}
+
 /****************************************************************************
  * MenuBrowseDevice
  ***************************************************************************/
@@ -539,6 +613,7 @@ static int MenuBrowseDevice() {
         else
             return MENU_SETTINGS;
     }
+    BrowserDiscInfo();
 
     int menu = MENU_NONE;
 
@@ -583,6 +658,10 @@ static int MenuBrowseDevice() {
     while (menu == MENU_NONE) {
         TH_UGUI();
         usleep(THREAD_SLEEP);
+
+        if (DiscInfoPoll(BrowserScanDone) > 0)
+            fileBrowser.TriggerUpdate();
+
         // update file browser based on arrow xenon_buttons
         // set MENU_EXIT if A xenon_button pressed on a file
         for (i = 0; i < FILE_PAGESIZE; i++) {
@@ -591,6 +670,7 @@ static int MenuBrowseDevice() {
                 // check corresponding browser entry
                 if (browserList[browser.selIndex].isdir) {
                     if (BrowserChangeFolder()) {
+                        BrowserDiscInfo();
                         fileBrowser.ResetState();
                         fileBrowser.fileList[0]->SetState(STATE_SELECTED);
                         fileBrowser.TriggerUpdate();
@@ -612,6 +692,8 @@ static int MenuBrowseDevice() {
         if (backBtn.GetState() == STATE_CLICKED)
             menu = MENU_SETTINGS;
     }
+    DiscInfoStop();
+
     HaltGui();
     mainWindow->Remove(&titleTxt);
     mainWindow->Remove(&xenon_buttonWindow);
@@ -901,6 +983,9 @@ static int MenuConfig() {
     sprintf(options.name[i++], "Parasite Eve 2, Vandal Hearts 1/2 Fix");
     //    sprintf(options.name[i++], "Use network");
     sprintf(options.name[i++], "InuYasha Sengoku Battle Fix");
+    sprintf(options.name[i++], "Cd Speed");
+    sprintf(options.name[i++], "Compressed Image Cache");
+    sprintf(options.name[i++], "Preload Image");
     options.length = i;
 
     for (i = 0; i < options.length; i++)
@@ -1026,6 +1111,21 @@ static int MenuConfig() {
                 if (Config.VSyncWA > 1)
                     Config.VSyncWA = 0;
                 break;
+            case 11:
+                Config.CdSpeed++;
+                if (Config.CdSpeed > CDR_SPEED_INSTANT)
+                    Config.CdSpeed = 0;
+                break;
+            case 12:
+                Config.CdCache++;
+                if (Config.CdCache > 3)
+                    Config.CdCache = 0;
+                break;
+            case 13:
+                Config.CdPreload++;
+                if (Config.CdPreload > CDR_PRELOAD_ALL)
+                    Config.CdPreload = CDR_PRELOAD_OFF;
+                break;
         }
 
         if (ret >= 0 || firstRun) {
@@ -1069,6 +1169,23 @@ static int MenuConfig() {
 //            enabled_disabled(Config.UseNet);
             enabled_disabled(Config.VSyncWA);
 
+            j++;
+            if (Config.CdSpeed == CDR_SPEED_INSTANT)
+                sprintf(options.value[j], "Instant");
+            else
+                sprintf(options.value[j], "%dx", 1 << Config.CdSpeed);
+
+            j++;
+            sprintf(options.value[j], "%d MB", 4 << Config.CdCache);
+
+            j++;
+            if (Config.CdPreload == CDR_PRELOAD_DATA)
+                sprintf(options.value[j], "Data Track");
+            else if (Config.CdPreload == CDR_PRELOAD_ALL)
+                sprintf(options.value[j], "Whole Image");
+            else
+                sprintf(options.value[j], "Disabled");
+
             optionBrowser.TriggerUpdate();
         }
 
@@ -1105,6 +1222,7 @@ static int MenuConfigSPU() {
     sprintf(options.name[i++], "XA playing");
     sprintf(options.name[i++], "Change XA Speed");
     sprintf(options.name[i++], "IRQ Wait");
+    sprintf(options.name[i++], "SPU Log");
     options.length = i;
 
     for (i = 0; i < options.length; i++)
@@ -1170,6 +1288,11 @@ static int MenuConfigSPU() {
                 if (SpuConfig.irq_wait > 1)
                     SpuConfig.irq_wait = 0;
                 break;
+            case 3:
+                SpuConfig.spu_log++;
+                if (SpuConfig.spu_log > 1)
+                    SpuConfig.spu_log = 0;
+                break;
         }
 
         if (ret >= 0 || firstRun) {
@@ -1190,6 +1313,11 @@ static int MenuConfigSPU() {
             else
                 sprintf(options.value[2], "Disabled");
 
+            if (SpuConfig.spu_log)
+                sprintf(options.value[3], "Enabled");
+            else
+                sprintf(options.value[3], "Disabled");
+
 
             optionBrowser.TriggerUpdate();
         }
@@ -1927,6 +2055,7 @@ int main() {
     SpuConfig.change_xa_speed = 1;
     SpuConfig.enable_xa = 1;
     SpuConfig.irq_wait = 1;
+    SpuConfig.spu_log = 0;
 
     HwGpuConfig.fps_limit = 1;
     HwGpuConfig.gte_accuracy = 1;
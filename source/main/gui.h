@@ -22,6 +22,7 @@ extern "C" {
         int enable_xa;
         int change_xa_speed;
         int irq_wait;
+        int spu_log; // spu.log of what the emu feeds the spu, see tools/spurender
     };
 
     extern SPU_Config SpuConfig;
@@ -25,6 +25,7 @@
 #include "debug.h"
 #include "sio.h"
 #include "misc.h"
+#include "cdriso.h"
 //#include "cheat.h"
 #include <stdio.h>
 #include <console/console.h>
@@ -74,6 +75,10 @@ void buffer_dump(uint8_t * buf, int size) {
 uint8_t * xtaf_buff();
 
 void SetIso(const char * fname) {
+	cdrIsoSetPreload(Config.CdPreload);
+	cdrcimg_set_preload(Config.CdPreload);
+	cdrcimg_set_cache_size(4096 << Config.CdCache);
+
 	FILE *fd = fopen(fname, "rb");
 	if (fd == NULL) {
 		printf("Error loading %s\r\n", fname);
@@ -85,7 +90,7 @@ void SetIso(const char * fname) {
 
 	buffer_dump(header, 0x10);
 
-	if (header[0] == 0x78 && header[1] == 0xDA) {
+	if ((header[0] == 0x78 && header[1] == 0xDA) || memcmp(header, "CDZ1", 4) == 0) {
 		printf("Use CDRCIMG for  %s\r\n", fname);
 		strcpy(Config.Cdr, "CDRCIMG");
 		cdrcimg_set_fname(fname);
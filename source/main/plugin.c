@@ -23,6 +23,7 @@
 #include "r3000a.h"
 #include "misc.h"
 #include "sio.h"
+#include "cdrom.h"
 
 #include "gamecube_plugins.h"
 
@@ -74,6 +75,7 @@ int _OpenPlugins() {
         SysMessage(_("Error Opening CDR Plugin"));
         return -1;
     }
+    cdrXAStart();
 
     ret = GPU_open(NULL, "PCSXR", NULL);
     if (ret < 0) {
@@ -125,6 +127,7 @@ void ClosePlugins() {
     PAD1_close();
     PAD2_close();
 
+    cdrXAStop();
     ret = CDR_close();
     if (ret < 0) {
         SysMessage(_("Error Closing CDR Plugin"));
@@ -15,6 +15,17 @@
 #include <bzlib.h>
 #include <byteswap.h>
 #include "cdrcimg.h"
+#include "cdz.h"
+#include "cdrstats.h"
+
+#ifdef LIBXENON
+#include <xenon_soc/xenon_power.h>
+#include <unistd.h>
+#define lwsync() __asm__ __volatile__("lwsync" : : : "memory")
+#else
+#include <sys/mman.h>
+#define lwsync()
+#endif
 
 #define SWAP16(x) bswap_16(x)
 #define SWAP32(x) __builtin_bswap32(x)
@@ -30,6 +41,7 @@ enum {
     CDRC_ZLIB,
     CDRC_ZLIB2,
     CDRC_BZ,
+    CDRC_CDZ,
 };
 
 static const char *cd_fname;
@@ -38,13 +50,77 @@ static unsigned int cd_index_len;
 static unsigned int cd_sectors_per_blk;
 static int cd_compression;
 static FILE *cd_file;
+static unsigned char *cd_hunk_codec; // cdz: codec of each block
+static unsigned int cd_total_sectors;
 
 static struct {
-    unsigned char raw[16][CD_FRAMESIZE_RAW];
     unsigned char compressed[CD_FRAMESIZE_RAW * 16 + 100];
 } *cdbuffer;
+static z_stream cd_z;
 static int current_block, current_sect_in_blk;
 
+/*
+Decompressed blocks are kept in an lru cache (cache_kb of memory), so
+seeking back and forth doesn't inflate the same blocks again. While the
+emu reads the blocks one after the other, a worker on another hw thread
+inflates the next ones ahead into the cache, with its own file handle and
+z_stream. The worker runs from the open of the image to its close, so the
+spu mix threads see its hw thread taken. Not on the xenon, or with the hw
+thread taken, only the cache is used.
+
+The slot of the current block stays pinned: CDRCIMGgetBuffer hands out a
+pointer into it.
+*/
+
+#define CACHE_DEFAULT_KB    4096
+#define CACHE_MAX_SLOTS     2048                // 32 MB of 8 sector cdz hunks
+#define CACHE_AHEAD_SECTORS 64                  // inflated ahead while streaming
+#define CACHE_THREAD        5
+
+enum {
+    SLOT_FREE,
+    SLOT_BUSY, // being inflated
+    SLOT_READY,
+};
+
+struct cache_slot {
+    int block;
+    int state;
+    unsigned int lru;
+};
+
+static unsigned int cache_kb = CACHE_DEFAULT_KB;
+static struct cache_slot *cache;
+static unsigned char *cache_data;
+static int *cache_map; // block -> slot, -1: not cached
+static int cache_slots, cache_blk_size;
+static unsigned int cache_clock;
+static int cur_slot = -1;
+static int last_block = -2;
+
+// blocks the worker should inflate: ra_from ... ra_to - 1
+static int ra_from = -1, ra_to = -1;
+
+static volatile int cache_lock_v;
+#define cache_lock()   while (__sync_lock_test_and_set(&cache_lock_v, 1))
+#define cache_unlock() __sync_lock_release(&cache_lock_v)
+
+/*
+Preload: the compressed data track (preload mode 1) or whole image (2),
+up to PRELOAD_MAX of it, gets copied to RAM when the image is opened. On the xenon the inflate
+ahead worker loads it from the start whenever it has no block to inflate,
+blocks below pl_loaded are inflated right from RAM, the rest gets read
+from the image like before. The other builds mmap the image instead.
+*/
+
+#define PRELOAD_CHUNK 0x40000
+#define PRELOAD_MAX   (64 * 1024 * 1024)
+
+static int pl_mode;
+static unsigned char *pl_data; // image bytes pl_base ... pl_base + pl_size - 1
+static unsigned int pl_base;
+static volatile unsigned int pl_size, pl_loaded;
+
 struct CdrStat;
 extern long CDR__getStatus(struct CdrStat *stat);
 
@@ -66,6 +142,8 @@ struct trackinfo {
 #define MAXTRACKS 100 /* How many tracks can a CD hold? */
 
 static int numtracks = 0;
+static int cd_track_type[MAXTRACKS + 1]; // cdz tracks
+static unsigned int cd_track_start[MAXTRACKS + 1];
 
 #define btoi(b)           ((b) / 16 * 10 + (b) % 16) /* BCD to u_char */
 #define MSF2SECT(m, s, f) (((m) * 60 + (s) - 2) * 75 + (f))
@@ -89,6 +167,16 @@ long CDRCIMGgetTN(unsigned char *buffer) {
 //  byte 2 - minute
 
 long CDRCIMGgetTD(unsigned char track, unsigned char *buffer) {
+    if (numtracks > 0 && track <= numtracks) {
+        // track 0: end of the disc
+        unsigned int sect = (track == 0 ? cd_total_sectors : cd_track_start[track]) + 150;
+
+        buffer[2] = sect / 75 / 60;
+        buffer[1] = sect / 75 % 60;
+        buffer[0] = sect % 75;
+        return 0;
+    }
+
     buffer[2] = 0;
     buffer[1] = 2;
     buffer[0] = 0;
@@ -96,43 +184,462 @@ long CDRCIMGgetTD(unsigned char track, unsigned char *buffer) {
     return 0;
 }
 
-int uncompress2(void *out, unsigned long *out_size, void *in, unsigned long in_size) {
-    static z_stream z;
+static int uncompress_raw(z_stream *z, void *out, unsigned long *out_size, void *in, unsigned long in_size) {
     int ret = 0;
 
-    if (z.zalloc == NULL) {
+    if (z->zalloc == NULL) {
         // XXX: one-time leak here..
-        z.next_in = Z_NULL;
-        z.avail_in = 0;
-        z.zalloc = Z_NULL;
-        z.zfree = Z_NULL;
-        z.opaque = Z_NULL;
-        ret = inflateInit2(&z, -15);
+        z->next_in = Z_NULL;
+        z->avail_in = 0;
+        z->zalloc = Z_NULL;
+        z->zfree = Z_NULL;
+        z->opaque = Z_NULL;
+        ret = inflateInit2(z, -15);
     } else
-        ret = inflateReset(&z);
+        ret = inflateReset(z);
     if (ret != Z_OK)
         return ret;
 
-    z.next_in = in;
-    z.avail_in = in_size;
-    z.next_out = out;
-    z.avail_out = *out_size;
+    z->next_in = in;
+    z->avail_in = in_size;
+    z->next_out = out;
+    z->avail_out = *out_size;
 
-    ret = inflate(&z, Z_NO_FLUSH);
-    //inflateEnd(&z);
+    ret = inflate(z, Z_NO_FLUSH);
+    //inflateEnd(z);
 
-    *out_size -= z.avail_out;
+    *out_size -= z->avail_out;
     return ret == 1 ? 0 : ret;
 }
 
+// read and inflate one block into out
+static int read_block(FILE *f, z_stream *z, unsigned char *compressed, int block, unsigned char *out) {
+    unsigned int start_byte, size, t;
+    unsigned long cdbuffer_size;
+    int ret;
+
+    start_byte = cd_index_table[block];
+    size = cd_index_table[block + 1] - start_byte;
+    if (size > sizeof (cdbuffer->compressed)) {
+        err("block %d is too large: %u\n", block, size);
+        return -1;
+    }
+
+    if (pl_data != NULL && start_byte >= pl_base && start_byte - pl_base + size <= pl_loaded) {
+        // preloaded: inflate from there
+        lwsync();
+        compressed = pl_data + start_byte - pl_base;
+    } else {
+        if (fseek(f, start_byte, SEEK_SET) != 0) {
+            err("seek error for block %d at %x: ",
+                    block, start_byte);
+            perror(NULL);
+            return -1;
+        }
+
+        if (fread(compressed, 1, size, f) != size) {
+            err("read error for block %d at %x: ", block, start_byte);
+            perror(NULL);
+            return -1;
+        }
+
+        cdrStats.bytesRead += size;
+    }
+
+    t = CdrStatsTime();
+
+    cdbuffer_size = cache_blk_size;
+    switch (cd_compression) {
+        case CDRC_ZLIB:
+            ret = uncompress(out, &cdbuffer_size, compressed, size);
+            break;
+        case CDRC_ZLIB2:
+            ret = uncompress_raw(z, out, &cdbuffer_size, compressed, size);
+            break;
+        case CDRC_BZ:
+            ret = BZ2_bzBuffToBuffDecompress((char *) out, (unsigned int *) &cdbuffer_size,
+                    (char *) compressed, size, 0, 0);
+            break;
+        case CDRC_CDZ: {
+            // the last hunk can be short
+            int first = block * cd_sectors_per_blk;
+            int n = cd_total_sectors - first;
+
+            if (n > cd_sectors_per_blk)
+                n = cd_sectors_per_blk;
+
+            ret = cdz_decode_hunk(compressed, size, cd_hunk_codec[block], first, n, out);
+            memset(out + n * CD_FRAMESIZE_RAW, 0, cache_blk_size - n * CD_FRAMESIZE_RAW);
+            break;
+        }
+        default:
+            err("bad cd_compression: %d\n", cd_compression);
+            return -1;
+    }
+
+    cdrStats.bytesInflated += cache_blk_size;
+    cdrStats.inflateTime += CdrStatsTime() - t;
+
+    if (ret != 0) {
+        err("uncompress failed with %d for block %d\n",
+                ret, block);
+        return -1;
+    }
+    if (cdbuffer_size != cache_blk_size)
+        err("cdbuffer_size: %lu != %d, block %d\n", cdbuffer_size,
+            cache_blk_size, block);
+
+    return 0;
+}
+
+// block cache
+
+// (cache locked) slot for block: the least recently used one, not the
+// pinned one, not one being inflated. -1 if there is none
+static int cache_alloc(int block) {
+    int i, slot = -1;
+
+    for (i = 0; i < cache_slots; i++) {
+        if (cache[i].state == SLOT_BUSY || i == cur_slot)
+            continue;
+        if (slot < 0 || cache[i].lru < cache[slot].lru)
+            slot = i;
+    }
+
+    if (slot < 0)
+        return -1;
+
+    if (cache[slot].block >= 0)
+        cache_map[cache[slot].block] = -1;
+
+    cache[slot].block = block;
+    cache[slot].state = SLOT_BUSY;
+    cache[slot].lru = ++cache_clock;
+    cache_map[block] = slot;
+
+    return slot;
+}
+
+// (cache locked) inflate of a slot finished
+static void cache_done(int slot, int ret) {
+    if (ret == 0) {
+        cache[slot].state = SLOT_READY;
+        return;
+    }
+
+    cache_map[cache[slot].block] = -1;
+    cache[slot].block = -1;
+    cache[slot].state = SLOT_FREE;
+    cache[slot].lru = 0;
+}
+
+static void cache_free(void) {
+    free(cache);
+    free(cache_data);
+    free(cache_map);
+    cache = NULL;
+    cache_data = NULL;
+    cache_map = NULL;
+    cache_slots = 0;
+    cur_slot = -1;
+}
+
+static int cache_setup(void) {
+    int i, ahead;
+
+    cache_blk_size = CD_FRAMESIZE_RAW * cd_sectors_per_blk;
+    ahead = (CACHE_AHEAD_SECTORS + cd_sectors_per_blk - 1) / cd_sectors_per_blk;
+
+    // at least the pinned block, one to fill and the ones ahead
+    cache_slots = cache_kb * 1024 / cache_blk_size;
+    if (cache_slots < ahead + 2)
+        cache_slots = ahead + 2;
+    if (cache_slots > CACHE_MAX_SLOTS)
+        cache_slots = CACHE_MAX_SLOTS;
+
+    cache = malloc(cache_slots * sizeof (cache[0]));
+    cache_data = malloc(cache_slots * cache_blk_size);
+    cache_map = malloc(cd_index_len * sizeof (cache_map[0]));
+    if (cache == NULL || cache_data == NULL || cache_map == NULL) {
+        err("OOM\n");
+        cache_free();
+        return -1;
+    }
+
+    for (i = 0; i < cache_slots; i++) {
+        cache[i].block = -1;
+        cache[i].state = SLOT_FREE;
+        cache[i].lru = 0;
+    }
+    for (i = 0; i < cd_index_len; i++)
+        cache_map[i] = -1;
+
+    cache_clock = 0;
+    cur_slot = -1;
+    last_block = -2;
+    ra_from = ra_to = -1;
+
+    return 0;
+}
+
+// inflate ahead worker
+
+#ifdef LIBXENON
+static FILE *ra_file;
+static z_stream ra_z;
+static unsigned char ra_compressed[sizeof (cdbuffer->compressed)];
+
+static int ra_open = 0; // 0: not tried, 1: open and running, -1: failed
+static volatile int ra_end = 0; // (emu) worker, stop
+static volatile int ra_ended = 1; // (worker) stopped
+static unsigned char ra_thread_stack[0x10000];
+
+// (worker) next chunk of the preload
+static void pl_load_chunk(void) {
+    unsigned int pos = pl_loaded, n = pl_size - pos;
+
+    if (n > PRELOAD_CHUNK)
+        n = PRELOAD_CHUNK;
+
+    if (fseek(ra_file, pl_base + pos, SEEK_SET) != 0 ||
+            fread(pl_data + pos, 1, n, ra_file) != n) {
+        pl_size = pos; // the rest stays on disk
+        return;
+    }
+
+    lwsync(); // data before pl_loaded
+    pl_loaded = pos + n;
+}
+
+static void ra_thread(void) {
+    while (!ra_end) {
+        int b, slot = -1, preload = 0;
+
+        cache_lock();
+        for (b = ra_from; b >= 0 && b < ra_to && b < cd_index_len; b++) {
+            if (cache_map[b] < 0) {
+                slot = cache_alloc(b);
+                break;
+            }
+        }
+        if (slot >= 0)
+            ra_from = b + 1;
+        else if (pl_loaded < pl_size)
+            preload = 1;
+        cache_unlock();
+
+        if (preload) {
+            pl_load_chunk();
+            continue;
+        }
+
+        if (slot < 0) {
+            usleep(500);
+            continue;
+        }
+
+        b = read_block(ra_file, &ra_z, ra_compressed, b, cache_data + slot * cache_blk_size);
+
+        cache_lock();
+        cache_done(slot, b);
+        cache_unlock();
+    }
+
+    ra_ended = 1;
+}
+
+// open the worker's file, then start it: ra_open tells how it went
+static void ra_start(void) {
+    if (ra_open != 0)
+        return;
+
+    ra_open = -1;
+
+    // hw thread taken (spu mix threads, disc info scan)?
+    if (!ra_ended || xenon_is_thread_task_running(CACHE_THREAD))
+        return;
+
+    ra_file = fopen(cd_fname, "rb");
+    if (ra_file == NULL)
+        return;
+
+    ra_end = 0;
+    ra_ended = 0;
+    ra_open = 1;
+    lwsync(); // all of it before the worker runs
+    xenon_run_thread_task(CACHE_THREAD, &ra_thread_stack[sizeof (ra_thread_stack) - 0x100], ra_thread);
+}
+#endif
+
+// end the worker (nothing in flight after this), close its file
+static void ra_stop(void) {
+    cache_lock();
+    ra_from = ra_to = -1;
+    pl_size = 0;
+    cache_unlock();
+
+#ifdef LIBXENON
+    if (ra_open == 1) {
+        ra_end = 1;
+        while (!ra_ended)
+            usleep(100);
+    }
+
+    if (ra_file != NULL) {
+        fclose(ra_file);
+        ra_file = NULL;
+    }
+
+    ra_open = 0;
+#endif
+}
+
+// the emu moved on to block: stream on behind it, or stop after a seek
+static void ra_update(int block) {
+#ifdef LIBXENON
+    int seq = (block == last_block + 1);
+
+    last_block = block;
+
+    if (seq)
+        ra_start();
+    if (ra_open != 1)
+        return;
+
+    cache_lock();
+    if (seq) {
+        if (ra_from < block + 1)
+            ra_from = block + 1;
+        ra_to = block + 1 + (CACHE_AHEAD_SECTORS + cd_sectors_per_blk - 1) / cd_sectors_per_blk;
+    } else
+        ra_from = ra_to = -1;
+    cache_unlock();
+#endif
+}
+
+// start the worker and the preload of the image that just got opened
+static void pl_start(void) {
+    unsigned int end, last = cd_index_len;
+    long file_size;
+
+#ifdef LIBXENON
+    ra_start();
+#endif
+
+    if (pl_mode == 0)
+        return;
+
+    // data track: the blocks before the first audio one
+    if (pl_mode == 1 && cd_compression == CDRC_CDZ && numtracks > 1 &&
+            cd_track_type[2] == CDZ_TRACK_AUDIO)
+        last = (cd_track_start[2] + cd_sectors_per_blk - 1) / cd_sectors_per_blk;
+
+    fseek(cd_file, 0, SEEK_END);
+    file_size = ftell(cd_file);
+
+    pl_base = cd_index_table[0];
+    end = cd_index_table[last];
+    if (end > file_size)
+        end = file_size;
+    if (end <= pl_base)
+        return;
+
+#ifdef LIBXENON
+    if (end - pl_base > PRELOAD_MAX)
+        end = pl_base + PRELOAD_MAX;
+
+    pl_data = malloc(end - pl_base);
+    if (pl_data == NULL)
+        return;
+
+    ra_start();
+    if (ra_open != 1) {
+        free(pl_data);
+        pl_data = NULL;
+        return;
+    }
+
+    cache_lock();
+    pl_loaded = 0;
+    pl_size = end - pl_base; // the worker takes it from here
+    cache_unlock();
+#else
+    // the mapping starts on a page
+    pl_data = mmap(NULL, end, PROT_READ, MAP_SHARED, fileno(cd_file), 0);
+    if (pl_data == MAP_FAILED) {
+        pl_data = NULL;
+        return;
+    }
+
+    pl_data += pl_base;
+    pl_size = pl_loaded = end - pl_base;
+#endif
+
+    printf(PFX "preloading %u KB\n", (end - pl_base) / 1024);
+}
+
+// after ra_stop: the worker is done with pl_data
+static void pl_stop(void) {
+    if (pl_data != NULL) {
+#ifdef LIBXENON
+        free(pl_data);
+#else
+        munmap(pl_data - pl_base, pl_base + pl_loaded);
+#endif
+    }
+
+    pl_data = NULL;
+    pl_size = pl_loaded = 0;
+}
+
+// make block the current one: from the cache, or read it ourselves
+static int cache_get(int block) {
+    int slot, ret;
+
+    for (;;) {
+        cache_lock();
+        slot = cache_map[block];
+        if (slot >= 0 && cache[slot].state == SLOT_READY) {
+            cache[slot].lru = ++cache_clock;
+            cur_slot = slot;
+            cache_unlock();
+            cdrStats.cacheHits++;
+            return 0;
+        }
+        if (slot < 0) {
+            slot = cache_alloc(block);
+            cache_unlock();
+            break;
+        }
+        cache_unlock();
+
+        // the worker is at it
+#ifdef LIBXENON
+        usleep(100);
+#endif
+    }
+
+    if (slot < 0)
+        return -1;
+
+    cdrStats.cacheMisses++;
+    ret = read_block(cd_file, &cd_z, cdbuffer->compressed, block, cache_data + slot * cache_blk_size);
+
+    cache_lock();
+    cache_done(slot, ret);
+    if (ret == 0)
+        cur_slot = slot;
+    cache_unlock();
+
+    return ret;
+}
+
 // read track
 // time: byte 0 - minute; byte 1 - second; byte 2 - frame
 // uses bcd format
 
 long CDRCIMGreadTrack(unsigned char *time) {
-    unsigned int start_byte, size;
-    unsigned long cdbuffer_size;
-    int ret, sector, block;
+    int sector, block;
 
     if (cd_file == NULL)
         return -1;
@@ -154,8 +661,9 @@ long CDRCIMGreadTrack(unsigned char *time) {
             current_sect_in_blk = sector & 15;
             break;
         default:
-            err("unhandled cd_sectors_per_blk: %d\n", cd_sectors_per_blk);
-            return -1;
+            block = sector / cd_sectors_per_blk;
+            current_sect_in_blk = sector % cd_sectors_per_blk;
+            break;
     }
 
     if (block == current_block) {
@@ -169,51 +677,12 @@ long CDRCIMGreadTrack(unsigned char *time) {
         return -1;
     }
 
-    start_byte = cd_index_table[block];
-    if (fseek(cd_file, start_byte, SEEK_SET) != 0) {
-        err("seek error for block %d at %x: ",
-                block, start_byte);
-        perror(NULL);
+    if (cache_get(block) != 0) {
+        err("failed to read sector %d\n", sector);
         return -1;
     }
 
-    size = cd_index_table[block + 1] - start_byte;
-    if (size > sizeof (cdbuffer->compressed)) {
-        err("block %d is too large: %u\n", block, size);
-        return -1;
-    }
-
-    if (fread(cdbuffer->compressed, 1, size, cd_file) != size) {
-        err("read error for block %d at %x: ", block, start_byte);
-        perror(NULL);
-        return -1;
-    }
-
-    cdbuffer_size = sizeof (cdbuffer->raw[0]) * cd_sectors_per_blk;
-    switch (cd_compression) {
-        case CDRC_ZLIB:
-            ret = uncompress(cdbuffer->raw[0], &cdbuffer_size, cdbuffer->compressed, size);
-            break;
-        case CDRC_ZLIB2:
-            ret = uncompress2(cdbuffer->raw[0], &cdbuffer_size, cdbuffer->compressed, size);
-            break;
-        case CDRC_BZ:
-            ret = BZ2_bzBuffToBuffDecompress((char *) cdbuffer->raw, (unsigned int *) &cdbuffer_size,
-                    (char *) cdbuffer->compressed, size, 0, 0);
-            break;
-        default:
-            err("bad cd_compression: %d\n", cd_compression);
-            return -1;
-    }
-
-    if (ret != 0) {
-        err("uncompress failed with %d for block %d, sector %d\n",
-                ret, block, sector);
-        return -1;
-    }
-    if (cdbuffer_size != sizeof (cdbuffer->raw[0]) * cd_sectors_per_blk)
-        err("cdbuffer_size: %lu != %d, sector %d\n", cdbuffer_size,
-            sizeof (cdbuffer->raw[0]) * cd_sectors_per_blk, sector);
+    ra_update(block);
 
     // done at last!
     current_block = block;
@@ -223,7 +692,10 @@ long CDRCIMGreadTrack(unsigned char *time) {
 // return read track
 
 unsigned char *CDRCIMGgetBuffer(void) {
-    return cdbuffer->raw[current_sect_in_blk] + 12;
+    if (cur_slot < 0)
+        return cdbuffer->compressed + 12; // nothing read yet
+
+    return cache_data + cur_slot * cache_blk_size + current_sect_in_blk * CD_FRAMESIZE_RAW + 12;
 }
 
 // plays cdda audio
@@ -255,6 +727,10 @@ long CDRCIMGgetStatus(struct CdrStat *stat) {
 }
 
 long CDRCIMGclose(void) {
+    ra_stop();
+    pl_stop();
+    cache_free();
+
     if (cd_file != NULL) {
         fclose(cd_file);
         cd_file = NULL;
@@ -263,6 +739,10 @@ long CDRCIMGclose(void) {
         free(cd_index_table);
         cd_index_table = NULL;
     }
+    if (cd_hunk_codec != NULL) {
+        free(cd_hunk_codec);
+        cd_hunk_codec = NULL;
+    }
     return 0;
 }
 
@@ -366,7 +846,12 @@ static long handle_eboot(void) {
 
     cd_compression = CDRC_ZLIB2;
     cd_sectors_per_blk = 16;
+
+    if (cache_setup() != 0)
+        goto fail_index;
+
     cd_file = f;
+    pl_start();
 
     printf(PFX "Loaded EBOOT CD Image: %s.\n", cd_fname);
     return 0;
@@ -379,6 +864,105 @@ fail_io:
     return -1;
 }
 
+static unsigned int get_le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+// cdz image, see cdz.h: the hunks are the blocks
+static long handle_cdz(void) {
+    unsigned char hdr[CDZ_HEADER_SIZE];
+    unsigned char entry[CDZ_INDEX_SIZE];
+    unsigned char track[CDZ_TRACK_SIZE];
+    unsigned int hunks, tracks, size, end = 0;
+    int i, ret;
+    FILE *f;
+
+    f = fopen(cd_fname, "rb");
+    if (f == NULL) {
+        err("missing file: %s: ", cd_fname);
+        perror(NULL);
+        return -1;
+    }
+
+    ret = fread(hdr, 1, sizeof (hdr), f);
+    if (ret != sizeof (hdr) || memcmp(hdr, CDZ_MAGIC, 4) != 0) {
+        err("bad cdz header\n");
+        goto fail_io;
+    }
+
+    cd_sectors_per_blk = get_le32(hdr + 4);
+    cd_total_sectors = get_le32(hdr + 8);
+    hunks = get_le32(hdr + 12);
+    tracks = get_le32(hdr + 16);
+
+    if (cd_sectors_per_blk < 1 || cd_sectors_per_blk > CDZ_MAX_HUNK_SECTORS ||
+            tracks >= MAXTRACKS || hunks == 0 ||
+            hunks != (cd_total_sectors + cd_sectors_per_blk - 1) / cd_sectors_per_blk) {
+        err("bad cdz header\n");
+        goto fail_io;
+    }
+
+    for (i = 1; i <= tracks; i++) {
+        ret = fread(track, 1, sizeof (track), f);
+        if (ret != sizeof (track)) {
+            err("failed to read track #%d\n", i);
+            goto fail_io;
+        }
+
+        cd_track_type[i] = track[0];
+        cd_track_start[i] = get_le32(track + 4);
+    }
+
+    cd_index_len = hunks;
+    cd_index_table = malloc((cd_index_len + 1) * sizeof (cd_index_table[0]));
+    cd_hunk_codec = malloc(cd_index_len);
+    if (cd_index_table == NULL || cd_hunk_codec == NULL)
+        goto fail_index;
+
+    // hunks are stored one after the other: the next offset gives the size
+    for (i = 0; i < cd_index_len; i++) {
+        ret = fread(entry, 1, sizeof (entry), f);
+        if (ret != sizeof (entry)) {
+            err("failed to read hunk #%d\n", i);
+            goto fail_index;
+        }
+
+        cd_index_table[i] = get_le32(entry);
+        size = get_le32(entry + 4);
+        cd_hunk_codec[i] = size >> 24;
+
+        if (i > 0 && cd_index_table[i] != end) {
+            err("hunk #%d out of order\n", i);
+            goto fail_index;
+        }
+        end = cd_index_table[i] + (size & 0xffffff);
+    }
+    cd_index_table[i] = end;
+
+    cd_compression = CDRC_CDZ;
+    numtracks = tracks;
+    cdz_eccedc_init();
+
+    if (cache_setup() != 0)
+        goto fail_index;
+
+    cd_file = f;
+    pl_start();
+
+    printf(PFX "Loaded cdz CD Image: %s.\n", cd_fname);
+    return 0;
+
+fail_index:
+    free(cd_index_table);
+    cd_index_table = NULL;
+    free(cd_hunk_codec);
+    cd_hunk_codec = NULL;
+fail_io:
+    numtracks = 0;
+    fclose(f);
+    return -1;
+}
+
 // This function is invoked by the front-end when opening an ISO
 // file for playback
 
@@ -415,12 +999,16 @@ long CDRCIMGopen(void) {
     if (cd_fname == NULL)
         return -1;
 
+    CdrStatsReset(cd_fname);
+
     ext = strrchr(cd_fname, '.');
     if (ext == NULL)
         return -1;
 
     if (strcasecmp(ext, ".pbp") == 0) {
         return handle_eboot();
+    } else if (strcasecmp(ext, ".cdz") == 0) {
+        return handle_cdz();
     }// pocketiso stuff
     else if (strcasecmp(ext, ".z") == 0) {
         cd_compression = CDRC_ZLIB;
@@ -522,13 +1110,18 @@ long CDRCIMGopen(void) {
             break;
     }
 
+    if (cache_setup() != 0)
+        goto fail_img;
+
     cd_file = fopen(cd_fname, "rb");
     if (cd_file == NULL) {
         err("failed to open: %s: ", table_fname);
         perror(NULL);
+        cache_free();
         goto fail_img;
     }
     fclose(f);
+    pl_start();
 
     printf(PFX "Loaded compressed CD Image: %s.\n", cd_fname);
 
@@ -547,3 +1140,13 @@ void cdrcimg_set_fname(const char *fname) {
     TR;
     cd_fname = fname;
 }
+
+// memory for decompressed blocks, used from the next open on
+void cdrcimg_set_cache_size(unsigned int kb) {
+    cache_kb = kb;
+}
+
+// 0: off, 1: data track, 2: whole image, from the next open on
+void cdrcimg_set_preload(int mode) {
+    pl_mode = mode;
+}
@@ -1,3 +1,5 @@
 
 void  cdrcimg_set_fname(const char *fname);
+void  cdrcimg_set_cache_size(unsigned int kb);
+void  cdrcimg_set_preload(int mode);
 void *cdrcimg_get_sym(const char *sym);
@@ -0,0 +1,234 @@
+/*
+ * cdz image hunks: sector regeneration and codecs, see cdz.h
+ *
+ * The EDC/ECC code follows the one of ECM by Neill Corlett.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include "cdz.h"
+
+const int cdz_kind_offset[CDZ_SECT_KINDS] = {0, 16, 16, 16, 16};
+const int cdz_kind_size[CDZ_SECT_KINDS] = {CDZ_SECTOR_SIZE, 2048, 8 + 2048, 8 + 2324, 8 + 2324};
+
+static unsigned char ecc_f_lut[256];
+static unsigned char ecc_b_lut[256];
+static unsigned int edc_lut[256];
+static int eccedc_ready;
+
+void cdz_eccedc_init(void) {
+    unsigned int i, j, edc;
+
+    if (eccedc_ready)
+        return;
+
+    for (i = 0; i < 256; i++) {
+        j = (i << 1) ^ (i & 0x80 ? 0x11d : 0);
+        ecc_f_lut[i] = j;
+        ecc_b_lut[i ^ j] = i;
+
+        edc = i;
+        for (j = 0; j < 8; j++)
+            edc = (edc >> 1) ^ (edc & 1 ? 0xd8018001 : 0);
+        edc_lut[i] = edc;
+    }
+
+    eccedc_ready = 1;
+}
+
+static unsigned int edc_compute(const unsigned char *src, int size) {
+    unsigned int edc = 0;
+
+    while (size--)
+        edc = (edc >> 8) ^ edc_lut[(edc ^ *src++) & 0xff];
+
+    return edc;
+}
+
+static void edc_store(unsigned char *dst, unsigned int edc) {
+    dst[0] = edc;
+    dst[1] = edc >> 8;
+    dst[2] = edc >> 16;
+    dst[3] = edc >> 24;
+}
+
+static void ecc_compute_block(const unsigned char *src, unsigned int major_count,
+        unsigned int minor_count, unsigned int major_mult, unsigned int minor_inc,
+        unsigned char *dst) {
+    unsigned int size = major_count * minor_count;
+    unsigned int major, minor;
+
+    for (major = 0; major < major_count; major++) {
+        unsigned int index = (major >> 1) * major_mult + (major & 1);
+        unsigned char ecc_a = 0, ecc_b = 0;
+
+        for (minor = 0; minor < minor_count; minor++) {
+            unsigned char temp = src[index];
+
+            index += minor_inc;
+            if (index >= size)
+                index -= size;
+
+            ecc_a ^= temp;
+            ecc_b ^= temp;
+            ecc_a = ecc_f_lut[ecc_a];
+        }
+
+        ecc_a = ecc_b_lut[ecc_f_lut[ecc_a] ^ ecc_b];
+        dst[major] = ecc_a;
+        dst[major + major_count] = ecc_a ^ ecc_b;
+    }
+}
+
+// P and Q parity, mode 2 computes them with a zero address
+static void ecc_generate(unsigned char *sector, int zero_address) {
+    unsigned char address[4] = {0, 0, 0, 0};
+
+    if (zero_address) {
+        memcpy(address, sector + 12, 4);
+        memset(sector + 12, 0, 4);
+    }
+
+    ecc_compute_block(sector + 0xc, 86, 24, 2, 86, sector + 0x81c);
+    ecc_compute_block(sector + 0xc, 52, 43, 86, 88, sector + 0x8c8);
+
+    if (zero_address)
+        memcpy(sector + 12, address, 4);
+}
+
+#define itob(i) ((i) / 10 * 16 + (i) % 10)
+
+void cdz_build_sector(unsigned char *sector, int kind, int lba) {
+    int msf = lba + 150;
+
+    if (kind == CDZ_SECT_RAW)
+        return;
+
+    sector[0] = 0;
+    memset(sector + 1, 0xff, 10);
+    sector[11] = 0;
+    sector[12] = itob(msf / 75 / 60);
+    sector[13] = itob(msf / 75 % 60);
+    sector[14] = itob(msf % 75);
+    sector[15] = kind == CDZ_SECT_MODE1 ? 1 : 2;
+
+    switch (kind) {
+        case CDZ_SECT_MODE1:
+            edc_store(sector + 0x810, edc_compute(sector, 0x810));
+            memset(sector + 0x814, 0, 8);
+            ecc_generate(sector, 0);
+            break;
+        case CDZ_SECT_MODE2_F1:
+            edc_store(sector + 0x818, edc_compute(sector + 0x10, 0x808));
+            ecc_generate(sector, 1);
+            break;
+        case CDZ_SECT_MODE2_F2:
+            edc_store(sector + 0x92c, edc_compute(sector + 0x10, 0x91c));
+            break;
+        case CDZ_SECT_MODE2_F2_NOEDC:
+            memset(sector + 0x92c, 0, 4);
+            break;
+    }
+}
+
+void cdz_cdda_predict(unsigned char *buf, int bytes) {
+    int i, ch;
+
+    // back to front: the prediction reads the original samples
+    for (ch = 0; ch < 2; ch++) {
+        for (i = bytes / 4 - 1; i >= 0; i--) {
+            unsigned char *p = buf + i * 4 + ch * 2;
+            int s = (short) (p[0] | p[1] << 8);
+            int s1 = i > 0 ? (short) (p[-4] | p[-3] << 8) : 0;
+            int s2 = i > 1 ? (short) (p[-8] | p[-7] << 8) : 0;
+            int r = s - (2 * s1 - s2);
+
+            p[0] = r;
+            p[1] = r >> 8;
+        }
+    }
+}
+
+void cdz_cdda_unpredict(unsigned char *buf, int bytes) {
+    int i, ch;
+
+    for (ch = 0; ch < 2; ch++) {
+        int s1 = 0, s2 = 0;
+
+        for (i = 0; i < bytes / 4; i++) {
+            unsigned char *p = buf + i * 4 + ch * 2;
+            int s = (short) ((p[0] | p[1] << 8) + 2 * s1 - s2);
+
+            p[0] = s;
+            p[1] = s >> 8;
+            s2 = s1;
+            s1 = s;
+        }
+    }
+}
+
+int cdz_decode_hunk(const unsigned char *in, unsigned int in_size, int codec,
+        int lba, int sectors, unsigned char *out) {
+    unsigned char kind[CDZ_MAX_HUNK_SECTORS];
+    unsigned int stored = 0, total = sectors * CDZ_SECTOR_SIZE;
+    unsigned char *data;
+    unsigned long size;
+    unsigned int bz_size;
+    int i;
+
+    if (sectors < 1 || sectors > CDZ_MAX_HUNK_SECTORS || in_size < (unsigned int) sectors)
+        return -1;
+
+    for (i = 0; i < sectors; i++) {
+        kind[i] = in[i];
+        if (kind[i] >= CDZ_SECT_KINDS)
+            return -1;
+        stored += cdz_kind_size[kind[i]];
+    }
+
+    in += sectors;
+    in_size -= sectors;
+
+    // stored bytes go to the end of out, the sectors get expanded
+    // in front of them
+    data = out + total - stored;
+
+    switch (codec) {
+        case CDZ_CODEC_NONE:
+            if (in_size != stored)
+                return -1;
+            memcpy(data, in, stored);
+            break;
+        case CDZ_CODEC_ZLIB:
+        case CDZ_CODEC_CDDA:
+            size = stored;
+            if (uncompress(data, &size, in, in_size) != Z_OK || size != stored)
+                return -1;
+            if (codec == CDZ_CODEC_CDDA)
+                cdz_cdda_unpredict(data, stored);
+            break;
+        case CDZ_CODEC_BZ2:
+            bz_size = stored;
+            if (BZ2_bzBuffToBuffDecompress((char *) data, &bz_size, (char *) in, in_size, 0, 0) != BZ_OK ||
+                    bz_size != stored)
+                return -1;
+            break;
+        default:
+            return -1;
+    }
+
+    // sector i never overlaps the stored bytes of the sectors after it
+    for (i = 0; i < sectors; i++) {
+        unsigned char *sector = out + i * CDZ_SECTOR_SIZE;
+        int n = cdz_kind_size[kind[i]];
+
+        memmove(sector + cdz_kind_offset[kind[i]], data, n);
+        data += n;
+
+        cdz_build_sector(sector, kind[i], lba + i);
+    }
+
+    return 0;
+}
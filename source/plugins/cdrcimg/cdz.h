@@ -0,0 +1,71 @@
+/*
+ * cdz: seekable compressed cd image
+ *
+ * All numbers are little endian.
+ *
+ *  0  "CDZ1"
+ *  4  u32 sectors per hunk (1 ... CDZ_MAX_HUNK_SECTORS)
+ *  8  u32 sectors
+ * 12  u32 hunks
+ * 16  u32 tracks
+ * 20  u32 reserved, 0
+ * 24  tracks * { u8 type, u8 mode, u16 0, u32 start sector, u32 sectors }
+ *     hunks * { u32 offset, u32 size | codec << 24 }
+ *     hunks, one after the other
+ *
+ * A hunk starts with one kind byte per sector, then the codec stream of
+ * what is stored of the sectors. Sync, header, EDC and ECC of data sectors
+ * get regenerated when the converter found they match (CDZ_SECT_*), other
+ * sectors are stored raw.
+ */
+
+#ifndef CDZ_H
+#define CDZ_H
+
+#define CDZ_MAGIC            "CDZ1"
+#define CDZ_HEADER_SIZE      24
+#define CDZ_TRACK_SIZE       12
+#define CDZ_INDEX_SIZE       8
+#define CDZ_MAX_HUNK_SECTORS 16
+#define CDZ_SECTOR_SIZE      2352
+
+enum {
+    CDZ_CODEC_NONE,
+    CDZ_CODEC_ZLIB,
+    CDZ_CODEC_BZ2,
+    CDZ_CODEC_CDDA, // audio: order 2 prediction, then zlib
+};
+
+enum {
+    CDZ_SECT_RAW,           // 2352 bytes
+    CDZ_SECT_MODE1,         // 2048 bytes user data
+    CDZ_SECT_MODE2_F1,      // subheader + 2048
+    CDZ_SECT_MODE2_F2,      // subheader + 2324
+    CDZ_SECT_MODE2_F2_NOEDC, // ... with an EDC of 0
+    CDZ_SECT_KINDS,
+};
+
+enum {
+    CDZ_TRACK_DATA = 1,
+    CDZ_TRACK_AUDIO = 2,
+};
+
+// where the stored bytes of a sector kind go in the sector, and how many
+extern const int cdz_kind_offset[CDZ_SECT_KINDS];
+extern const int cdz_kind_size[CDZ_SECT_KINDS];
+
+// tables of cdz_build_sector: call it once before the threads which
+// decode hunks start, they only read them
+void cdz_eccedc_init(void);
+// fill in sync, header, EDC and ECC around the stored bytes
+void cdz_build_sector(unsigned char *sector, int kind, int lba);
+
+// hunk of 'sectors' sectors starting at lba -> out (sectors * 2352)
+int cdz_decode_hunk(const unsigned char *in, unsigned int in_size, int codec,
+        int lba, int sectors, unsigned char *out);
+
+// order 2 prediction of 16 bit stereo samples (little endian), in place
+void cdz_cdda_predict(unsigned char *buf, int bytes);
+void cdz_cdda_unpredict(unsigned char *buf, int bytes);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * File:   GpuBatch.cpp
+ *
+ * Deferred draw batches, see GpuBatch.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "GpuBatch.h"
+
+bool GpuStatesEqual(const GpuRenderStates & a, const GpuRenderStates & b) {
+	// most frequent changes first
+	return a.surface == b.surface &&
+			a.currentPsShader == b.currentPsShader &&
+			a.blending_enabled == b.blending_enabled &&
+			a.blend_src == b.blend_src &&
+			a.blend_dst == b.blend_dst &&
+			a.blend_op == b.blend_op &&
+			a.alpha_test_enable == b.alpha_test_enable &&
+			a.alpha_test_func == b.alpha_test_func &&
+			a.alpha_test_ref == b.alpha_test_ref &&
+			a.scissor_enable == b.scissor_enable &&
+			a.scissor_left == b.scissor_left &&
+			a.scissor_top == b.scissor_top &&
+			a.scissor_right == b.scissor_right &&
+			a.scissor_bottom == b.scissor_bottom &&
+			a.z_enable == b.z_enable &&
+			a.z_write == b.z_write &&
+			a.z_func == b.z_func &&
+			a.cullmode == b.cullmode &&
+			a.fillmode_front == b.fillmode_front &&
+			a.fillmode_back == b.fillmode_back &&
+			a.stencil_enable == b.stencil_enable &&
+			a.stencil_func == b.stencil_func &&
+			a.stencil_op == b.stencil_op &&
+			a.stencil_ref == b.stencil_ref &&
+			a.stencil_mask == b.stencil_mask &&
+			a.stencil_writemask == b.stencil_writemask;
+}
+
+GpuBatcher::GpuBatcher() {
+	nb_batches = 0;
+	batch_start = 0;
+	applied_valid = false;
+	backend = NULL;
+	memset(&applied, 0, sizeof (applied));
+	memset(&stats, 0, sizeof (stats));
+	memset(&frameStats, 0, sizeof (frameStats));
+}
+
+void GpuBatcher::Close(const GpuRenderStates & states, int primType, int indicesCount, int verticesCount) {
+	int count = indicesCount - batch_start;
+
+	// nothing drawn with these states
+	if (count <= 0)
+		return;
+
+	stats.primitives += count / 3;
+
+	// same states as the previous batch and it ends where we start: extend it
+	if (nb_batches) {
+		GpuBatch * last = &batches[nb_batches - 1];
+		if (last->primType == primType &&
+				last->firstIndex + last->indexCount == batch_start &&
+				GpuStatesEqual(last->states, states)) {
+			last->indexCount += count;
+			batch_start = indicesCount;
+			stats.merged++;
+			return;
+		}
+	}
+
+	if (nb_batches == MAX_BATCH_COUNT)
+		Flush(verticesCount);
+
+	GpuBatch * b = &batches[nb_batches++];
+	b->states = states;
+	b->primType = primType;
+	b->firstIndex = batch_start;
+	b->indexCount = count;
+
+	batch_start = indicesCount;
+	stats.batches++;
+}
+
+void GpuBatcher::Flush(int verticesCount) {
+	if (nb_batches == 0)
+		return;
+
+	stats.flushes++;
+
+	for (int i = 0; i < nb_batches; i++) {
+		GpuBatch * b = &batches[i];
+
+		if (applied_valid && GpuStatesEqual(applied, b->states)) {
+			stats.redundant_states++;
+		} else {
+			backend->ApplyStates(b->states, applied_valid ? &applied : NULL);
+			applied = b->states;
+			applied_valid = true;
+			stats.state_changes++;
+		}
+
+		backend->DrawIndexed(b->primType, verticesCount, b->firstIndex, b->indexCount / 3);
+		stats.draws++;
+	}
+
+	nb_batches = 0;
+}
+
+void GpuBatcher::Reset() {
+	nb_batches = 0;
+	batch_start = 0;
+}
+
+void GpuBatcher::EndFrame() {
+	frameStats = stats;
+	memset(&stats, 0, sizeof (stats));
+}
@@ -0,0 +1,175 @@
+/*
+ * File:   GpuBatch.h
+ *
+ * Deferred draw batches for GpuRenderer: primitives are accumulated in the
+ * index buffer, a batch is closed only when the render states really change,
+ * and the batches are submitted in order (no reordering, psx draw order must
+ * be kept) with only the states that differ from the previous batch.
+ */
+
+#ifndef GPUBATCH_H
+#define	GPUBATCH_H
+
+#include <stdint.h>
+
+#ifndef GPUBATCH_HOST
+#include "gpu_types.h"
+#else
+// host check of the batch counts (tools/gpubatch): only the pointers are compared
+typedef struct GpuTex GpuTex;
+typedef struct GpuPS GpuPS;
+#endif
+
+#define MAX_BATCH_COUNT 4096
+
+/**
+ * Render states
+ */
+struct GpuRenderStates {
+	// texture
+	GpuTex * surface;
+
+	// shader
+	GpuPS * currentPsShader;
+
+	// z / depth
+	int32_t z_func;
+	uint32_t z_write;
+	uint32_t z_enable;
+
+	// fillmode
+	uint32_t fillmode_front;
+	uint32_t fillmode_back;
+
+	// blend
+	int32_t blend_op;
+	int32_t blend_src;
+	int32_t blend_dst;
+	int32_t blending_enabled;
+
+	// cull mode
+	uint32_t cullmode;
+
+	// alpha test
+	uint32_t alpha_test_enable;
+	int32_t alpha_test_func;
+	float alpha_test_ref;
+
+	// stencil
+	uint32_t stencil_enable;
+	uint32_t stencil_func;
+	uint32_t stencil_op;
+	uint32_t stencil_ref;
+	uint32_t stencil_mask;
+	uint32_t stencil_writemask;
+
+	// scissor
+	uint32_t scissor_enable;
+	uint32_t scissor_left;
+	uint32_t scissor_top;
+	uint32_t scissor_right;
+	uint32_t scissor_bottom;
+};
+
+bool GpuStatesEqual(const GpuRenderStates & a, const GpuRenderStates & b);
+
+/**
+ * One draw call: a range of the index buffer drawn with the same states
+ */
+struct GpuBatch {
+	GpuRenderStates states;
+	int primType;
+	int firstIndex;
+	int indexCount;
+};
+
+/**
+ * Per frame counters, for profiling
+ */
+struct GpuBatchStats {
+	uint32_t primitives;        // triangles / rects submitted
+	uint32_t batches;           // batches closed
+	uint32_t merged;            // batches appended to the previous one
+	uint32_t draws;             // draw calls issued
+	uint32_t state_changes;     // state blocks applied
+	uint32_t redundant_states;  // state blocks skipped, same as applied
+	uint32_t flushes;           // batch list submissions
+};
+
+/**
+ * What the batches are submitted to: the xenos device in GpuRenderer, or a
+ * recording backend when checking batch counts in a host build
+ */
+class GpuBatchBackend {
+public:
+	virtual ~GpuBatchBackend() {
+	}
+
+	/**
+	 * prev: states applied by the previous batch, NULL if the device state is unknown
+	 */
+	virtual void ApplyStates(const GpuRenderStates & states, const GpuRenderStates * prev) = 0;
+	virtual void DrawIndexed(int primType, int vertexCount, int firstIndex, int primCount) = 0;
+};
+
+class GpuBatcher {
+private:
+	GpuBatch batches[MAX_BATCH_COUNT];
+	int nb_batches;
+
+	// first index not in a batch yet
+	int batch_start;
+
+	GpuRenderStates applied;
+	bool applied_valid;
+
+	GpuBatchBackend * backend;
+
+	GpuBatchStats stats;
+	GpuBatchStats frameStats;
+
+public:
+	GpuBatcher();
+
+	void SetBackend(GpuBatchBackend * b) {
+		backend = b;
+	}
+
+	/**
+	 * The states are about to change: the indices since the last batch
+	 * become a batch drawn with the old states
+	 */
+	void Close(const GpuRenderStates & states, int primType, int indicesCount, int verticesCount);
+
+	/**
+	 * Submit all closed batches to the backend
+	 */
+	void Flush(int verticesCount);
+
+	/**
+	 * Index buffer restarted (new frame)
+	 */
+	void Reset();
+
+	/**
+	 * Device states changed behind our back (Xe_InvalidateState, clear ...)
+	 */
+	void InvalidateStates() {
+		applied_valid = false;
+	}
+
+	/**
+	 * Keep the counters of the finished frame
+	 */
+	void EndFrame();
+
+	int PendingBatches() {
+		return nb_batches;
+	}
+
+	const GpuBatchStats & GetFrameStats() {
+		return frameStats;
+	}
+};
+
+#endif	/* GPUBATCH_H */
@@ -22,6 +22,7 @@
 #define TR {printf("[Trace] in function %s, line %d, file %s\n",__FUNCTION__,__LINE__,__FILE__);}
 #endif
 #include "GpuRenderer.h"
+#include "vram_readback.h"
 
 // instance
 GpuRenderer gpuRenderer;
@@ -293,31 +294,52 @@ void GpuRenderer::InitPostProcess() {
 	BeginPostProcess();
 }
 
-void GpuRenderer::UpdatesStates() {
-	if (m_RenderStates.surface) {
-		m_RenderStates.surface->use_filtering = XE_TEXF_POINT;
-		if (postprocessenabled)
-			m_RenderStates.surface->use_filtering = XE_TEXF_LINEAR;
+/**
+ * Batch backend: only send what differs from the previous batch
+ */
+void GpuRenderer::ApplyStates(const GpuRenderStates & states, const GpuRenderStates * prev) {
+	if (!prev || prev->surface != states.surface) {
+		if (states.surface) {
+			states.surface->use_filtering = XE_TEXF_POINT;
+			if (postprocessenabled)
+				states.surface->use_filtering = XE_TEXF_LINEAR;
+		}
+		Xe_SetTexture(xe, 0, states.surface);
 	}
-	Xe_SetTexture(xe, 0, m_RenderStates.surface);
 
-	if (m_RenderStates.blending_enabled) {
-		Xe_SetBlendControl(xe,
-			m_RenderStates.blend_src, m_RenderStates.blend_op, m_RenderStates.blend_dst,
-			m_RenderStates.blend_src, m_RenderStates.blend_op, m_RenderStates.blend_dst);
-	} else {
-		Xe_SetBlendControl(xe,
-			XE_BLEND_ONE, XE_BLENDOP_ADD, XE_BLEND_ZERO,
-			XE_BLEND_ONE, XE_BLENDOP_ADD, XE_BLEND_ZERO);
+	if (!prev ||
+			prev->blending_enabled != states.blending_enabled ||
+			prev->blend_src != states.blend_src ||
+			prev->blend_dst != states.blend_dst ||
+			prev->blend_op != states.blend_op) {
+		if (states.blending_enabled) {
+			Xe_SetBlendControl(xe,
+				states.blend_src, states.blend_op, states.blend_dst,
+				states.blend_src, states.blend_op, states.blend_dst);
+		} else {
+			Xe_SetBlendControl(xe,
+				XE_BLEND_ONE, XE_BLENDOP_ADD, XE_BLEND_ZERO,
+				XE_BLEND_ONE, XE_BLENDOP_ADD, XE_BLEND_ZERO);
+		}
 	}
 
-	Xe_SetAlphaFunc(xe, m_RenderStates.alpha_test_func);
-	Xe_SetAlphaRef(xe, m_RenderStates.alpha_test_ref);
-	Xe_SetAlphaTestEnable(xe, m_RenderStates.alpha_test_enable);
+	if (!prev ||
+			prev->alpha_test_func != states.alpha_test_func ||
+			prev->alpha_test_ref != states.alpha_test_ref ||
+			prev->alpha_test_enable != states.alpha_test_enable) {
+		Xe_SetAlphaFunc(xe, states.alpha_test_func);
+		Xe_SetAlphaRef(xe, states.alpha_test_ref);
+		Xe_SetAlphaTestEnable(xe, states.alpha_test_enable);
+	}
 
-	Xe_SetZEnable(xe, m_RenderStates.z_enable);
-	Xe_SetZWrite(xe, m_RenderStates.z_write);
-	Xe_SetZFunc(xe, m_RenderStates.z_func);
+	if (!prev ||
+			prev->z_enable != states.z_enable ||
+			prev->z_write != states.z_write ||
+			prev->z_func != states.z_func) {
+		Xe_SetZEnable(xe, states.z_enable);
+		Xe_SetZWrite(xe, states.z_write);
+		Xe_SetZFunc(xe, states.z_func);
+	}
 
 	//nw
 /*	Xe_SetStencilEnable(xe, 1);
@@ -325,22 +347,40 @@ void GpuRenderer::UpdatesStates() {
 	Xe_SetStencilWriteMask(xe, 3, 2);
 	Xe_SetStencilOp(xe, 3, -1, XE_STENCILOP_INCR, XE_STENCILOP_ZERO);*/
 
-	if (m_RenderStates.currentPsShader)
-		Xe_SetShader(xe, SHADER_TYPE_PIXEL, m_RenderStates.currentPsShader, 0);
-	else
-		Xe_SetShader(xe, SHADER_TYPE_PIXEL, g_pPixelShaderC, 0);
+	if (!prev || prev->currentPsShader != states.currentPsShader) {
+		if (states.currentPsShader)
+			Xe_SetShader(xe, SHADER_TYPE_PIXEL, states.currentPsShader, 0);
+		else
+			Xe_SetShader(xe, SHADER_TYPE_PIXEL, g_pPixelShaderC, 0);
+	}
+
+	if (!prev ||
+			prev->scissor_enable != states.scissor_enable ||
+			prev->scissor_left != states.scissor_left ||
+			prev->scissor_top != states.scissor_top ||
+			prev->scissor_right != states.scissor_right ||
+			prev->scissor_bottom != states.scissor_bottom) {
+		Xe_SetScissor(xe, states.scissor_enable,
+				states.scissor_left, states.scissor_top, states.scissor_right, states.scissor_bottom);
+	}
+}
+
+void GpuRenderer::DrawIndexed(int primType, int vertexCount, int firstIndex, int primCount) {
+	Xe_DrawIndexedPrimitive(xe, (primType == PRIM_RECTLIST) ?XE_PRIMTYPE_RECTLIST:XE_PRIMTYPE_TRIANGLELIST, 0, 0, vertexCount, firstIndex, primCount);
+}
 
-	Xe_SetScissor(xe, m_RenderStates.scissor_enable,
-			m_RenderStates.scissor_left, m_RenderStates.scissor_top, m_RenderStates.scissor_right, m_RenderStates.scissor_bottom);
+/**
+ * States are about to change, keep the pending primitives in a batch
+ */
+void GpuRenderer::CloseBatch() {
+	m_Batcher.Close(m_RenderStates, (m_PrimType == PRIM_RECTLIST) ? PRIM_RECTLIST : PRIM_TRIANGLE, indicesCount(), verticesCount());
 }
 
 void GpuRenderer::SubmitVertices() {
-	// update render states
-	UpdatesStates();
+	CloseBatch();
 
 	// draw
-	Xe_DrawIndexedPrimitive(xe, (m_PrimType == PRIM_RECTLIST) ?XE_PRIMTYPE_RECTLIST:XE_PRIMTYPE_TRIANGLELIST, 0, 0, verticesCount(), prevIndicesCount, (indicesCount() - prevIndicesCount) / 3);
-	prevIndicesCount = indicesCount();
+	m_Batcher.Flush(verticesCount());
 }
 
 void GpuRenderer::InitStates() {
@@ -454,27 +494,36 @@ void GpuRenderer::Unlock() {
 		Xe_IB_Unlock(xe, pIb);
 }
 
+/**
+ * Lock again, keep adding after the vertices already there
+ */
+void GpuRenderer::Relock() {
+	Lock();
+	pCurrentVertex = pFirstVertex + nb_vertices;
+	pCurrentIndice = pFirstIndice + nb_indices;
+}
+
 /**
  *
  * @param s
  */
 void GpuRenderer::SetTexture(struct XenosSurface * s) {
 	if (s != m_RenderStates.surface) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.surface = s;
 	}
 }
 
 void GpuRenderer::EnableTexture() {
 	if (m_RenderStates.currentPsShader != g_pPixelShaderG) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.currentPsShader = g_pPixelShaderG;
 	}
 }
 
 void GpuRenderer::DisableTexture() {
 	if (m_RenderStates.currentPsShader != g_pPixelShaderC) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.currentPsShader = g_pPixelShaderC;
 	}
 }
@@ -490,6 +539,9 @@ void GpuRenderer::Clear(uint32_t flags) {
 	Xe_Clear(xe,flags);
 	Xe_Execute(xe);
 	clearing = true;
+
+	// the clear uses its own states
+	m_Batcher.InvalidateStates();
 }
 
 void GpuRenderer::ClearColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
@@ -503,21 +555,21 @@ void GpuRenderer::ClearColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
  */
 void GpuRenderer::DisableBlend() {
 	if (m_RenderStates.blending_enabled) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.blending_enabled = 0;
 	}
 }
 
 void GpuRenderer::EnableBlend() {
 	if (!m_RenderStates.blending_enabled) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.blending_enabled = 1;
 	}
 }
 
 void GpuRenderer::SetBlendFunc(int src, int dst) {
 	if ((m_RenderStates.blend_src != src) || (m_RenderStates.blend_dst != dst)) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.blend_src = src;
 		m_RenderStates.blend_dst = dst;
 	}
@@ -525,7 +577,7 @@ void GpuRenderer::SetBlendFunc(int src, int dst) {
 
 void GpuRenderer::SetBlendOp(int op) {
 	if (m_RenderStates.blend_op != op) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.blend_op = op;
 	}
 }
@@ -537,7 +589,7 @@ void GpuRenderer::SetBlendOp(int op) {
  */
 void GpuRenderer::SetAlphaFunc(int func, float ref) {
 	if ((m_RenderStates.alpha_test_func != func) || (m_RenderStates.alpha_test_ref != ref)) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.alpha_test_func = func;
 		m_RenderStates.alpha_test_ref = ref;
 	}
@@ -545,14 +597,14 @@ void GpuRenderer::SetAlphaFunc(int func, float ref) {
 
 void GpuRenderer::EnableAlphaTest() {
 	if (!m_RenderStates.alpha_test_enable) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.alpha_test_enable = 1;
 	}
 }
 
 void GpuRenderer::DisableAlphaTest() {
 	if (m_RenderStates.alpha_test_enable) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.alpha_test_enable = 0;
 	}
 }
@@ -573,7 +625,7 @@ void GpuRenderer::SetScissor(uint32_t x, uint32_t y, uint32_t width, uint32_t he
 			m_RenderStates.scissor_bottom != bottom
 
 			) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.scissor_left = left;
 		m_RenderStates.scissor_top = top;
 		m_RenderStates.scissor_right = right;
@@ -583,14 +635,14 @@ void GpuRenderer::SetScissor(uint32_t x, uint32_t y, uint32_t width, uint32_t he
 
 void GpuRenderer::DisableScissor() {
 	if (m_RenderStates.scissor_enable) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.scissor_enable = 0;
 	}
 };
 
 void GpuRenderer::EnableScissor() {
 	if (!m_RenderStates.scissor_enable) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.scissor_enable = 1;
 	}
 };
@@ -600,7 +652,7 @@ void GpuRenderer::EnableScissor() {
  */
 void GpuRenderer::EnableDepthTest() {
 	if (!m_RenderStates.z_write || !m_RenderStates.z_enable) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.z_write = 1;
 		m_RenderStates.z_enable = 1;
 	}
@@ -608,7 +660,7 @@ void GpuRenderer::EnableDepthTest() {
 
 void GpuRenderer::DisableDepthTest() {
 	if (m_RenderStates.z_write || m_RenderStates.z_enable) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.z_write = 0;
 		m_RenderStates.z_enable = 0;
 	}
@@ -616,11 +668,30 @@ void GpuRenderer::DisableDepthTest() {
 
 void GpuRenderer::DepthFunc(int func) {
 	if (m_RenderStates.z_func != func) {
-		SubmitVertices();
+		CloseBatch();
 		m_RenderStates.z_func = func;
 	}
 }
 
+// vram_readback.cpp resolve step
+static void XeReadbackResolve() {
+	gpuRenderer.ResolveReadback();
+}
+
+static const uint32_t * XeReadbackLock(int * width, int * height, int * pitch) {
+	return gpuRenderer.LockReadback(width, height, pitch);
+}
+
+static void XeReadbackUnlock() {
+	gpuRenderer.UnlockReadback();
+}
+
+static const vramResolver_t xeResolver = {
+	XeReadbackResolve,
+	XeReadbackLock,
+	XeReadbackUnlock
+};
+
 /**
  * Init
  */
@@ -632,6 +703,10 @@ void GpuRenderer::Init() {
 	pIb = Xe_CreateIndexBuffer(xe, MAX_VERTEX_COUNT * sizeof (uint16_t), XE_FMT_INDEX16);
 
 	m_RenderStates.currentPsShader = g_pPixelShaderC;
+	m_Batcher.SetBackend(this);
+	pReadbackSurface = NULL;
+	readback_pending = false;
+	SetVRamResolver(&xeResolver);
 	InitPostProcess();
 	Lock();
 }
@@ -645,6 +720,9 @@ static float screen[2] = {0, 0};
 static float mwp[4][4];
 
 void GpuRenderer::SetOrtho(float l, float r, float b, float t, float zn, float zf) {
+	// pending batches use the previous matrix
+	SubmitVertices();
+
 	/*
 	screen[0] = r;
 	screen[1] = b;
@@ -735,6 +813,8 @@ void GpuRenderer::Render() {
 	// Resolve in temporary surface
 	RenderPostProcess();
 
+	m_Batcher.EndFrame();
+
 	rendering = true;
 
 	Xe_ResolveInto(xe, Xe_GetFramebufferSurface(xe), XE_SOURCE_COLOR, XE_CLEAR_DS);
@@ -765,19 +845,79 @@ void GpuRenderer::FinishPendingRender() {
 
 	// relock
 	Lock();
+	RestoreStates();
+	// Wireframe
+	//Xe_SetFillMode(xe,0x25,0x25);
+
+	m_Batcher.Reset();
+
+	nb_indices = 0;
+	nb_vertices = 0;
+}
+
+/**
+ * After Xe_InvalidateState
+ */
+void GpuRenderer::RestoreStates() {
 	Xe_SetCullMode(xe, XE_CULL_NONE);
 	Xe_SetVertexShaderConstantF(xe, 0, (float*) mwp, 4);
 	Xe_SetVertexShaderConstantF(xe, 1, (float*) screen, 1);
 
 	// restore shader
 	Xe_SetShader(xe, SHADER_TYPE_VERTEX, g_pVertexShader, 0);
-	// Wireframe
-	//Xe_SetFillMode(xe,0x25,0x25);
 
-	prevIndicesCount = 0;
+	m_Batcher.InvalidateStates();
+}
 
-	nb_indices = 0;
-	nb_vertices = 0;
+/**
+ * Vram readback
+ */
+void GpuRenderer::ResolveReadback() {
+	// previous frame still running
+	FinishPendingRender();
+
+	// everything drawn up to now must be in edram
+	SubmitVertices();
+	Unlock();
+	FinishPendingClear();
+
+	if (pReadbackSurface == NULL)
+		pReadbackSurface = Xe_CreateTexture(xe, pRenderSurface->width, pRenderSurface->height, 0, XE_FMT_8888 | XE_FMT_ARGB, 0);
+
+	// copy, don't clear: the frame goes on
+	Xe_ResolveInto(xe, pReadbackSurface, XE_SOURCE_COLOR, 0);
+	Xe_Execute(xe); // start background resolve !
+	readback_pending = true;
+
+	Xe_InvalidateState(xe);
+	Relock();
+	RestoreStates();
+}
+
+const uint32_t * GpuRenderer::LockReadback(int * width, int * height, int * pitch) {
+	if (pReadbackSurface == NULL)
+		return NULL;
+
+	if (readback_pending) {
+		// vertices added since the resolve go with the sync
+		Unlock();
+		Xe_Sync(xe); // wait for background resolve to finish !
+		readback_pending = false;
+
+		Xe_InvalidateState(xe);
+		Relock();
+		RestoreStates();
+	}
+
+	*width = pReadbackSurface->width;
+	*height = pReadbackSurface->height;
+	*pitch = pReadbackSurface->wpitch / 4;
+
+	return (const uint32_t *) Xe_Surface_LockRect(xe, pReadbackSurface, 0, 0, 0, 0, XE_LOCK_READ);
+}
+
+void GpuRenderer::UnlockReadback() {
+	Xe_Surface_Unlock(xe, pReadbackSurface);
 }
 
 void GpuRenderer::FinishPendingClear() {
@@ -812,7 +952,7 @@ void GpuRenderer::NextIndice() {
 
 void GpuRenderer::primBegin(int primType) {
 	if(m_PrimType!=primType){
-		SubmitVertices();
+		CloseBatch();
 		m_PrimType = primType;
 	}
 	
@@ -880,6 +1020,10 @@ static int n_texture = 0;
 static uint64_t allocated_texture_size = 0;
 
 void GpuRenderer::DestroyTexture(XenosSurface *surf) {
+	// pending batches may still use it
+	if (m_Batcher.PendingBatches())
+		SubmitVertices();
+
 	if (surf) {
 		allocated_texture_size -= surf->hpitch * surf->wpitch;
 		n_texture--;
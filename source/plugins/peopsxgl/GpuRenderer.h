@@ -9,6 +9,7 @@
 #define	GPURENDERER_H
 
 #include "gpu_types.h"
+#include "GpuBatch.h"
 
 #define XE_TEXF_POINT 0
 #define XE_TEXF_LINEAR 1
@@ -42,7 +43,7 @@ enum GlExt {
 
 extern "C" void systemPoll();
 
-class GpuRenderer {
+class GpuRenderer : public GpuBatchBackend {
 private:
 
 	/**
@@ -76,6 +77,12 @@ private:
 
 	bool rendering;
 	bool clearing;
+
+	/**
+	 * Vram readback
+	 */
+	GpuTex * pReadbackSurface;
+	bool readback_pending;
 	
 	/**
 	 * Post process
@@ -88,56 +95,15 @@ private:
 	/**
 	 * Render states
 	 */
-	struct RenderStates {
-		// texture
-		GpuTex * surface;
-
-		// shader
-		GpuPS * currentPsShader;
-
-		// z / depth
-		int32_t z_func;
-		uint32_t z_write;
-		uint32_t z_enable;
-
-		// fillmode
-		uint32_t fillmode_front;
-		uint32_t fillmode_back;
-
-		// blend
-		int32_t blend_op;
-		int32_t blend_src;
-		int32_t blend_dst;
-		int32_t blending_enabled;
-
-		// cull mode
-		uint32_t cullmode;
-
-		// alpha test
-		uint32_t alpha_test_enable;
-		int32_t alpha_test_func;
-		float alpha_test_ref;
-
-		// stencil
-		uint32_t stencil_enable;
-		uint32_t stencil_func;
-		uint32_t stencil_op;
-		uint32_t stencil_ref;
-		uint32_t stencil_mask;
-		uint32_t stencil_writemask;
-
-		// scissor
-		uint32_t scissor_enable;
-		uint32_t scissor_left;
-		uint32_t scissor_top;
-		uint32_t scissor_right;
-		uint32_t scissor_bottom;
-	};
+	GpuRenderStates m_RenderStates;
 
-	RenderStates m_RenderStates;
+	/**
+	 * Pending draw batches
+	 */
+	GpuBatcher m_Batcher;
 
 private:
-	void UpdatesStates();
+	void CloseBatch();
 	void SubmitVertices();
 
 
@@ -154,6 +120,8 @@ private:
 
 	void Lock();
 	void Unlock();
+	void Relock();
+	void RestoreStates();
 public:
 
 
@@ -219,6 +187,13 @@ public:
 	void FinishPendingClear();
 	void Render();
 
+	/**
+	 * Vram readback: resolve what is drawn so far, without waiting
+	 */
+	void ResolveReadback();
+	const uint32_t * LockReadback(int * width, int * height, int * pitch);
+	void UnlockReadback();
+
 	/**
 	 * Gl like func
 	 */
@@ -246,9 +221,18 @@ public:
 
 	int verticesCount();
 	int indicesCount();
-	int prevIndicesCount;
 	int prevVerticesCount;
 
+	/**
+	 * Batch backend
+	 */
+	void ApplyStates(const GpuRenderStates & states, const GpuRenderStates * prev);
+	void DrawIndexed(int primType, int vertexCount, int firstIndex, int primCount);
+
+	const GpuBatchStats & GetBatchStats() {
+		return m_Batcher.GetFrameStats();
+	}
+
 	// viewport
 	void SetViewPort(int left, int top, int right, int bottom);
 	void SetOrtho(float l, float r, float b, float t, float zn, float zf);
@@ -21,47 +21,198 @@
 #include <math.h>
 #include "externals.h"
 
-//BOOL bGteAccuracy = TRUE;
-//float ***gteCoords = NULL;
+// Subpixel vertex cache: a small open addressed hash, keyed on the packed
+// integer screen coords, replacing the 128 MB float[4096][4096][2] table.
+// Every entry carries the generation (frame) it was written in; entries of
+// the current and the previous frame are live, so vertices the game
+// transforms before a flip and draws after it still match. Starting a new
+// frame is a counter increment, nothing gets cleared: older entries stay
+// in the probe chains as dead slots that new vertices reuse. Only a slot
+// that was never used ends a chain, and chains are cut at GTE_PROBE_MAX.
+// Once too many slots were used, or the generation wraps, the live entries
+// get rehashed into a clean table.
+// The table is allocated once at its maximum size (GPUaddVertex runs on the
+// emulation thread, getGteVertex on the gpu thread), only the used part
+// grows when the vertex count of the last frames needs it.
 
-typedef float (*gteCoords_t)[0x800 * 2][2];
-static gteCoords_t gteCoords = NULL;
-// TODO: use malloc and pointer to the array's center.
-// 08000000
+#define GTE_CACHE_MINBITS 12
+#define GTE_CACHE_MAXBITS 17
+
+#define GTE_KEY(sx, sy) ((((uint32_t)(sy) & 0xfff) << 12) | ((uint32_t)(sx) & 0xfff))
+#define GTE_KEYMASK 0xffffff
+#define GTE_GENSHIFT 24
+#define GTE_GENMAX 0xff
+#define GTE_PROBE_MAX 32
+
+typedef struct {
+	uint32_t key;		// generation << 24 | packed sy/sx, generation 0: never used
+	float x;
+	float y;
+} gteVertex_t;
+
+static gteVertex_t *gteCache = NULL;
+static int gteCacheBits = GTE_CACHE_MINBITS;
+static uint32_t gteCacheMask = (1 << GTE_CACHE_MINBITS) - 1;
+static uint32_t gteGen = 1;
+static uint32_t gtePrevGen = 0;
+static uint32_t gteCount = 0;
+static uint32_t gtePrevCount = 0;
+static uint32_t gteUsed = 0;	// slots with a generation, live or dead
 
 using namespace xegpu;
 
+static inline uint32_t gteHash(uint32_t key) {
+	return ((key & GTE_KEYMASK) * 0x9E3779B1) >> (32 - gteCacheBits);
+}
+
+static inline int gteLive(uint32_t key) {
+	uint32_t gen = key >> GTE_GENSHIFT;
+	return gen == gteGen || (gen && gen == gtePrevGen);
+}
+
+static void clearGteCache() {
+	memset(gteCache, 0, (1 << GTE_CACHE_MAXBITS) * sizeof(gteVertex_t));
+	gteGen = 1;
+	gtePrevGen = 0;
+	gteCount = gtePrevCount = 0;
+	gteUsed = 0;
+}
+
+// slot of key: its live entry, else the first free one of its chain
+static int gteSlot(uint32_t key, int *live) {
+	uint32_t i, k, n;
+	int slot = -1;
+
+	*live = 0;
+
+	for (n = 0, i = gteHash(key); n < GTE_PROBE_MAX; n++, i = (i + 1) & gteCacheMask) {
+		k = gteCache[i].key;
+
+		if (gteLive(k)) {
+			if ((k & GTE_KEYMASK) != (key & GTE_KEYMASK)) continue;
+			*live = 1;
+			return i;
+		}
+
+		// dead or never used: taken unless the key is further on
+		if (slot < 0) slot = i;
+		if (k == 0) break;
+	}
+
+	return slot;
+}
+
+static void gteStore(uint32_t key, float x, float y) {
+	int i, live;
+
+	i = gteSlot(key, &live);
+	if (i < 0) return; // long chain: no subpixel precision
+
+	if (live) {
+		if (gteCache[i].key != key) {
+			gtePrevCount--;
+			gteCount++;
+		}
+	} else {
+		// keep the table at most 3/4 full, later vertices just lose subpixel precision
+		if (gteCount + gtePrevCount >= (gteCacheMask >> 2) * 3) return;
+		if (gteCache[i].key == 0) gteUsed++;
+		gteCount++;
+	}
+
+	gteCache[i].x = x;
+	gteCache[i].y = y;
+	gteCache[i].key = key;
+}
+
 EXTERN void CALLBACK GPUaddVertex(short sx, short sy, long long fx, long long fy, long long fz) {
-	if (peops_cfg.bGteAccuracy) {
+	if (peops_cfg.bGteAccuracy && gteCache) {
 		if (sx >= -0x800 && sx <= 0x7ff &&
 				sy >= -0x800 && sy <= 0x7ff) {
-			gteCoords[sy + 0x800][sx + 0x800][0] = fx / 65536.0f;
-			gteCoords[sy + 0x800][sx + 0x800][1] = fy / 65536.0f;
+			gteStore((gteGen << GTE_GENSHIFT) | GTE_KEY(sx, sy), fx / 65536.0f, fy / 65536.0f);
 		}
 	}
 }
 
 void resetGteVertices() {
 	if (peops_cfg.bGteAccuracy) {
-		if (gteCoords == NULL)
-			gteCoords = (gteCoords_t) malloc(0x8000000);
-		memset(gteCoords, 0x00, 0x8000000);
+		if (gteCache == NULL)
+			gteCache = (gteVertex_t *) malloc((1 << GTE_CACHE_MAXBITS) * sizeof(gteVertex_t));
+		gteCacheBits = GTE_CACHE_MINBITS;
+		gteCacheMask = (1 << GTE_CACHE_MINBITS) - 1;
+		clearGteCache();
+	}
+}
+
+// put the entries of the frame that just ended into a clean table
+static void rehashGteCache(int bits) {
+	gteVertex_t *live;
+	uint32_t i, n = 0, gen = gtePrevGen;
+
+	live = (gteVertex_t *) malloc(gtePrevCount * sizeof(gteVertex_t) + 1);
+
+	for (i = 0; live && i <= gteCacheMask && n < gtePrevCount; i++) {
+		if ((gteCache[i].key >> GTE_GENSHIFT) == gen)
+			live[n++] = gteCache[i];
 	}
+
+	gteCacheBits = bits;
+	gteCacheMask = (1 << bits) - 1;
+	memset(gteCache, 0, (gteCacheMask + 1) * sizeof(gteVertex_t));
+
+	gtePrevGen = 1;
+	gteGen = 2;
+	gteCount = gtePrevCount = 0;
+	gteUsed = 0;
+
+	for (i = 0; i < n; i++)
+		gteStore((1 << GTE_GENSHIFT) | (live[i].key & GTE_KEYMASK), live[i].x, live[i].y);
+
+	gtePrevCount = gteCount;
+	gteCount = 0;
+
+	free(live);
+}
+
+// called once per frame
+void nextGteFrame() {
+	int grow;
+
+	if (!peops_cfg.bGteAccuracy || !gteCache) return;
+
+	// last frames filled more than 3/8: grow
+	grow = gteCount + gtePrevCount >= (gteCacheMask >> 3) * 3 && gteCacheBits < GTE_CACHE_MAXBITS;
+
+	gtePrevGen = gteGen;
+	gtePrevCount = gteCount;
+	gteCount = 0;
+
+	if (grow || ++gteGen > GTE_GENMAX || gteUsed >= (gteCacheMask >> 3) * 7)
+		rehashGteCache(grow ? gteCacheBits + 1 : gteCacheBits);
 }
 
 int getGteVertex(short sx, short sy, float *fx, float *fy) {
-	if (peops_cfg.bGteAccuracy) {
+	uint32_t key, i, n;
+
+	if (peops_cfg.bGteAccuracy && gteCache) {
 		if (sx >= -0x800 && sx <= 0x7ff &&
 				sy >= -0x800 && sy <= 0x7ff) {
-			if ((fabsf(gteCoords[sy + 0x800][sx + 0x800][0] - sx) < 1.0) &&
-					(fabsf(gteCoords[sy + 0x800][sx + 0x800][1] - sy) < 1.0)) {
-				*fx = gteCoords[sy + 0x800][sx + 0x800][0];
-				*fy = gteCoords[sy + 0x800][sx + 0x800][1];
+			key = GTE_KEY(sx, sy);
+
+			for (n = 0, i = gteHash(key); n < GTE_PROBE_MAX && gteCache[i].key; n++, i = (i + 1) & gteCacheMask) {
+				if (!gteLive(gteCache[i].key) || (gteCache[i].key & GTE_KEYMASK) != key) continue;
 
-				return 1;
+				if ((fabsf(gteCache[i].x - sx) < 1.0) &&
+						(fabsf(gteCache[i].y - sy) < 1.0)) {
+					*fx = gteCache[i].x;
+					*fy = gteCache[i].y;
+
+					return 1;
+				}
+				break;
 			}
 		}
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
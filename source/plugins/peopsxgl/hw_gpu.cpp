@@ -39,6 +39,7 @@ using namespace xegpu;
 #include "texture.h"
 #include "gte_accuracy.h"
 #include "GpuRenderer.h"
+#include "vram_readback.h"
 
 #ifdef ENABLE_NLS
 #include <libintl.h>
@@ -888,7 +889,9 @@ static void ShowFPS() {
 	nowTick = mftb() / (PPC_TIMEBASE_FREQ / 1000);
 	if (lastTick + 1000 <= nowTick) {
 
-		printf("GPUupdateLace %d fps\r\n", frames);
+		const GpuBatchStats & bs = gpuRenderer.GetBatchStats();
+		printf("GPUupdateLace %d fps, last frame: %d draws (%d merged, %d states skipped)\r\n",
+				frames, bs.draws, bs.merged, bs.redundant_states);
 
 		frames = 0;
 		lastTick = nowTick;
@@ -902,6 +905,8 @@ EXTERN void CALLBACK GPUupdateLace(void) {
 	// STATUSREG^=0x80000000;                               // interlaced bit toggle, if the CC game fix is not active (see gpuReadStatus)
 	ShowFPS();
 
+	nextGteFrame(); // age subpixel vertices of older frames
+
 	if (!(peops_cfg.dwActFixes & 128)) // normal frame limit func
 		CheckFrameRate();
 
@@ -1259,14 +1264,12 @@ __inline void FinishedVRAMRead(void) {
 
 ////////////////////////////////////////////////////////////////////////
 // vram read check ex (reading from card's back/frontbuffer if needed...
-// slow!)
+// the resolve is scheduled in vram_readback.cpp)
 ////////////////////////////////////////////////////////////////////////
 
 void CheckVRamReadEx(int x, int y, int dx, int dy) {
 	unsigned short sArea;
-	int ux, uy, udx, udy, wx, wy;
-	unsigned short * p1, *p2;
-	float XS, YS;
+	int ux, uy, udx, udy, mx, my;
 
 	if (STATUSREG & GPUSTATUS_RGB24) return;
 
@@ -1298,7 +1301,9 @@ void CheckVRamReadEx(int x, int y, int dx, int dy) {
 
 	//////////////
 
-	p2 = 0;
+	// the whole display area is read back, and stored into the other
+	// display buffer too if it has the same size
+	mx = my = -1;
 
 	if (sArea == 0) {
 		ux = PSXDisplay.DisplayPosition.x;
@@ -1308,9 +1313,10 @@ void CheckVRamReadEx(int x, int y, int dx, int dy) {
 		if ((PreviousPSXDisplay.DisplayEnd.x -
 				PreviousPSXDisplay.DisplayPosition.x) == udx &&
 				(PreviousPSXDisplay.DisplayEnd.y -
-				PreviousPSXDisplay.DisplayPosition.y) == udy)
-			p2 = (psxVuw + (1024 * PreviousPSXDisplay.DisplayPosition.y) +
-				PreviousPSXDisplay.DisplayPosition.x);
+				PreviousPSXDisplay.DisplayPosition.y) == udy) {
+			mx = PreviousPSXDisplay.DisplayPosition.x;
+			my = PreviousPSXDisplay.DisplayPosition.y;
+		}
 	} else {
 		ux = PreviousPSXDisplay.DisplayPosition.x;
 		uy = PreviousPSXDisplay.DisplayPosition.y;
@@ -1319,115 +1325,28 @@ void CheckVRamReadEx(int x, int y, int dx, int dy) {
 		if ((PSXDisplay.DisplayEnd.x -
 				PSXDisplay.DisplayPosition.x) == udx &&
 				(PSXDisplay.DisplayEnd.y -
-				PSXDisplay.DisplayPosition.y) == udy)
-			p2 = (psxVuw + (1024 * PSXDisplay.DisplayPosition.y) +
-				PSXDisplay.DisplayPosition.x);
+				PSXDisplay.DisplayPosition.y) == udy) {
+			mx = PSXDisplay.DisplayPosition.x;
+			my = PSXDisplay.DisplayPosition.y;
+		}
 	}
 
-	p1 = (psxVuw + (1024 * uy) + ux);
-	if (p1 == p2) p2 = 0;
-
-	x = 0;
-	y = 0;
-	wx = dx = udx;
-	wy = dy = udy;
+	if (mx == ux && my == uy) mx = my = -1;
 
 	if (udx <= 0) return;
 	if (udy <= 0) return;
-	if (dx <= 0) return;
-	if (dy <= 0) return;
-	if (wx <= 0) return;
-	if (wy <= 0) return;
-
-	XS = (float) rRatioRect.right / (float) wx;
-	YS = (float) rRatioRect.bottom / (float) wy;
-
-	dx = (int) ((float) (dx) * XS);
-	dy = (int) ((float) (dy) * YS);
-
-	if (dx > peops_cfg.iResX) dx = peops_cfg.iResX;
-	if (dy > peops_cfg.iResY) dy = peops_cfg.iResY;
-
-	if (dx <= 0) return;
-	if (dy <= 0) return;
-
-	// ogl y adjust
-	y = peops_cfg.iResY - y - dy;
-
-	x += rRatioRect.left;
-	y -= rRatioRect.top;
-
-	if (y < 0) y = 0;
-	if ((y + dy) > peops_cfg.iResY) dy = peops_cfg.iResY - y;
-
-	TR;
-#if 0
-	unsigned char * ps;
-	unsigned char * px;
-	unsigned short s, sx;
-
-	if (!pGfxCardScreen) {
-		glPixelStorei(GL_PACK_ALIGNMENT, 1);
-		pGfxCardScreen = (unsigned char *) malloc(iResX * iResY * 4);
-	}
 
-	ps = pGfxCardScreen;
-
-	if (!sArea) glReadBuffer(GL_FRONT);
-
-	glReadPixels(x, y, dx, dy, GL_RGB, GL_UNSIGNED_BYTE, ps);
-
-	if (!sArea) glReadBuffer(GL_BACK);
-
-	s = 0;
-
-	XS = (float) dx / (float) (udx);
-	YS = (float) dy / (float) (udy + 1);
-
-	for (y = udy; y > 0; y--) {
-		for (x = 0; x < udx; x++) {
-			if (p1 >= psxVuw && p1 < psxVuw_eom) {
-				px = ps + (3 * ((int) ((float) x * XS))+
-						(3 * dx)*((int) ((float) y * YS)));
-				sx = (*px) >> 3;
-				px++;
-				s = sx;
-				sx = (*px) >> 3;
-				px++;
-				s |= sx << 5;
-				sx = (*px) >> 3;
-				s |= sx << 10;
-				s &= ~0x8000;
-				*p1 = s;
-			}
-			if (p2 >= psxVuw && p2 < psxVuw_eom) *p2 = s;
-
-			p1++;
-			if (p2) p2++;
-		}
-
-		p1 += 1024 - udx;
-		if (p2) p2 += 1024 - udx;
-	}
-#endif
+	VRamReadback(ux, uy, udx, udy, ux, uy, udx, udy, mx, my);
 }
 
 ////////////////////////////////////////////////////////////////////////
 // vram read check (reading from card's back/frontbuffer if needed...
-// slow!)
+// the resolve is scheduled in vram_readback.cpp)
 ////////////////////////////////////////////////////////////////////////
 
 void CheckVRamRead(int x, int y, int dx, int dy, BOOL bFront) {
-
-	// speed hack
-	return;
-
 	unsigned short sArea;
-	unsigned short * p;
-	int ux, uy, udx, udy, wx, wy;
-	float XS, YS;
-	unsigned char * ps, * px;
-	unsigned short s = 0, sx;
+	int ux, uy, wx, wy;
 
 	if (STATUSREG & GPUSTATUS_RGB24) return;
 
@@ -1457,125 +1376,31 @@ void CheckVRamRead(int x, int y, int dx, int dy, BOOL bFront) {
 		iRenderFVR = 2;
 	}
 
-	ux = x;
-	uy = y;
-	udx = dx;
-	udy = dy;
-
 	if (sArea == 0) {
-		x -= PSXDisplay.DisplayPosition.x;
-		dx -= PSXDisplay.DisplayPosition.x;
-		y -= PSXDisplay.DisplayPosition.y;
-		dy -= PSXDisplay.DisplayPosition.y;
-		wx = PSXDisplay.DisplayEnd.x - PSXDisplay.DisplayPosition.x;
-		wy = PSXDisplay.DisplayEnd.y - PSXDisplay.DisplayPosition.y;
+		ux = PSXDisplay.DisplayPosition.x;
+		uy = PSXDisplay.DisplayPosition.y;
+		wx = PSXDisplay.DisplayEnd.x - ux;
+		wy = PSXDisplay.DisplayEnd.y - uy;
 	} else {
-		x -= PreviousPSXDisplay.DisplayPosition.x;
-		dx -= PreviousPSXDisplay.DisplayPosition.x;
-		y -= PreviousPSXDisplay.DisplayPosition.y;
-		dy -= PreviousPSXDisplay.DisplayPosition.y;
-		wx = PreviousPSXDisplay.DisplayEnd.x - PreviousPSXDisplay.DisplayPosition.x;
-		wy = PreviousPSXDisplay.DisplayEnd.y - PreviousPSXDisplay.DisplayPosition.y;
-	}
-	if (x < 0) {
-		ux -= x;
-		x = 0;
-	}
-	if (y < 0) {
-		uy -= y;
-		y = 0;
-	}
-	if (dx > wx) {
-		udx -= (dx - wx);
-		dx = wx;
-	}
-	if (dy > wy) {
-		udy -= (dy - wy);
-		dy = wy;
+		ux = PreviousPSXDisplay.DisplayPosition.x;
+		uy = PreviousPSXDisplay.DisplayPosition.y;
+		wx = PreviousPSXDisplay.DisplayEnd.x - ux;
+		wy = PreviousPSXDisplay.DisplayEnd.y - uy;
 	}
-	udx -= ux;
-	udy -= uy;
 
-	p = (psxVuw + (1024 * uy) + ux);
+	// clip to the display area
+	if (x < ux) x = ux;
+	if (y < uy) y = uy;
+	if (dx > ux + wx) dx = ux + wx;
+	if (dy > uy + wy) dy = uy + wy;
 
-	if (udx <= 0) return;
-	if (udy <= 0) return;
-	if (dx <= 0) return;
-	if (dy <= 0) return;
+	if (dx <= x) return;
+	if (dy <= y) return;
 	if (wx <= 0) return;
 	if (wy <= 0) return;
 
-	XS = (float) rRatioRect.right / (float) wx;
-	YS = (float) rRatioRect.bottom / (float) wy;
-
-	dx = (int) ((float) (dx) * XS);
-	dy = (int) ((float) (dy) * YS);
-	x = (int) ((float) x * XS);
-	y = (int) ((float) y * YS);
-
-	dx -= x;
-	dy -= y;
-
-	if (dx > peops_cfg.iResX) dx = peops_cfg.iResX;
-	if (dy > peops_cfg.iResY) dy = peops_cfg.iResY;
-
-	if (dx <= 0) return;
-	if (dy <= 0) return;
-
-	// ogl y adjust
-	y = peops_cfg.iResY - y - dy;
-
-	x += rRatioRect.left;
-	y -= rRatioRect.top;
-
-	if (y < 0) y = 0;
-	if ((y + dy) > peops_cfg.iResY) dy = peops_cfg.iResY - y;
-
-
-
-
-	TR;
-
-	if (!pGfxCardScreen) {
-		//        glPixelStorei(GL_PACK_ALIGNMENT, 1);
-		pGfxCardScreen = (unsigned char *) malloc(peops_cfg.iResX * peops_cfg.iResY * 4);
-	}
-
-	ps = pGfxCardScreen;
-
-	if (bFront) {
-		//        glReadBuffer(GL_FRONT);
-	} else {
-
-	}
-
-	//    glReadPixels(x, y, dx, dy, GL_RGB, GL_UNSIGNED_BYTE, ps);
-
-
-	XS = (float) dx / (float) (udx);
-	YS = (float) dy / (float) (udy + 1);
-
-	for (y = udy; y > 0; y--) {
-		for (x = 0; x < udx; x++) {
-			if (p >= psxVuw && p < psxVuw_eom) {
-				px = ps + (3 * ((int) ((float) x * XS))+
-						(3 * dx)*((int) ((float) y * YS)));
-				sx = (*px) >> 3;
-				px++;
-				s = sx;
-				sx = (*px) >> 3;
-				px++;
-				s |= sx << 5;
-				sx = (*px) >> 3;
-				s |= sx << 10;
-				s &= ~0x8000;
-				*p = s;
-			}
-			p++;
-		}
-		p += 1024 - udx;
-	}
-
+	// only one buffer in edram: bFront reads the same
+	VRamReadback(x, y, dx - x, dy - y, ux, uy, wx, wy, -1, -1);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -1836,6 +1661,7 @@ ENDVRAM:
 			if (gpuDataP == gpuDataC) {
 				gpuDataC = gpuDataP = 0;
 				primTableJ[gpuCommand]((unsigned char *) gpuDataM);
+				VRamReadbackPrimitive();
 
 				if (dwEmuFixes & 0x0001 || peops_cfg.dwActFixes & 0x20000) // hack for emulating "gpu busy" in some games
 					iFakePrimBusy = 4;
@@ -29,6 +29,7 @@ using namespace xegpu;
 #include "soft.h"
 #include "texture.h"
 #include "GpuRenderer.h"
+#include "vram_readback.h"
 
 ////////////////////////////////////////////////////////////////////////
 // defines
@@ -1681,6 +1682,9 @@ static void primStoreImage(unsigned char * baseAddr) {
 
     iDataReadMode = DR_VRAMTRANSFER;
 
+    // gfx card buffer reads: start resolving now, GPUreadDataMem waits for it
+    if (peops_cfg.iFrameReadType & 1) VRamReadbackAnnounce();
+
     STATUSREG |= GPUSTATUS_READYFORVRAM;
 }
 
@@ -4273,4 +4277,5 @@ void DoBufferSwap() {
 //    if(PSXDisplay.InterlacedTest)
 //        printf("InterlacedTest\r\n");
     gpuRenderer.Render();
+    VRamReadbackNextFrame();
 }
\ No newline at end of file
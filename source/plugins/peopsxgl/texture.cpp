@@ -69,6 +69,7 @@ using namespace xegpu;
 #include "GpuRenderer.h"
 #include "texture_movie.h"
 #include "texture_load.h"
+#include "texture_pagecache.h"
 
 
 #define CLUTCHK   0x00060000
@@ -101,6 +102,9 @@ using namespace xegpu;
 #define SOFFD 3072
 
 
+// ClutID hash for the sub cache index (one per SOFFB area)
+#define SUBHASH(c) ((uint32_t)((c) * 0x9E3779B1) >> 26)
+
 #define XCHECK(pos1,pos2) ((pos1._0>=pos2._1)&&(pos1._1<=pos2._0)&&(pos1._2>=pos2._3)&&(pos1._3<=pos2._2))
 #define INCHECK(pos2,pos1) ((pos1._0<=pos2._0) && (pos1._1>=pos2._1) && (pos1._2<=pos2._2) && (pos1._3>=pos2._3))
 
@@ -143,6 +147,11 @@ unsigned short (*PTCF[2]) (unsigned short);
 
 textureWndCacheEntry wcWndtexStore[MAXWNDTEXCACHE];
 textureSubCacheEntryS * pscSubtexStore[3][MAXTPAGES_MAX];
+textureSubCacheIndex * pscSubtexIndex[3][MAXTPAGES_MAX];
+unsigned short * pscSubtexNext[3][MAXTPAGES_MAX];
+uint32_t uiSubIndexGen = 1;
+uint32_t uiSubTexLRU[MAXSORTTEX_MAX];
+uint32_t uiSubTexTick = 0;
 EXLong * pxSsubtexLeft [MAXSORTTEX_MAX];
 GpuTex * uiStexturePage[MAXSORTTEX_MAX];
 
@@ -504,13 +513,21 @@ void InitializeTextureStore() {
         for (j = 0; j < MAXTPAGES; j++) {
             pscSubtexStore[i][j] = (textureSubCacheEntryS *) malloc(CSUBSIZES * sizeof (textureSubCacheEntryS));
             memset(pscSubtexStore[i][j], 0, CSUBSIZES * sizeof (textureSubCacheEntryS));
+            pscSubtexIndex[i][j] = (textureSubCacheIndex *) malloc(4 * sizeof (textureSubCacheIndex));
+            memset(pscSubtexIndex[i][j], 0, 4 * sizeof (textureSubCacheIndex));
+            pscSubtexNext[i][j] = (unsigned short *) malloc(CSUBSIZES * sizeof (unsigned short));
         }
     for (i = 0; i < MAXSORTTEX; i++) // -> info 0..511
     {
         pxSsubtexLeft[i] = (EXLong *) malloc(CSUBSIZE * sizeof (EXLong));
         memset(pxSsubtexLeft[i], 0, CSUBSIZE * sizeof (EXLong));
         uiStexturePage[i] = 0;
+        uiSubTexLRU[i] = 0;
     }
+    uiSubIndexGen = 1;
+    uiSubTexTick = 0;
+
+    InitializeTexPageCache();
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -554,6 +571,8 @@ void CleanupTextureStore() {
         for (j = 0; j < MAXTPAGES; j++) // loop tex pages
         {
             free(pscSubtexStore[i][j]); // -> clean mem
+            free(pscSubtexIndex[i][j]);
+            free(pscSubtexNext[i][j]);
         }
     for (i = 0; i < MAXSORTTEX; i++) {
         if (uiStexturePage[i]) // --> tex used ?
@@ -564,6 +583,8 @@ void CleanupTextureStore() {
         free(pxSsubtexLeft[i]); // -> clean mem
     }
     //----------------------------------------------------//
+    CleanupTexPageCache(); // converted pages
+    //----------------------------------------------------//
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -605,6 +626,7 @@ void ResetTextureArea(BOOL bDelTex) {
             (tss + SOFFC)->pos.l = 0;
             (tss + SOFFD)->pos.l = 0;
         }
+    uiSubIndexGen++;
 
     for (i = 0; i < iSortTexCnt; i++) {
         lu = pxSsubtexLeft[i];
@@ -615,10 +637,46 @@ void ResetTextureArea(BOOL bDelTex) {
             uiStexturePage[i] = 0;
         }
     }
+
+    ResetTexPageCache();
 }
 
 
 
+////////////////////////////////////////////////////////////////////////
+// sub cache index: hash chains of all used entries of one SOFFB area,
+// ordered like the area itself. Rebuilt after entries got removed.
+////////////////////////////////////////////////////////////////////////
+textureSubCacheIndex * GetSubCacheIndex(int mode, int page, int area) {
+    textureSubCacheIndex * idx = pscSubtexIndex[mode][page] + area;
+    textureSubCacheEntryS * tsg, * tsb;
+    unsigned short * next;
+    int i, h;
+
+    if (idx->gen == uiSubIndexGen) return idx;
+
+    tsg = pscSubtexStore[mode][page] + area * SOFFB;
+    next = pscSubtexNext[mode][page] + area * SOFFB;
+
+    memset(idx->head, 0, sizeof (idx->head));
+    idx->freecnt = 0;
+    idx->texmask = 0;
+
+    for (i = tsg->pos.l, tsb = tsg + i; i > 0; i--, tsb--) {
+        if (!tsb->ClutID) {
+            idx->freecnt++;
+            continue;
+        }
+        h = SUBHASH(tsb->ClutID);
+        next[i] = idx->head[h];
+        idx->head[h] = i;
+        idx->texmask |= 1ULL << (tsb->cTexID & 63);
+    }
+
+    idx->gen = uiSubIndexGen;
+    return idx;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // same for sort textures
 ////////////////////////////////////////////////////////////////////////
@@ -687,6 +745,8 @@ void InvalidateSubSTextureArea(int X, int Y, int W, int H) {
     W++;
     H++;
 
+    InvalidateTexPageCacheArea(X, Y, W, H);
+
     if (iGPUHeight == 1024) iYM = 3;
 
     py1 = min(iYM, Y >> 8);
@@ -748,6 +808,7 @@ void InvalidateSubSTextureArea(int X, int Y, int W, int H) {
 
                             tsb->ClutID = 0;
                             MarkFree(tsb);
+                            pscSubtexIndex[k][j][0].gen = 0;
                         }
 
                     //         if(npos.l & 0x00800000)
@@ -762,6 +823,7 @@ void InvalidateSubSTextureArea(int X, int Y, int W, int H) {
                                 DUMP_ISTA()
                                 tsb->ClutID = 0;
                                 MarkFree(tsb);
+                                pscSubtexIndex[k][j][1].gen = 0;
                             }
                     }
 
@@ -777,6 +839,7 @@ void InvalidateSubSTextureArea(int X, int Y, int W, int H) {
                                 DUMP_ISTA()
                                 tsb->ClutID = 0;
                                 MarkFree(tsb);
+                                pscSubtexIndex[k][j][2].gen = 0;
                             }
                     }
 
@@ -792,6 +855,7 @@ void InvalidateSubSTextureArea(int X, int Y, int W, int H) {
                                 DUMP_ISTA()
                                 tsb->ClutID = 0;
                                 MarkFree(tsb);
+                                pscSubtexIndex[k][j][3].gen = 0;
                             }
                     }
                 }
@@ -825,40 +889,55 @@ void InvalidateTextureArea(int X, int Y, int W, int H) {
 }
 
 /////////////////////////////////////////////////////////////////////////////
-// texture cache garbage collection
+// texture cache garbage collection: frees the least recently used textures,
+// only areas which may reference them (index texmask) get swept
 /////////////////////////////////////////////////////////////////////////////
 void DoTexGarbageCollection(void) {
-    static unsigned short LRUCleaned = 0;
-    unsigned short iC, iC1, iC2;
-    int i, j, iMax;
+    unsigned char bCleaned[MAXSORTTEX_MAX];
+    unsigned short iC, iOld, iFirst = 0;
+    uint64_t texmask = 0;
+    int i, j, n, iMax;
     textureSubCacheEntryS * tsb;
+    textureSubCacheIndex * idx;
 
-    iC = 4; //=iSortTexCnt/2,
-    LRUCleaned += iC; // we clean different textures each time
-    if ((LRUCleaned + iC) >= iSortTexCnt) LRUCleaned = 0; // wrap? wrap!
-    iC1 = LRUCleaned; // range of textures to clean
-    iC2 = LRUCleaned + iC;
+    memset(bCleaned, 0, iSortTexCnt);
 
-    for (iC = iC1; iC < iC2; iC++) // make some textures available
+    for (n = 0; n < 4 && n < iSortTexCnt; n++) // make some textures available
     {
-        pxSsubtexLeft[iC]->l = 0;
+        iOld = 0xffff;
+        for (iC = 0; iC < iSortTexCnt; iC++)
+            if (!bCleaned[iC] && (iOld == 0xffff || uiSubTexLRU[iC] < uiSubTexLRU[iOld]))
+                iOld = iC;
+
+        if (!n) iFirst = iOld;
+        bCleaned[iOld] = 1;
+        texmask |= 1ULL << (iOld & 63);
+        pxSsubtexLeft[iOld]->l = 0;
+        uiSubTexLRU[iOld] = uiSubTexTick;
     }
 
     for (i = 0; i < 3; i++) // remove all references to that textures
         for (j = 0; j < MAXTPAGES; j++)
             for (iC = 0; iC < 4; iC++) // loop all texture rect info areas
             {
+                idx = pscSubtexIndex[i][j] + iC;
+                if (idx->gen == uiSubIndexGen && !(idx->texmask & texmask))
+                    continue;
+
                 tsb = pscSubtexStore[i][j]+(iC * SOFFB);
                 iMax = tsb->pos.l;
                 if (iMax)
                     do {
                         tsb++;
-                        if (tsb->cTexID >= iC1 && tsb->cTexID < iC2) // info uses the cleaned textures? remove info
+                        if (tsb->ClutID && bCleaned[tsb->cTexID]) // info uses the cleaned textures? remove info
+                        {
                             tsb->ClutID = 0;
+                            idx->gen = 0;
+                        }
                     } while (--iMax);
             }
 
-    usLRUTexPage = LRUCleaned;
+    usLRUTexPage = iFirst;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -874,43 +953,46 @@ unsigned char * CheckTextureInSubSCache(int TextureMode, uint32_t GivenClutId, u
     EXLong * ul = 0, * uls;
     EXLong rfree;
     unsigned char cXAdj, cYAdj;
+    int iArea = (GivenClutId & CLUTCHK) >> CLUTSHIFT;
+    textureSubCacheIndex * idx;
+    unsigned short * next;
+    BOOL bLink = TRUE;
 
     npos.l = GETLE32((uint32_t *) & gl_ux[4]);
+    uiSubTexTick++;
 
     //--------------------------------------------------------------//
     // find matching texturepart first... speed up...
     //--------------------------------------------------------------//
     tsg = pscSubtexStore[TextureMode][GlobalTexturePage];
-    tsg += ((GivenClutId & CLUTCHK) >> CLUTSHIFT) * SOFFB;
+    tsg += iArea * SOFFB;
+    next = pscSubtexNext[TextureMode][GlobalTexturePage] + iArea * SOFFB;
 
     iMax = tsg->pos.l;
 
-    if (iMax) {
-        i = iMax;
-        tsb = tsg + 1;
-        do {
-            if (GivenClutId == tsb->ClutID &&
-                    (INCHECK(tsb->pos, npos))) {
-                {
-                    cx = tsb->pos._3 - tsb->posTX;
-                    cy = tsb->pos._1 - tsb->posTY;
-
-                    gl_ux[0] -= cx;
-                    gl_ux[1] -= cx;
-                    gl_ux[2] -= cx;
-                    gl_ux[3] -= cx;
-                    gl_vy[0] -= cy;
-                    gl_vy[1] -= cy;
-                    gl_vy[2] -= cy;
-                    gl_vy[3] -= cy;
-
-                    ubOpaqueDraw = tsb->Opaque;
-                    *pCache = tsb->cTexID;
-                    return NULL;
-                }
-            }
-            tsb++;
-        } while (--i);
+    idx = GetSubCacheIndex(TextureMode, GlobalTexturePage, iArea);
+
+    for (i = idx->head[SUBHASH(GivenClutId)]; i; i = next[i]) {
+        tsb = tsg + i;
+        if (GivenClutId == tsb->ClutID &&
+                (INCHECK(tsb->pos, npos))) {
+            cx = tsb->pos._3 - tsb->posTX;
+            cy = tsb->pos._1 - tsb->posTY;
+
+            gl_ux[0] -= cx;
+            gl_ux[1] -= cx;
+            gl_ux[2] -= cx;
+            gl_ux[3] -= cx;
+            gl_vy[0] -= cy;
+            gl_vy[1] -= cy;
+            gl_vy[2] -= cy;
+            gl_vy[3] -= cy;
+
+            ubOpaqueDraw = tsb->Opaque;
+            *pCache = tsb->cTexID;
+            uiSubTexLRU[tsb->cTexID] = uiSubTexTick;
+            return NULL;
+        }
     }
     //----------------------------------------------------//
 
@@ -923,10 +1005,13 @@ unsigned char * CheckTextureInSubSCache(int TextureMode, uint32_t GivenClutId, u
     tsx = NULL;
     tsb = tsg + 1;
 
-    for (i = 0; i < iMax; i++, tsb++) {
-        if (!tsb->ClutID) {
-            tsx = tsb;
-            break;
+    if (idx->freecnt) {
+        for (i = 0; i < iMax; i++, tsb++) {
+            if (!tsb->ClutID) {
+                tsx = tsb;
+                idx->freecnt--;
+                break;
+            }
         }
     }
 
@@ -943,6 +1028,8 @@ unsigned char * CheckTextureInSubSCache(int TextureMode, uint32_t GivenClutId, u
                 }
                 iMax--;
                 tsb = tsg + 1;
+                bLink = FALSE;
+                idx->gen = 0;
 
                 for (i = 0; i < iMax; i++, tsb++) // 1. search other slots with same cluts, and unite the area
                     if (GivenClutId == tsb->ClutID) {
@@ -972,6 +1059,8 @@ unsigned char * CheckTextureInSubSCache(int TextureMode, uint32_t GivenClutId, u
                 }
             }
             iMax = 1;
+            bLink = FALSE;
+            idx->gen = 0;
         }
         tsx = tsg + iMax;
 
@@ -1103,6 +1192,7 @@ ENDLOOP:
                     (tsb + SOFFC)->pos.l = 0;
                     (tsb + SOFFD)->pos.l = 0;
                 }
+            uiSubIndexGen++;
             for (i = 0; i < iSortTexCnt; i++) {
                 ul = pxSsubtexLeft[i];
                 ul->l = 0;
@@ -1153,6 +1243,16 @@ ENDLOOP:
     tsx->posTX = rfree._3;
     tsx->posTY = rfree._1;
 
+    uiSubTexLRU[iC] = uiSubTexTick;
+
+    // new entry: link it into the index (still valid, if nothing got removed)
+    if (bLink && idx->gen == uiSubIndexGen) {
+        i = tsx - tsg;
+        next[i] = idx->head[SUBHASH(GivenClutId)];
+        idx->head[SUBHASH(GivenClutId)] = i;
+        idx->texmask |= 1ULL << (iC & 63);
+    } else idx->gen = 0;
+
     cx = gl_ux[7] - rfree._3;
     cy = gl_ux[5] - rfree._1;
 
@@ -1324,6 +1424,7 @@ void CompressTextureSpace(void) {
     int lOGTP = GlobalTexturePage;
     uint32_t l, row;
     uint32_t *lSRCPtr;
+    unsigned short * next;
 
     opos.l = GETLE32((uint32_t *) & gl_ux[4]);
 
@@ -1349,12 +1450,16 @@ void CompressTextureSpace(void) {
 
             for (m = 0; m < 4; m++, tsg += SOFFB) {
                 iMax = tsg->pos.l;
+                next = pscSubtexNext[j][k] + m * SOFFB;
+                pscSubtexIndex[j][k][m].gen = 0; // fresh index: chains are ascending, only later entries follow
+                GetSubCacheIndex(j, k, m);
 
                 tsx = tsg + 1;
                 for (i = 0; i < iMax; i++, tsx++) {
                     if (tsx->ClutID) {
                         r.l = tsx->pos.l;
-                        for (n = i + 1, tsb = tsx + 1; n < iMax; n++, tsb++) {
+                        for (n = next[i + 1]; n; n = next[n]) {
+                            tsb = tsg + n;
                             if (tsx->ClutID == tsb->ClutID) {
                                 r._3 = min(r._3, tsb->pos._3);
                                 r._2 = max(r._2, tsb->pos._2);
@@ -1393,6 +1498,7 @@ void CompressTextureSpace(void) {
                                         (tsb + SOFFC)->pos.l = 0;
                                         (tsb + SOFFD)->pos.l = 0;
                                     }
+                                uiSubIndexGen++;
                                 for (i = 0; i < iSortTexCnt; i++) {
                                     ul = pxSsubtexLeft[i];
                                     ul->l = 0;
@@ -1436,6 +1542,8 @@ void CompressTextureSpace(void) {
 
     if (dwTexPageComp == 0xffffffff) dwTexPageComp = 0;
 
+    uiSubIndexGen++; // entries got merged/moved
+
     PUTLE32(((uint32_t *) & gl_ux[4]), opos.l);
 
     GlobalTexturePage = lOGTP;
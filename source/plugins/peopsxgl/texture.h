@@ -28,6 +28,7 @@
 #define MAXTPAGES_MAX  64*4
 #define MAXSORTTEX_MAX 196*4
 #define MAXWNDTEXCACHE 128*4
+#define SUBHASHSIZE    64
 
 // "texture window" cache entry
 typedef struct textureWndCacheEntryTag {
@@ -50,6 +51,15 @@ typedef struct textureSubCacheEntryTagS {
     unsigned char Opaque;
 } textureSubCacheEntryS;
 
+// index of one "standard texture" cache area: ClutID hash chains (links are
+// kept in a separate array, to keep the entries small), rebuilt on demand
+typedef struct textureSubCacheIndexTag {
+    uint32_t gen;                      // == uiSubIndexGen: index is up to date
+    unsigned short freecnt;            // unused entries (ClutID 0) in the area
+    unsigned short head[SUBHASHSIZE];  // first entry of each hash chain, 0: none
+    uint64_t texmask;                  // bit (cTexID & 63) of each entry
+} textureSubCacheIndex;
+
 void           InitializeTextureStore();
 void           CleanupTextureStore();
 GpuTex *         LoadTextureWnd(int pageid, int TextureMode, uint32_t GivenClutId);
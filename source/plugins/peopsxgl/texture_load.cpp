@@ -8,6 +8,7 @@ using namespace xegpu;
 #include "prim.h"
 #include "GpuRenderer.h"
 #include "texture_load.h"
+#include "texture_pagecache.h"
 
 namespace xegpu{
 
@@ -124,12 +125,8 @@ void DefineSubTextureSort(void) {
 // load texture part (unpacked)
 /////////////////////////////////////////////////////////////////////////////
 void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy) {
-    uint32_t start, row, column, j, sxh, sxm;
-    unsigned int palstart;
-    uint32_t *px, *pa, *ta;
-    unsigned char *cSRCPtr;
-    unsigned short *wSRCPtr;
-    uint32_t LineOffset;
+    uint32_t row, column;
+    uint32_t *pa, *ta;
     uint32_t x2a, xalign = 0;
     uint32_t x1 = gl_ux[7];
     uint32_t x2 = gl_ux[6];
@@ -137,7 +134,6 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy) {
     uint32_t y2 = gl_ux[4];
     uint32_t dx = x2 - x1 + 1;
     uint32_t dy = y2 - y1 + 1;
-    int pmult = pageid / 16;
     uint32_t(*LTCOL)(uint32_t);
     unsigned int a, r, g, b, cnt, h;
     uint32_t scol[8];
@@ -146,11 +142,7 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy) {
 
     LTCOL = TCF[DrawSemiTrans];
 
-    pa = px = (uint32_t *) ubPaletteBuffer;
     ta = (uint32_t *) texturepart;
-    palstart = cx + (cy << 10);
-
-    ubOpaqueDraw = 0;
 
     if (YTexS) {
         ta += dx;
@@ -161,130 +153,9 @@ void LoadSubTexturePageSort(int pageid, int mode, short cx, short cy) {
         xalign = 2;
     }
 
-    switch (mode) {
-            //--------------------------------------------------//
-            // 4bit texture load ..
-        case 0:
-            start = ((pageid - 16 * pmult) << 7) + 524288 * pmult;
-            // convert CLUT to 32bits .. and then use THAT as a lookup table
-
-            wSRCPtr = psxVuw + palstart;
-
-            row = 4;
-            do {
-                *px = (LTCOL(ptr32(wSRCPtr)));
-                *(px + 1) = (LTCOL(ptr32(wSRCPtr + 1)));
-                *(px + 2) = (LTCOL(ptr32(wSRCPtr + 2)));
-                *(px + 3) = (LTCOL(ptr32(wSRCPtr + 3)));
-
-                row--;
-                px += 4;
-                wSRCPtr += 4;
-            } while (row);
-
-            x2a = x2 ? (x2 - 1) : 0; //if(x2) x2a=x2-1; else x2a=0;
-            sxm = x1 & 1;
-            sxh = x1 >> 1;
-            j = sxm ? (x1 + 1) : x1; //if(sxm) j=x1+1; else j=x1;
-            for (column = y1; column <= y2; column++) {
-                cSRCPtr = psxVub + start + (column << 11) + sxh;
-
-                if (sxm)
-                    *ta++ = *(pa + ((*cSRCPtr++ >> 4) & 0xF));
-
-                for (row = j; row < x2a; row += 2) {
-                    *ta = *(pa + (*cSRCPtr & 0xF));
-                    *(ta + 1) = *(pa + ((*cSRCPtr >> 4) & 0xF));
-                    cSRCPtr++;
-                    ta += 2;
-                }
-
-                if (row <= x2) {
-                    *ta++ = *(pa + (*cSRCPtr & 0xF));
-                    row++;
-                    if (row <= x2)
-                        *ta++ = *(pa + ((*cSRCPtr >> 4) & 0xF));
-                }
-
-                ta += xalign;
-            }
-
-            break;
-            //--------------------------------------------------//
-            // 8bit texture load ..
-        case 1:
-            start = ((pageid - 16 * pmult) << 7) + 524288 * pmult;
-
-            cSRCPtr = psxVub + start + (y1 << 11) + x1;
-            LineOffset = 2048 - dx;
-
-            if (dy * dx > 384) {
-                wSRCPtr = psxVuw + palstart;
-
-                row = 64;
-                do {
-                    *px = (LTCOL(ptr32(wSRCPtr)));
-                    *(px + 1) = (LTCOL(ptr32(wSRCPtr + 1)));
-                    *(px + 2) = (LTCOL(ptr32(wSRCPtr + 2)));
-                    *(px + 3) = (LTCOL(ptr32(wSRCPtr + 3)));
-
-                    row--;
-                    px += 4;
-                    wSRCPtr += 4;
-                } while (row);
-
-                column = dy;
-                do {
-                    row = dx;
-                    do {
-                        *ta++ = *(pa + (*cSRCPtr++));
-                        row--;
-                    } while (row);
-                    ta += xalign;
-                    cSRCPtr += LineOffset;
-                    column--;
-                } while (column);
-            } else {
-                wSRCPtr = psxVuw + palstart;
-
-                column = dy;
-                do {
-                    row = dx;
-                    do {
-                        *ta++ = LTCOL(ptr32(wSRCPtr + *cSRCPtr++));
-                        row--;
-                    } while (row);
-                    ta += xalign;
-                    cSRCPtr += LineOffset;
-                    column--;
-                } while (column);
-            }
-
-            break;
-            //--------------------------------------------------//
-            // 16bit texture load ..
-        case 2:
-            start = ((pageid - 16 * pmult) << 6) + 262144 * pmult;
-
-            wSRCPtr = psxVuw + start + (y1 << 10) + x1;
-            LineOffset = 1024 - dx;
-
-            column = dy;
-            do {
-                row = dx;
-                do {
-                    *ta++ = (LTCOL(ptr32(wSRCPtr++)));
-                    row--;
-                } while (row);
-                ta += xalign;
-                wSRCPtr += LineOffset;
-                column--;
-            } while (column);
-
-            break;
-            //--------------------------------------------------//
-            // others are not possible !
-    }
+    // 4/8/16 bit texels are converted once per page (and clut) into the page
+    // cache, the texture part is just copied out of it
+    ubOpaqueDraw = LoadTexPageCacheRect(ta, pageid, mode, cx, cy, LTCOL, x1, y1, dx, dy, xalign);
 
     x2a = dx + xalign;
 
@@ -0,0 +1,374 @@
+#define _IN_TEXTURE
+
+#include "stdafx.h"
+#include <malloc.h>
+#include "externals.h"
+using namespace xegpu;
+#include "texture.h"
+#include "texture_pagecache.h"
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
+// Converted texture page cache: LoadSubTexturePageSort used to expand every
+// psx texel through a TCF[] call each time a texture part got uploaded. Now the
+// whole 256 texel wide page is converted row by row (in 32 texel chunks) into
+// a cache slot, keyed by page, mode, clut contents and colour func, and kept
+// until a vram write (InvalidateSubSTextureArea) touches the source texels.
+// Re-uploads after a vram write only have to convert the touched chunks again.
+
+#define TPC_SLOTS     16                // cached pages
+#define TPC_LUTS      4                 // cached 15 bit colour tables
+#define TPC_CHUNK     32                // texels converted per step
+#define TPC_ALIGN     __attribute__((aligned(16)))
+
+typedef struct texPageCacheEntryTag {
+    int pageid;                         // -1: unused slot
+    int mode;
+    short cx;
+    short cy;
+    short semitrans;
+    uint32_t(*colfn)(uint32_t);
+    uint32_t lastused;
+    unsigned short clut[256];           // raw clut, as found in psx vram
+    uint32_t pal[256] TPC_ALIGN;        // converted clut
+    unsigned char palop[256];           // ubOpaqueDraw result of each clut entry
+    unsigned char palplane[5][16] TPC_ALIGN; // 4 bit clut split in byte planes (A,R,G,B,opaque)
+    unsigned char rowvalid[256];        // bit n: texels n*32..n*32+31 converted
+    uint32_t * texels;                  // 256x256 converted texels
+    unsigned char * opaque;             // 256x256 ubOpaqueDraw result per texel
+} texPageCacheEntry;
+
+typedef struct texColLutTag {
+    uint32_t(*colfn)(uint32_t);
+    short semitrans;
+    uint32_t * col;                     // 64k converted colours
+    unsigned char * opaque;             // 64k ubOpaqueDraw results
+} texColLut;
+
+static texPageCacheEntry tpcStore[TPC_SLOTS];
+static texColLut tpcLut[TPC_LUTS];
+static int iTpcLutTurn = 0;
+static uint32_t uiTpcTick = 0;
+
+////////////////////////////////////////////////////////////////////////
+// init/cleanup
+////////////////////////////////////////////////////////////////////////
+
+void InitializeTexPageCache(void) {
+    int i;
+
+    memset(tpcStore, 0, sizeof (tpcStore));
+    memset(tpcLut, 0, sizeof (tpcLut));
+
+    for (i = 0; i < TPC_SLOTS; i++) {
+        tpcStore[i].pageid = -1;
+        tpcStore[i].texels = (uint32_t *) memalign(128, 256 * 256 * 4);
+        tpcStore[i].opaque = (unsigned char *) memalign(128, 256 * 256);
+    }
+    iTpcLutTurn = 0;
+    uiTpcTick = 0;
+}
+
+void CleanupTexPageCache(void) {
+    int i;
+
+    for (i = 0; i < TPC_SLOTS; i++) {
+        free(tpcStore[i].texels);
+        free(tpcStore[i].opaque);
+        tpcStore[i].texels = 0;
+        tpcStore[i].opaque = 0;
+        tpcStore[i].pageid = -1;
+    }
+    for (i = 0; i < TPC_LUTS; i++) {
+        free(tpcLut[i].col);
+        free(tpcLut[i].opaque);
+        tpcLut[i].col = 0;
+        tpcLut[i].opaque = 0;
+        tpcLut[i].colfn = 0;
+    }
+}
+
+void ResetTexPageCache(void) {
+    int i;
+
+    for (i = 0; i < TPC_SLOTS; i++)
+        tpcStore[i].pageid = -1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// vram got written: drop converted chunks of the touched area
+// (X1/Y1 are exclusive). Clut changes are caught by the clut compare.
+////////////////////////////////////////////////////////////////////////
+
+void InvalidateTexPageCacheArea(int X0, int Y0, int X1, int Y1) {
+    int i, y, px0, px1, py0, tx0, tx1, pmult;
+    unsigned char mask;
+    texPageCacheEntry * tpc = tpcStore;
+
+    for (i = 0; i < TPC_SLOTS; i++, tpc++) {
+        if (tpc->pageid < 0) continue;
+
+        pmult = tpc->pageid / 16;
+        px0 = (tpc->pageid - 16 * pmult) << 6;
+        px1 = px0 + (64 << tpc->mode);
+        py0 = pmult << 8;
+
+        if (X1 <= px0 || X0 >= px1) continue;
+        if (Y1 <= py0 || Y0 >= py0 + 256) continue;
+
+        tx0 = (max(X0, px0) - px0) << (2 - tpc->mode);
+        tx1 = ((min(X1, px1) - px0) << (2 - tpc->mode)) - 1;
+        if (tx1 > 255) tx1 = 255;
+
+        mask = (unsigned char) (((2 << (tx1 / TPC_CHUNK)) - 1) & ~((1 << (tx0 / TPC_CHUNK)) - 1));
+
+        for (y = max(Y0, py0) - py0; y < min(Y1, py0 + 256) - py0; y++)
+            tpc->rowvalid[y] &= ~mask;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+// 15 bit colour table: one TCF call per possible psx colour, done once
+////////////////////////////////////////////////////////////////////////
+
+static texColLut * GetTexColLut(uint32_t(*LTCOL)(uint32_t)) {
+    int i;
+    texColLut * lut;
+    unsigned char ubOldOpaque = ubOpaqueDraw;
+
+    for (i = 0; i < TPC_LUTS; i++) {
+        lut = &tpcLut[i];
+        if (lut->col && lut->colfn == LTCOL && lut->semitrans == DrawSemiTrans)
+            return lut;
+    }
+
+    lut = &tpcLut[iTpcLutTurn];
+    iTpcLutTurn = (iTpcLutTurn + 1) % TPC_LUTS;
+
+    if (!lut->col) {
+        lut->col = (uint32_t *) malloc(65536 * 4);
+        lut->opaque = (unsigned char *) malloc(65536);
+    }
+    lut->colfn = LTCOL;
+    lut->semitrans = DrawSemiTrans;
+
+    for (i = 0; i < 65536; i++) {
+        ubOpaqueDraw = 0;
+        lut->col[i] = LTCOL(i);
+        lut->opaque[i] = ubOpaqueDraw;
+    }
+
+    ubOpaqueDraw = ubOldOpaque;
+    return lut;
+}
+
+////////////////////////////////////////////////////////////////////////
+// row kernels, TPC_CHUNK texels each
+////////////////////////////////////////////////////////////////////////
+
+static void ConvertChunk4(texPageCacheEntry * tpc, uint32_t * ta, unsigned char * to, unsigned char * cSRCPtr) {
+#ifdef __ALTIVEC__
+    // 16 entry clut fits a vperm: look up each byte plane and merge the planes back to ARGB
+    vector unsigned char vA = vec_ld(0, tpc->palplane[0]);
+    vector unsigned char vR = vec_ld(0, tpc->palplane[1]);
+    vector unsigned char vG = vec_ld(0, tpc->palplane[2]);
+    vector unsigned char vB = vec_ld(0, tpc->palplane[3]);
+    vector unsigned char vO = vec_ld(0, tpc->palplane[4]);
+    vector unsigned char vS = vec_perm(vec_ld(0, cSRCPtr), vec_ld(15, cSRCPtr), vec_lvsl(0, cSRCPtr));
+    vector unsigned char vLo = vec_and(vS, vec_splat_u8(0xf));
+    vector unsigned char vHi = vec_sr(vS, vec_splat_u8(4));
+    vector unsigned char vIdx[2];
+    int i;
+
+    vIdx[0] = vec_mergeh(vLo, vHi); // texel n is low nibble, n+1 high nibble
+    vIdx[1] = vec_mergel(vLo, vHi);
+
+    for (i = 0; i < 2; i++, ta += 16, to += 16) {
+        vector unsigned char a = vec_perm(vA, vA, vIdx[i]);
+        vector unsigned char r = vec_perm(vR, vR, vIdx[i]);
+        vector unsigned char g = vec_perm(vG, vG, vIdx[i]);
+        vector unsigned char b = vec_perm(vB, vB, vIdx[i]);
+        vector unsigned short arh = (vector unsigned short) vec_mergeh(a, r);
+        vector unsigned short arl = (vector unsigned short) vec_mergel(a, r);
+        vector unsigned short gbh = (vector unsigned short) vec_mergeh(g, b);
+        vector unsigned short gbl = (vector unsigned short) vec_mergel(g, b);
+
+        vec_st((vector unsigned char) vec_mergeh(arh, gbh), 0, (unsigned char *) ta);
+        vec_st((vector unsigned char) vec_mergel(arh, gbh), 16, (unsigned char *) ta);
+        vec_st((vector unsigned char) vec_mergeh(arl, gbl), 32, (unsigned char *) ta);
+        vec_st((vector unsigned char) vec_mergel(arl, gbl), 48, (unsigned char *) ta);
+        vec_st(vec_perm(vO, vO, vIdx[i]), 0, to);
+    }
+#else
+    uint32_t * pa = tpc->pal;
+    unsigned char * po = tpc->palop;
+    int row;
+
+    for (row = 0; row < TPC_CHUNK; row += 2, cSRCPtr++) {
+        *ta++ = pa[*cSRCPtr & 0xF];
+        *ta++ = pa[*cSRCPtr >> 4];
+        *to++ = po[*cSRCPtr & 0xF];
+        *to++ = po[*cSRCPtr >> 4];
+    }
+#endif
+}
+
+static void ConvertChunk8(texPageCacheEntry * tpc, uint32_t * ta, unsigned char * to, unsigned char * cSRCPtr) {
+    uint32_t * pa = tpc->pal;
+    unsigned char * po = tpc->palop;
+    int row;
+
+    for (row = 0; row < TPC_CHUNK; row += 4, cSRCPtr += 4, ta += 4, to += 4) {
+        ta[0] = pa[cSRCPtr[0]];
+        ta[1] = pa[cSRCPtr[1]];
+        ta[2] = pa[cSRCPtr[2]];
+        ta[3] = pa[cSRCPtr[3]];
+        to[0] = po[cSRCPtr[0]];
+        to[1] = po[cSRCPtr[1]];
+        to[2] = po[cSRCPtr[2]];
+        to[3] = po[cSRCPtr[3]];
+    }
+}
+
+static void ConvertChunk15(texColLut * lut, uint32_t * ta, unsigned char * to, unsigned short * wSRCPtr) {
+    uint32_t c;
+    int row;
+
+    for (row = 0; row < TPC_CHUNK; row++) {
+        c = GETLE16(wSRCPtr++);
+        *ta++ = lut->col[c];
+        *to++ = lut->opaque[c];
+    }
+}
+
+static void ConvertTexPageRow(texPageCacheEntry * tpc, uint32_t row, unsigned char chunks) {
+    int pmult = tpc->pageid / 16;
+    uint32_t start, k;
+    uint32_t * ta = tpc->texels + (row << 8);
+    unsigned char * to = tpc->opaque + (row << 8);
+    texColLut * lut = 0;
+
+    if (tpc->mode == 2) {
+        start = ((tpc->pageid - 16 * pmult) << 6) + 262144 * pmult;
+        lut = GetTexColLut(tpc->colfn);
+    } else
+        start = ((tpc->pageid - 16 * pmult) << 7) + 524288 * pmult;
+
+    for (k = 0; k < 256 / TPC_CHUNK; k++) {
+        if (!(chunks & (1 << k))) continue;
+
+        switch (tpc->mode) {
+            case 0:
+                ConvertChunk4(tpc, ta + k * TPC_CHUNK, to + k * TPC_CHUNK,
+                        psxVub + start + (row << 11) + k * (TPC_CHUNK / 2));
+                break;
+            case 1:
+                ConvertChunk8(tpc, ta + k * TPC_CHUNK, to + k * TPC_CHUNK,
+                        psxVub + start + (row << 11) + k * TPC_CHUNK);
+                break;
+            case 2:
+                ConvertChunk15(lut, ta + k * TPC_CHUNK, to + k * TPC_CHUNK,
+                        psxVuw + start + (row << 10) + k * TPC_CHUNK);
+                break;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+// find (or set up) the cache slot of a page/clut/colour func combination
+////////////////////////////////////////////////////////////////////////
+
+static texPageCacheEntry * GetTexPageCacheEntry(int pageid, int mode, short cx, short cy, uint32_t(*LTCOL)(uint32_t)) {
+    int i, iClutSize;
+    unsigned short * wSRCPtr = psxVuw + cx + (cy << 10);
+    texPageCacheEntry * tpc, * tpcOld = tpcStore;
+    unsigned char ubOldOpaque = ubOpaqueDraw;
+
+    uiTpcTick++;
+
+    if (mode == 0) iClutSize = 16;
+    else if (mode == 1) iClutSize = 256;
+    else iClutSize = 0;
+
+    for (i = 0, tpc = tpcStore; i < TPC_SLOTS; i++, tpc++) {
+        if (tpc->pageid == pageid && tpc->mode == mode &&
+                tpc->colfn == LTCOL && tpc->semitrans == DrawSemiTrans &&
+                tpc->cx == cx && tpc->cy == cy &&
+                !memcmp(tpc->clut, wSRCPtr, iClutSize * 2)) {
+            tpc->lastused = uiTpcTick;
+            return tpc;
+        }
+        if (tpcOld->pageid >= 0 && (tpc->pageid < 0 || tpc->lastused < tpcOld->lastused))
+            tpcOld = tpc;
+    }
+
+    // not found: replace least recently used page
+    tpc = tpcOld;
+    tpc->pageid = pageid;
+    tpc->mode = mode;
+    tpc->cx = cx;
+    tpc->cy = cy;
+    tpc->colfn = LTCOL;
+    tpc->semitrans = DrawSemiTrans;
+    tpc->lastused = uiTpcTick;
+    memset(tpc->rowvalid, 0, sizeof (tpc->rowvalid));
+    memcpy(tpc->clut, wSRCPtr, iClutSize * 2);
+
+    for (i = 0; i < iClutSize; i++) {
+        ubOpaqueDraw = 0;
+        tpc->pal[i] = LTCOL(ptr32(wSRCPtr + i));
+        tpc->palop[i] = ubOpaqueDraw;
+    }
+    ubOpaqueDraw = ubOldOpaque;
+
+    if (mode == 0) {
+        unsigned char * pc = (unsigned char *) tpc->pal;
+        for (i = 0; i < 16; i++, pc += 4) {
+            tpc->palplane[0][i] = pc[0];
+            tpc->palplane[1][i] = pc[1];
+            tpc->palplane[2][i] = pc[2];
+            tpc->palplane[3][i] = pc[3];
+            tpc->palplane[4][i] = tpc->palop[i];
+        }
+    }
+
+    return tpc;
+}
+
+////////////////////////////////////////////////////////////////////////
+// copy a texture part out of the page cache, converting missing chunks
+// on the fly. Returns the ubOpaqueDraw state of the copied texels.
+////////////////////////////////////////////////////////////////////////
+
+unsigned char LoadTexPageCacheRect(uint32_t * ta, int pageid, int mode, short cx, short cy,
+        uint32_t(*LTCOL)(uint32_t), uint32_t x1, uint32_t y1, uint32_t dx, uint32_t dy, uint32_t xalign) {
+    texPageCacheEntry * tpc;
+    uint32_t x2 = x1 + dx - 1, column, row;
+    uint32_t * pa;
+    unsigned char * po, need, missing, op = 0;
+
+    if (mode > 2) return 0;
+
+    tpc = GetTexPageCacheEntry(pageid, mode, cx, cy, LTCOL);
+    need = (unsigned char) (((2 << (x2 / TPC_CHUNK)) - 1) & ~((1 << (x1 / TPC_CHUNK)) - 1));
+
+    for (column = y1; column < y1 + dy; column++) {
+        missing = need & ~tpc->rowvalid[column];
+        if (missing) {
+            ConvertTexPageRow(tpc, column, missing);
+            tpc->rowvalid[column] |= missing;
+        }
+
+        pa = tpc->texels + (column << 8) + x1;
+        po = tpc->opaque + (column << 8) + x1;
+
+        memcpy(ta, pa, dx * 4);
+        for (row = 0; row < dx; row++)
+            op |= po[row];
+
+        ta += dx + xalign;
+    }
+
+    return op ? 1 : 0;
+}
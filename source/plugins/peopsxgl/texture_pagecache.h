@@ -0,0 +1,9 @@
+#pragma once
+
+// converted texture page cache (texture_pagecache.cpp)
+void InitializeTexPageCache(void);
+void CleanupTexPageCache(void);
+void ResetTexPageCache(void);
+void InvalidateTexPageCacheArea(int X0, int Y0, int X1, int Y1);
+unsigned char LoadTexPageCacheRect(uint32_t * ta, int pageid, int mode, short cx, short cy,
+        uint32_t(*LTCOL)(uint32_t), uint32_t x1, uint32_t y1, uint32_t dx, uint32_t dy, uint32_t xalign);
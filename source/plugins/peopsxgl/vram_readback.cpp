@@ -0,0 +1,54 @@
+#include "stdafx.h"
+#include "externals.h"
+using namespace xegpu;
+#include "vram_readback.h"
+
+////////////////////////////////////////////////////////////////////////
+// copy the psx rect x/y/w/h back from the gfx card buffer, the rect is
+// in the display area dispX/dispY/dispW/dispH. mirrorX >= 0: store it
+// there too.
+////////////////////////////////////////////////////////////////////////
+
+void VRamReadback(int x, int y, int w, int h, int dispX, int dispY, int dispW, int dispH, int mirrorX, int mirrorY) {
+	const vramResolver_t * resolver;
+	const uint32_t * pix;
+	unsigned short * p, * p2;
+	unsigned short * eom;
+	int sw, sh, pitch, i, j;
+	int sx, sy, stepx, stepy, sx0;
+
+	if (w <= 0 || h <= 0 || dispW <= 0 || dispH <= 0) return;
+
+	resolver = VRamReadbackSchedule(x, y, w, h);
+	if (!resolver) return;
+
+	pix = resolver->Lock(&sw, &sh, &pitch);
+	if (!pix) return;
+
+	// 16.16 steps through the screen rect, sampling the pixel centers
+	stepx = (rRatioRect.right << 16) / dispW;
+	stepy = (rRatioRect.bottom << 16) / dispH;
+	sx0 = (rRatioRect.left << 16) + (x - dispX) * stepx + (stepx >> 1);
+	sy = (rRatioRect.top << 16) + (y - dispY) * stepy + (stepy >> 1);
+
+	eom = psxVuw + 1024 * iGPUHeight;
+	p = psxVuw + (1024 * y) + x;
+	p2 = (mirrorX >= 0) ? psxVuw + (1024 * mirrorY) + mirrorX : NULL;
+
+	for (j = 0; j < h; j++, sy += stepy) {
+		const uint32_t * row = pix + pitch * min(max(sy >> 16, 0), sh - 1);
+
+		for (i = 0, sx = sx0; i < w; i++, sx += stepx) {
+			uint32_t c = row[min(max(sx >> 16, 0), sw - 1)];
+			unsigned short s = ((c >> 19) & 0x1f) | ((c >> 6) & 0x3e0) | ((c << 7) & 0x7c00);
+
+			if (p + i >= psxVuw && p + i < eom) PUTLE16(p + i, s);
+			if (p2 && p2 + i >= psxVuw && p2 + i < eom) PUTLE16(p2 + i, s);
+		}
+
+		p += 1024;
+		if (p2) p2 += 1024;
+	}
+
+	resolver->Unlock();
+}
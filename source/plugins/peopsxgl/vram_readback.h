@@ -0,0 +1,7 @@
+#pragma once
+
+// vram readback (vram_readback.cpp), scheduled by vram_schedule.cpp
+
+#include "vram_schedule.h"
+
+void VRamReadback(int x, int y, int w, int h, int dispX, int dispY, int dispW, int dispH, int mirrorX, int mirrorY);
@@ -0,0 +1,145 @@
+#include <string.h>
+#include "vram_schedule.h"
+
+// Vram readback scheduler: CheckVRamRead/CheckVRamReadEx used to read the
+// pixels back right when the game needed them, so the gpu had to finish
+// everything drawn so far while both threads waited on it.
+// Now every read rect is remembered, with the number of gpu commands
+// processed in the frame before the read. A rect that gets read again each
+// frame (render to texture effects, framebuffer reads) is predicted: in the
+// next frame the resolve is started as soon as that many commands are done,
+// and the gpu works on it while the game goes on. A vram -> psx mem transfer
+// command starts its resolve right away as well. The read itself only waits
+// if the resolve is not finished, and resolves on the spot if something got
+// drawn since the last one (the prediction was wrong).
+// The pixels get converted back by VRamReadback (vram_readback.cpp).
+
+#define VRB_REGIONS 8
+
+typedef struct {
+	short x, y, w, h;           // psx vram rect, w == 0: unused
+	uint32_t frame;             // last frame it was read in
+	uint32_t prim;              // commands processed in that frame before the read
+	int hits;                   // consecutive frames it was read in
+} vramReadRegion_t;
+
+static vramReadRegion_t vrRegions[VRB_REGIONS];
+static const vramResolver_t * vrResolver = NULL;
+static vramReadbackStats_t vrStats;
+
+static uint32_t uiReadbackFrame = 1;
+static uint32_t uiResolvedFrame = 0;   // frame / command count the last resolve was issued at
+static uint32_t uiResolvedPrim = 0;
+
+uint32_t uiReadbackPrim = 0;
+uint32_t uiReadbackIssueAt = 0;        // 0: no resolve predicted in this frame
+int iReadbackAnnounced = 0;
+
+void SetVRamResolver(const vramResolver_t * r) {
+	vrResolver = r;
+	memset(vrRegions, 0, sizeof (vrRegions));
+	memset(&vrStats, 0, sizeof (vrStats));
+	uiReadbackFrame = 1;
+	uiResolvedFrame = 0;
+	uiResolvedPrim = 0;
+	uiReadbackPrim = 0;
+	uiReadbackIssueAt = 0;
+	iReadbackAnnounced = 0;
+}
+
+const vramReadbackStats_t * GetVRamReadbackStats(void) {
+	return &vrStats;
+}
+
+////////////////////////////////////////////////////////////////////////
+// next predicted read after "after" commands, 0 if none
+////////////////////////////////////////////////////////////////////////
+
+static uint32_t NextIssuePoint(uint32_t after) {
+	uint32_t next = 0;
+	int i;
+
+	for (i = 0; i < VRB_REGIONS; i++) {
+		vramReadRegion_t * r = &vrRegions[i];
+		if (!r->w || r->hits < 2) continue;
+		if (r->frame != uiReadbackFrame - 1) continue;
+		if (r->prim <= after) continue;
+		if (!next || r->prim < next) next = r->prim;
+	}
+	return next;
+}
+
+static void TrackRegion(int x, int y, int w, int h) {
+	vramReadRegion_t * r = NULL;
+	int i;
+
+	for (i = 0; i < VRB_REGIONS; i++) {
+		if (vrRegions[i].w == w && vrRegions[i].h == h &&
+				vrRegions[i].x == x && vrRegions[i].y == y) {
+			r = &vrRegions[i];
+			break;
+		}
+	}
+
+	if (r) {
+		if (r->frame == uiReadbackFrame - 1) r->hits++;
+		else if (r->frame != uiReadbackFrame) r->hits = 1;
+	} else {
+		// replace the region not read for the longest time
+		r = &vrRegions[0];
+		for (i = 1; i < VRB_REGIONS; i++)
+			if (vrRegions[i].frame < r->frame) r = &vrRegions[i];
+		r->x = x;
+		r->y = y;
+		r->w = w;
+		r->h = h;
+		r->hits = 1;
+	}
+
+	r->frame = uiReadbackFrame;
+	r->prim = uiReadbackPrim;
+}
+
+////////////////////////////////////////////////////////////////////////
+// start a resolve if something got drawn since the last one
+////////////////////////////////////////////////////////////////////////
+
+static int ResolveIfNeeded(void) {
+	if (uiResolvedFrame == uiReadbackFrame && uiResolvedPrim == uiReadbackPrim)
+		return 0;
+
+	vrResolver->Resolve();
+	uiResolvedFrame = uiReadbackFrame;
+	uiResolvedPrim = uiReadbackPrim;
+	return 1;
+}
+
+void VRamReadbackIssue(void) {
+	iReadbackAnnounced = 0;
+
+	if (vrResolver && ResolveIfNeeded())
+		vrStats.issued++;
+
+	uiReadbackIssueAt = NextIssuePoint(uiReadbackPrim);
+}
+
+void VRamReadbackNextFrame(void) {
+	uiReadbackFrame++;
+	uiReadbackPrim = 0;
+	iReadbackAnnounced = 0;
+	uiReadbackIssueAt = NextIssuePoint(0);
+}
+
+const vramResolver_t * VRamReadbackSchedule(int x, int y, int w, int h) {
+	if (!vrResolver) return NULL;
+
+	if (ResolveIfNeeded())
+		vrStats.stalls++;
+	else
+		vrStats.early++;
+	vrStats.reads++;
+
+	TrackRegion(x, y, w, h);
+
+	return vrResolver;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// vram readback scheduler (vram_schedule.cpp), no plugin headers needed:
+// tools/vramreadback checks it on the host with a software resolver
+
+#include <stdint.h>
+
+// the resolve step: copies what has been drawn so far out of edram.
+// GpuRenderer provides the xenos one, a software stand-in can replace it.
+typedef struct vramResolverTag {
+	void (*Resolve)(void);                                              // start it, don't wait
+	const uint32_t * (*Lock)(int * width, int * height, int * pitch);   // wait for it, argb pixels, pitch in pixels
+	void (*Unlock)(void);
+} vramResolver_t;
+
+typedef struct vramReadbackStatsTag {
+	uint32_t reads;         // rects copied back into psx vram
+	uint32_t early;         // ... from a resolve issued before they were needed
+	uint32_t stalls;        // ... that had to resolve and wait on the spot
+	uint32_t issued;        // early resolves
+} vramReadbackStats_t;
+
+extern uint32_t uiReadbackPrim;
+extern uint32_t uiReadbackIssueAt;
+extern int iReadbackAnnounced;
+
+// also forgets the tracked rects and the stats
+void SetVRamResolver(const vramResolver_t * r);
+void VRamReadbackIssue(void);
+void VRamReadbackNextFrame(void);
+// the rect x/y/w/h gets read now: resolves if something got drawn since
+// the last resolve, returns the resolver to lock (NULL: none)
+const vramResolver_t * VRamReadbackSchedule(int x, int y, int w, int h);
+const vramReadbackStats_t * GetVRamReadbackStats(void);
+
+// the game set up a vram -> psx mem transfer: resolve after this command
+static inline void VRamReadbackAnnounce(void) {
+	iReadbackAnnounced = 1;
+}
+
+// called after each gpu command: issues the predicted resolves
+static inline void VRamReadbackPrimitive(void) {
+	if (++uiReadbackPrim == uiReadbackIssueAt || iReadbackAnnounced)
+		VRamReadbackIssue();
+}
@@ -0,0 +1,208 @@
+/***************************************************************************
+adpcm.c  -  description
+-------------------
+***************************************************************************/
+
+/***************************************************************************
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License as published by  *
+*   the Free Software Foundation; either version 2 of the License, or     *
+*   (at your option) any later version. See also the license.txt file for *
+*   additional informations.                                              *
+*                                                                         *
+***************************************************************************/
+
+#include "stdafx.h"
+
+#define _IN_ADPCM
+
+// will be included from spu.c
+#ifdef _IN_SPU
+
+#include "adpcm.h"
+
+////////////////////////////////////////////////////////////////////////
+// decoded adpcm block cache
+////////////////////////////////////////////////////////////////////////
+
+/*
+Games play the same instrument samples from spu ram over and over, so
+every voice decoded the same 16 byte blocks again and again. We keep the
+28 decoded samples of a block, keyed by its spu ram address (blocks start
+on 8 byte boundaries) and the filter history it was decoded with. Filter
+0 doesn't use the history, those blocks match any.
+
+Writes to spu ram (registers, dma) drop the blocks they touch. The reverb
+unit writes its work area on its own, blocks in there are not cached.
+
+Each mix thread has its own lane of the cache, so voices mixed at the
+same time never fill the same entry.
+*/
+
+#define ADPCM_CACHE_SIZE 4096                          // entries, direct mapped
+#define ADPCM_CACHE_MASK (ADPCM_CACHE_SIZE - 1)
+
+typedef struct {
+    int key; // spu ram addr >> 3, -1: empty
+    int predict_nr;
+    int s_1, s_2; // history before the block ...
+    int o_1, o_2; // ... and after it
+    int SB[28];
+} ADPCMCache;
+
+static ADPCMCache adpcmCache[MAXMIXTHREADS][ADPCM_CACHE_SIZE];
+
+// bumped on every invalidation: a block decoded while the emu wrote
+// spu ram must not get stored
+static volatile unsigned long dwADPCMWrites = 0;
+
+////////////////////////////////////////////////////////////////////////
+
+void ResetADPCMCache(void) {
+    int i, lane;
+
+    for (lane = 0; lane < MAXMIXTHREADS; lane++)
+        for (i = 0; i < ADPCM_CACHE_SIZE; i++)
+            adpcmCache[lane][i].key = -1;
+
+    dwADPCMWrites++;
+}
+
+INLINE void DropADPCM(int key) {
+    int lane;
+
+    for (lane = 0; lane < MAXMIXTHREADS; lane++) {
+        ADPCMCache * e = &adpcmCache[lane][key & ADPCM_CACHE_MASK];
+
+        if (e->key == key) e->key = -1;
+    }
+}
+
+void InvalidateADPCM(unsigned long addr) {
+    int key = (addr & 0x7ffff) >> 3;
+
+    dwADPCMWrites++;
+
+    // the block starting here and the one starting 8 bytes before
+    DropADPCM(key);
+    DropADPCM((key - 1) & 0xffff);
+}
+
+void InvalidateADPCMRange(unsigned long addr, unsigned long size) {
+    int key, last;
+
+    if (!size) return;
+
+    key = (addr & 0x7ffff) >> 3;
+    last = ((addr & 0x7ffff) + size - 1) >> 3;
+
+    // more than the cache holds: just drop all
+    if (last - key >= ADPCM_CACHE_SIZE) {
+        ResetADPCMCache();
+        return;
+    }
+
+    dwADPCMWrites++;
+
+    for (key--; key <= last; key++)
+        DropADPCM(key & 0xffff);
+}
+
+////////////////////////////////////////////////////////////////////////
+// decode the 28 samples after the block header at start
+////////////////////////////////////////////////////////////////////////
+
+INLINE void DecodeADPCM(int * SB, unsigned char * start, int predict_nr, int shift_factor, int * ps_1, int * ps_2) {
+    int s_1 = *ps_1, s_2 = *ps_2;
+    int nSample, d, s, fa;
+
+    for (nSample = 0; nSample < 28; start++) {
+        int t1, t2;
+
+        d = (int) *start;
+        s = ((d & 0xf) << 12);
+        if (s & 0x8000) s |= 0xffff0000;
+
+        // -------------------------------
+
+        fa = (s >> shift_factor);
+
+        t1 = (s_1 * f[predict_nr][0]) / 64;
+        t2 = (s_2 * f[predict_nr][1]) / 64;
+
+        // MTV Music Generator - don't clamp here (demo1 vocal)
+        //CLAMP16(t1); CLAMP16(t2);
+        //fa + CLAMP16(t1+t2)/64
+
+        // snes brr clamps
+        fa = CLAMP16(fa + (t1 + t2));
+
+        s_2 = s_1;
+        s_1 = fa;
+        SB[nSample++] = fa;
+
+
+
+        s = ((d & 0xf0) << 8);
+        if (s & 0x8000) s |= 0xffff0000;
+
+        fa = (s >> shift_factor);
+
+        t1 = (s_1 * f[predict_nr][0]) / 64;
+        t2 = (s_2 * f[predict_nr][1]) / 64;
+
+        // snes brr clamps
+        fa = CLAMP16(fa + (t1 + t2));
+
+        s_2 = s_1;
+        s_1 = fa;
+        SB[nSample++] = fa;
+    }
+
+    *ps_1 = s_1;
+    *ps_2 = s_2;
+}
+
+////////////////////////////////////////////////////////////////////////
+// fill pChannel->SB with the block at start (after the header), from
+// cache lane 'lane' if possible
+////////////////////////////////////////////////////////////////////////
+
+INLINE void GetADPCMBlock(SPUCHAN * pChannel, int lane, unsigned char * start, int predict_nr, int shift_factor, int * ps_1, int * ps_2) {
+    int addr = (start - 2) - spuMemC;
+    int key = addr >> 3;
+    ADPCMCache * e = &adpcmCache[lane][key & ADPCM_CACHE_MASK];
+    unsigned long dwWrites;
+
+    // reverb work area
+    if (rvb.StartAddr && (addr >> 1) >= rvb.StartAddr) {
+        DecodeADPCM(pChannel->SB, start, predict_nr, shift_factor, ps_1, ps_2);
+        return;
+    }
+
+    if (e->key == key &&
+            (e->predict_nr == 0 || (e->s_1 == *ps_1 && e->s_2 == *ps_2))) {
+        memcpy(pChannel->SB, e->SB, 28 * sizeof (int));
+        *ps_1 = e->o_1;
+        *ps_2 = e->o_2;
+        return;
+    }
+
+    dwWrites = dwADPCMWrites;
+
+    e->key = -1;
+    e->predict_nr = predict_nr;
+    e->s_1 = *ps_1;
+    e->s_2 = *ps_2;
+
+    DecodeADPCM(e->SB, start, predict_nr, shift_factor, ps_1, ps_2);
+
+    e->o_1 = *ps_1;
+    e->o_2 = *ps_2;
+    memcpy(pChannel->SB, e->SB, 28 * sizeof (int));
+
+    if (dwWrites == dwADPCMWrites) e->key = key;
+}
+
+#endif
@@ -44,6 +44,7 @@
 #define _IN_CFG
 
 #include "externals.h"
+#include "../../main/gui.h"
 
 extern int iZincEmu;
 
@@ -102,6 +103,12 @@ void ReadConfig(void) {
     iVolXA = 0xC;
     iVolVoices = 10;
 
+    // 2-3: voices mixed on more hw threads
+    iSpuThreads = 1;
+
+    // 1: log what the emu feeds the spu to spu.log (SPUrenderLog)
+    iSpuLog = SpuConfig.spu_log;
+
     iXAStrength = 0;
     iCDDAStrength = 4;
     iOutput2Strength = 0xA;
@@ -30,15 +30,72 @@
 
 #include "externals.h"
 #include "registers.h"
+#include "adpcm.h"
+#include "spulog.h"
 
 
 
 #include <stdio.h>
+#include <string.h>
 extern FILE *fp_spu_log;
 
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
 
 //#define SPU_LOG
 
+////////////////////////////////////////////////////////////////////////
+// bulk dma helpers
+////////////////////////////////////////////////////////////////////////
+
+/*
+The dma moves whole blocks between psx ram and spu ram, both keep the psx
+byte order: no swapping, just a copy. The irq address gets checked once
+against the range (the old loop checked every halfword before writing it,
+the first match is the only one that can hit).
+*/
+
+// halfwords the dma can move from spuAddr on: it stops at the end of spu ram
+static int DMACount(int iSize) {
+    int iLeft;
+
+    if (spuAddr > 0x7ffff) return 0;
+
+    iLeft = (0x80000 - spuAddr) >> 1;
+    return iSize < iLeft ? iSize : iLeft;
+}
+
+static void DMACheckIRQ(unsigned long dwStart, int iCount) {
+    unsigned long dwIrq = pSpuIrq - spuMemC;
+
+    if (dwIrq >= dwStart && dwIrq < dwStart + iCount * 2 && !(dwIrq & 1))
+        Check_IRQ(dwIrq, 0);
+}
+
+// iBytes: even, dst and src halfword aligned
+static void DMACopy(unsigned char * dst, const unsigned char * src, int iBytes) {
+#ifdef __ALTIVEC__
+    // up to an aligned dst
+    for (; iBytes >= 2 && ((unsigned long) dst & 15); iBytes -= 2, dst += 2, src += 2)
+        *(unsigned short *) dst = *(const unsigned short *) src;
+
+    if (iBytes >= 16) {
+        vector unsigned char perm = vec_lvsl(0, src);
+        vector unsigned char lo = vec_ld(0, src), hi;
+
+        for (; iBytes >= 16; iBytes -= 16, dst += 16, src += 16) {
+            hi = vec_ld(16, src);
+            vec_st(vec_perm(lo, hi, perm), 0, dst);
+            lo = hi;
+        }
+    }
+#endif
+
+    memcpy(dst, src, iBytes);
+}
+
 ////////////////////////////////////////////////////////////////////////
 // READ DMA (one value)
 ////////////////////////////////////////////////////////////////////////
@@ -49,6 +106,7 @@ extern "C" unsigned short CALLBACK SPUreadDMA(void) {
 
     s = spuMem[spuAddr >> 1];
 
+    if (bSpuLog) SPULogDMARead1();
 
     spuAddr += 2;
     if (spuAddr > 0x7ffff) spuAddr = 0;
@@ -65,7 +123,7 @@ extern "C" unsigned short CALLBACK SPUreadDMA(void) {
 extern void (CALLBACK *irqCallback)(void); // func of main emu, called on spu irq
 
 extern "C" void CALLBACK SPUreadDMAMem(unsigned short * pusPSXMem, int iSize) {
-    int i;
+    int iCount = DMACount(iSize);
     
 
 #ifdef SPU_LOG
@@ -89,21 +147,17 @@ extern "C" void CALLBACK SPUreadDMAMem(unsigned short * pusPSXMem, int iSize) {
     spuStat |= STAT_DATA_BUSY;
 
 
-    for (i = 0; i < iSize; i++) {
-        Check_IRQ(spuAddr, 0);
+    // Guesswork based on Vib Ribbon (dma-w): stops at the end of spu ram
+    // - creates a dma hang?
+    DMACheckIRQ(spuAddr, iCount);
 
-        // guesswork
-        //if( (spuCtrl & CTRL_DMA_F) == CTRL_DMA_R ) {
-        {
-            *pusPSXMem++ = spuMem[spuAddr >> 1]; // spu addr got by writeregister
-        }
-        spuAddr += 2; // inc spu addr
+    if (bSpuLog) SPULogDMARead(spuAddr, iCount);
 
+    // guesswork
+    //if( (spuCtrl & CTRL_DMA_F) == CTRL_DMA_R ) {
+    DMACopy((unsigned char *) pusPSXMem, spuMemC + spuAddr, iCount * 2); // spu addr got by writeregister
 
-        // Guesswork based on Vib Ribbon (dma-w)
-        // - creates a dma hang?
-        if (spuAddr > 0x7ffff) break;
-    }
+    spuAddr += iCount * 2; // inc spu addr
 
     iSpuAsyncWait = 0;
 
@@ -129,6 +183,9 @@ extern "C" void CALLBACK SPUreadDMAMem(unsigned short * pusPSXMem, int iSize) {
 extern "C" void CALLBACK SPUwriteDMA(unsigned short val) {
     
     spuMem[spuAddr >> 1] = val; // spu addr got by writeregister
+    InvalidateADPCM(spuAddr);
+
+    if (bSpuLog) SPULogDMAWrite1(spuAddr);
 
     spuAddr += 2; // inc spu addr
     if (spuAddr > 0x7ffff) spuAddr = 0; // wrap
@@ -142,7 +199,7 @@ extern "C" void CALLBACK SPUwriteDMA(unsigned short val) {
 ////////////////////////////////////////////////////////////////////////
 
 extern "C" void CALLBACK SPUwriteDMAMem(unsigned short * pusPSXMem, int iSize) {
-    int i;
+    int iCount = DMACount(iSize);
     
 
 #ifdef SPU_LOG
@@ -167,20 +224,19 @@ extern "C" void CALLBACK SPUwriteDMAMem(unsigned short * pusPSXMem, int iSize) {
     spuStat |= STAT_DATA_BUSY;
 
 
-    for (i = 0; i < iSize; i++) {
-        Check_IRQ(spuAddr, 0);
+    // Vib Ribbon - stop transfer at the end of spu ram (reverb playback)
+    DMACheckIRQ(spuAddr, iCount);
 
-        // guesswork
-        //if( (spuCtrl & CTRL_DMA_F) == CTRL_DMA_W ) {
-        {
-            spuMem[spuAddr >> 1] = *pusPSXMem++; // spu addr got by writeregister
-        }
-        spuAddr += 2; // inc spu addr
+    // guesswork
+    //if( (spuCtrl & CTRL_DMA_F) == CTRL_DMA_W ) {
+    DMACopy(spuMemC + spuAddr, (unsigned char *) pusPSXMem, iCount * 2); // spu addr got by writeregister
 
+    // drop the decoded blocks we wrote over
+    InvalidateADPCMRange(spuAddr, iCount * 2);
 
-        // Vib Ribbon - stop transfer (reverb playback)
-        if (spuAddr > 0x7ffff) break;
-    }
+    if (bSpuLog) SPULogDMAWrite(spuAddr, iCount);
+
+    spuAddr += iCount * 2; // inc spu addr
 
     iSpuAsyncWait = 0;
 
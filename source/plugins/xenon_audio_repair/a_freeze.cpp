@@ -43,6 +43,8 @@ email                : BlackDove@addcom.de
 #include "regs.h"
 #include "dsoundoss.h"
 #include "freeze.h"
+#include "adpcm.h"
+#include "spulog.h"
 
 ////////////////////////////////////////////////////////////////////////
 // freeze structs
@@ -136,8 +138,11 @@ extern "C" long CALLBACK SPUfreeze(unsigned long ulFreezeMode,SPUFreeze_t * pF)
 	RemoveTimer();                                        // we stop processing while doing the save!
 	
 	memcpy(spuMem,pF->cSPURam,0x80000);                   // get ram
+	ResetADPCMCache();
 	memcpy(regArea,pF->cSPUPort,0x200);
 
+	if(bSpuLog) SPULogSnapshot();                        // new ram for the spu log
+
 	if(pF->xaS.nsamples<=4032)                            // start xa again
 		SPUplayADPCMchannel(&pF->xaS);
 
@@ -0,0 +1,129 @@
+/***************************************************************************
+record.c  -  description
+-------------------
+***************************************************************************/
+
+/***************************************************************************
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License as published by  *
+*   the Free Software Foundation; either version 2 of the License, or     *
+*   (at your option) any later version. See also the license.txt file for *
+*   additional informations.                                              *
+*                                                                         *
+***************************************************************************/
+
+#include "stdafx.h"
+
+#define _IN_RECORD
+
+#include "externals.h"
+#include "record.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WINDOWS
+
+////////////////////////////////////////////////////////////////////////
+// wav capture
+////////////////////////////////////////////////////////////////////////
+
+/*
+Everything the mixer hands to the sound output also goes into a 16 bit
+pcm wav file, 44100 hz, output_channels. The sizes in the header get
+filled in on RecordStop, a capture that never got stopped still has the
+samples, just a bad header.
+*/
+
+static FILE * fpRecord = NULL;
+static unsigned long dwRecordBytes = 0;
+
+static void PutLE32(unsigned char * p, unsigned long v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void PutLE16(unsigned char * p, unsigned short v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void WriteWavHeader(void) {
+    unsigned char h[44];
+
+    memcpy(h, "RIFF", 4);
+    PutLE32(h + 4, 36 + dwRecordBytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    PutLE32(h + 16, 16);
+    PutLE16(h + 20, 1); // pcm
+    PutLE16(h + 22, output_channels);
+    PutLE32(h + 24, 44100);
+    PutLE32(h + 28, 44100 * output_channels * 2);
+    PutLE16(h + 32, output_channels * 2);
+    PutLE16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    PutLE32(h + 40, dwRecordBytes);
+
+    fseek(fpRecord, 0, SEEK_SET);
+    fwrite(h, 1, sizeof (h), fpRecord);
+    fseek(fpRecord, 0, SEEK_END);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void RecordStart(const char * pName) {
+    if (fpRecord) RecordStop();
+
+    fpRecord = fopen(pName, "wb");
+    if (!fpRecord) {
+        printf("spu: can't record to %s\n", pName);
+        return;
+    }
+
+    dwRecordBytes = 0;
+    WriteWavHeader();
+}
+
+void RecordBuffer(unsigned char* pSound, long lBytes) {
+    if (!fpRecord || lBytes <= 0) return;
+
+    lBytes &= ~1;
+
+#ifdef __BIG_ENDIAN__
+    {
+        // wav samples are little endian
+        unsigned char buf[4096];
+        long i, n;
+
+        while (lBytes > 0) {
+            n = lBytes > (long) sizeof (buf) ? (long) sizeof (buf) : lBytes;
+
+            for (i = 0; i < n; i += 2) {
+                buf[i] = pSound[i + 1];
+                buf[i + 1] = pSound[i];
+            }
+
+            fwrite(buf, 1, n, fpRecord);
+            dwRecordBytes += n;
+            pSound += n;
+            lBytes -= n;
+        }
+    }
+#else
+    fwrite(pSound, 1, lBytes, fpRecord);
+    dwRecordBytes += lBytes;
+#endif
+}
+
+void RecordStop() {
+    if (!fpRecord) return;
+
+    WriteWavHeader();
+    fclose(fpRecord);
+    fpRecord = NULL;
+}
+
+#endif
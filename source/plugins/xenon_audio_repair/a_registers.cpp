@@ -45,6 +45,8 @@ email                : BlackDove@addcom.de
 #include "registers.h"
 #include "regs.h"
 #include "reverb.h"
+#include "adpcm.h"
+#include "spulog.h"
 
 /*
 // adsr time values (in ms) by James Higgs ... see the end of
@@ -112,6 +114,8 @@ extern "C" void CALLBACK SPUwriteRegister(unsigned long reg, unsigned short val)
 	
 	regArea[(r-0xc00)>>1] = val;
 	
+	if(bSpuLog) SPULogRegister(reg,val);
+	
 	
 #ifdef SPU_LOG
 	if( !fp_spu_log ){
@@ -282,6 +286,7 @@ extern "C" void CALLBACK SPUwriteRegister(unsigned long reg, unsigned short val)
 		Check_IRQ( spuAddr, 0 );
 		
 		spuMem[spuAddr>>1] = val;
+		InvalidateADPCM(spuAddr);
 		spuAddr+=2;
 		
 		
@@ -224,6 +224,245 @@ INLINE void s_buffer1(int iOff,int iVal)                // set_buffer (+1 sample
 	*(p+iOff)=(short)iVal;
 }
 
+////////////////////////////////////////////////////////////////////////
+// NEILL'S REVERB, BLOCK VERSION
+////////////////////////////////////////////////////////////////////////
+
+/*
+Same integer math as g_buffer/s_buffer and MixREVERBLeft/Right, but for
+all reverb steps (every 2nd sample) of a block at once. The work area
+addresses of the taps are set up once per block. A block is cut into
+parts where no tap wraps around the end of the work area, in there the
+taps just go up by one per step.
+*/
+
+enum {
+	RT_IIR_SRC_A0, RT_IIR_SRC_A1, RT_IIR_SRC_B0, RT_IIR_SRC_B1,
+	RT_IIR_DEST_A0, RT_IIR_DEST_A1, RT_IIR_DEST_B0, RT_IIR_DEST_B1,
+	RT_IIR_WR_A0, RT_IIR_WR_A1, RT_IIR_WR_B0, RT_IIR_WR_B1,        // dest + 1
+	RT_ACC_SRC_A0, RT_ACC_SRC_B0, RT_ACC_SRC_C0, RT_ACC_SRC_D0,
+	RT_ACC_SRC_A1, RT_ACC_SRC_B1, RT_ACC_SRC_C1, RT_ACC_SRC_D1,
+	RT_FB_A0, RT_FB_A1, RT_FB_B0, RT_FB_B1,
+	RT_MIX_DEST_A0, RT_MIX_DEST_A1, RT_MIX_DEST_B0, RT_MIX_DEST_B1,
+	RT_CURR,
+	RVB_TAPS
+};
+
+static int iRvbTapAddr[RVB_TAPS];                      // work area addr of each tap
+static int iRvbStepL[NSSIZE];                          // results of the reverb steps of a block
+static int iRvbStepR[NSSIZE];
+
+// work area offset -> addr, the work area goes from StartAddr to 0x3ffff
+INLINE int RvbWrap(int iOff)
+{
+	const int iSize=0x40000-rvb.StartAddr;
+
+	iOff=(iOff-rvb.StartAddr)%iSize;
+	if(iOff<0) iOff+=iSize;
+	return rvb.StartAddr+iOff;
+}
+
+INLINE void SetupReverbTaps(void)
+{
+	const int c=rvb.CurrAddr;
+	int * a=iRvbTapAddr;
+
+	a[RT_IIR_SRC_A0]=rvb.IIR_SRC_A0*4+c;
+	a[RT_IIR_SRC_A1]=rvb.IIR_SRC_A1*4+c;
+	a[RT_IIR_SRC_B0]=rvb.IIR_SRC_B0*4+c;
+	a[RT_IIR_SRC_B1]=rvb.IIR_SRC_B1*4+c;
+	a[RT_IIR_DEST_A0]=rvb.IIR_DEST_A0*4+c;
+	a[RT_IIR_DEST_A1]=rvb.IIR_DEST_A1*4+c;
+	a[RT_IIR_DEST_B0]=rvb.IIR_DEST_B0*4+c;
+	a[RT_IIR_DEST_B1]=rvb.IIR_DEST_B1*4+c;
+	a[RT_IIR_WR_A0]=rvb.IIR_DEST_A0*4+c+1;
+	a[RT_IIR_WR_A1]=rvb.IIR_DEST_A1*4+c+1;
+	a[RT_IIR_WR_B0]=rvb.IIR_DEST_B0*4+c+1;
+	a[RT_IIR_WR_B1]=rvb.IIR_DEST_B1*4+c+1;
+	a[RT_ACC_SRC_A0]=rvb.ACC_SRC_A0*4+c;
+	a[RT_ACC_SRC_B0]=rvb.ACC_SRC_B0*4+c;
+	a[RT_ACC_SRC_C0]=rvb.ACC_SRC_C0*4+c;
+	a[RT_ACC_SRC_D0]=rvb.ACC_SRC_D0*4+c;
+	a[RT_ACC_SRC_A1]=rvb.ACC_SRC_A1*4+c;
+	a[RT_ACC_SRC_B1]=rvb.ACC_SRC_B1*4+c;
+	a[RT_ACC_SRC_C1]=rvb.ACC_SRC_C1*4+c;
+	a[RT_ACC_SRC_D1]=rvb.ACC_SRC_D1*4+c;
+	a[RT_FB_A0]=(rvb.MIX_DEST_A0-rvb.FB_SRC_A)*4+c;
+	a[RT_FB_A1]=(rvb.MIX_DEST_A1-rvb.FB_SRC_A)*4+c;
+	a[RT_FB_B0]=(rvb.MIX_DEST_B0-rvb.FB_SRC_B)*4+c;
+	a[RT_FB_B1]=(rvb.MIX_DEST_B1-rvb.FB_SRC_B)*4+c;
+	a[RT_MIX_DEST_A0]=rvb.MIX_DEST_A0*4+c;
+	a[RT_MIX_DEST_A1]=rvb.MIX_DEST_A1*4+c;
+	a[RT_MIX_DEST_B0]=rvb.MIX_DEST_B0*4+c;
+	a[RT_MIX_DEST_B1]=rvb.MIX_DEST_B1*4+c;
+	a[RT_CURR]=c;
+}
+
+INLINE short RvbSat(int iVal)
+{
+	if(iVal<-32768L) iVal=-32768L;if(iVal>32767L) iVal=32767L;
+	return (short)iVal;
+}
+
+////////////////////////////////////////////////////////////////////////
+// do iSteps reverb steps, input pIn[0/1], pIn[4/5], ... (every 2nd
+// sample of sRVBStart), results into iRvbStepL/R. bOn: CTRL_REVERB set
+////////////////////////////////////////////////////////////////////////
+
+INLINE void RunReverbSteps(const int * pIn,int iSteps,int bOn)
+{
+	short * const m=(short *)spuMem;
+	const int iVolL=rvb.VolLeft & 0x7fff;
+	const int iVolR=rvb.VolRight & 0x7fff;
+	const int iMix=iReverbBoost ? 38 : 33;
+	short * p[RVB_TAPS];
+	int i,t,n=0;
+
+	SetupReverbTaps();
+	for(t=0;t<RVB_TAPS;t++) iRvbTapAddr[t]=RvbWrap(iRvbTapAddr[t]);
+
+	while(n<iSteps)
+	{
+		// part up to the first tap that hits the work area end
+		int iLen=iSteps-n;
+		for(t=0;t<RVB_TAPS;t++)
+		{
+			if(0x40000-iRvbTapAddr[t]<iLen) iLen=0x40000-iRvbTapAddr[t];
+			p[t]=m+iRvbTapAddr[t];
+		}
+
+		for(i=0;i<iLen;i++,n++,pIn+=4)
+		{
+			int iL,iR;
+
+			if(bOn)                                         // -> reverb on? oki
+			{
+				int ACC0,ACC1,FB_A0,FB_A1,FB_B0,FB_B1;
+
+				const int INPUT_SAMPLE_L=pIn[0];
+				const int INPUT_SAMPLE_R=pIn[1];
+
+				const int IIR_INPUT_A0 = (p[RT_IIR_SRC_A0][i] * rvb.IIR_COEF)/32768L + (INPUT_SAMPLE_L * rvb.IN_COEF_L)/32768L;
+				const int IIR_INPUT_A1 = (p[RT_IIR_SRC_A1][i] * rvb.IIR_COEF)/32768L + (INPUT_SAMPLE_R * rvb.IN_COEF_R)/32768L;
+				const int IIR_INPUT_B0 = (p[RT_IIR_SRC_B0][i] * rvb.IIR_COEF)/32768L + (INPUT_SAMPLE_L * rvb.IN_COEF_L)/32768L;
+				const int IIR_INPUT_B1 = (p[RT_IIR_SRC_B1][i] * rvb.IIR_COEF)/32768L + (INPUT_SAMPLE_R * rvb.IN_COEF_R)/32768L;
+
+				const int IIR_A0 = (IIR_INPUT_A0 * rvb.IIR_ALPHA)/32768L + (p[RT_IIR_DEST_A0][i] * (32768L - rvb.IIR_ALPHA))/32768L;
+				const int IIR_A1 = (IIR_INPUT_A1 * rvb.IIR_ALPHA)/32768L + (p[RT_IIR_DEST_A1][i] * (32768L - rvb.IIR_ALPHA))/32768L;
+				const int IIR_B0 = (IIR_INPUT_B0 * rvb.IIR_ALPHA)/32768L + (p[RT_IIR_DEST_B0][i] * (32768L - rvb.IIR_ALPHA))/32768L;
+				const int IIR_B1 = (IIR_INPUT_B1 * rvb.IIR_ALPHA)/32768L + (p[RT_IIR_DEST_B1][i] * (32768L - rvb.IIR_ALPHA))/32768L;
+
+				p[RT_IIR_WR_A0][i]=RvbSat(IIR_A0);
+				p[RT_IIR_WR_A1][i]=RvbSat(IIR_A1);
+				p[RT_IIR_WR_B0][i]=RvbSat(IIR_B0);
+				p[RT_IIR_WR_B1][i]=RvbSat(IIR_B1);
+
+				ACC0 = (p[RT_ACC_SRC_A0][i] * rvb.ACC_COEF_A)/32768L +
+					(p[RT_ACC_SRC_B0][i] * rvb.ACC_COEF_B)/32768L +
+					(p[RT_ACC_SRC_C0][i] * rvb.ACC_COEF_C)/32768L +
+					(p[RT_ACC_SRC_D0][i] * rvb.ACC_COEF_D)/32768L;
+				ACC1 = (p[RT_ACC_SRC_A1][i] * rvb.ACC_COEF_A)/32768L +
+					(p[RT_ACC_SRC_B1][i] * rvb.ACC_COEF_B)/32768L +
+					(p[RT_ACC_SRC_C1][i] * rvb.ACC_COEF_C)/32768L +
+					(p[RT_ACC_SRC_D1][i] * rvb.ACC_COEF_D)/32768L;
+
+				FB_A0 = p[RT_FB_A0][i];
+				FB_A1 = p[RT_FB_A1][i];
+				FB_B0 = p[RT_FB_B0][i];
+				FB_B1 = p[RT_FB_B1][i];
+
+				p[RT_MIX_DEST_A0][i]=RvbSat(ACC0 - (FB_A0 * rvb.FB_ALPHA)/32768L);
+				p[RT_MIX_DEST_A1][i]=RvbSat(ACC1 - (FB_A1 * rvb.FB_ALPHA)/32768L);
+
+				p[RT_MIX_DEST_B0][i]=RvbSat((rvb.FB_ALPHA * ACC0)/32768L - (FB_A0 * (int)(rvb.FB_ALPHA^0xFFFF8000))/32768L - (FB_B0 * rvb.FB_X)/32768L);
+				p[RT_MIX_DEST_B1][i]=RvbSat((rvb.FB_ALPHA * ACC1)/32768L - (FB_A1 * (int)(rvb.FB_ALPHA^0xFFFF8000))/32768L - (FB_B1 * rvb.FB_X)/32768L);
+
+				// Neill - guessed at 0.333
+				// Final Fantasy - use 0.38+ for more bass
+				iL = CLAMP16( iMix*(p[RT_MIX_DEST_A0][i]+p[RT_MIX_DEST_B0][i])/100 );
+				iR = CLAMP16( iMix*(p[RT_MIX_DEST_A1][i]+p[RT_MIX_DEST_B1][i])/100 );
+			}
+			else                                            // -> reverb off
+			{
+				// Vib Ribbon - grab current reverb sample (cdda data)
+				// - mono data
+				iL = iR = p[RT_CURR][i];
+			}
+
+			// Resident Evil 2 - reverb on hall door locks ($4000)
+			iRvbStepL[n] = ( iL * iVolL ) / 0x8000;
+			iRvbStepR[n] = ( iR * iVolR ) / 0x8000;
+
+			Check_IRQ( (iRvbTapAddr[RT_CURR]+i)*2, 0 );
+		}
+
+		// go on, taps at the work area end start over
+		for(t=0;t<RVB_TAPS;t++)
+		{
+			iRvbTapAddr[t]+=iLen;
+			if(iRvbTapAddr[t]>0x3ffff) iRvbTapAddr[t]=rvb.StartAddr;
+		}
+	}
+
+	rvb.CurrAddr=iRvbTapAddr[RT_CURR];
+}
+
+////////////////////////////////////////////////////////////////////////
+// reverb output for the samples 0 ... count-1 of the block
+////////////////////////////////////////////////////////////////////////
+
+INLINE void MixREVERBBlock(int count,int * pOutL,int * pOutR)
+{
+	const int bOn=(spuCtrl & CTRL_REVERB);
+	int ns,n,iFirst;
+
+	if(!rvb.StartAddr)                                    // reverb is off
+	{
+		rvb.iLastRVBLeft=rvb.iLastRVBRight=rvb.iRVBLeft=rvb.iRVBRight=0;
+		memset(pOutL,0,count*sizeof(int));
+		memset(pOutR,0,count*sizeof(int));
+		return;
+	}
+
+	// we work on every second value: downsample to 22 khz
+	iFirst=(iRvbCnt==0) ? 0 : 1;
+	RunReverbSteps(sRVBStart+(iFirst<<1),(count-iFirst+1)/2,bOn);
+
+	for(ns=0,n=0;ns<count;ns++)
+	{
+		iRvbCnt++; iRvbCnt &= 1;
+
+		if(iRvbCnt == 1)
+		{
+			if(bOn)
+			{
+				// save last position for lerp (linear interpolation)
+				rvb.iLastRVBLeft  = rvb.iRVBLeft;
+				rvb.iLastRVBRight = rvb.iRVBRight;
+			}
+			else
+			{
+				rvb.iLastRVBLeft = rvb.iRVBLeft;
+				rvb.iLastRVBLeft = rvb.iRVBRight;
+			}
+
+			rvb.iRVBLeft  = iRvbStepL[n];
+			rvb.iRVBRight = iRvbStepR[n];
+			n++;
+
+			// spos = 0x0000
+			pOutL[ns] = CLAMP16( rvb.iLastRVBLeft );
+			pOutR[ns] = CLAMP16( rvb.iLastRVBRight );
+		}
+		else
+		{
+			// spos = 0x8000
+			pOutL[ns] = CLAMP16( rvb.iLastRVBLeft + (rvb.iRVBLeft-rvb.iLastRVBLeft)/2 );
+			pOutR[ns] = CLAMP16( rvb.iLastRVBRight + (rvb.iRVBRight-rvb.iLastRVBRight)/2 );
+		}
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////
 
 #if 0
@@ -106,9 +106,12 @@ email 							 : BlackDove@addcom.de
 #include "record.h"
 #include "resource.h"
 #include "registers.h"
+#include "spulog.h"
 
 
+#ifdef LIBXENON
 #include <xenon_soc/xenon_power.h>
+#endif
 #include <stdio.h>
 extern FILE *fp_spu_log;
 
@@ -176,6 +179,8 @@ int iOutputInterp2 = 0;
 int iVolCDDA = 10;
 int iVolXA = 10;
 int iVolVoices = 10;
+int iSpuThreads = 1;
+int iSpuLog = 0;
 
 int iXAStrength = 4;
 int iCDDAStrength = 4;
@@ -233,14 +238,14 @@ const int f[5][2] = {
     { 122, -60}
 };
 
-int SSumR[NSSIZE];
-int SSumL[NSSIZE];
-int iFMod[NSSIZE];
+int SSumR[NSSIZE] ALIGNED;
+int SSumL[NSSIZE] ALIGNED;
+int iNoiseBlock[NSSIZE]; // noise generator output for each sample of the block
+int iRvbOutL[NSSIZE]; // reverb output of the block
+int iRvbOutR[NSSIZE];
 int iCycle = 0;
 short * pS;
 
-static int lastch = -1; // last channel processed on spu irq in timer mode
-static int lastns = 0; // last ns pos
 static int iSecureStart = 0; // secure start counter
 
 ////////////////////////////////////////////////////////////////////////
@@ -251,6 +256,7 @@ static int iSecureStart = 0; // secure start counter
 
 #include "a_reverb.cpp"
 #include "a_adsr.cpp"
+#include "a_adpcm.cpp"
 
 
 
@@ -837,10 +843,10 @@ INLINE void VoiceChangeFrequency(SPUCHAN * pChannel) {
 
 ////////////////////////////////////////////////////////////////////////
 
-INLINE void FModChangeFrequency(SPUCHAN * pChannel, int ns) {
+INLINE void FModChangeFrequency(SPUCHAN * pChannel, int * pFMod, int ns) {
     int NP = pChannel->iRawPitch;
 
-    NP = ((32768L + iFMod[ns]) * NP) / 32768L;
+    NP = ((32768L + pFMod[ns]) * NP) / 32768L;
 
     if (NP > 0x3fff) NP = 0x3fff;
     if (NP < 0x1) NP = 0x1;
@@ -853,7 +859,7 @@ INLINE void FModChangeFrequency(SPUCHAN * pChannel, int ns) {
     if (!pChannel->sinc) pChannel->sinc = 1;
     if (iUseInterpolation == 1) pChannel->SB[32] = 1; // freq change in simple interpolation mode
 
-    iFMod[ns] = 0;
+    pFMod[ns] = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -927,10 +933,10 @@ INLINE void NoiseClock() {
     }
 }
 
-INLINE int iGetNoiseVal(SPUCHAN * pChannel) {
+INLINE int iGetNoiseVal(SPUCHAN * pChannel, int ns) {
     int fa;
 
-    fa = (short) dwNoiseVal;
+    fa = iNoiseBlock[ns];
 
     // don't upset VAG decoder
     //if(iUseInterpolation<2) 															// no gauss/cubic interpolation?
@@ -1178,589 +1184,599 @@ INLINE int iGetInterpolationVal(SPUCHAN * pChannel) {
     return CLAMP16(fa);
 }
 
+#include "a_vmix.cpp"
+
 ////////////////////////////////////////////////////////////////////////
-// MAIN SPU FUNCTION
-// here is the main job handler... thread, timer or direct func call
-// basically the whole sound processing is done in this fat func!
+// BLOCK MIXER
+// each channel renders the whole block (APU_run samples) in one go, into
+// iChanOut, which then gets summed up with the channel volume. Ordering
+// between channels is kept: fmod reads iFMod[ns] from the previous
+// channel, which is always done with the block first. An irq the main emu
+// has to wait for ends the block part at that sample: the other channels
+// catch up to it, then we wait and go on with the rest of the block.
 ////////////////////////////////////////////////////////////////////////
 
-// 5 ms waiting phase, if buffer is full and no new sound has to get started
-// .. can be made smaller (smallest val: 1 ms), but bigger waits give
-// better performance
+int iSpuAsyncWait = 0;
 
-#define PAUSE_W 1
-#define PAUSE_L 1000
+static VOICEMIX voiceMix[MAXMIXTHREADS] ALIGNED; // [0]: spu thread
+static int iChanPos[MAXCHAN]; // samples of the block rendered by each channel
+static int iBlockDecoded = 0; // decoded buffer pos at block start
+static int iBlockPending = 0; // block started, not all channels done
 
-////////////////////////////////////////////////////////////////////////
+INLINE void StartMixBlock(void) {
+    int ns, decoded_voice = decoded_ptr;
 
-int iSpuAsyncWait = 0;
+    for (ns = 0; ns < APU_run; ns++) {
+        SSumL[ns] = 0;
+        SSumR[ns] = 0;
 
-extern int old_irq;
+        // decoded buffer values - dummy
+        spuMem[ (0x000 + decoded_voice) / 2 ] = (short) 0;
+        spuMem[ (0x400 + decoded_voice) / 2 ] = (short) 0;
+        spuMem[ (0x800 + decoded_voice) / 2 ] = (short) 0;
+        spuMem[ (0xc00 + decoded_voice) / 2 ] = (short) 0;
 
+        decoded_voice += 2;
+        decoded_voice &= 0x3ff;
 
-#ifdef _WINDOWS
-static VOID CALLBACK MAINProc(UINT nTimerId, UINT msg, DWORD dwUser, DWORD dwParam1, DWORD dwParam2)
-#else
+        NoiseClock();
+        iNoiseBlock[ns] = (short) dwNoiseVal;
+    }
 
-static void *MAINThread(void *arg)
-#endif
-{
-    ;
-    int s_1, s_2, fa, ns, voldiv = iVolume;
-    unsigned char * start;
-    unsigned int nSample;
-    int ch, predict_nr, shift_factor, flags, d, s;
-    int bIRQReturn = 0;
-    SPUCHAN * pChannel;
-    int decoded_voice;
+    memset(iChanPos, 0, sizeof (iChanPos));
+    iBlockDecoded = decoded_ptr;
+    iBlockPending = 1;
+}
 
+INLINE void FinishMixBlock(void) {
+    int ns, decoded_voice = iBlockDecoded;
 
-    while (!bEndThread) // until we are shutting down
-    {
-        //--------------------------------------------------//
-        // ok, at the beginning we are looking if there is
-        // enuff free place in the dsound/oss buffer to
-        // fill in new data, or if there is a new channel to start.
-        // if not, we wait (thread) or return (timer/spuasync)
-        // until enuff free place is available/a new channel gets
-        // started
-
-        if (iUseTimer < 3) {
-            if (dwNewChannel) // new channel should start immedately?
-            { // (at least one bit 0 ... MAXCHANNEL is set?)
-                iSecureStart++; // -> set iSecure
-                if (iSecureStart > 5) iSecureStart = 0; //		(if it is set 5 times - that means on 5 tries a new samples has been started - in a row, we will reset it, to give the sound update a chance)
-            } else iSecureStart = 0; // 0: no new channel should start
+    for (ns = 0; ns < APU_run; ns++) {
+        // voice boost
+        SSumL[ns] = ((SSumL[ns] * iVolVoices) / 10);
+        SSumR[ns] = ((SSumR[ns] * iVolVoices) / 10);
 
 
-            while (!iSecureStart && !bEndThread && // no new start? no thread end?
-                    // and still enuff data in sound buffer?
-                    (SoundGetBytesBuffered() > SOUNDLEN(5 + LATENCY))) {
-                iSecureStart = 0; // reset secure
+        // decoded buffer - voice
+        decoded_voice += 2;
+        decoded_voice &= 0x3ff;
 
-#ifdef _WINDOWS
-                if (iUseTimer) // no-thread mode?
-                {
-                    if (iUseTimer == 1) // -> ok, timer mode 1: setup a oneshot timer of x ms to wait
-                        timeSetEvent(PAUSE_W, 1, MAINProc, 0, TIME_ONESHOT);
-                    return; // -> and done this time (timer mode 1 or 2)
-                }
-                // win thread mode:
-                Sleep(PAUSE_W); // sleep for x ms (win)
-#else
-                if (iUseTimer) return 0; // linux no-thread mode? bye
-                usleep(PAUSE_L); // else sleep for x ms (linux)
-#endif
 
-                if (dwNewChannel) iSecureStart = 1; // if a new channel kicks in (or, of course, sound buffer runs low), we will leave the loop
-            }
+        // IRQ work
+        // - OPTIMIZE
+        if (pSpuIrq - spuMemC < 0x1000) {
+            // check all decoded buffer IRQs - timing issue
+            Check_IRQ(decoded_voice + 0x000, 0);
+            Check_IRQ(decoded_voice + 0x400, 0);
+            Check_IRQ(decoded_voice + 0x800, 0);
+            Check_IRQ(decoded_voice + 0xc00, 0);
         }
-        //--------------------------------------------------// continue from irq handling in timer mode?
+    }
 
-        if (lastch >= 0) // will be -1 if no continue is pending
-        {
-            ch = lastch;
-            ns = lastns;
-            lastch = -1; // -> setup all kind of vars to continue
-            pChannel = &s_chan[ch];
-            goto GOON; // -> directly jump to the continue point
-        }
+    // status flag
+    if (decoded_voice >= 0x200) {
+        spuStat |= STAT_DECODED;
+    } else {
+        spuStat &= ~STAT_DECODED;
+    }
 
-        //--------------------------------------------------//
-        //- main channel loop 														 -//
-        //--------------------------------------------------//
-        {
-            ns = 0;
-            decoded_voice = decoded_ptr;
+    iBlockPending = 0;
+}
 
-            while (ns < APU_run) // loop until 1 ms of data is reached
-            {
-                SSumL[ns] = 0;
-                SSumR[ns] = 0;
+////////////////////////////////////////////////////////////////////////
+// render channel ch from sample ns up to end, returns the sample it
+// stopped at: end, or the one after an irq hit (*pIRQWait gets set)
+////////////////////////////////////////////////////////////////////////
 
+static int MixChannel(VOICEMIX * m, SPUCHAN * pChannel, int ch, int ns, int end, int * pIRQWait) {
+    int s_1, s_2, fa;
+    unsigned char * start;
+    int predict_nr, shift_factor, flags;
+    int bIRQReturn = 0;
+    int first = ns, i;
 
-                // decoded buffer values - dummy
-                spuMem[ (0x000 + decoded_voice) / 2 ] = (short) 0;
-                spuMem[ (0x400 + decoded_voice) / 2 ] = (short) 0;
-                spuMem[ (0x800 + decoded_voice) / 2 ] = (short) 0;
-                spuMem[ (0xc00 + decoded_voice) / 2 ] = (short) 0;
+    if (m->bDefer) memset(&ucRvbStore[ch][ns], 0, end - ns);
 
+    // nothing playing and nothing to start: no output
+    if (!pChannel->bOn && !pChannel->bNew)
+        return end;
 
+    for (; ns < end; ns++) {
+        m->ucChanFlags[ns] = CHAN_SKIP;
+        ClearVoiceSample(m, ns);
 
-                NoiseClock();
+        if (pChannel->bNew) {
+            if (pChannel->ADSRX.StartDelay == 0) {
+                StartSound(pChannel); // start new sound
 
-                pChannel = s_chan;
-                for (ch = 0; ch < MAXCHAN; ch++, pChannel++) // loop em all... we will collect 1 ms of sound of each playing channel
-                {
-                    if (pChannel->bNew) {
-                        if (pChannel->ADSRX.StartDelay == 0) {
-                            StartSound(pChannel); // start new sound
-                            dwNewChannel &= ~(1 << ch); // clear new channel bit
-                        } else {
-                            pChannel->ADSRX.StartDelay--;
-                        }
-                    }
+                if (m->bDefer) m->dwNewDone |= 1 << ch;
+                else dwNewChannel &= ~(1 << ch); // clear new channel bit
+            } else {
+                pChannel->ADSRX.StartDelay--;
+            }
+        }
 
 
-                    if (!pChannel->bOn) continue; // channel not playing? next
+        if (!pChannel->bOn) continue; // channel not playing? next
 
 
-                    // BIOS - uses $1000
-                    // - decoded voice = off area (???)
+        // BIOS - uses $1000
+        // - decoded voice = off area (???)
 
-                    if (pChannel->pCurr - spuMemC < 0x1000) {
-                        pChannel->bOn = 0;
+        if (pChannel->pCurr - spuMemC < 0x1000) {
+            pChannel->bOn = 0;
 
-                        pChannel->iSilent = 2;
+            pChannel->iSilent = 2;
 
-                        pChannel->ADSRX.lVolume = 0;
-                        pChannel->ADSRX.EnvelopeVol = 0;
-                        pChannel->ADSRX.EnvelopeVol_f = 0;
+            pChannel->ADSRX.lVolume = 0;
+            pChannel->ADSRX.EnvelopeVol = 0;
+            pChannel->ADSRX.EnvelopeVol_f = 0;
 
-                        continue;
-                    }
+            continue;
+        }
 
 
-                    // Silhouette Mirage - ending mini-game
-                    // ?? - behavior?
+        // Silhouette Mirage - ending mini-game
+        // ?? - behavior?
 
-                    if (pChannel->pCurr - spuMemC >= 0x80000) {
-                        // dead channel - abort (no more IRQs)
-                        pChannel->bOn = 0;
+        if (pChannel->pCurr - spuMemC >= 0x80000) {
+            // dead channel - abort (no more IRQs)
+            pChannel->bOn = 0;
 
-                        pChannel->iSilent = 2;
+            pChannel->iSilent = 2;
 
-                        pChannel->ADSRX.lVolume = 0;
-                        pChannel->ADSRX.EnvelopeVol = 0;
-                        pChannel->ADSRX.EnvelopeVol_f = 0;
+            pChannel->ADSRX.lVolume = 0;
+            pChannel->ADSRX.EnvelopeVol = 0;
+            pChannel->ADSRX.EnvelopeVol_f = 0;
 
-                        continue;
-                    }
+            continue;
+        }
 
 
 
-                    if (pChannel->iActFreq != pChannel->iUsedFreq) // new psx frequency?
-                        VoiceChangeFrequency(pChannel);
+        if (pChannel->iActFreq != pChannel->iUsedFreq) // new psx frequency?
+            VoiceChangeFrequency(pChannel);
 
-                    if (pChannel->bFMod == 1 && iFMod[ns]) // fmod freq channel
-                        FModChangeFrequency(pChannel, ns);
+        if (pChannel->bFMod == 1 && m->iFMod[ns]) // fmod freq channel
+            FModChangeFrequency(pChannel, m->iFMod, ns);
 
-                    while (pChannel->spos >= 0x10000L) {
-                        if (pChannel->iSBPos == 28) // 28 reached?
-                        {
-                            /*
-                            Xenogears - must do $4 flag here ($7 sound effects)
-                            Jungle Book - external loop
-                            Xenogears - Anima Relic dungeons
-                             */
-                            if (pChannel->bLoopJump == 1) {
-                                pChannel->pCurr = pChannel->pLoop;
+        while (pChannel->spos >= 0x10000L) {
+            if (pChannel->iSBPos == 28) // 28 reached?
+            {
+                /*
+                Xenogears - must do $4 flag here ($7 sound effects)
+                Jungle Book - external loop
+                Xenogears - Anima Relic dungeons
+                 */
+                if (pChannel->bLoopJump == 1) {
+                    pChannel->pCurr = pChannel->pLoop;
 
 
-                                // ??? - stop illegal addresses
-                                if (pChannel->pCurr - spuMemC < 0x1000) {
-                                    pChannel->bOn = 0;
+                    // ??? - stop illegal addresses
+                    if (pChannel->pCurr - spuMemC < 0x1000) {
+                        pChannel->bOn = 0;
 
 
-                                    pChannel->iSilent = 2;
+                        pChannel->iSilent = 2;
 
-                                    pChannel->ADSRX.lVolume = 0;
-                                    pChannel->ADSRX.EnvelopeVol = 0;
-                                    pChannel->ADSRX.EnvelopeVol_f = 0;
+                        pChannel->ADSRX.lVolume = 0;
+                        pChannel->ADSRX.EnvelopeVol = 0;
+                        pChannel->ADSRX.EnvelopeVol_f = 0;
 
 
-                                    // abort - don't trigger IRQs
-                                    break;
-                                }
+                        // abort - don't trigger IRQs
+                        break;
+                    }
 
 
-                                /*
-                                Metal Gear Solid
-                                - Does an on-off clear test at start
-                                - ???: stop playback to avoid dupe IRQ @ ch 1
-                                 */
+                    /*
+                    Metal Gear Solid
+                    - Does an on-off clear test at start
+                    - ???: stop playback to avoid dupe IRQ @ ch 1
+                     */
 
-                                if (pChannel->pCurr - spuMemC == 0x1000 &&
-                                        pChannel->iSilent == 2) {
-                                    pChannel->bOn = 0;
+                    if (pChannel->pCurr - spuMemC == 0x1000 &&
+                            pChannel->iSilent == 2) {
+                        pChannel->bOn = 0;
 
-                                    pChannel->ADSRX.lVolume = 0;
-                                    pChannel->ADSRX.EnvelopeVol = 0;
-                                    pChannel->ADSRX.EnvelopeVol_f = 0;
+                        pChannel->ADSRX.lVolume = 0;
+                        pChannel->ADSRX.EnvelopeVol = 0;
+                        pChannel->ADSRX.EnvelopeVol_f = 0;
 
-                                    break;
-                                }
+                        break;
+                    }
 
 
-                                // Nuclear Strike / Soviet Strike
-                                if (Check_IRQ((pChannel->pCurr - spuMemC) - 0, 0)) {
+                    // Nuclear Strike / Soviet Strike
+                    if (VoiceCheckIRQ(m, (pChannel->pCurr - spuMemC) - 0, ch, ns)) {
 #ifdef SPU_LOG
-                                    fprintf(fp_spu_log, "%d = IRQ %X\n", ch + 1, pSpuIrq - spuMemC);
+                        fprintf(fp_spu_log, "%d = IRQ %X\n", ch + 1, pSpuIrq - spuMemC);
 #endif
 
-                                    pChannel->iIrqDone = 1; // -> debug flag
-
-                                    if (iSPUIRQWait) // -> option: wait after irq for main emu
-                                    {
-                                        iSpuAsyncWait = 1;
-                                        bIRQReturn = 1;
-                                    }
-                                }
-                            }
+                        pChannel->iIrqDone = 1; // -> debug flag
 
-                            pChannel->bLoopJump = 0;
-
-
-
-                            start = pChannel->pCurr; // set up the current pos
+                        if (iSPUIRQWait) // -> option: wait after irq for main emu
+                        {
+                            iSpuAsyncWait = 1;
+                            bIRQReturn = 1;
+                        }
+                    }
+                }
 
-                            if (pChannel->iSilent == 1 || start == (unsigned char*) - 1) // special "stop" sign
-                            {
-                                // silence = let channel keep running (IRQs)
-                                //pChannel->bOn=0;												// -> turn everything off
-                                pChannel->iSilent = 2;
+                pChannel->bLoopJump = 0;
 
-                                // Actua Soccer 2 - stop envelope now
-                                pChannel->ADSRX.lVolume = 0;
-                                pChannel->ADSRX.EnvelopeVol = 0;
-                                pChannel->ADSRX.EnvelopeVol_f = 0;
-                            }
 
-                            pChannel->iSBPos = 0;
 
-                            //////////////////////////////////////////// spu irq handler here? mmm... do it later
+                start = pChannel->pCurr; // set up the current pos
 
-                            s_1 = pChannel->s_1;
-                            s_2 = pChannel->s_2;
+                if (pChannel->iSilent == 1 || start == (unsigned char*) - 1) // special "stop" sign
+                {
+                    // silence = let channel keep running (IRQs)
+                    //pChannel->bOn=0;												// -> turn everything off
+                    pChannel->iSilent = 2;
+
+                    // Actua Soccer 2 - stop envelope now
+                    pChannel->ADSRX.lVolume = 0;
+                    pChannel->ADSRX.EnvelopeVol = 0;
+                    pChannel->ADSRX.EnvelopeVol_f = 0;
+                }
 
-                            predict_nr = (int) *start;
-                            start++;
-                            shift_factor = predict_nr & 0xf;
-                            predict_nr >>= 4;
-                            flags = (int) *start;
-                            start++;
+                pChannel->iSBPos = 0;
 
+                //////////////////////////////////////////// spu irq handler here? mmm... do it later
 
-                            // Silhouette Mirage - Serah fight
-                            if (predict_nr > 4) predict_nr = 0;
+                s_1 = pChannel->s_1;
+                s_2 = pChannel->s_2;
 
-                            // -------------------------------------- //
+                predict_nr = (int) *start;
+                start++;
+                shift_factor = predict_nr & 0xf;
+                predict_nr >>= 4;
+                flags = (int) *start;
+                start++;
 
-                            for (nSample = 0; nSample < 28; start++) {
-                                int t1, t2;
 
+                // Silhouette Mirage - Serah fight
+                if (predict_nr > 4) predict_nr = 0;
 
-                                // OPTIMIZE - skip this
-                                if (pChannel->iSilent == 2) {
-                                    // don't use break - start++ keeps track of this
-                                    nSample += 2;
-                                    continue;
-                                }
+                // -------------------------------------- //
 
+                // OPTIMIZE - skip this when silent
+                if (pChannel->iSilent != 2)
+                    GetADPCMBlock(pChannel, m->iLane, start, predict_nr, shift_factor, &s_1, &s_2);
+                start += 14;
 
-                                d = (int) *start;
-                                s = ((d & 0xf) << 12);
-                                if (s & 0x8000) s |= 0xffff0000;
+                //////////////////////////////////////////// irq check
 
-                                // -------------------------------
+                // Misadventures of Tron Bonne uses (-8)
+                if (VoiceCheckIRQ(m, (start - spuMemC) - 8, ch, ns) ||
+                        VoiceCheckIRQ(m, (start - spuMemC) - 0, ch, ns)) {
+#ifdef SPU_LOG
+                    fprintf(fp_spu_log, "%d = IRQ %X\n", ch + 1, pSpuIrq - spuMemC);
+#endif
 
-                                fa = (s >> shift_factor);
+                    pChannel->iIrqDone = 1; // -> debug flag
 
-                                t1 = (s_1 * f[predict_nr][0]) / 64;
-                                t2 = (s_2 * f[predict_nr][1]) / 64;
+                    if (iSPUIRQWait) // -> option: wait after irq for main emu
+                    {
+                        iSpuAsyncWait = 1;
+                        bIRQReturn = 1;
+                    }
+                }
 
-                                // MTV Music Generator - don't clamp here (demo1 vocal)
-                                //CLAMP16(t1); CLAMP16(t2);
-                                //fa + CLAMP16(t1+t2)/64
+                //////////////////////////////////////////// flag handler
 
-                                // snes brr clamps
-                                fa = CLAMP16(fa + (t1 + t2));
+                /*
+                SPU2-X (PCSX2 team):
+                $4 = set loop to current block
+                $2 = keep envelope on (no mute)
+                $1 = jump to loop address
 
-                                s_2 = s_1;
-                                s_1 = fa;
-                                pChannel->SB[nSample++] = fa;
+                silence means no volume (ADSR keeps playing!!)
+                 */
 
 
+                // Misadventures of Tron Bonne
+                // - ignore illegal flags
+                if (flags > 7) {
+                    flags = 0;
 
-                                s = ((d & 0xf0) << 8);
-                                if (s & 0x8000) s |= 0xffff0000;
 
-                                fa = (s >> shift_factor);
+                    // Tron Bonne (???)
+                    // - Final boss with Loath (set envelope -next- loop)
+                    pChannel->iSilent = 1;
+                }
 
-                                t1 = (s_1 * f[predict_nr][0]) / 64;
-                                t2 = (s_2 * f[predict_nr][1]) / 64;
 
-                                // MTV Music Generator - don't clamp here (demo1 vocal)
-                                //CLAMP16(t1); CLAMP16(t2);
-                                //fa + CLAMP16(t1+t2)/64
 
-                                // snes brr clamps
-                                fa = CLAMP16(fa + (t1 + t2));
+                // Xenogears - must do $4 flag here (sound effects)
+                if (flags & 4) {
+                    // Xenogears - Anima Relic dungeons
+                    pChannel->pLoop = start - 16;
+                }
 
-                                s_2 = s_1;
-                                s_1 = fa;
-                                pChannel->SB[nSample++] = fa;
-                            }
 
-                            //////////////////////////////////////////// irq check
+                // Jungle Book - don't reset (wrong gameplay speed - IRQ hits)
+                //pChannel->bIgnoreLoop = 0;
 
-                            // Misadventures of Tron Bonne uses (-8)
-                            if (Check_IRQ((start - spuMemC) - 8, 0) ||
-                                    Check_IRQ((start - spuMemC) - 0, 0)) {
-#ifdef SPU_LOG
-                                fprintf(fp_spu_log, "%d = IRQ %X\n", ch + 1, pSpuIrq - spuMemC);
-#endif
 
-                                pChannel->iIrqDone = 1; // -> debug flag
+                if (flags & 1) {
+                    // set jump flag
+                    pChannel->bLoopJump = 1;
 
-                                if (iSPUIRQWait) // -> option: wait after irq for main emu
-                                {
-                                    iSpuAsyncWait = 1;
-                                    bIRQReturn = 1;
-                                }
-                            }
+                    // Xenogears - 7 = menu sound + other missing sounds
+                    //start = pChannel->pLoop;
 
-                            //////////////////////////////////////////// flag handler
+                    // silence = keep playing
+                    if ((flags & 2) == 0) {
+                        // silence = don't start release phase
+                        //pChannel->bStop = 1;
 
-                            /*
-                            SPU2-X (PCSX2 team):
-                            $4 = set loop to current block
-                            $2 = keep envelope on (no mute)
-                            $1 = jump to loop address
+                        // Xenogears - shutdown volume
+                        // 1 - right now
+                        // 2 - right after block plays (*)
+                        // - fixes cavern water drops
+                        pChannel->iSilent = 1;
+                    } else {
+                        // Jungle Book - don't set silent back to off (loop buzz)
+                        //pChannel->iSilent = 0;
+                    }
 
-                            silence means no volume (ADSR keeps playing!!)
-                             */
 
+                    // Jungle Book - don't do this (scratchy)
+                    //s_1 = 0;
+                    //s_2 = 0;
+                }
 
-                            // Misadventures of Tron Bonne
-                            // - ignore illegal flags
-                            if (flags > 7) {
-                                flags = 0;
 
+#if 0
+                // crash check
+                if (start == 0)
+                    start = (unsigned char *) - 1;
+                if (start >= spuMemC + 0x80000)
+                    start = spuMemC - 0x80000;
+#endif
 
-                                // Tron Bonne (???)
-                                // - Final boss with Loath (set envelope -next- loop)
-                                pChannel->iSilent = 1;
-                            }
 
+                pChannel->pCurr = start; // store values for next cycle
+                pChannel->s_1 = s_1;
+                pChannel->s_2 = s_2;
 
+            }
 
-                            // Xenogears - must do $4 flag here (sound effects)
-                            if (flags & 4) {
-                                // Xenogears - Anima Relic dungeons
-                                pChannel->pLoop = start - 16;
-                            }
+            fa = pChannel->SB[pChannel->iSBPos++]; // get sample data
 
+            StoreInterpolationVal(pChannel, fa); // store val for later interpolation
 
-                            // Jungle Book - don't reset (wrong gameplay speed - IRQ hits)
-                            //pChannel->bIgnoreLoop = 0;
+            pChannel->spos -= 0x10000L;
+        }
 
+        ////////////////////////////////////////////////
 
-                            if (flags & 1) {
-                                // set jump flag
-                                pChannel->bLoopJump = 1;
+        // OPTIMIZE - skip this when silent (sample stays 0)
+        // - Tron Bonne hack
+        if (pChannel->iSilent != 2) {
+            // get noise val
+            if (pChannel->bNoise)
+                m->iChanBase[ns] = iGetNoiseVal(pChannel, ns);
 
-                                // Xenogears - 7 = menu sound + other missing sounds
-                                //start = pChannel->pLoop;
+                // gauss: summed up for the block in MixVoiceSamples
+            else if (iUseInterpolation == 2)
+                StoreGaussTaps(m, pChannel, ns);
 
-                                // silence = keep playing
-                                if ((flags & 2) == 0) {
-                                    // silence = don't start release phase
-                                    //pChannel->bStop = 1;
+                // get sample val
+            else
+                m->iChanBase[ns] = iGetInterpolationVal(pChannel);
+        }
 
-                                    // Xenogears - shutdown volume
-                                    // 1 - right now
-                                    // 2 - right after block plays (*)
-                                    // - fixes cavern water drops
-                                    pChannel->iSilent = 1;
-                                } else {
-                                    // Jungle Book - don't set silent back to off (loop buzz)
-                                    //pChannel->iSilent = 0;
-                                }
 
+        spu_ch = ch;
 
-                                // Jungle Book - don't do this (scratchy)
-                                //s_1 = 0;
-                                //s_2 = 0;
-                            }
+        // Actua Soccer 2 - stop envelope
+        if (pChannel->iSilent != 2)
+            m->sChanEnv[ns] = MixADSR(pChannel); // mix adsr
 
 
-#if 0
-                            // crash check
-                            if (start == 0)
-                                start = (unsigned char *) - 1;
-                            if (start >= spuMemC + 0x80000)
-                                start = spuMemC - 0x80000;
-#endif
+        // OPTIMIZE
+        if (pChannel->iMute || pChannel->iSilent == 2)
+            m->ucChanFlags[ns] = CHAN_MUTED; // debug mute
+        else
+            m->ucChanFlags[ns] = CHAN_PLAY;
 
+        pChannel->spos += pChannel->sinc;
 
-                            pChannel->pCurr = start; // store values for next cycle
-                            pChannel->s_1 = s_1;
-                            pChannel->s_2 = s_2;
+        // irq wait requested: this sample is done, the others have to catch up first
+        if (bIRQReturn) {
+            ns++;
+            break;
+        }
+    }
 
-                            ////////////////////////////////////////////
+    MixVoiceSamples(m, first, ns);
 
-                            if (bIRQReturn) // special return for "spu irq - wait for cpu action"
-                            {
-                                bIRQReturn = 0;
-                                if (iUseTimer < 2) {
-                                    DWORD dwWatchTime = timeGetTime() + 2500;
+    for (i = first; i < ns; i++) {
+        m->iChanOut[i] = 0;
 
-                                    while (iSpuAsyncWait && !bEndThread &&
-                                            timeGetTime() < dwWatchTime)
+        if (m->ucChanFlags[i] == CHAN_SKIP) continue;
 
-#ifdef _WINDOWS
-                                        Sleep(1);
-#else
-                                        usleep(1000L);
-#endif
+        fa = m->sChanFa[i];
 
-                                } else {
-                                    lastch = ch;
-                                    lastns = ns;
+        // Voice 1/3 decoded buffer
+        if (ch == 0) {
+            spuMem[ (0x800 + ((iBlockDecoded + i * 2) & 0x3ff)) / 2 ] = (short) fa;
+        } else if (ch == 2) {
+            spuMem[ (0xc00 + ((iBlockDecoded + i * 2) & 0x3ff)) / 2 ] = (short) fa;
+        }
 
-#ifdef _WINDOWS
-                                    return;
-#else
-                                    return 0;
-#endif
-                                }
-                            }
+        // assume 15-bit value + sign-bit
+        pChannel->sval = m->iChanSval[i];
 
-                            ////////////////////////////////////////////
+        if (pChannel->bFMod == 2) // fmod freq channel
+            m->iFMod[i] = pChannel->sval; // -> store 1T sample data, use that to do fmod on next channel
 
-GOON:
-                            ;
-                        }
 
-                        fa = pChannel->SB[pChannel->iSBPos++]; // get sample data
+        // Xenogears: mix fmod channel into output
+        // - fixes save icon (high pitch)
+        {
+            if (m->ucChanFlags[i] == CHAN_MUTED)
+                pChannel->sval = 0; // debug mute
+            else
+                m->iChanOut[i] = pChannel->sval; // -> summed up with the volume after the block
 
-                        StoreInterpolationVal(pChannel, fa); // store val for later interpolation
+            //////////////////////////////////////////////
+            // now let us store sound data for reverb
 
-                        pChannel->spos -= 0x10000L;
-                    }
+            // check reverb write flags
+            if (pChannel->bRVBActive) {
+                if (m->bDefer) // -> stored in channel order by the merge
+                {
+                    iRvbSval[ch][i] = pChannel->sval;
+                    ucRvbStore[ch][i] = 1;
+                } else
+                    StoreREVERB(pChannel, i);
+            }
+        }
+    }
 
-                    ////////////////////////////////////////////////
+    ////////////////////////////////////////////////
+    // ok, left/right sound volume (psx volume goes from 0 ... 0x3fff)
+    MixVoiceVolume(m, first, ns, pChannel->iLeftVolume & 0x3fff, pChannel->iRightVolume & 0x3fff);
 
-                    // OPTIMIZE - skip this
-                    // - Tron Bonne hack
-                    if (pChannel->iSilent == 2)
-                        fa = 0;
+    if (bIRQReturn) *pIRQWait = 1;
 
-                        // get noise val
-                    else if (pChannel->bNoise)
-                        fa = (iGetNoiseVal(pChannel));
+    return ns;
+}
 
-                        // get sample val
-                    else
-                        fa = (iGetInterpolationVal(pChannel));
+#include "a_vthread.cpp"
 
 
+////////////////////////////////////////////////////////////////////////
+// MAIN SPU FUNCTION
+// here is the main job handler... thread, timer or direct func call
+// basically the whole sound processing is done in this fat func!
+////////////////////////////////////////////////////////////////////////
 
-                    // Voice 1/3 decoded buffer
-                    if (ch == 0) {
-                        spuMem[ (0x800 + decoded_voice) / 2 ] = (short) fa;
-                    } else if (ch == 2) {
-                        spuMem[ (0xc00 + decoded_voice) / 2 ] = (short) fa;
-                    }
+// 5 ms waiting phase, if buffer is full and no new sound has to get started
+// .. can be made smaller (smallest val: 1 ms), but bigger waits give
+// better performance
 
+#define PAUSE_W 1
+#define PAUSE_L 1000
 
-                    spu_ch = ch;
+////////////////////////////////////////////////////////////////////////
 
-                    // Actua Soccer 2 - stop envelope
-                    if (pChannel->iSilent == 2)
-                        pChannel->sval = 0;
-                    else
-                        // assume 15-bit value + sign-bit
-                        pChannel->sval = ((MixADSR(pChannel) * fa) / 0x8000); // mix adsr
+extern int old_irq;
 
+static int bSpuRender = 0; // offline render (SPUrenderLog): no sound output
 
-                    if (pChannel->bFMod == 2) // fmod freq channel
-                        iFMod[ns] = pChannel->sval; // -> store 1T sample data, use that to do fmod on next channel
+#ifdef _WINDOWS
+static VOID CALLBACK MAINProc(UINT nTimerId, UINT msg, DWORD dwUser, DWORD dwParam1, DWORD dwParam2)
+#else
 
+static void *MAINThread(void *arg)
+#endif
+{
+    int ns, voldiv = iVolume;
+    int ch;
+    SPUCHAN * pChannel;
 
-                    // Xenogears: mix fmod channel into output
-                    // - fixes save icon (high pitch)
-                    {
-                        //////////////////////////////////////////////
-                        // ok, left/right sound volume (psx volume goes from 0 ... 0x3fff)
 
-                        // OPTIMIZE
-                        if (pChannel->iMute || pChannel->iSilent == 2)
-                            pChannel->sval = 0; // debug mute
-                        else {
-                            int lc, rc;
+    while (!bEndThread) // until we are shutting down
+    {
+        //--------------------------------------------------//
+        // ok, at the beginning we are looking if there is
+        // enuff free place in the dsound/oss buffer to
+        // fill in new data, or if there is a new channel to start.
+        // if not, we wait (thread) or return (timer/spuasync)
+        // until enuff free place is available/a new channel gets
+        // started
 
-                            // assume 14-bit value + no sign
-                            lc = ((pChannel->sval * (pChannel->iLeftVolume & 0x3fff)) / 0x4000L);
-                            rc = ((pChannel->sval * (pChannel->iRightVolume & 0x3fff)) / 0x4000L);
+        if (iUseTimer < 3) {
+            if (dwNewChannel) // new channel should start immedately?
+            { // (at least one bit 0 ... MAXCHANNEL is set?)
+                iSecureStart++; // -> set iSecure
+                if (iSecureStart > 5) iSecureStart = 0; //		(if it is set 5 times - that means on 5 tries a new samples has been started - in a row, we will reset it, to give the sound update a chance)
+            } else iSecureStart = 0; // 0: no new channel should start
 
-                            SSumL[ns] = (SSumL[ns] + lc);
-                            SSumR[ns] = (SSumR[ns] + rc);
-                        }
 
-                        //////////////////////////////////////////////
-                        // now let us store sound data for reverb
+            while (!iSecureStart && !bEndThread && // no new start? no thread end?
+                    // and still enuff data in sound buffer?
+                    (SoundGetBytesBuffered() > SoundGetLatencyBytes())) {
+                iSecureStart = 0; // reset secure
 
-                        // check reverb write flags
-                        if (pChannel->bRVBActive)
-                            StoreREVERB(pChannel, ns);
-                    }
+#ifdef _WINDOWS
+                if (iUseTimer) // no-thread mode?
+                {
+                    if (iUseTimer == 1) // -> ok, timer mode 1: setup a oneshot timer of x ms to wait
+                        timeSetEvent(PAUSE_W, 1, MAINProc, 0, TIME_ONESHOT);
+                    return; // -> and done this time (timer mode 1 or 2)
+                }
+                // win thread mode:
+                Sleep(PAUSE_W); // sleep for x ms (win)
+#else
+                if (iUseTimer) return 0; // linux no-thread mode? bye
+                usleep(PAUSE_L); // else sleep for x ms (linux)
+#endif
 
-                    pChannel->spos += pChannel->sinc;
-                } // end ch
+                if (dwNewChannel) iSecureStart = 1; // if a new channel kicks in (or, of course, sound buffer runs low), we will leave the loop
+            }
+        }
+        //--------------------------------------------------//
+        //- main channel loop 														 -//
+        //--------------------------------------------------//
+        {
+            int end;
 
+            if (!iBlockPending) // else: continue the block after irq handling in timer mode
+                StartMixBlock();
 
-                ////////////////////////////////////////////////
-                // ok, go on until 1 ms data of this channel is collected
+            do {
+                int bIRQWait = 0;
 
-                // voice boost
-                SSumL[ns] = ((SSumL[ns] * iVolVoices) / 10);
-                SSumR[ns] = ((SSumR[ns] * iVolVoices) / 10);
+                end = APU_run;
 
+                // whole block done by the mix threads?
+                if (MixVoicesSplit()) break;
 
-                // decoded buffer - voice
-                decoded_voice += 2;
-                decoded_voice &= 0x3ff;
+                pChannel = s_chan;
+                for (ch = 0; ch < MAXCHAN; ch++, pChannel++) // loop em all... we will collect 1 ms of sound of each playing channel
+                {
+                    if (iChanPos[ch] >= end) continue;
 
+                    iChanPos[ch] = MixChannel(&voiceMix[0], pChannel, ch, iChanPos[ch], end, &bIRQWait);
 
-                // status flag
-                if (decoded_voice >= 0x200) {
-                    spuStat |= STAT_DECODED;
-                } else {
-                    spuStat &= ~STAT_DECODED;
+                    // irq hit: the next channels only go up to there
+                    if (iChanPos[ch] < end) end = iChanPos[ch];
                 }
 
+                if (bIRQWait) // special return for "spu irq - wait for cpu action"
+                {
+                    if (iUseTimer < 2) {
+                        DWORD dwWatchTime = timeGetTime() + 2500;
 
-                // IRQ work
-                // - OPTIMIZE
-                if (pSpuIrq - spuMemC < 0x1000) {
-                    unsigned char *old_irq;
-                    int old_ptr;
-
-                    old_irq = pSpuIrq;
-                    old_ptr = decoded_voice;
-
+                        while (iSpuAsyncWait && !bEndThread &&
+                                timeGetTime() < dwWatchTime)
 
-#if 0
-                    // align to boundaries ($0, $200, $400, $600)
-                    pSpuIrq = ((pSpuIrq - spuMemC) & (~0x1ff)) + spuMemC;
-                    decoded_voice = decoded_voice & (~0x1ff);
+#ifdef _WINDOWS
+                            Sleep(1);
+#else
+                            usleep(1000L);
 #endif
 
-                    // check all decoded buffer IRQs - timing issue
-                    Check_IRQ(decoded_voice + 0x000, 0);
-                    Check_IRQ(decoded_voice + 0x400, 0);
-                    Check_IRQ(decoded_voice + 0x800, 0);
-                    Check_IRQ(decoded_voice + 0xc00, 0);
-
-                    pSpuIrq = old_irq;
-                    decoded_voice = old_ptr;
+                    } else {
+#ifdef _WINDOWS
+                        return;
+#else
+                        return 0;
+#endif
+                    }
                 }
+            } while (end < APU_run);
 
+            FinishMixBlock();
+            ns = APU_run;
 
-                ns++;
-            } // end ns
+            if (bSpuLog) SPULogBlock();
         } // end main channel code
 
         //---------------------------------------------------//
@@ -1779,12 +1795,19 @@ GOON:
         ///////////////////////////////////////////////////////
         // mix all channels (including reverb) into one buffer
 
+        if (iUseReverb == 2) MixREVERBBlock(APU_run, iRvbOutL, iRvbOutR);
+
         for (ns = 0; ns < APU_run; ns++) {
             int lc, rc;
 
 
-            lc = CLAMP16(SSumL[ns] + MixREVERBLeft(ns));
-            rc = CLAMP16(SSumR[ns] + MixREVERBRight());
+            if (iUseReverb == 2) {
+                lc = CLAMP16(SSumL[ns] + iRvbOutL[ns]);
+                rc = CLAMP16(SSumR[ns] + iRvbOutR[ns]);
+            } else {
+                lc = CLAMP16(SSumL[ns] + MixREVERBLeft(ns));
+                rc = CLAMP16(SSumR[ns] + MixREVERBRight());
+            }
 
 
             lc = CLAMP16((lc * (iVolMainL & 0x3fff)) / 0x4000);
@@ -2306,8 +2329,15 @@ GOON:
             }
 
 
+#ifndef _WINDOWS
+            if (iRecordMode)
+                RecordBuffer((unsigned char*) pSpuBuffer,
+                    ((unsigned char *) pS)-
+                    ((unsigned char *) pSpuBuffer));
+#endif
+
             // overflow check - likely fast-forward
-            if (test < TESTMAX)
+            if (test < TESTMAX && !bSpuRender)
                 SoundFeedStreamData((unsigned char*) pSpuBuffer,
                     ((unsigned char *) pS)-
                     ((unsigned char *) pSpuBuffer));
@@ -2449,6 +2479,8 @@ extern "C" void CALLBACK SPUplayADPCMchannel(xa_decode_t *xap) {
     if (!xap) return;
     if (!xap->freq) return; // no xa freq ? bye
 
+    if (bSpuLog) SPULogXA(xap);
+
     FeedXA(xap); // call main XA feeder
 }
 
@@ -2460,6 +2492,8 @@ extern "C" void CALLBACK SPUplayCDDAchannel(short *pcm, int nbytes) {
     if (!pcm) return;
     if (nbytes <= 0) return;
 
+    if (bSpuLog) SPULogCDDA((unsigned char *) pcm, nbytes);
+
     FeedCDDA((unsigned char *) pcm, nbytes);
 }
 
@@ -2478,9 +2512,15 @@ void RemoveTimer(void);
 void SetupTimer(void) {
     memset(SSumR, 0, NSSIZE * sizeof (int)); // init some mixing buffers
     memset(SSumL, 0, NSSIZE * sizeof (int));
-    memset(iFMod, 0, NSSIZE * sizeof (int));
+    InitVoiceMix();
+
+    out_gauss_ptr = 0; // output interpolation history
+    memset(out_gauss_window, 0, sizeof (out_gauss_window));
+    memset(pete_simple_l, 0, sizeof (pete_simple_l));
+    memset(pete_simple_r, 0, sizeof (pete_simple_r));
 
     pS = (short *) pSpuBuffer; // setup soundbuffer pointer
+    iCycle = 0;
 
     bEndThread = 0; // init thread vars
     bThreadEnded = 0;
@@ -2499,6 +2539,7 @@ void SetupTimer(void) {
     {
         //pthread_create(&thread, NULL, MAINThread, NULL);
         atexit(RemoveTimer);
+        StartMixThreads();
         xenon_run_thread_task(2, &thread_stack[sizeof (thread_stack) - 0x100], (void*)MAINThread);
     }
 #else
@@ -2545,6 +2586,7 @@ void RemoveTimer(void) {
             usleep(1000L);
             i++;
         } // -> wait until thread has ended
+        StopMixThreads();
         //xenon_sleep_thread(2);
         printf("RemoveTimer\r\n");
     }
@@ -2654,6 +2696,7 @@ extern "C" long CALLBACK SPUinit(void) {
     memset((void *) s_chan, 0, MAXCHAN * sizeof (SPUCHAN));
     memset((void *) &rvb, 0, sizeof (REVERBInfo));
     InitADSR();
+    ResetADPCMCache();
 
 
 
@@ -2738,6 +2781,9 @@ extern "C" long SPUopen(void)
         UpdateWindow(hWRecord);
         SetFocus(hWMain);
     }
+#else
+    if (iRecordMode) RecordStart(SPU_CAPTURE_DIR "spu.wav"); // capture of the output ...
+    if (iSpuLog) SPULogStart(SPU_CAPTURE_DIR "spu.log"); // ... and of what the emu feeds us
 #endif
 
     return PSE_SPU_ERR_SUCCESS;
@@ -2772,6 +2818,11 @@ extern "C" long CALLBACK SPUclose(void) {
     RemoveSound(); // no more sound handling
     RemoveStreams(); // no more streaming
 
+#ifndef _WINDOWS
+    SPULogStop();
+    RecordStop();
+#endif
+
     return 0;
 }
 
@@ -2853,3 +2904,7 @@ extern "C" void CALLBACK SPUsetframelimit(int option) {
     printf("SPUsetframelimit\r\n");
     framelimiter = option;
 }
+
+////////////////////////////////////////////////////////////////////////
+
+#include "a_spulog.cpp"
@@ -0,0 +1,457 @@
+/***************************************************************************
+spulog.c  -  description
+-------------------
+***************************************************************************/
+
+/***************************************************************************
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License as published by  *
+*   the Free Software Foundation; either version 2 of the License, or     *
+*   (at your option) any later version. See also the license.txt file for *
+*   additional informations.                                              *
+*                                                                         *
+***************************************************************************/
+
+#include "stdafx.h"
+
+#define _IN_SPULOG
+
+// will be included from spu.c
+#ifdef _IN_SPU
+
+#ifdef LIBXENON
+#include <ppc/timebase.h>
+#else
+#include <sys/time.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// spu input log and offline render
+////////////////////////////////////////////////////////////////////////
+
+/*
+With iSpuLog set ("SPU Log" in the spu options, read at SPUinit),
+everything the main emu feeds the spu gets logged to spu.log: register
+writes, dma, xa and cdda data, and a marker after each mixed block. The
+log starts with a snapshot of spu ram and the registers.
+
+SPUrenderLog replays such a log without the emu: the events between two
+markers, then one block mixed, as fast as it goes. The output goes into
+a wav, the time of each block is summed up by the number of voices that
+were playing, so mixer changes can be compared by ear (or bit by bit, the
+replay is deterministic) and by speed.
+
+The log is little endian:
+
+"SPULOG1\n"
+'M' spu ram (0x80000 bytes, as in spu ram), 256 registers 0x1f801c00+
+'R' reg (4), val (2)
+'W' addr (4), count (4), count halfwords as in spu ram
+'w' addr (4), 1 halfword as in spu ram
+'D' addr (4), count (4)
+'d'
+'X' freq, nbits, stereo, nsamples (4 each), nsamples (* 2 stereo) pcm (2)
+'C' bytes (4), cdda data
+'B' block mixed
+
+A savestate loaded while logging only gets a new 'M', the voice state of
+the savestate is not in the log.
+*/
+
+#define SPULOG_MAGIC "SPULOG1\n"
+
+#define LOG_RAM     'M'
+#define LOG_REG     'R'
+#define LOG_DMAW    'W'
+#define LOG_DMAW1   'w'
+#define LOG_DMAR    'D'
+#define LOG_DMAR1   'd'
+#define LOG_XA      'X'
+#define LOG_CDDA    'C'
+#define LOG_BLOCK   'B'
+
+// a_dma.cpp
+extern "C" unsigned short CALLBACK SPUreadDMA(void);
+extern "C" void CALLBACK SPUreadDMAMem(unsigned short * pusPSXMem, int iSize);
+extern "C" void CALLBACK SPUwriteDMA(unsigned short val);
+extern "C" void CALLBACK SPUwriteDMAMem(unsigned short * pusPSXMem, int iSize);
+
+int bSpuLog = 0;
+
+static FILE * fpSpuLog = NULL;
+
+// register writes come from the emu thread, blocks from the spu thread
+static volatile int iSpuLogLock = 0;
+
+#define LogLock()   while (__sync_lock_test_and_set(&iSpuLogLock, 1))
+#define LogUnlock() __sync_lock_release(&iSpuLogLock)
+
+////////////////////////////////////////////////////////////////////////
+
+static void LogPut8(int v) {
+    fputc(v, fpSpuLog);
+}
+
+static void LogPut16(unsigned short v) {
+    unsigned char b[2];
+
+    b[0] = v;
+    b[1] = v >> 8;
+    fwrite(b, 1, 2, fpSpuLog);
+}
+
+static void LogPut32(unsigned long v) {
+    unsigned char b[4];
+
+    b[0] = v;
+    b[1] = v >> 8;
+    b[2] = v >> 16;
+    b[3] = v >> 24;
+    fwrite(b, 1, 4, fpSpuLog);
+}
+
+static int LogGet16(FILE * fp, unsigned short * v) {
+    unsigned char b[2];
+
+    if (fread(b, 1, 2, fp) != 2) return 0;
+
+    *v = b[0] | (b[1] << 8);
+    return 1;
+}
+
+static int LogGet32(FILE * fp, unsigned long * v) {
+    unsigned char b[4];
+
+    if (fread(b, 1, 4, fp) != 4) return 0;
+
+    *v = b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned long) b[3] << 24);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// logging
+////////////////////////////////////////////////////////////////////////
+
+void SPULogStart(const char * pName) {
+    SPULogStop();
+
+    fpSpuLog = fopen(pName, "wb");
+    if (!fpSpuLog) {
+        printf("spu: can't log to %s\n", pName);
+        return;
+    }
+
+    fwrite(SPULOG_MAGIC, 1, 8, fpSpuLog);
+
+    bSpuLog = 1;
+    SPULogSnapshot();
+}
+
+void SPULogStop(void) {
+    bSpuLog = 0;
+
+    LogLock();
+    if (fpSpuLog) fclose(fpSpuLog);
+    fpSpuLog = NULL;
+    LogUnlock();
+}
+
+void SPULogSnapshot(void) {
+    int i;
+
+    LogLock();
+    if (fpSpuLog) {
+        LogPut8(LOG_RAM);
+        fwrite(spuMemC, 1, 0x80000, fpSpuLog);
+
+        for (i = 0; i < 256; i++)
+            LogPut16(regArea[i]);
+    }
+    LogUnlock();
+}
+
+void SPULogRegister(unsigned long reg, unsigned short val) {
+    LogLock();
+    if (fpSpuLog) {
+        LogPut8(LOG_REG);
+        LogPut32(reg);
+        LogPut16(val);
+    }
+    LogUnlock();
+}
+
+void SPULogDMAWrite(unsigned long addr, int iCount) {
+    LogLock();
+    if (fpSpuLog) {
+        LogPut8(LOG_DMAW);
+        LogPut32(addr);
+        LogPut32(iCount);
+        fwrite(spuMemC + addr, 1, iCount * 2, fpSpuLog);
+    }
+    LogUnlock();
+}
+
+void SPULogDMAWrite1(unsigned long addr) {
+    LogLock();
+    if (fpSpuLog) {
+        LogPut8(LOG_DMAW1);
+        LogPut32(addr);
+        fwrite(spuMemC + addr, 1, 2, fpSpuLog);
+    }
+    LogUnlock();
+}
+
+void SPULogDMARead(unsigned long addr, int iCount) {
+    LogLock();
+    if (fpSpuLog) {
+        LogPut8(LOG_DMAR);
+        LogPut32(addr);
+        LogPut32(iCount);
+    }
+    LogUnlock();
+}
+
+void SPULogDMARead1(void) {
+    LogLock();
+    if (fpSpuLog) LogPut8(LOG_DMAR1);
+    LogUnlock();
+}
+
+void SPULogXA(xa_decode_t * xap) {
+    int i, n = xap->nsamples * (xap->stereo ? 2 : 1);
+
+    if (n < 0) n = 0;
+    if (n > 16384) n = 16384;
+
+    LogLock();
+    if (fpSpuLog) {
+        LogPut8(LOG_XA);
+        LogPut32(xap->freq);
+        LogPut32(xap->nbits);
+        LogPut32(xap->stereo);
+        LogPut32(xap->nsamples);
+
+        for (i = 0; i < n; i++)
+            LogPut16(xap->pcm[i]);
+    }
+    LogUnlock();
+}
+
+void SPULogCDDA(unsigned char * pcm, int nBytes) {
+    LogLock();
+    if (fpSpuLog) {
+        LogPut8(LOG_CDDA);
+        LogPut32(nBytes);
+        fwrite(pcm, 1, nBytes, fpSpuLog);
+    }
+    LogUnlock();
+}
+
+void SPULogBlock(void) {
+    LogLock();
+    if (fpSpuLog) LogPut8(LOG_BLOCK);
+    LogUnlock();
+}
+
+////////////////////////////////////////////////////////////////////////
+// offline render
+////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+    unsigned long blocks;
+    unsigned long samples;
+    unsigned long long us;
+} RENDERSTAT;
+
+static unsigned long long RenderTime(void) {
+#ifdef LIBXENON
+    return mftb() / (PPC_TIMEBASE_FREQ / 1000000);
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+// registers of a snapshot, without the ones that start something
+static void RenderRegisters(FILE * fp) {
+    unsigned short val;
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        const unsigned long r = 0xc00 + i * 2;
+
+        if (!LogGet16(fp, &val)) return;
+
+        if ((r >= H_SPUon1 && r <= H_SPUoff2) || r == H_SPUdata) {
+            regArea[i] = val;
+            continue;
+        }
+
+        SPUwriteRegister(0x1f801000 + r, val);
+    }
+}
+
+static void RenderBlock(RENDERSTAT * stat) {
+    unsigned long long t;
+    int ch, voices = 0;
+
+    for (ch = 0; ch < MAXCHAN; ch++)
+        if (s_chan[ch].bOn || s_chan[ch].bNew) voices++;
+
+    t = RenderTime();
+    MAINThread(0);
+    t = RenderTime() - t;
+
+    stat[voices].blocks++;
+    stat[voices].samples += APU_run;
+    stat[voices].us += t;
+}
+
+extern "C" long SPUrenderLog(const char * pLog, const char * pWav) {
+    static unsigned char ucBuf[0x80000];
+    static xa_decode_t xa;
+    RENDERSTAT stat[MAXCHAN + 1];
+    unsigned long a, n, hdr[4], samples = 0;
+    unsigned long long us = 0;
+    unsigned short val;
+    int type, i, ok = 1;
+    FILE * fp;
+
+    fp = fopen(pLog, "rb");
+    if (!fp) return -1;
+
+    if (fread(ucBuf, 1, 8, fp) != 8 || memcmp(ucBuf, SPULOG_MAGIC, 8)) {
+        fclose(fp);
+        return -1;
+    }
+
+    memset(stat, 0, sizeof (stat));
+
+    SPUinit();
+
+    iUseTimer = 4; // we call the mixer ourselves, one block each
+    iSPUIRQWait = 0; // ... and nobody waits for irqs
+    framelimiter = 0;
+    iRecordMode = 0;
+    iSpuLog = 0;
+
+    SPUopen();
+
+    bSpuRender = 1;
+    RecordStart(pWav);
+    iRecordMode = 1;
+
+    while (ok && (type = fgetc(fp)) != EOF) {
+        switch (type) {
+            case LOG_RAM:
+                ok = fread(spuMemC, 1, 0x80000, fp) == 0x80000;
+                ResetADPCMCache();
+                RenderRegisters(fp);
+                break;
+
+            case LOG_REG:
+                ok = LogGet32(fp, &a) && LogGet16(fp, &val);
+                if (ok) SPUwriteRegister(a, val);
+                break;
+
+            case LOG_DMAW:
+                ok = LogGet32(fp, &a) && LogGet32(fp, &n) && n <= 0x40000 &&
+                        fread(ucBuf, 1, n * 2, fp) == n * 2;
+                if (ok) {
+                    spuAddr = a;
+                    SPUwriteDMAMem((unsigned short *) ucBuf, n);
+                }
+                break;
+
+            case LOG_DMAW1:
+                ok = LogGet32(fp, &a) && fread(&val, 1, 2, fp) == 2;
+                if (ok) {
+                    spuAddr = a;
+                    SPUwriteDMA(val);
+                }
+                break;
+
+            case LOG_DMAR:
+                ok = LogGet32(fp, &a) && LogGet32(fp, &n) && n <= 0x40000;
+                if (ok) {
+                    spuAddr = a;
+                    SPUreadDMAMem((unsigned short *) ucBuf, n);
+                }
+                break;
+
+            case LOG_DMAR1:
+                SPUreadDMA();
+                break;
+
+            case LOG_XA:
+                for (i = 0; ok && i < 4; i++)
+                    ok = LogGet32(fp, &hdr[i]);
+                if (!ok) break;
+
+                xa.freq = hdr[0];
+                xa.nbits = hdr[1];
+                xa.stereo = hdr[2];
+                xa.nsamples = hdr[3];
+                n = xa.nsamples * (xa.stereo ? 2 : 1);
+                if (n > 16384) n = 16384;
+
+                for (i = 0; ok && i < (int) n; i++) {
+                    ok = LogGet16(fp, &val);
+                    xa.pcm[i] = val;
+                }
+
+                if (ok) SPUplayADPCMchannel(&xa);
+                break;
+
+            case LOG_CDDA:
+                ok = LogGet32(fp, &n) && n <= sizeof (ucBuf) &&
+                        fread(ucBuf, 1, n, fp) == n;
+                if (ok) SPUplayCDDAchannel((short *) ucBuf, n);
+                break;
+
+            case LOG_BLOCK:
+                RenderBlock(stat);
+                break;
+
+            default:
+                printf("spu render: bad log entry %02x\n", type);
+                ok = 0;
+                break;
+        }
+    }
+
+    fclose(fp);
+
+    // the last samples, short of an upload
+    RecordBuffer((unsigned char *) pSpuBuffer, ((unsigned char *) pS)-((unsigned char *) pSpuBuffer));
+    pS = (short *) pSpuBuffer;
+    iCycle = 0;
+
+    iRecordMode = 0;
+    RecordStop();
+    bSpuRender = 0;
+
+    SPUclose();
+
+    printf("spu render: %s -> %s\n", pLog, pWav);
+
+    for (i = 0; i <= MAXCHAN; i++) {
+        if (!stat[i].blocks) continue;
+
+        samples += stat[i].samples;
+        us += stat[i].us;
+
+        printf("%2d voices: %8lu samples, %10.0f samples/s\n", i, stat[i].samples,
+                stat[i].us ? stat[i].samples * 1000000.0 / stat[i].us : 0.0);
+    }
+
+    printf("     total: %8lu samples, %10.0f samples/s\n", samples,
+            us ? samples * 1000000.0 / us : 0.0);
+
+    return ok ? 0 : -1;
+}
+
+#endif
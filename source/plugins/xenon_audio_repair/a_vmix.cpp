@@ -0,0 +1,274 @@
+/***************************************************************************
+vmix.c  -  description
+-------------------
+***************************************************************************/
+
+/***************************************************************************
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License as published by  *
+*   the Free Software Foundation; either version 2 of the License, or     *
+*   (at your option) any later version. See also the license.txt file for *
+*   additional informations.                                              *
+*                                                                         *
+***************************************************************************/
+
+#include "stdafx.h"
+
+#define _IN_VMIX
+
+// will be included from spu.c
+#ifdef _IN_SPU
+
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// vector voice mixing
+////////////////////////////////////////////////////////////////////////
+
+/*
+MixChannel walks a voice through the block sample by sample: decoding,
+pitch stepping, envelope. For each sample it only gathers what the output
+needs:
+
+- gauss interpolation: the 4 taps and their 4 gauss factors
+- anything else (noise, other interpolations, silence): the final sample
+  in iChanBase
+- the envelope value
+
+The sums, the clamp and the envelope multiply are then done for 8 samples
+at a time, and so is the volume mix into SSumL/SSumR. The results are the
+same as the old per sample code: every product is shifted on its own and
+the divisions round toward zero, like the C ones.
+
+The scratch buffers of a voice live in a VOICEMIX, one for each mix thread
+(see a_vthread.cpp), the spu thread itself uses voiceMix[0].
+
+The plain C kernels are always built: they are the reference of the vector
+ones. With bScalarMix set the vector builds use them too, so spurender -c
+(tools/spurender) can mix a spu.log both ways and compare the outputs.
+*/
+
+#define NSSIZE_V ((NSSIZE + 7) & ~7)
+
+// taps of 4 samples: t0/t1 of each sample interleaved, then t2/t3
+#define GTAP(n, t) (((n) & ~3) * 4 + ((t) & 2) * 4 + ((n) & 3) * 2 + ((t) & 1))
+
+#define CHAN_SKIP  0 // channel off: no output, fmod, reverb
+#define CHAN_MUTED 1 // playing, but not audible
+#define CHAN_PLAY  2
+
+#define MAXVOICEIRQ 64 // irq hits a mix thread can note in one block
+
+int bScalarMix = 0; // mix with the plain C kernels only
+
+typedef struct {
+    int ns, ch;
+    int addr;
+} VOICEIRQ;
+
+typedef struct {
+    // all sizes are multiples of 16 bytes: every array stays aligned
+    short sGaussTap[NSSIZE_V * 4] __attribute__((aligned(16)));
+    short sGaussFactor[NSSIZE_V * 4];
+    int iChanBase[NSSIZE_V];
+    short sChanEnv[NSSIZE_V];
+    short sChanFa[NSSIZE_V]; // interpolated sample
+    int iChanSval[NSSIZE_V]; // ... with the envelope
+    int iChanOut[NSSIZE_V]; // output of the channel being rendered
+    int iSumL[NSSIZE_V]; // voice sums of a mix thread, added to SSumL/R
+    int iSumR[NSSIZE_V];
+    int iFMod[NSSIZE_V]; // fmod data for the next channel
+    unsigned char ucChanFlags[NSSIZE_V]; // CHAN_SKIP/CHAN_MUTED/CHAN_PLAY
+
+    int * pSumL, * pSumR; // where the voices get summed up
+    int iLane; // adpcm cache lane
+
+    // block split up over the mix threads: new channel bits, reverb
+    // input and irq hits are kept for the merge instead
+    int bDefer;
+    unsigned long dwNewDone;
+    int iIrqCount;
+    VOICEIRQ irq[MAXVOICEIRQ];
+} VOICEMIX;
+
+// reverb input of the voices in a split block (bDefer)
+static int iRvbSval[MAXCHAN][NSSIZE];
+static unsigned char ucRvbStore[MAXCHAN][NSSIZE];
+
+INLINE void ClearVoiceSample(VOICEMIX * m, int ns) {
+    m->sGaussTap[GTAP(ns, 0)] = 0;
+    m->sGaussTap[GTAP(ns, 1)] = 0;
+    m->sGaussTap[GTAP(ns, 2)] = 0;
+    m->sGaussTap[GTAP(ns, 3)] = 0;
+    m->iChanBase[ns] = 0;
+    m->sChanEnv[ns] = 0;
+}
+
+// gauss interpolation, see iGetInterpolationVal
+INLINE void StoreGaussTaps(VOICEMIX * m, SPUCHAN * pChannel, int ns) {
+    int gpos = pChannel->SB[28];
+    int vl = ((pChannel->spos & 0xffff) >> 6) & ~3;
+
+    m->sGaussTap[GTAP(ns, 0)] = gval0;
+    m->sGaussTap[GTAP(ns, 1)] = gval(1);
+    m->sGaussTap[GTAP(ns, 2)] = gval(2);
+    m->sGaussTap[GTAP(ns, 3)] = gval(3);
+    m->sGaussFactor[GTAP(ns, 0)] = gauss[vl];
+    m->sGaussFactor[GTAP(ns, 1)] = gauss[vl + 1];
+    m->sGaussFactor[GTAP(ns, 2)] = gauss[vl + 2];
+    m->sGaussFactor[GTAP(ns, 3)] = gauss[vl + 3];
+}
+
+////////////////////////////////////////////////////////////////////////
+// samples first ... last-1: sChanFa = CLAMP16(gauss sum + base),
+// iChanSval = env * fa / 0x8000
+////////////////////////////////////////////////////////////////////////
+
+INLINE void MixVoiceSamplesC(VOICEMIX * m, int first, int last) {
+    int n;
+
+    for (n = first; n < last; n++) {
+        const short * t = &m->sGaussTap[GTAP(n, 0)];
+        const short * f = &m->sGaussFactor[GTAP(n, 0)];
+        int fa;
+
+        fa = (t[0] * f[0]) >> 15;
+        fa += (t[1] * f[1]) >> 15;
+        fa += (t[8] * f[8]) >> 15;
+        fa += (t[9] * f[9]) >> 15;
+        fa = CLAMP16(fa + m->iChanBase[n]);
+
+        m->sChanFa[n] = fa;
+        m->iChanSval[n] = (m->sChanEnv[n] * fa) / 0x8000;
+    }
+}
+
+#ifdef __ALTIVEC__
+
+INLINE vector signed int GaussSum(vector signed short t, vector signed short f) {
+    const vector unsigned int v15 = vec_splat_u32(15);
+
+    return vec_add(vec_sra(vec_mule(t, f), v15), vec_sra(vec_mulo(t, f), v15));
+}
+
+// x / (1 << shift), rounding toward zero
+INLINE vector signed int DivPow2(vector signed int x, vector unsigned int shift, vector signed int bias) {
+    const vector unsigned int v31 = (vector unsigned int) vec_splat_s32(-1);
+
+    return vec_sra(vec_add(x, vec_and(vec_sra(x, v31), bias)), shift);
+}
+
+INLINE void MixVoiceSamples(VOICEMIX * m, int first, int last) {
+    const vector unsigned int v15 = vec_splat_u32(15);
+    const vector signed int bias = (vector signed int) {0x7fff, 0x7fff, 0x7fff, 0x7fff};
+    int n;
+
+    if (bScalarMix) {
+        MixVoiceSamplesC(m, first, last);
+        return;
+    }
+
+    for (n = first & ~7; n < last; n += 8) {
+        const short * t = &m->sGaussTap[n * 4];
+        const short * f = &m->sGaussFactor[n * 4];
+        vector signed int s0, s1, pe, po;
+        vector signed short fa, env;
+
+        s0 = vec_add(GaussSum(vec_ld(0, t), vec_ld(0, f)), GaussSum(vec_ld(16, t), vec_ld(16, f)));
+        s1 = vec_add(GaussSum(vec_ld(32, t), vec_ld(32, f)), GaussSum(vec_ld(48, t), vec_ld(48, f)));
+        s0 = vec_add(s0, vec_ld(0, &m->iChanBase[n]));
+        s1 = vec_add(s1, vec_ld(16, &m->iChanBase[n]));
+
+        fa = vec_packs(s0, s1); // CLAMP16
+        vec_st(fa, 0, &m->sChanFa[n]);
+
+        env = vec_ld(0, &m->sChanEnv[n]);
+        pe = DivPow2(vec_mule(env, fa), v15, bias);
+        po = DivPow2(vec_mulo(env, fa), v15, bias);
+        vec_st(vec_mergeh(pe, po), 0, &m->iChanSval[n]);
+        vec_st(vec_mergel(pe, po), 16, &m->iChanSval[n]);
+    }
+}
+
+#else
+
+INLINE void MixVoiceSamples(VOICEMIX * m, int first, int last) {
+    MixVoiceSamplesC(m, first, last);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// sums += iChanOut * volume / 0x4000 for samples first ... last-1
+////////////////////////////////////////////////////////////////////////
+
+INLINE void MixVoiceVolume(VOICEMIX * m, int first, int last, int lv, int rv) {
+    const int * out = m->iChanOut;
+    int * sumL = m->pSumL;
+    int * sumR = m->pSumR;
+    int n = first;
+
+#ifdef __ALTIVEC__
+    const vector unsigned int v14 = vec_splat_u32(14);
+    const vector signed int bias = (vector signed int) {0x3fff, 0x3fff, 0x3fff, 0x3fff};
+    vector signed short vl, vr;
+    short vol[8] __attribute__((aligned(16)));
+
+    vol[0] = lv;
+    vol[1] = rv;
+    vl = vec_splat(vec_ld(0, vol), 0);
+    vr = vec_splat(vec_ld(0, vol), 1);
+
+    // up to the first aligned sample
+    for (; n < last && (n & 7); n++) {
+        sumL[n] += (out[n] * lv) / 0x4000L;
+        sumR[n] += (out[n] * rv) / 0x4000L;
+    }
+
+    for (; !bScalarMix && n + 8 <= last; n += 8) {
+        vector signed short o = vec_packs(vec_ld(0, &out[n]), vec_ld(16, &out[n]));
+        vector signed int e, od;
+
+        e = DivPow2(vec_mule(o, vl), v14, bias);
+        od = DivPow2(vec_mulo(o, vl), v14, bias);
+        vec_st(vec_add(vec_ld(0, &sumL[n]), vec_mergeh(e, od)), 0, &sumL[n]);
+        vec_st(vec_add(vec_ld(16, &sumL[n]), vec_mergel(e, od)), 16, &sumL[n]);
+
+        e = DivPow2(vec_mule(o, vr), v14, bias);
+        od = DivPow2(vec_mulo(o, vr), v14, bias);
+        vec_st(vec_add(vec_ld(0, &sumR[n]), vec_mergeh(e, od)), 0, &sumR[n]);
+        vec_st(vec_add(vec_ld(16, &sumR[n]), vec_mergel(e, od)), 16, &sumR[n]);
+    }
+#endif
+
+    for (; n < last; n++) {
+        // assume 14-bit value + no sign
+        sumL[n] += (out[n] * lv) / 0x4000L;
+        sumR[n] += (out[n] * rv) / 0x4000L;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+// irq check of a voice: done right away, or noted for the merge when
+// the block is split up (the spu thread replays them in sample order)
+////////////////////////////////////////////////////////////////////////
+
+INLINE int VoiceCheckIRQ(VOICEMIX * m, int addr, int ch, int ns) {
+    if (!m->bDefer) return Check_IRQ(addr, 0);
+
+    if ((spuCtrl & CTRL_IRQ) && bIrqHit == 0 &&
+            pSpuIrq == spuMemC + addr && m->iIrqCount < MAXVOICEIRQ) {
+        VOICEIRQ * e = &m->irq[m->iIrqCount++];
+
+        e->ns = ns;
+        e->ch = ch;
+        e->addr = addr;
+    }
+
+    return 0;
+}
+
+#endif
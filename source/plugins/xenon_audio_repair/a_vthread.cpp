@@ -0,0 +1,332 @@
+/***************************************************************************
+vthread.c  -  description
+-------------------
+***************************************************************************/
+
+/***************************************************************************
+*                                                                         *
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License as published by  *
+*   the Free Software Foundation; either version 2 of the License, or     *
+*   (at your option) any later version. See also the license.txt file for *
+*   additional informations.                                              *
+*                                                                         *
+***************************************************************************/
+
+#include "stdafx.h"
+
+#define _IN_VTHREAD
+
+// will be included from spu.c
+#ifdef _IN_SPU
+
+////////////////////////////////////////////////////////////////////////
+// voice mixing on more hw threads
+////////////////////////////////////////////////////////////////////////
+
+/*
+With iSpuThreads 2 or 3 the 24 voices of a block get split up into
+ranges, one for each mix thread: the spu thread mixes the first range
+itself, the others run on free hw threads. A range never starts on an
+fmod channel, it stays with the channel before it.
+
+The output has to be the same as with one thread, so everything that
+depends on the channel order waits for the merge on the spu thread:
+
+- each mix thread sums its voices up on its own, the sums get added to
+  SSumL/SSumR (no clamping there, the order doesn't matter)
+- reverb input gets stored in channel order, it clamps on every add
+- spu irq hits are only noted, then checked in sample order
+- new channel bits get cleared
+
+An irq the main emu has to wait for stops the block at that sample, which
+only works with the voices mixed one after the other. So while such an
+irq can hit (iSPUIRQWait), blocks get mixed by the spu thread alone.
+
+Only in thread mode on the xenon, everything else uses one thread.
+
+The hw threads all have an owner: 0 emu, 1 xa decode (cdrom.c), 2 spu,
+3 sound output, 4 gpu, 5 image read ahead (cdriso.c, cdrcimg). The xa and
+image workers start with the cdrom, before the spu gets opened, so a mix
+thread only gets 1 or 5 if that worker doesn't run for this game (xa
+turned off, a cdr plugin without one). Fewer mix threads than iSpuThreads
+get logged.
+*/
+
+#ifdef LIBXENON
+#define lwsync()      __asm__ __volatile__("lwsync" : : : "memory")
+#define prio_low()    __asm__ __volatile__("or 1,1,1")   // while spinning: leave the core
+#define prio_medium() __asm__ __volatile__("or 2,2,2")   // ... to the other hw thread
+#else
+#define lwsync()
+#define prio_low()
+#define prio_medium()
+#endif
+
+static int iMixThreads = 1; // running mix threads, with the spu thread
+static int iMixFirst[MAXMIXTHREADS + 1]; // voices of mix thread k: iMixFirst[k] ... iMixFirst[k+1]-1
+
+static volatile unsigned long dwMixJob = 0; // blocks handed out
+static volatile unsigned long dwMixDone[MAXMIXTHREADS]; // ... and mixed by each thread
+static volatile int bMixEnd = 0;
+static volatile int bMixEnded[MAXMIXTHREADS];
+
+#ifdef LIBXENON
+static const int iMixHwThread[MAXMIXTHREADS] = {2, 5, 1}; // [0]: spu thread, then the ones to try
+static unsigned char mix_stack[MAXMIXTHREADS][0x10000];
+#endif
+
+////////////////////////////////////////////////////////////////////////
+
+INLINE void InitVoiceMix(void) {
+    int k;
+
+    for (k = 0; k < MAXMIXTHREADS; k++) {
+        VOICEMIX * m = &voiceMix[k];
+
+        memset(m->iFMod, 0, sizeof (m->iFMod));
+
+        // the spu thread sums up right into the output
+        m->pSumL = k ? m->iSumL : SSumL;
+        m->pSumR = k ? m->iSumR : SSumR;
+        m->iLane = k;
+        m->bDefer = 0;
+    }
+}
+
+INLINE void MixVoiceRange(VOICEMIX * m, int first, int last) {
+    int ch, bIRQWait = 0;
+
+    for (ch = first; ch < last; ch++)
+        MixChannel(m, &s_chan[ch], ch, 0, APU_run, &bIRQWait);
+}
+
+////////////////////////////////////////////////////////////////////////
+// about the same number of playing voices for each thread
+////////////////////////////////////////////////////////////////////////
+
+INLINE void SplitVoices(void) {
+    int ch, k, active = 0, n = 0;
+
+    for (ch = 0; ch < MAXCHAN; ch++)
+        if (s_chan[ch].bOn || s_chan[ch].bNew) active++;
+
+    iMixFirst[0] = 0;
+
+    for (k = 1, ch = 0; k < iMixThreads; k++) {
+        const int want = (active * k) / iMixThreads;
+
+        while (ch < MAXCHAN && n < want) {
+            if (s_chan[ch].bOn || s_chan[ch].bNew) n++;
+            ch++;
+        }
+
+        // fmod reads the channel before
+        while (ch < MAXCHAN && s_chan[ch].bFMod == 1) ch++;
+
+        iMixFirst[k] = ch;
+    }
+
+    iMixFirst[iMixThreads] = MAXCHAN;
+}
+
+////////////////////////////////////////////////////////////////////////
+// mix thread k: waits for a block, mixes its voices
+////////////////////////////////////////////////////////////////////////
+
+static void MixThread(int k) {
+    unsigned long dwBlock = dwMixDone[k];
+
+    while (!bMixEnd) {
+        if (dwMixJob == dwBlock) {
+            prio_low();
+            continue;
+        }
+
+        prio_medium();
+
+        dwBlock = dwMixJob;
+        lwsync(); // block set up before we read it
+
+        MixVoiceRange(&voiceMix[k], iMixFirst[k], iMixFirst[k + 1]);
+
+        lwsync(); // our output written before the spu thread sees it
+        dwMixDone[k] = dwBlock;
+    }
+
+    prio_medium();
+    bMixEnded[k] = 1;
+}
+
+static void MixThread1(void) {
+    MixThread(1);
+}
+
+static void MixThread2(void) {
+    MixThread(2);
+}
+
+////////////////////////////////////////////////////////////////////////
+// merge of a split block, in channel order
+////////////////////////////////////////////////////////////////////////
+
+INLINE void MergeVoices(void) {
+    VOICEIRQ * hit[MAXMIXTHREADS * MAXVOICEIRQ];
+    unsigned long dwNewDone = 0;
+    int k, ch, ns, i, n = 0;
+
+    for (k = 0; k < iMixThreads; k++) {
+        VOICEMIX * m = &voiceMix[k];
+
+        if (k) {
+            for (ns = 0; ns < APU_run; ns++) {
+                SSumL[ns] += m->iSumL[ns];
+                SSumR[ns] += m->iSumR[ns];
+            }
+        }
+
+        dwNewDone |= m->dwNewDone;
+
+        // sort the irq hits by sample, then channel
+        for (i = 0; i < m->iIrqCount; i++) {
+            VOICEIRQ * e = &m->irq[i];
+            int j = n++;
+
+            while (j > 0 && (hit[j - 1]->ns > e->ns ||
+                    (hit[j - 1]->ns == e->ns && hit[j - 1]->ch > e->ch))) {
+                hit[j] = hit[j - 1];
+                j--;
+            }
+            hit[j] = e;
+        }
+    }
+
+    dwNewChannel &= ~dwNewDone; // clear new channel bits
+
+    for (ch = 0; ch < MAXCHAN; ch++) {
+        SPUCHAN * pChannel = &s_chan[ch];
+        const int sval = pChannel->sval;
+
+        for (ns = 0; ns < APU_run; ns++) {
+            if (!ucRvbStore[ch][ns]) continue;
+
+            pChannel->sval = iRvbSval[ch][ns];
+            StoreREVERB(pChannel, ns);
+        }
+
+        pChannel->sval = sval;
+    }
+
+    // one-time: the first one that still hits
+    for (i = 0; i < n; i++) {
+        if (Check_IRQ(hit[i]->addr, 0)) {
+#ifdef SPU_LOG
+            fprintf(fp_spu_log, "%d = IRQ %X\n", hit[i]->ch + 1, pSpuIrq - spuMemC);
+#endif
+
+            s_chan[hit[i]->ch].iIrqDone = 1; // -> debug flag
+            break;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+// mix the whole block split up over the mix threads, returns 0 if it
+// has to be mixed by the spu thread alone
+////////////////////////////////////////////////////////////////////////
+
+static int MixVoicesSplit(void) {
+    unsigned long dwBlock;
+    int k, ch;
+
+    if (iMixThreads < 2) return 0;
+
+    // rest of a block after an irq wait
+    for (ch = 0; ch < MAXCHAN; ch++)
+        if (iChanPos[ch]) return 0;
+
+    // irq the main emu would wait for
+    if (iSPUIRQWait && (spuCtrl & CTRL_IRQ) && bIrqHit == 0) return 0;
+
+    SplitVoices();
+
+    for (k = 0; k < iMixThreads; k++) {
+        VOICEMIX * m = &voiceMix[k];
+
+        m->bDefer = 1;
+        m->dwNewDone = 0;
+        m->iIrqCount = 0;
+
+        if (k) {
+            memset(m->iSumL, 0, APU_run * sizeof (int));
+            memset(m->iSumR, 0, APU_run * sizeof (int));
+        }
+    }
+
+    dwBlock = dwMixJob + 1;
+    lwsync(); // block set up before the mix threads see it
+    dwMixJob = dwBlock;
+
+    MixVoiceRange(&voiceMix[0], iMixFirst[0], iMixFirst[1]);
+
+    for (k = 1; k < iMixThreads; k++)
+        while (dwMixDone[k] != dwBlock) prio_low();
+
+    prio_medium();
+    lwsync(); // their output read after the done flags
+
+    MergeVoices();
+
+    voiceMix[0].bDefer = 0;
+
+    for (ch = 0; ch < MAXCHAN; ch++)
+        iChanPos[ch] = APU_run;
+
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// start/stop the mix threads (with the spu thread)
+////////////////////////////////////////////////////////////////////////
+
+static void StartMixThreads(void) {
+#ifdef LIBXENON
+    int i, k = 1, n = iSpuThreads;
+
+    if (n < 1) n = 1;
+    if (n > MAXMIXTHREADS) n = MAXMIXTHREADS;
+
+    bMixEnd = 0;
+
+    for (i = 1; i < MAXMIXTHREADS && k < n; i++) {
+        // the xa or image worker has it
+        if (xenon_is_thread_task_running(iMixHwThread[i])) continue;
+
+        dwMixDone[k] = dwMixJob;
+        bMixEnded[k] = 0;
+        xenon_run_thread_task(iMixHwThread[i], &mix_stack[k][sizeof (mix_stack[k]) - 0x100],
+                (void*) (k == 1 ? MixThread1 : MixThread2));
+        k++;
+    }
+
+    iMixThreads = k;
+
+    if (k < n)
+        printf("SPU: %d of %d mix threads, the other hw threads are taken\r\n", k, n);
+#endif
+}
+
+static void StopMixThreads(void) {
+    int k, i;
+
+    bMixEnd = 1;
+
+    for (k = 1; k < iMixThreads; k++) {
+        for (i = 0; !bMixEnded[k] && i < 2000; i++)
+            usleep(1000L); // -> wait until thread has ended
+    }
+
+    iMixThreads = 1;
+}
+
+#endif
@@ -0,0 +1,23 @@
+/***************************************************************************
+                           adpcm.h  -  description
+                             -------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version. See also the license.txt file for *
+ *   additional informations.                                              *
+ *                                                                         *
+ ***************************************************************************/
+
+// decoded adpcm block cache (a_adpcm.cpp)
+
+// spu ram got written at addr (byte address)
+void InvalidateADPCM(unsigned long addr);
+// ... in the range addr - addr+size-1
+void InvalidateADPCMRange(unsigned long addr, unsigned long size);
+// whole spu ram changed
+void ResetADPCMCache(void);
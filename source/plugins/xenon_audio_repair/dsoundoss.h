@@ -33,6 +33,19 @@ int SoundGetSamplesBuffered(void);
 void SoundFeedStreamData(unsigned char* pSound,long lBytes);
 void ResetSound(void);
 void SoundRecordStreamData(unsigned char* pSound,long lBytes);
+int SoundGetLatencyBytes(void);
+
+// output ring stats (xr_xenonsnd.cpp)
+typedef struct {
+ unsigned long frames;                                 // played from the ring
+ unsigned long underruns;                              // ran dry
+ unsigned long overflows;                              // mixer output dropped, ring full
+ int           targetMs;                               // wanted ring fill
+ int           fillMs;                                 // ring fill at the last submit
+ int           adjust;                                 // resampling correction, 1/65536
+} xenonSoundStats_t;
+
+const xenonSoundStats_t * SoundGetStats(void);
 
 #ifndef _WINDOWS
 unsigned long timeGetTime();
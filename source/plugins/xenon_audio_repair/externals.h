@@ -128,6 +128,9 @@ extern int output_samplesize;
 // num of channels
 #define MAXCHAN     24
 
+// max threads the voices of a block get split up to (iSpuThreads)
+#define MAXMIXTHREADS 3
+
 
 ///////////////////////////////////////////////////////////
 // struct defines
@@ -324,6 +327,8 @@ extern int				iOutputInterp2;
 extern int				iVolCDDA;
 extern int				iVolXA;
 extern int				iVolVoices;
+extern int				iSpuThreads;
+extern int				iSpuLog;
 extern int				iVolMainL;
 extern int				iVolMainR;
 
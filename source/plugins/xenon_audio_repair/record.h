@@ -6,6 +6,11 @@ void RecordStart();
 void RecordBuffer(unsigned char* pSound,long lBytes);
 void RecordStop();
 BOOL CALLBACK RecordDlgProc(HWND hW, UINT uMsg, WPARAM wParam, LPARAM lParam);
+#else
+// wav capture of the mixed output (a_record.cpp)
+void RecordStart(const char * pName);
+void RecordBuffer(unsigned char* pSound,long lBytes);
+void RecordStop();
 #endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+/***************************************************************************
+                         resample.h  -  description
+                             -------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version. See also the license.txt file for *
+ *   additional informations.                                              *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <byteswap.h>
+
+// 44100 -> 48000 hz, input frames per output frame in 16.16 (44100 << 16
+// does not fit an int)
+#define RESAMPLE_STEP ((int) ((44100U << 16) / 48000))
+#define RESAMPLE_ADJ_MAX (RESAMPLE_STEP / 200)         // ratio corrections up to 0.5%
+
+/*
+ * Linear resampler of the sound output (xr_xenonsnd.cpp), on its own so
+ * tools/resample can measure it on the host.
+ *
+ * Input frames are words of a ring, left sample in the upper half. The
+ * state carries the last input frame and the position between it and the
+ * next one, in 1/65536, over to the next call.
+ */
+typedef struct {
+    short prev[2];
+    unsigned int phase;
+} RESAMPLER;
+
+static inline void ResampleReset(RESAMPLER * rs) {
+    rs->prev[0] = rs->prev[1] = 0;
+    rs->phase = 0;
+}
+
+/*
+ * resamples count frames of ring (mask + 1 frames) from first on, linear
+ * interpolation, stepping step (16.16) input frames per output frame.
+ * The output is written byte swapped, ready for xenon_sound_submit.
+ * Returns the number of output frames.
+ */
+static inline int ResampleLinear(RESAMPLER * rs, const unsigned int * ring, unsigned int mask,
+        unsigned int first, int count, unsigned int step, unsigned int * out) {
+    int prevL = rs->prev[0], prevR = rs->prev[1];
+    unsigned int phase = rs->phase;
+    unsigned int src = first, end = first + count;
+    int n = 0;
+
+    // prevL/R is the input frame before src, output while we are between them
+    while (src != end) {
+        unsigned int cur = ring[src & mask];
+        int w = phase >> 1;
+        int l = prevL + ((((short) (cur >> 16)) - prevL) * w >> 15);
+        int r = prevR + ((((short) cur) - prevR) * w >> 15);
+
+        out[n++] = bswap_32(((unsigned int) (unsigned short) l << 16) | (unsigned short) r);
+
+        phase += step;
+        while (phase >= 0x10000 && src != end) {
+            phase -= 0x10000;
+            cur = ring[src & mask];
+            prevL = (short) (cur >> 16);
+            prevR = (short) cur;
+            src++;
+        }
+    }
+
+    rs->prev[0] = prevL;
+    rs->prev[1] = prevR;
+    rs->phase = phase;
+
+    return n;
+}
+
+#endif
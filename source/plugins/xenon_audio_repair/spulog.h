@@ -0,0 +1,42 @@
+/***************************************************************************
+                          spulog.h  -  description
+                             -------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version. See also the license.txt file for *
+ *   additional informations.                                              *
+ *                                                                         *
+ ***************************************************************************/
+
+// spu input log and offline render (a_spulog.cpp)
+
+// where the captures go (spu.wav, spu.log)
+#ifdef LIBXENON
+#define SPU_CAPTURE_DIR "uda:/"
+#else
+#define SPU_CAPTURE_DIR ""
+#endif
+
+extern int bSpuLog; // log open: check before calling the SPULog funcs
+
+void SPULogStart(const char * pName);
+void SPULogStop(void);
+void SPULogSnapshot(void);
+void SPULogRegister(unsigned long reg, unsigned short val);
+// dma writes: logged after the copy, with what landed in spu ram
+void SPULogDMAWrite(unsigned long addr, int iCount);
+void SPULogDMAWrite1(unsigned long addr);
+void SPULogDMARead(unsigned long addr, int iCount);
+void SPULogDMARead1(void);
+void SPULogXA(xa_decode_t * xap);
+void SPULogCDDA(unsigned char * pcm, int nBytes);
+void SPULogBlock(void);
+
+// replays a log as fast as possible into a wav, prints samples/s
+// per number of playing voices
+extern "C" long SPUrenderLog(const char * pLog, const char * pWav);
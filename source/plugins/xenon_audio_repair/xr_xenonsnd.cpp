@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "record.h"
 #include "externals.h"
+#include "dsoundoss.h"
+#include "resample.h"
 #include <stdio.h>
 
 #include <stdio.h>
@@ -19,8 +21,16 @@ int output_samplesize = 4;
 #define MAX_UNPLAYED 32768
 #define BUFFER_SIZE 65536
 
-static char buffer[BUFFER_SIZE];
-static double freq_ratio;
+// ring between the spu mixer and the output thread, in stereo frames
+#define RING_FRAMES 16384
+#define RING_MASK (RING_FRAMES - 1)
+
+#define OUT_CHUNK 441                                  // frames per submit: 10 ms
+#define OUT_QUEUED ((48000 * 10 / 1000) * 4)           // keep 10 ms queued in the hw
+
+#define OUTPUT_THREAD 3
+
+static unsigned int buffer[BUFFER_SIZE / 4];
 
 static int buffer_size = 1024;
 
@@ -39,86 +49,191 @@ typedef uintptr_t uptr;
 
 typedef uint8_t boolean;
 
-static s16 prevLastSample[2] = {0, 0};
+#define lwsync() __asm__ __volatile__("lwsync" : : : "memory")
+
+/*
+ * The mixer thread writes its output into the ring, a thread of its own
+ * keeps the hw fed from it. Only the mixer moves ringWrite, only the
+ * output thread moves ringRead: no locks needed.
+ *
+ * The output thread aims for a target fill level: a bit more or less
+ * than that speeds the resampling up or slows it down slightly, instead
+ * of waiting for the hw or dropping samples. Running dry raises the
+ * target (and waits until it is filled up again), a long time without
+ * running dry lowers it.
+ */
+static u32 ring[RING_FRAMES] __attribute__((aligned(128)));
+static volatile u32 ringWrite = 0;
+static volatile u32 ringRead = 0;
+
+static int iTargetMs = 0;                              // wanted ring fill
+static int iMinTargetMs = 0;
+static int iMaxTargetMs = 0;
+static u32 uiSinceUnderrun = 0;                        // frames played since running dry
+static int bPrimed = 0;
+
+static volatile int bOutputEnd = 0;
+static volatile int bOutputEnded = 1;
+static unsigned char output_stack[0x10000];
+
+static xenonSoundStats_t soundStats;
+
+static RESAMPLER resampler;
 
 static void inline play_buffer(void) {
-    int i;
-    for (i = 0; i < buffer_size / 4; ++i) 
-        ((int*) buffer)[i] = bswap_32(((int*) buffer)[i]);
-    
     xenon_sound_submit(buffer, buffer_size);
 }
 
+static inline u32 RingFill(void) {
+    return ringWrite - ringRead;
+}
+
 /*
- * resamples pStereoSamples 
- * (taken from http://pcsx2.googlecode.com/svn/trunk/plugins/zerospu2/zerospu2.cpp)
+ * OUTPUT THREAD
  */
-static void ResampleLinear(s16* pStereoSamples, s32 oldsamples, s16* pNewSamples, s32 newsamples) {
-    s32 newsampL, newsampR;
-    s32 i;
-    for (i = 0; i < newsamples; ++i) {
-        s32 io = i * oldsamples;
-        s32 old = io / newsamples;
-        s32 rem = io - old * newsamples;
-
-        old *= 2;
-        //printf("%d %d\n",old,oldsamples);
-        if (old == 0) {
-            newsampL = prevLastSample[0] * (newsamples - rem) + pStereoSamples[0] * rem;
-            newsampR = prevLastSample[1] * (newsamples - rem) + pStereoSamples[1] * rem;
-        } else {
-            newsampL = pStereoSamples[old - 2] * (newsamples - rem) + pStereoSamples[old] * rem;
-            newsampR = pStereoSamples[old - 1] * (newsamples - rem) + pStereoSamples[old + 1] * rem;
+static void OutputThread(void) {
+    while (!bOutputEnd) {
+        u32 fill, target, count, step;
+        s32 adj;
+
+        if (xenon_sound_get_unplayed() > OUT_QUEUED) {
+            usleep(1000L);
+            continue;
+        }
+
+        fill = RingFill();
+        target = 44100 * iTargetMs / 1000;
+
+        if (!bPrimed) {
+            // (re)start once the target is reached
+            if (fill < target) {
+                usleep(1000L);
+                continue;
+            }
+            bPrimed = 1;
+        }
+
+        if (fill == 0) {
+            // ran dry: more latency, refill before playing on
+            if (xenon_sound_get_unplayed() == 0) {
+                soundStats.underruns++;
+                if (iTargetMs < iMaxTargetMs) iTargetMs += 10;
+                uiSinceUnderrun = 0;
+                bPrimed = 0;
+            }
+            usleep(1000L);
+            continue;
+        }
+
+        // 10 s without running dry: try less latency
+        if (uiSinceUnderrun > 44100 * 10) {
+            if (iTargetMs > iMinTargetMs) iTargetMs -= 5;
+            uiSinceUnderrun = 0;
         }
-        pNewSamples[2 * i] = newsampL / newsamples;
-        pNewSamples[2 * i + 1] = newsampR / newsamples;
-    }
-    prevLastSample[0] = pStereoSamples[oldsamples * 2 - 2];
-    prevLastSample[1] = pStereoSamples[oldsamples * 2 - 1];
-}
 
-static void inline add_to_buffer(void* stream, unsigned int length) {
-    unsigned int lengthLeft;
-    unsigned int rlengthLeft;
-    
-    lengthLeft = length >> 2;
-    rlengthLeft = ceil(lengthLeft * freq_ratio);
+        // more than the target buffered: play a bit faster, less: slower
+        adj = ((s32) fill - (s32) target) / 4;
+        if (adj > RESAMPLE_ADJ_MAX) adj = RESAMPLE_ADJ_MAX;
+        if (adj < -RESAMPLE_ADJ_MAX) adj = -RESAMPLE_ADJ_MAX;
+        step = RESAMPLE_STEP + adj;
 
-//    copy_to_buffer((int *)buffer, stream , rlengthLeft, lengthLeft);
-    ResampleLinear((s16 *) stream, lengthLeft, (s16 *) buffer, rlengthLeft);
-    
-    buffer_size = rlengthLeft << 2;
-    play_buffer();
+        count = fill < OUT_CHUNK ? fill : OUT_CHUNK;
 
+        buffer_size = ResampleLinear(&resampler, ring, RING_MASK, ringRead, count, step, buffer) << 2;
+
+        lwsync(); // done reading before the mixer may write there
+        ringRead += count;
+
+        play_buffer();
+
+        uiSinceUnderrun += count;
+        soundStats.frames += count;
+        soundStats.targetMs = iTargetMs;
+        soundStats.fillMs = fill * 1000 / 44100;
+        soundStats.adjust = adj;
+    }
+
+    bOutputEnded = 1;
 }
 
 /*
  * SETUP SOUND
  */
 void SetupSound(void) {
-    freq_ratio = 48000.0f / 44100.0f;
+    ringWrite = ringRead = 0;
+    ResampleReset(&resampler);
+
+    iTargetMs = LATENCY;
+    iMinTargetMs = LATENCY / 2;
+    iMaxTargetMs = LATENCY * 4;
+    uiSinceUnderrun = 0;
+    bPrimed = 0;
+    memset(&soundStats, 0, sizeof (soundStats));
+
+    if (bOutputEnded) {
+        bOutputEnd = 0;
+        bOutputEnded = 0;
+        xenon_run_thread_task(OUTPUT_THREAD, &output_stack[sizeof (output_stack) - 0x100], (void*) OutputThread);
+    }
 }
 
 /*
  * REMOVE SOUND
  */
 void RemoveSound(void) {
+    int i = 0;
+
+    bOutputEnd = 1;
+    while (!bOutputEnded && i < 2000) {
+        usleep(1000L);
+        i++;
+    } // -> wait until thread has ended
 }
 
 /*
  * GET BYTES BUFFERED
  */
-unsigned long SoundGetBytesBuffered(void) {
-    return xenon_sound_get_unplayed();
+int SoundGetBytesBuffered(void) {
+    // ring + hw queue, in spu output bytes
+    return RingFill() * 4 + xenon_sound_get_unplayed() * 147 / 160;
+}
+
+/*
+ * GET LATENCY BYTES: the mixer fills up to this
+ */
+int SoundGetLatencyBytes(void) {
+    return SOUNDLEN(5 + iTargetMs);
+}
+
+const xenonSoundStats_t * SoundGetStats(void) {
+    return &soundStats;
 }
 
 /*
  * FEED SOUND DATA
  */
 void SoundFeedStreamData(unsigned char* pSound, long lBytes) {
-    if (lBytes < 0)
+    const u32 * src = (const u32 *) pSound;
+    u32 frames, room, w, i;
+
+    if (lBytes <= 0)
         return;
-    add_to_buffer(pSound, lBytes);
+
+    frames = lBytes >> 2;
+    room = RING_FRAMES - RingFill();
+
+    // full: the output thread is stuck, drop the rest
+    if (frames > room) {
+        soundStats.overflows++;
+        frames = room;
+    }
+
+    w = ringWrite;
+    for (i = 0; i < frames; i++)
+        ring[(w + i) & RING_MASK] = src[i];
+
+    lwsync(); // frames visible before the output thread sees the new index
+    ringWrite = w + frames;
 }
 
 void ResetSound()
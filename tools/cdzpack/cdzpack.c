@@ -0,0 +1,317 @@
+/*
+ * cdzpack: converts a .bin (or a .cue with one .bin) to a .cdz image,
+ * see source/plugins/cdrcimg/cdz.h
+ *
+ * Runs on the host, build it with:
+ *   gcc -O2 -o cdzpack cdzpack.c ../../source/plugins/cdrcimg/cdz.c -lz -lbz2
+ *
+ * usage: cdzpack <image.bin|image.cue> <out.cdz> [sectors per hunk]
+ *
+ * Each hunk gets the smallest of the codecs that fit it, and is decoded
+ * again and compared before it gets written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include "../../source/plugins/cdrcimg/cdz.h"
+
+#define MAXTRACKS 100
+#define DEFAULT_HUNK_SECTORS 8
+
+static struct {
+    int type; // CDZ_TRACK_*
+    int mode; // 0 audio, 1, 2
+    unsigned int start;
+    unsigned int sectors;
+} tracks[MAXTRACKS];
+static int num_tracks;
+
+static void put_le32(unsigned char *p, unsigned int v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static int track_of(unsigned int lba) {
+    int i;
+
+    for (i = num_tracks - 1; i > 0; i--)
+        if (lba >= tracks[i].start)
+            break;
+
+    return i;
+}
+
+// FILE, TRACK and INDEX 01 of a single file cue sheet
+static int parse_cue(const char *cue, char *bin, int bin_size) {
+    char line[512], *p, *q;
+    int m, s, f;
+    FILE *fc;
+
+    fc = fopen(cue, "r");
+    if (fc == NULL) {
+        perror(cue);
+        return -1;
+    }
+
+    bin[0] = 0;
+    num_tracks = 0;
+
+    while (fgets(line, sizeof (line), fc) != NULL) {
+        for (p = line; isspace((unsigned char) *p); p++)
+            ;
+
+        if (strncmp(p, "FILE", 4) == 0 && bin[0] == 0) {
+            p = strchr(p, '"');
+            q = p ? strchr(p + 1, '"') : NULL;
+            if (q == NULL)
+                continue;
+            *q = 0;
+
+            // relative to the cue
+            strncpy(bin, cue, bin_size - 1);
+            bin[bin_size - 1] = 0;
+            q = strrchr(bin, '/');
+            q = q ? q + 1 : bin;
+            snprintf(q, bin_size - (q - bin), "%s", p + 1);
+        } else if (strncmp(p, "TRACK", 5) == 0 && num_tracks < MAXTRACKS) {
+            tracks[num_tracks].type = strstr(p, "AUDIO") ? CDZ_TRACK_AUDIO : CDZ_TRACK_DATA;
+            tracks[num_tracks].mode = strstr(p, "MODE1") ? 1 : strstr(p, "MODE2") ? 2 : 0;
+            tracks[num_tracks].start = 0;
+            num_tracks++;
+        } else if (strncmp(p, "INDEX 01", 8) == 0 && num_tracks > 0) {
+            if (sscanf(p + 8, "%d:%d:%d", &m, &s, &f) == 3)
+                tracks[num_tracks - 1].start = (m * 60 + s) * 75 + f;
+        }
+    }
+
+    fclose(fc);
+
+    if (bin[0] == 0 || num_tracks == 0) {
+        fprintf(stderr, "%s: no FILE/TRACK found\n", cue);
+        return -1;
+    }
+
+    return 0;
+}
+
+// kind of a sector: the first one that regenerates it exactly
+static int sector_kind(const unsigned char *raw, unsigned int lba) {
+    unsigned char test[CDZ_SECTOR_SIZE];
+    int kind;
+
+    for (kind = CDZ_SECT_MODE1; kind < CDZ_SECT_KINDS; kind++) {
+        memset(test, 0, sizeof (test));
+        memcpy(test + cdz_kind_offset[kind], raw + cdz_kind_offset[kind], cdz_kind_size[kind]);
+        cdz_build_sector(test, kind, lba);
+
+        if (memcmp(test, raw, CDZ_SECTOR_SIZE) == 0)
+            return kind;
+    }
+
+    return CDZ_SECT_RAW;
+}
+
+static int stats_codec[4], stats_kind[CDZ_SECT_KINDS];
+
+// one hunk -> out (kinds + codec stream), returns its size
+static unsigned int pack_hunk(const unsigned char *raw, unsigned int lba, int n,
+        unsigned char *out, int *codec) {
+    static unsigned char stored[CDZ_MAX_HUNK_SECTORS * CDZ_SECTOR_SIZE];
+    static unsigned char tmp[CDZ_MAX_HUNK_SECTORS * CDZ_SECTOR_SIZE * 2];
+    static unsigned char check[CDZ_MAX_HUNK_SECTORS * CDZ_SECTOR_SIZE];
+    unsigned int size = 0, best, bz_size;
+    unsigned long z_size;
+    int i, kind, audio = 1;
+
+    for (i = 0; i < n; i++) {
+        const unsigned char *sector = raw + i * CDZ_SECTOR_SIZE;
+
+        if (tracks[track_of(lba + i)].type == CDZ_TRACK_AUDIO)
+            kind = CDZ_SECT_RAW;
+        else {
+            kind = sector_kind(sector, lba + i);
+            audio = 0;
+        }
+
+        stats_kind[kind]++;
+        out[i] = kind;
+        memcpy(stored + size, sector + cdz_kind_offset[kind], cdz_kind_size[kind]);
+        size += cdz_kind_size[kind];
+    }
+
+    // none
+    *codec = CDZ_CODEC_NONE;
+    memcpy(out + n, stored, size);
+    best = size;
+
+    z_size = sizeof (tmp);
+    if (compress2(tmp, &z_size, stored, size, 9) == Z_OK && z_size < best) {
+        *codec = CDZ_CODEC_ZLIB;
+        memcpy(out + n, tmp, z_size);
+        best = z_size;
+    }
+
+    bz_size = sizeof (tmp);
+    if (BZ2_bzBuffToBuffCompress((char *) tmp, &bz_size, (char *) stored, size, 9, 0, 0) == BZ_OK &&
+            bz_size < best) {
+        *codec = CDZ_CODEC_BZ2;
+        memcpy(out + n, tmp, bz_size);
+        best = bz_size;
+    }
+
+    if (audio) {
+        cdz_cdda_predict(stored, size);
+
+        z_size = sizeof (tmp);
+        if (compress2(tmp, &z_size, stored, size, 9) == Z_OK && z_size < best) {
+            *codec = CDZ_CODEC_CDDA;
+            memcpy(out + n, tmp, z_size);
+            best = z_size;
+        }
+    }
+
+    if (cdz_decode_hunk(out, n + best, *codec, lba, n, check) != 0 ||
+            memcmp(check, raw, n * CDZ_SECTOR_SIZE) != 0) {
+        fprintf(stderr, "hunk at sector %u does not decode back\n", lba);
+        exit(1);
+    }
+
+    stats_codec[*codec]++;
+    return n + best;
+}
+
+int main(int argc, char *argv[]) {
+    static unsigned char raw[CDZ_MAX_HUNK_SECTORS * CDZ_SECTOR_SIZE];
+    static unsigned char hunk[CDZ_MAX_HUNK_SECTORS * (CDZ_SECTOR_SIZE + 1)];
+    unsigned char hdr[CDZ_HEADER_SIZE], entry[CDZ_TRACK_SIZE];
+    unsigned char *index;
+    unsigned int sectors, hunks, h, offset, size;
+    int hunk_sectors = DEFAULT_HUNK_SECTORS;
+    char bin[1024];
+    const char *ext;
+    long bin_size;
+    FILE *fi, *fo;
+    int i, n, codec;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <image.bin|image.cue> <out.cdz> [sectors per hunk]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc > 3)
+        hunk_sectors = atoi(argv[3]);
+    if (hunk_sectors < 1 || hunk_sectors > CDZ_MAX_HUNK_SECTORS) {
+        fprintf(stderr, "sectors per hunk: 1 ... %d\n", CDZ_MAX_HUNK_SECTORS);
+        return 1;
+    }
+
+    ext = strrchr(argv[1], '.');
+    if (ext != NULL && strcasecmp(ext, ".cue") == 0) {
+        if (parse_cue(argv[1], bin, sizeof (bin)) != 0)
+            return 1;
+    } else {
+        snprintf(bin, sizeof (bin), "%s", argv[1]);
+        num_tracks = 1;
+        tracks[0].type = CDZ_TRACK_DATA;
+        tracks[0].mode = 2;
+        tracks[0].start = 0;
+    }
+
+    fi = fopen(bin, "rb");
+    if (fi == NULL) {
+        perror(bin);
+        return 1;
+    }
+
+    fseek(fi, 0, SEEK_END);
+    bin_size = ftell(fi);
+    fseek(fi, 0, SEEK_SET);
+
+    if (bin_size % CDZ_SECTOR_SIZE != 0)
+        fprintf(stderr, "warning: %s is not made of %d byte sectors\n", bin, CDZ_SECTOR_SIZE);
+
+    sectors = bin_size / CDZ_SECTOR_SIZE;
+    hunks = (sectors + hunk_sectors - 1) / hunk_sectors;
+
+    for (i = 0; i < num_tracks; i++)
+        tracks[i].sectors = (i + 1 < num_tracks ? tracks[i + 1].start : sectors) - tracks[i].start;
+
+    fo = fopen(argv[2], "wb");
+    if (fo == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    cdz_eccedc_init();
+
+    memcpy(hdr, CDZ_MAGIC, 4);
+    put_le32(hdr + 4, hunk_sectors);
+    put_le32(hdr + 8, sectors);
+    put_le32(hdr + 12, hunks);
+    put_le32(hdr + 16, num_tracks);
+    put_le32(hdr + 20, 0);
+    fwrite(hdr, 1, sizeof (hdr), fo);
+
+    for (i = 0; i < num_tracks; i++) {
+        memset(entry, 0, sizeof (entry));
+        entry[0] = tracks[i].type;
+        entry[1] = tracks[i].mode;
+        put_le32(entry + 4, tracks[i].start);
+        put_le32(entry + 8, tracks[i].sectors);
+        fwrite(entry, 1, sizeof (entry), fo);
+    }
+
+    // index gets written when all hunks are
+    index = calloc(hunks, CDZ_INDEX_SIZE);
+    if (index == NULL) {
+        fprintf(stderr, "OOM\n");
+        return 1;
+    }
+    fwrite(index, CDZ_INDEX_SIZE, hunks, fo);
+    offset = CDZ_HEADER_SIZE + num_tracks * CDZ_TRACK_SIZE + hunks * CDZ_INDEX_SIZE;
+
+    for (h = 0; h < hunks; h++) {
+        n = sectors - h * hunk_sectors;
+        if (n > hunk_sectors)
+            n = hunk_sectors;
+
+        if (fread(raw, CDZ_SECTOR_SIZE, n, fi) != n) {
+            fprintf(stderr, "read error at sector %u\n", h * hunk_sectors);
+            return 1;
+        }
+
+        size = pack_hunk(raw, h * hunk_sectors, n, hunk, &codec);
+        fwrite(hunk, 1, size, fo);
+
+        put_le32(index + h * CDZ_INDEX_SIZE, offset);
+        put_le32(index + h * CDZ_INDEX_SIZE + 4, size | codec << 24);
+        offset += size;
+
+        if ((h & 1023) == 0)
+            fprintf(stderr, "\r%u%%", h * 100 / hunks);
+    }
+
+    fseek(fo, CDZ_HEADER_SIZE + num_tracks * CDZ_TRACK_SIZE, SEEK_SET);
+    fwrite(index, CDZ_INDEX_SIZE, hunks, fo);
+
+    fclose(fo);
+    fclose(fi);
+    free(index);
+
+    fprintf(stderr, "\r%s: %u sectors, %d tracks -> %u bytes (%.1f%%)\n", argv[2], sectors, num_tracks,
+            offset, bin_size ? offset * 100.0 / bin_size : 0.0);
+    fprintf(stderr, "hunks: %d none, %d zlib, %d bzip2, %d cdda\n",
+            stats_codec[CDZ_CODEC_NONE], stats_codec[CDZ_CODEC_ZLIB],
+            stats_codec[CDZ_CODEC_BZ2], stats_codec[CDZ_CODEC_CDDA]);
+    fprintf(stderr, "sectors: %d raw, %d mode1, %d mode2 form1, %d mode2 form2\n",
+            stats_kind[CDZ_SECT_RAW], stats_kind[CDZ_SECT_MODE1], stats_kind[CDZ_SECT_MODE2_F1],
+            stats_kind[CDZ_SECT_MODE2_F2] + stats_kind[CDZ_SECT_MODE2_F2_NOEDC]);
+
+    return 0;
+}
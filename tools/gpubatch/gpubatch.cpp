@@ -0,0 +1,253 @@
+/*
+ * gpubatch: checks the draw batching of the hw gpu plugin on the host,
+ * see source/plugins/peopsxgl/GpuBatch.h
+ *
+ * Runs on the host, build it with:
+ *   g++ -O2 -DGPUBATCH_HOST -o gpubatch gpubatch.cpp ../../source/plugins/peopsxgl/GpuBatch.cpp
+ *
+ * Feeds scripted primitive streams to a GpuBatcher with a backend that only
+ * records what it gets, then checks the draws, merges and state blocks.
+ * Exits with 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../source/plugins/peopsxgl/GpuBatch.h"
+
+// GpuPrimTypes of GpuRenderer.h, the batches only see these two
+#define PRIM_TRIANGLE 0
+#define PRIM_RECTLIST 3
+
+#define MAX_DRAWS 8192
+
+struct Draw {
+    int primType;
+    int firstIndex;
+    int primCount;
+    GpuTex * surface;
+};
+
+class RecordBackend : public GpuBatchBackend {
+public:
+    Draw draws[MAX_DRAWS];
+    int nb_draws;
+    int applies;
+    int full_applies; // with prev NULL: device state unknown
+    GpuTex * surface;
+
+    RecordBackend() {
+        Clear();
+    }
+
+    void Clear() {
+        nb_draws = applies = full_applies = 0;
+        surface = NULL;
+    }
+
+    virtual void ApplyStates(const GpuRenderStates & states, const GpuRenderStates * prev) {
+        applies++;
+        if (prev == NULL)
+            full_applies++;
+        surface = states.surface;
+    }
+
+    virtual void DrawIndexed(int primType, int vertexCount, int firstIndex, int primCount) {
+        if (nb_draws < MAX_DRAWS) {
+            Draw * d = &draws[nb_draws];
+            d->primType = primType;
+            d->firstIndex = firstIndex;
+            d->primCount = primCount;
+            d->surface = surface;
+        }
+        nb_draws++;
+    }
+};
+
+static int failed;
+
+#define CHECK(what, got, want) \
+    do { \
+        if ((got) != (want)) { \
+            printf("  %s: %s is %d, expected %d\n", test, what, (int) (got), (int) (want)); \
+            failed++; \
+        } \
+    } while (0)
+
+// the renderer: states, and the index/vertex counts of its buffers
+static GpuBatcher * batcher;
+static RecordBackend backend;
+static GpuRenderStates states;
+static int indices, vertices;
+static int primType;
+
+static GpuTex * const texA = (GpuTex *) 0x1000;
+static GpuTex * const texB = (GpuTex *) 0x2000;
+
+static void Begin() {
+    delete batcher;
+    batcher = new GpuBatcher();
+    batcher->SetBackend(&backend);
+    backend.Clear();
+
+    memset(&states, 0, sizeof (states));
+    indices = vertices = 0;
+    primType = PRIM_TRIANGLE;
+}
+
+// what GpuRenderer does before a state changes
+static void CloseBatch() {
+    batcher->Close(states, primType, indices, vertices);
+}
+
+static void SetTexture(GpuTex * t) {
+    CloseBatch();
+    states.surface = t;
+}
+
+static void SetBlend(int enabled) {
+    CloseBatch();
+    states.blending_enabled = enabled;
+}
+
+static void SetPrim(int type) {
+    CloseBatch();
+    primType = type;
+}
+
+static void Quad() {
+    indices += 6;
+    vertices += 4;
+}
+
+static void Triangle() {
+    indices += 3;
+    vertices += 3;
+}
+
+static void Submit() {
+    CloseBatch();
+    batcher->Flush(vertices);
+}
+
+static void EndFrame() {
+    Submit();
+    batcher->EndFrame();
+    batcher->Reset();
+    indices = vertices = 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char * test;
+    int i;
+
+    test = "same states";
+    Begin();
+    SetTexture(texA);
+    for (i = 0; i < 100; i++) {
+        Quad();
+        SetTexture(texA); // setters get called for every primitive
+        SetBlend(0);
+    }
+    EndFrame();
+    CHECK("draws", backend.nb_draws, 1);
+    CHECK("primitives", backend.draws[0].primCount, 200);
+    CHECK("batches", batcher->GetFrameStats().batches, 1);
+    CHECK("merged", batcher->GetFrameStats().merged, 99);
+    CHECK("state blocks", backend.applies, 1);
+
+    test = "texture changes";
+    Begin();
+    for (i = 0; i < 10; i++) {
+        SetTexture(i & 1 ? texB : texA);
+        Quad();
+        Quad();
+    }
+    EndFrame();
+    CHECK("draws", backend.nb_draws, 10);
+    CHECK("state blocks", backend.applies, 10);
+    CHECK("first index of draw 3", backend.draws[3].firstIndex, 36);
+    CHECK("texture of draw 3", backend.draws[3].surface == texB, 1);
+    CHECK("primitives of draw 3", backend.draws[3].primCount, 4);
+
+    test = "change and back";
+    Begin();
+    SetTexture(texA);
+    Quad();
+    SetBlend(1); // nothing drawn with it
+    SetBlend(0);
+    Quad();
+    EndFrame();
+    CHECK("draws", backend.nb_draws, 1);
+    CHECK("merged", batcher->GetFrameStats().merged, 1);
+
+    test = "triangles and quads";
+    Begin();
+    SetTexture(texA);
+    for (i = 0; i < 8; i++) {
+        Triangle();
+        SetTexture(texA);
+        Quad();
+        SetTexture(texA);
+    }
+    EndFrame();
+    CHECK("draws", backend.nb_draws, 1);
+    CHECK("primitives", backend.draws[0].primCount, 24);
+
+    test = "rect list";
+    Begin();
+    SetTexture(texA);
+    Quad();
+    SetPrim(PRIM_RECTLIST);
+    Triangle();
+    SetPrim(PRIM_TRIANGLE);
+    Quad();
+    EndFrame();
+    CHECK("draws", backend.nb_draws, 3);
+    CHECK("type of draw 1", backend.draws[1].primType, PRIM_RECTLIST);
+    CHECK("state blocks", backend.applies, 1);
+    CHECK("redundant", batcher->GetFrameStats().redundant_states, 2);
+
+    test = "flush in between";
+    Begin();
+    SetTexture(texA);
+    Quad();
+    Submit(); // vram read
+    Quad();
+    Submit();
+    EndFrame();
+    CHECK("draws", backend.nb_draws, 2);
+    CHECK("state blocks", backend.applies, 1);
+    CHECK("redundant", batcher->GetFrameStats().redundant_states, 1);
+
+    test = "invalidated states";
+    Begin();
+    SetTexture(texA);
+    Quad();
+    Submit();
+    batcher->InvalidateStates(); // clear
+    Quad();
+    EndFrame();
+    CHECK("draws", backend.nb_draws, 2);
+    CHECK("full state blocks", backend.full_applies, 2);
+
+    test = "batch list full";
+    Begin();
+    for (i = 0; i < MAX_BATCH_COUNT + 10; i++) {
+        SetTexture(i & 1 ? texB : texA);
+        Quad();
+    }
+    EndFrame();
+    CHECK("draws", backend.nb_draws, MAX_BATCH_COUNT + 10);
+    CHECK("flushes", batcher->GetFrameStats().flushes, 2);
+
+    delete batcher;
+
+    if (failed) {
+        printf("%d checks failed\n", failed);
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}
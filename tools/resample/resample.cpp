@@ -0,0 +1,157 @@
+/*
+ * resample: checks the linear resampler of the sound output on the host,
+ * see source/plugins/xenon_audio_repair/resample.h
+ *
+ * Runs on the host, build it with:
+ *   g++ -O2 -o resample resample.cpp -lm
+ *
+ * Feeds a 1 kHz tone at 44100 Hz through the ring in chunks, the way the
+ * output thread of xr_xenonsnd.cpp does, and checks the number of output
+ * frames, that the chunking changes nothing, and the THD+N of the output.
+ * Then prints the throughput. Exits with 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "../../source/plugins/xenon_audio_repair/resample.h"
+
+// as in xr_xenonsnd.cpp
+#define RING_FRAMES 16384
+#define RING_MASK (RING_FRAMES - 1)
+#define OUT_CHUNK 441
+
+#define TONE_HZ 1000.0
+#define TONE_AMP 16000.0
+#define SECONDS 10
+#define IN_FRAMES (44100 * SECONDS)
+#define OUT_MAX (IN_FRAMES * 11 / 10)
+
+// linear interpolation of a 1 kHz tone gives about -62 dB
+#define THD_MAX_DB -58.0
+
+static unsigned int ring[RING_FRAMES];
+static unsigned int out[OUT_MAX];
+static unsigned int ref[OUT_MAX];
+
+static int failed;
+
+static unsigned int Frame(int i) {
+    double v = TONE_AMP * sin(2.0 * M_PI * TONE_HZ * i / 44100.0);
+    short l = (short) lrint(v), r = (short) lrint(-v);
+
+    return ((unsigned int) (unsigned short) l << 16) | (unsigned short) r;
+}
+
+// the whole tone through the ring, in chunks of chunk frames
+static int Run(int step, int chunk, unsigned int * dst) {
+    RESAMPLER rs;
+    unsigned int read = 0;
+    int i, n = 0;
+
+    ResampleReset(&rs);
+
+    while ((int) read < IN_FRAMES) {
+        int count = IN_FRAMES - read < (unsigned int) chunk ? IN_FRAMES - read : chunk;
+
+        for (i = 0; i < count; i++)
+            ring[(read + i) & RING_MASK] = Frame(read + i);
+
+        n += ResampleLinear(&rs, ring, RING_MASK, read, count, step, &dst[n]);
+        read += count;
+    }
+
+    return n;
+}
+
+static short Left(unsigned int w) {
+    return (short) (bswap_32(w) >> 16);
+}
+
+// THD+N in dB of the left channel: everything but the fitted tone
+static double ThdN(int n, int step) {
+    const double w = 2.0 * M_PI * TONE_HZ / 44100.0 * step / 65536.0;
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0, a, b, sig = 0, err = 0;
+    int k, first = 100; // past the start from silence
+
+    for (k = first; k < n; k++) {
+        double s = sin(w * k), c = cos(w * k), y = Left(out[k]);
+
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        ys += y * s;
+        yc += y * c;
+    }
+
+    // least squares a * sin + b * cos
+    a = (ys * cc - yc * sc) / (ss * cc - sc * sc);
+    b = (yc * ss - ys * sc) / (ss * cc - sc * sc);
+
+    for (k = first; k < n; k++) {
+        double fit = a * sin(w * k) + b * cos(w * k), y = Left(out[k]);
+
+        sig += fit * fit;
+        err += (y - fit) * (y - fit);
+    }
+
+    return 10.0 * log10(err / sig);
+}
+
+static double Now(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char *argv[]) {
+    const int steps[3] = {RESAMPLE_STEP, RESAMPLE_STEP - RESAMPLE_ADJ_MAX, RESAMPLE_STEP + RESAMPLE_ADJ_MAX};
+    double t, thd;
+    int i, n, m, runs;
+
+    for (i = 0; i < 3; i++) {
+        const double want = (double) IN_FRAMES * 65536.0 / steps[i];
+
+        n = Run(steps[i], OUT_CHUNK, out);
+        if (fabs(n - want) > 1.0) {
+            printf("step %d: %d output frames, expected %.1f\n", steps[i], n, want);
+            failed++;
+        }
+
+        // one frame at a time and all at once give the same
+        m = Run(steps[i], 1, ref);
+        if (m != n || memcmp(out, ref, n * 4)) {
+            printf("step %d: output changes with the chunk size\n", steps[i]);
+            failed++;
+        }
+        m = Run(steps[i], RING_FRAMES, ref);
+        if (m != n || memcmp(out, ref, n * 4)) {
+            printf("step %d: output changes with the chunk size\n", steps[i]);
+            failed++;
+        }
+
+        thd = ThdN(n, steps[i]);
+        printf("step %d: %d frames, THD+N %.1f dB\n", steps[i], n, thd);
+        if (thd > THD_MAX_DB) {
+            printf("step %d: THD+N above %.1f dB\n", steps[i], THD_MAX_DB);
+            failed++;
+        }
+    }
+
+    t = Now();
+    for (runs = 0; Now() - t < 1.0; runs++)
+        Run(RESAMPLE_STEP, OUT_CHUNK, out);
+    t = Now() - t;
+    printf("%.0f output frames/s, %.0fx realtime\n", runs * (double) n / t, runs * SECONDS / t);
+
+    if (failed) {
+        printf("%d checks failed\n", failed);
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}
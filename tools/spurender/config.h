@@ -0,0 +1,15 @@
+/*
+ * spurender: host stand-in for include/config.h, which pulls in the
+ * libxenon headers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAXPATHLEN 256
+#define PACKAGE_VERSION "1.9"
+#define PREFIX "./"
+
+#define ALIGNED_128 __attribute__((aligned(128)))
+#define ALIGNED_32 __attribute__((aligned(32)))
+#define ALIGNED ALIGNED_128
@@ -0,0 +1,248 @@
+/*
+ * spurender: replays a spu.log through the spu mixer and writes a wav,
+ * see SPUrenderLog in source/plugins/xenon_audio_repair/a_spulog.cpp
+ *
+ * Runs on the host, build it with:
+ *   g++ -O2 -w -DNOTHREADLIB -I. -I../../source/plugins/xenon_audio_repair -I../../source/libpcsxcore \
+ *     -o spurender spurender.cpp ../../source/plugins/xenon_audio_repair/a_*.cpp
+ *
+ * usage: spurender <spu.log> <out.wav>
+ *        spurender -c <spu.log> <vector.wav> <scalar.wav>
+ *        spurender -t <out.log>
+ *
+ * The log gets written on the console with "SPU Log" set in the spu
+ * options. The mixer is the one of the plugin, only the sound output
+ * (xr_xenonsnd.cpp) is left out: the render calls the mixer itself and
+ * nothing gets played.
+ *
+ * -c renders the log with the vector mix kernels of a_vmix.cpp and again
+ * with the plain C ones, and fails if the two wavs differ in one bit.
+ * The vector kernels are AltiVec: on x86 both renders use the C kernels
+ * and only check that the replay is deterministic, for the real check
+ * build it for ppc with -maltivec (and run it under qemu-ppc64 if need
+ * be).
+ *
+ * -t writes a log to test with: all voices keyed on and off at different
+ * pitches, volumes and envelopes, over noise adpcm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "../../source/main/gui.h"
+
+// a_spulog.cpp
+extern "C" long SPUrenderLog(const char * pLog, const char * pWav);
+
+// a_vmix.cpp
+extern int bScalarMix;
+
+SPU_Config SpuConfig;
+
+// the sound output of xr_xenonsnd.cpp
+
+int output_channels = 2;
+int output_samplesize = 4;
+
+void SetupSound(void) {
+}
+
+void RemoveSound(void) {
+}
+
+void ResetSound(void) {
+}
+
+int SoundGetBytesBuffered(void) {
+    return 0;
+}
+
+int SoundGetLatencyBytes(void) {
+    return 0;
+}
+
+void SoundFeedStreamData(unsigned char* pSound, long lBytes) {
+}
+
+unsigned long timeGetTime(void) {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// the test log
+
+static FILE * fpLog;
+
+static void Put16(unsigned int v) {
+    fputc(v & 0xff, fpLog);
+    fputc((v >> 8) & 0xff, fpLog);
+}
+
+static void Put32(unsigned int v) {
+    Put16(v & 0xffff);
+    Put16(v >> 16);
+}
+
+static void PutReg(unsigned int reg, unsigned int val) {
+    fputc('R', fpLog);
+    Put32(0x1f801000 + reg);
+    Put16(val);
+}
+
+#define TEST_SAMPLE 0x1000 // spu ram address of the adpcm
+#define TEST_BLOCKS 64     // 16 byte adpcm blocks, loops
+#define TEST_MIXED  4000   // mixed blocks
+
+static int WriteTestLog(const char * pName) {
+    static unsigned char ram[0x80000];
+    unsigned short regs[256];
+    int i, ch;
+
+    fpLog = fopen(pName, "wb");
+    if (!fpLog) return -1;
+
+    srand(1);
+    memset(ram, 0, sizeof (ram));
+    for (i = 0; i < TEST_BLOCKS; i++) {
+        unsigned char * b = &ram[TEST_SAMPLE + i * 16];
+        int k;
+
+        b[0] = (i % 5) << 4 | (i % 13); // filter, shift
+        b[1] = (i == 0 ? 4 : 0) | (i == TEST_BLOCKS - 1 ? 3 : 0); // loop start, loop end + repeat
+        for (k = 2; k < 16; k++)
+            b[k] = rand() & 0xff;
+    }
+
+    memset(regs, 0, sizeof (regs));
+    regs[(0xd80 - 0xc00) / 2] = 0x3fff; // main volume
+    regs[(0xd82 - 0xc00) / 2] = 0x3fff;
+    regs[(0xdaa - 0xc00) / 2] = 0xc000; // spu on, unmuted
+
+    fwrite("SPULOG1\n", 1, 8, fpLog);
+    fputc('M', fpLog);
+    fwrite(ram, 1, sizeof (ram), fpLog);
+    for (i = 0; i < 256; i++)
+        Put16(regs[i]);
+
+    for (ch = 0; ch < 24; ch++) {
+        const unsigned int v = 0xc00 + ch * 16;
+
+        PutReg(v + 0, ch & 1 ? 0x3fff : 0x1000 + ch * 0x100); // volume
+        PutReg(v + 2, ch & 2 ? 0x7000 - ch : 0x3fff - ch * 0x200); // negative ones too
+        PutReg(v + 4, 0x200 + ch * 0x1a7); // pitch: below and above 44.1 kHz
+        PutReg(v + 6, TEST_SAMPLE >> 3);
+        PutReg(v + 8, 0x80ff - (ch & 3) * 0x10); // adsr
+        PutReg(v + 10, 0x5fc0 + ch);
+    }
+
+    for (i = 0; i < TEST_MIXED; i++) {
+        if (i % 400 == 0) {
+            PutReg(0xd88, 0xffff); // key on
+            PutReg(0xd8a, 0xff);
+        }
+        if (i % 400 == 250) {
+            PutReg(0xd8c, 0x5555); // key off half of them
+            PutReg(0xd8e, 0x55);
+        }
+        fputc('B', fpLog);
+    }
+
+    fclose(fpLog);
+    return 0;
+}
+
+// the two renders of -c
+
+static unsigned char * ReadFile(const char * pName, long * size) {
+    unsigned char * buf;
+    FILE * fp;
+
+    fp = fopen(pName, "rb");
+    if (!fp) return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = (unsigned char *) malloc(*size + 1);
+    if (buf && fread(buf, 1, *size, fp) != (size_t) * size) {
+        free(buf);
+        buf = NULL;
+    }
+
+    fclose(fp);
+    return buf;
+}
+
+static int CompareRenders(const char * pLog, const char * pVector, const char * pScalar) {
+    unsigned char * v, * s;
+    long vsize, ssize, i;
+    int ret = 0;
+
+#ifndef __ALTIVEC__
+    printf("spurender: no vector kernels in this build, both renders are plain C\n");
+#endif
+
+    bScalarMix = 0;
+    if (SPUrenderLog(pLog, pVector) < 0) return -1;
+
+    bScalarMix = 1;
+    if (SPUrenderLog(pLog, pScalar) < 0) return -1;
+    bScalarMix = 0;
+
+    v = ReadFile(pVector, &vsize);
+    s = ReadFile(pScalar, &ssize);
+    if (!v || !s) {
+        ret = -1;
+    } else if (vsize != ssize) {
+        printf("spurender: %ld bytes of vector output, %ld of scalar output\n", vsize, ssize);
+        ret = 1;
+    } else {
+        for (i = 0; i < vsize && v[i] == s[i]; i++);
+        if (i < vsize) {
+            // 44 bytes of wav header, then 16 bit stereo
+            printf("spurender: the outputs differ from sample %ld on\n", (i - 44) / 4);
+            ret = 1;
+        } else {
+            printf("spurender: the outputs are the same, %ld samples\n", (vsize - 44) / 4);
+        }
+    }
+
+    free(v);
+    free(s);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    int ret;
+
+    if (argc == 5 && !strcmp(argv[1], "-c")) {
+        ret = CompareRenders(argv[2], argv[3], argv[4]);
+        if (ret < 0) printf("spurender: can't render %s\n", argv[2]);
+        return ret ? 1 : 0;
+    }
+
+    if (argc == 3 && !strcmp(argv[1], "-t")) {
+        if (WriteTestLog(argv[2]) < 0) {
+            printf("spurender: can't write %s\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc != 3) {
+        printf("usage: spurender <spu.log> <out.wav>\n");
+        printf("       spurender -c <spu.log> <vector.wav> <scalar.wav>\n");
+        printf("       spurender -t <out.log>\n");
+        return 1;
+    }
+
+    if (SPUrenderLog(argv[1], argv[2]) < 0) {
+        printf("spurender: can't render %s\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
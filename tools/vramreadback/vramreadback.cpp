@@ -0,0 +1,153 @@
+/*
+ * vramreadback: checks the vram readback scheduling of the hw gpu plugin
+ * on the host, see source/plugins/peopsxgl/vram_schedule.h
+ *
+ * Runs on the host, build it with:
+ *   g++ -O2 -o vramreadback vramreadback.cpp ../../source/plugins/peopsxgl/vram_schedule.cpp
+ *
+ * Drives the scheduler like the plugin does (gpu commands, frames, reads)
+ * with a resolver that only counts, then checks how many reads got their
+ * resolve early and how many had to stall. Exits with 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../source/plugins/peopsxgl/vram_schedule.h"
+
+// the stand-in resolver: a 320x240 black screen
+static uint32_t screen[320 * 240];
+static int resolves;
+
+static void CountResolve(void) {
+    resolves++;
+}
+
+static const uint32_t * ScreenLock(int * width, int * height, int * pitch) {
+    *width = 320;
+    *height = 240;
+    *pitch = 320;
+    return screen;
+}
+
+static void ScreenUnlock(void) {
+}
+
+static const vramResolver_t countResolver = { CountResolve, ScreenLock, ScreenUnlock };
+
+static int failed;
+
+#define CHECK(what, got, want) \
+    do { \
+        if ((int) (got) != (int) (want)) { \
+            printf("  %s: %s is %d, expected %d\n", test, what, (int) (got), (int) (want)); \
+            failed++; \
+        } \
+    } while (0)
+
+static void Begin() {
+    SetVRamResolver(&countResolver);
+    resolves = 0;
+}
+
+// what hw_gpu.cpp does after each gpu command
+static void Commands(int n) {
+    while (n--)
+        VRamReadbackPrimitive();
+}
+
+// CheckVRamRead: the rect gets read back
+static void Read(int x, int y, int w, int h) {
+    const vramResolver_t * r = VRamReadbackSchedule(x, y, w, h);
+    int sw, sh, pitch;
+
+    if (r != NULL && r->Lock(&sw, &sh, &pitch) != NULL)
+        r->Unlock();
+}
+
+static void CheckStats(const char * test, int early, int stalls, int issued) {
+    const vramReadbackStats_t * st = GetVRamReadbackStats();
+
+    CHECK("reads", st->reads, early + stalls);
+    CHECK("early", st->early, early);
+    CHECK("stalls", st->stalls, stalls);
+    CHECK("issued", st->issued, issued);
+    CHECK("resolves", resolves, stalls + st->issued);
+}
+
+int main(int argc, char *argv[]) {
+    const char * test;
+    int frame;
+
+    // frames 1 and 2 stall, from the third one on the resolve gets
+    // issued after the 50 commands before the read
+    test = "read every frame";
+    Begin();
+    for (frame = 0; frame < 6; frame++) {
+        VRamReadbackNextFrame();
+        Commands(50);
+        Read(0, 0, 256, 240);
+        Commands(30);
+    }
+    CheckStats(test, 4, 2, 4);
+
+    test = "read every frame, issue point";
+    Begin();
+    for (frame = 0; frame < 3; frame++) {
+        VRamReadbackNextFrame();
+        Commands(50);
+        Read(0, 0, 256, 240);
+    }
+    VRamReadbackNextFrame();
+    CHECK("issue at", uiReadbackIssueAt, 50);
+
+    // 0xc0 (vram -> psx mem) starts the resolve when the command is done
+    test = "0xc0 announce";
+    Begin();
+    VRamReadbackNextFrame();
+    Commands(20);
+    VRamReadbackAnnounce();
+    Commands(1);
+    Read(64, 0, 32, 32);
+    CheckStats(test, 1, 0, 1);
+
+    // drawn after the resolve: it is outdated, the read resolves again
+    test = "read after a new draw";
+    Begin();
+    VRamReadbackNextFrame();
+    Commands(20);
+    VRamReadbackAnnounce();
+    Commands(1);
+    Commands(1);
+    Read(64, 0, 32, 32);
+    CheckStats(test, 0, 1, 1);
+
+    // read once: never predicted in the frames after
+    test = "one-off read";
+    Begin();
+    VRamReadbackNextFrame();
+    Commands(30);
+    Read(0, 256, 64, 64);
+    for (frame = 0; frame < 4; frame++) {
+        VRamReadbackNextFrame();
+        CHECK("issue at", uiReadbackIssueAt, 0);
+        Commands(100);
+    }
+    CheckStats(test, 0, 1, 0);
+
+    test = "no resolver";
+    SetVRamResolver(NULL);
+    resolves = 0;
+    VRamReadbackNextFrame();
+    Commands(10);
+    CHECK("resolver", VRamReadbackSchedule(0, 0, 16, 16) == NULL, 1);
+    CheckStats(test, 0, 0, 0);
+
+    if (failed) {
+        printf("%d checks failed\n", failed);
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}